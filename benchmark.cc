@@ -1,20 +1,35 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "batch.h"
 #include "hashtable.h"
+#include "histogram.h"
+#include "prng.h"
 #include "queue.h"
+#include "timer.h"
+#include "workload.h"
+
+// All worker threads and the main thread meet here after the prefill, and again after the warm-up
+pthread_barrier_t start_barrier;
 
 typedef struct ThreadArgs {
     int id;
-    OperationType type;
+    int num_threads;
     int num_ops;
     HashTable* table;
+    Workload* workload;
+    int sample_every;  // time every n-th operation only
+    int width;         // operations executed together
+    int group;         // operations applied atomically together, 0 to execute them on their own
+    uint64_t seed;
+    bool pregenerate;  // draw the whole trace before the prefill
+    bool prefilled;    // the prefill was bulk loaded
 
-    double accumulated_insert_latency;
-    double accumulated_delete_latency;
-    double accumulated_lookup_latency;
+    Histogram latency[3];  // indexed by OperationType
 } ThreadArgs;
 
 double elapsed_ms(struct timespec* begin, struct timespec* end) {
@@ -23,113 +38,476 @@ double elapsed_ms(struct timespec* begin, struct timespec* end) {
 
 void* thread_func(void* thd_args);
 
+// Write one CSV header and record with the throughput and the latency summary of every operation type.
+int write_result(const char* path, double total_ms, double throughput, const Histogram* latency,
+                 const char* const* names) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+
+    fprintf(out, "total_ms,throughput_ops");
+    for (int type = 0; type < 3; ++type) {
+        const char* name = names[type];
+        fprintf(out, ",%s_count,%s_mean_ns,%s_p50_ns,%s_p90_ns,%s_p99_ns,%s_p999_ns,%s_max_ns", name, name, name, name,
+                name, name, name);
+    }
+
+    fprintf(out, "\n%.3f,%.0f", total_ms, throughput);
+    for (int type = 0; type < 3; ++type) {
+        const Histogram* hist = &latency[type];
+        fprintf(out, ",%lu,%.1f,%lu,%lu,%lu,%lu,%lu", hist->count, histogram_mean(hist),
+                histogram_percentile(hist, 50.0), histogram_percentile(hist, 90.0), histogram_percentile(hist, 99.0),
+                histogram_percentile(hist, 99.9), hist->max);
+    }
+    fprintf(out, "\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <hashtable_size> <num_ops_per_thread>\n", prog);
+    fprintf(stderr, "  -t <num_threads>           number of worker threads (default: number of cores)\n");
+    fprintf(stderr, "  -d <distribution>          uniform, zipfian, latest or hotspot key distribution\n");
+    fprintf(stderr, "  -z <theta>                 Zipfian skew in (0, 1)\n");
+    fprintf(stderr, "  -k <key_space>             keys are drawn from [0, key_space)\n");
+    fprintf(stderr, "  -w <mix>                   YCSB workload a-f or lookup:insert:delete percentages\n");
+    fprintf(stderr, "  -p <prefill>               fraction of the key space inserted before the run\n");
+    fprintf(stderr, "  -B                         bulk load the prefill instead of inserting it\n");
+    fprintf(stderr, "  -W <warmup_ops>            operations per thread before the measurement\n");
+    fprintf(stderr, "  -a <none|compact|scatter>  thread placement policy\n");
+    fprintf(stderr, "  -l <llc>                   only use the cpus of this LLC domain\n");
+    fprintf(stderr, "  -o <offset>                skip the first cpus of the placement order\n");
+    fprintf(stderr, "  -c <capacity>              put a hot-key cache of this many keys in front of the table\n");
+    fprintf(stderr, "  -f                         put a counting Bloom filter in front of every bucket\n");
+    fprintf(stderr, "  -i                         index the chains that grow long for logarithmic walks\n");
+    fprintf(stderr, "  -C <max_keys>              evict keys with CLOCK beyond this many keys\n");
+    fprintf(stderr, "  -Y <max_mib>               evict keys with CLOCK beyond this many MiB of nodes\n");
+    fprintf(stderr, "  -E <ttl_ms>                expire keys this long after their insert\n");
+    fprintf(stderr, "  -s <seed>                  seed of the per-thread generators (default: clock)\n");
+    fprintf(stderr, "  -T                         pre-generate each thread's operations before the run\n");
+    fprintf(stderr, "  -S <n>                     time every n-th operation only (default: 1)\n");
+    fprintf(stderr, "  -b <width>                 execute this many operations at once and interleave their lookups\n");
+    fprintf(stderr, "  -M <n>                     apply every n operations atomically, as a compound request\n");
+    fprintf(stderr, "  -R <path>                  write the results as a CSV header and record, e.g., for sweep\n");
+    fprintf(stderr, "  -H <path>                  export latency histograms as CSV, or JSON for a .json path\n");
+    fprintf(stderr, "  -K <n>                     time every n-th lock acquisition into a lock profile (USE_PROBES)\n");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <hashtable_size> <num_ops_per_thread>\n", argv[0]);
+    PinPolicy pin_policy = PinNone;
+    int pin_llc = -1;
+    int pin_offset = 0;
+    int hotcache_capacity = 0;
+    bool use_filter = false;
+    bool use_index = false;
+    bool use_cache = false;
+    CacheConfig cache_config;
+    cache_default_config(&cache_config);
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int sample_every = 1;
+    int lockprof_every = 0;
+    int width = 1;
+    int group = 0;
+    const char* histogram_path = NULL;
+    const char* result_path = NULL;
+    uint64_t seed = prng_default_seed();
+    bool pregenerate = false;
+    bool bulk_load = false;
+
+    WorkloadConfig config;
+    workload_default_config(&config);
+    const char* distribution = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:z:k:w:p:BW:a:l:o:c:fiC:Y:E:s:TS:b:M:H:R:K:")) != -1) {
+        switch (opt) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'd':
+                distribution = optarg;
+                break;
+            case 'z':
+                config.theta = atof(optarg);
+                break;
+            case 'k':
+                config.key_space = atoi(optarg);
+                break;
+            case 'w':
+                if (workload_parse_mix(optarg, &config) != 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'p':
+                config.prefill = atof(optarg);
+                break;
+            case 'B':
+                bulk_load = true;
+                break;
+            case 'W':
+                config.warmup_ops = atoi(optarg);
+                break;
+            case 'a':
+                if (placement_parse_policy(optarg, &pin_policy) != 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'l':
+                pin_llc = atoi(optarg);
+                break;
+            case 'o':
+                pin_offset = atoi(optarg);
+                break;
+            case 'c':
+                hotcache_capacity = atoi(optarg);
+                break;
+            case 'f':
+                use_filter = true;
+                break;
+            case 'i':
+                use_index = true;
+                break;
+            case 'C':
+                cache_config.max_keys = atoi(optarg);
+                use_cache = true;
+                break;
+            case 'Y':
+                cache_config.max_bytes = (size_t)atol(optarg) << 20;
+                use_cache = true;
+                break;
+            case 'E':
+                cache_config.default_ttl_ms = atoi(optarg);
+                use_cache = true;
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'T':
+                pregenerate = true;
+                break;
+            case 'S':
+                sample_every = atoi(optarg);
+                break;
+            case 'b':
+                width = atoi(optarg);
+                break;
+            case 'M':
+                group = atoi(optarg);
+                break;
+            case 'H':
+                histogram_path = optarg;
+                break;
+            case 'K':
+                lockprof_every = atoi(optarg);
+                if (lockprof_every <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'R':
+                result_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+    }
+
+    // An explicit distribution overrides the one implied by the workload mix
+    if (distribution != NULL && workload_parse_distribution(distribution, &config.distribution) != 0) {
+        usage(argv[0]);
+    }
+
+    int num_buckets = atoi(argv[optind]);
+    int num_ops_per_thread = atoi(argv[optind + 1]);
+    if (num_buckets <= 0 || num_ops_per_thread <= 0 || num_threads <= 0 || sample_every <= 0) {
+        fprintf(stderr,
+                "<hashtable_size>, <num_ops_per_thread>, threads and sampling must be an integer greater than 0.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (width <= 0 || width > BATCH_MAX_OPS) {
+        fprintf(stderr, "The batch width must be between 1 and %d.\n", BATCH_MAX_OPS);
+        exit(EXIT_FAILURE);
+    }
+    if (group < 0 || group > HASHTABLE_APPLY_MAX_OPS || (group > 0 && width > 1)) {
+        fprintf(stderr, "Atomic groups hold between 1 and %d operations and are not batched.\n",
+                HASHTABLE_APPLY_MAX_OPS);
         exit(EXIT_FAILURE);
     }
 
-    int hashtable_size = atoi(argv[1]);
-    int num_ops_per_thread = atoi(argv[2]);
-    if (hashtable_size <= 0 || num_ops_per_thread <= 0) {
-        fprintf(stderr, "<hashtable_size> and <num_ops_per_thread> must be an integer greater than 0.\n");
+    Workload workload;
+    if (workload_init(&workload, &config) != 0) {
+        fprintf(stderr, "Invalid workload configuration.\n");
         exit(EXIT_FAILURE);
     }
 
-    srand(time(NULL));
+    timer_calibrate();
 
     long ncores = sysconf(_SC_NPROCESSORS_ONLN);
-    int num_threads = ncores * 3;  // ncores thread per each operation {insert, delete, lookup}
-    printf("Performing benchmark on machine with %ld cores, %d threads.\n", ncores, num_threads);
+    printf("Performing benchmark on machine with %ld cores, %d threads, %s locking.\n", ncores, num_threads,
+           hashtable_policy_name());
+    printf("Workload: %d keys, lookup/insert/delete = %d/%d/%d per mille, prefill %.2f, %d warm-up ops.\n",
+           config.key_space, config.lookup_permille, config.insert_permille, config.delete_permille, config.prefill,
+           config.warmup_ops);
+    printf("Seed: %lu%s\n", seed, pregenerate ? ", pre-generated traces" : "");
+
+    Topology topo;
+    Placement placement;
+    if (topology_detect(&topo) != 0 || placement_init(&placement, &topo, pin_policy, pin_llc, pin_offset) != 0) {
+        fprintf(stderr, "Failed to place threads with the given affinity options.\n");
+        exit(EXIT_FAILURE);
+    }
+    placement_print(stdout, &placement, "thread", num_threads);
 
-    HashTable* table = hashtable_create(hashtable_size);
+    // Keep the bucket array on the node the threads run on
+    affinity_pin_self(placement_cpu(&placement, 0));
+    affinity_prefer_node(placement_home_node(&placement));
+
+    HashTable* table = hashtable_create(num_buckets);
     if (table == NULL) {
-        fprintf(stderr, "Failed to create hash table with %d buckets.", hashtable_size);
+        fprintf(stderr, "Failed to create hash table with %d buckets.", num_buckets);
     }
 
-    struct timespec begin, end;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+    if (hotcache_capacity > 0 && hashtable_attach_hotcache(table, hotcache_capacity) != 0) {
+        fprintf(stderr, "Failed to create hot-key cache of %d keys.", hotcache_capacity);
+    }
+
+    if (use_filter && hashtable_attach_filter(table) != 0) {
+        fprintf(stderr, "Failed to create the bucket filters.");
+    }
+
+    if (use_index && hashtable_attach_index(table) != 0) {
+        fprintf(stderr, "Failed to create the chain indexes.");
+    }
+
+    if (use_cache && hashtable_attach_cache(table, &cache_config) != 0) {
+        fprintf(stderr, "Failed to turn the table into a cache.");
+    }
+
+    if (lockprof_every > 0 && hashtable_attach_lockprof(table, lockprof_every) != 0) {
+        fprintf(stderr, "Failed to profile the lock waits, it needs a build with -DUSE_PROBES=ON.\n");
+    }
+
+    if (group > 0 && hashtable_attach_gates(table) != 0) {
+        fprintf(stderr, "Failed to create the bucket gates.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bulk_load) {
+        // The same keys the threads would insert
+        int* keys = (int*)malloc(sizeof(int) * config.key_space);
+        if (keys == NULL) {
+            fprintf(stderr, "Failed to allocate the prefill.\n");
+            exit(EXIT_FAILURE);
+        }
+        int n = 0;
+        for (int key = 0; key < config.key_space; ++key) {
+            if (workload_is_prefilled(&workload, key)) {
+                keys[n++] = key;
+            }
+        }
+
+        struct timespec load_begin, load_end;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &load_begin);
+        int loaded = hashtable_bulk_load(table, keys, n, num_threads);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &load_end);
+        if (loaded < 0) {
+            fprintf(stderr, "Failed to bulk load the prefill.\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("Bulk loaded %d keys in %.3f ms\n", loaded, elapsed_ms(&load_begin, &load_end));
+        free(keys);
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
 
     pthread_t threads[num_threads];
-    ThreadArgs args[num_threads];
+    ThreadArgs* args = (ThreadArgs*)malloc(sizeof(ThreadArgs) * num_threads);  // too large for the stack
 
     for (int i = 0; i < num_threads; i++) {
         args[i].id = i;
+        args[i].num_threads = num_threads;
         args[i].num_ops = num_ops_per_thread;
         args[i].table = table;
-        args[i].type = (OperationType)(i % 3);  // Must match enum OperationType values
-        args[i].accumulated_insert_latency = 0;
-        args[i].accumulated_delete_latency = 0;
-        args[i].accumulated_lookup_latency = 0;
-        pthread_create(&threads[i], NULL, thread_func, (void**)&args[i]);
+        args[i].workload = &workload;
+        args[i].sample_every = sample_every;
+        args[i].width = width;
+        args[i].group = group;
+        args[i].seed = seed;
+        args[i].pregenerate = pregenerate;
+        args[i].prefilled = bulk_load;
+        for (int type = 0; type < 3; ++type) {
+            histogram_init(&args[i].latency[type]);
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        affinity_set_attr(&attr, placement_cpu(&placement, i));
+        pthread_create(&threads[i], &attr, thread_func, (void**)&args[i]);
+        pthread_attr_destroy(&attr);
     }
 
-    /**
-     * TODO: Wait for all threads to be created before starting their job by using conditional variable.
-     */
+    struct timespec begin, end;
+
+    // Wait for the prefill, then for the warm-up of every thread
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
 
-    double total_insert_latency = 0.0;
-    double total_delete_latency = 0.0;
-    double total_lookup_latency = 0.0;
     for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL);
-
-        total_insert_latency += args[i].accumulated_insert_latency;
-        total_delete_latency += args[i].accumulated_delete_latency;
-        total_lookup_latency += args[i].accumulated_lookup_latency;
     }
 
     clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-    fprintf(stdout, "Total operation time (ms): %.3f\n", elapsed_ms(&begin, &end));
 
-    printf("Average time per ops (ms):\n");
-    printf("\tinsert: %f\n", total_insert_latency / num_ops_per_thread);
-    printf("\tdelete: %f\n", total_delete_latency / num_ops_per_thread);
-    printf("\tlookup: %f\n", total_lookup_latency / num_ops_per_thread);
+    Histogram latency[3];
+    for (int type = 0; type < 3; ++type) {
+        histogram_init(&latency[type]);
+        for (int i = 0; i < num_threads; i++) {
+            histogram_merge(&latency[type], &args[i].latency[type]);
+        }
+    }
+
+    double total_ms = elapsed_ms(&begin, &end);
+    double throughput = (double)num_threads * num_ops_per_thread / total_ms * 1000;
+    fprintf(stdout, "Total operation time (ms): %.3f\n", total_ms);
+    fprintf(stdout, "Throughput (ops/s): %.0f\n", throughput);
+
+    if (sample_every > 1) {
+        printf("Latencies of every %d-th operation:\n", sample_every);
+    }
+    const char* names[3] = {"insert", "delete", "lookup"};
+    histogram_print_header(stdout);
+    for (int type = 0; type < 3; ++type) {
+        histogram_print_summary(stdout, &latency[type], names[type]);
+    }
+
+    if (histogram_path != NULL && histogram_export(histogram_path, latency, names, 3) != 0) {
+        fprintf(stderr, "Failed to export histograms to %s.\n", histogram_path);
+    }
+
+    if (result_path != NULL && write_result(result_path, total_ms, throughput, latency, names) != 0) {
+        fprintf(stderr, "Failed to write the results to %s.\n", result_path);
+    }
+
+    hashtable_stats_print(stdout, table);
+    if (table->lockprof != NULL) {
+        lockprof_print(stdout, table->lockprof, LOCKPROF_TOP);
+    }
+
+    printf("Keys in the table: %d\n", hashtable_size(table));
+
+    pthread_barrier_destroy(&start_barrier);
+    free(args);
 
-    int freed = hashtable_free(table);
+    struct timespec free_begin, free_end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &free_begin);
+    int freed = hashtable_free_parallel(table, num_threads);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &free_end);
     if (freed != 0) {
         fprintf(stderr, "Failed to free hash table.");
     }
+    printf("Freed the table in %.3f ms\n", elapsed_ms(&free_begin, &free_end));
 
     return EXIT_SUCCESS;
 }
 
+void execute(HashTable* table, Operation op) {
+    switch (op.type) {
+        case Insert:
+            hashtable_insert(table, op.key);
+            break;
+        case Delete:
+            hashtable_delete(table, op.key);
+            break;
+        case Lookup:
+            hashtable_lookup(table, op.key);
+            break;
+        default:
+            break;
+    }
+}
+
+// Apply the operations as one atomic group, or else as a batch
+void execute_batch(HashTable* table, const Operation* ops, bool* succeeded, int n, const ThreadArgs* args) {
+    if (args->group == 0) {
+        batch_execute(table, ops, succeeded, n, args->width);
+        return;
+    }
+
+    int keys[HASHTABLE_APPLY_MAX_OPS];
+    OperationType types[HASHTABLE_APPLY_MAX_OPS];
+    for (int i = 0; i < n; ++i) {
+        keys[i] = ops[i].key;
+        types[i] = ops[i].type;
+    }
+    hashtable_apply(table, keys, types, n, false, succeeded);
+}
+
 void* thread_func(void* thd_args) {
     ThreadArgs* args = (ThreadArgs*)thd_args;
 
     int id = args->id;
-    OperationType type = args->type;
     int num_ops = args->num_ops;
     HashTable* table = args->table;
+    Workload* workload = args->workload;
+    int warmup_ops = workload->config.warmup_ops;
 
-    for (int i = 0; i < num_ops; ++i) {
-        int key = rand();  // TODO: skewed workload test
+    Prng prng;
+    prng_seed(&prng, args->seed, id);
 
-        struct timespec begin, end;
-        clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+    // The trace covers the warm-up and the measured operations, in the order they would be drawn
+    Operation* trace = NULL;
+    if (args->pregenerate) {
+        trace = workload_generate(workload, &prng, warmup_ops + num_ops);
+        if (trace == NULL) {
+            fprintf(stderr, "Failed to allocate the trace of thread %d, drawing operations during the run.\n", id);
+        }
+    }
+
+    // Prefill: each thread inserts its share of the prefilled population
+    int key_space = workload->config.key_space;
+    for (int key = id; key < key_space && !args->prefilled; key += args->num_threads) {
+        if (workload_is_prefilled(workload, key)) {
+            hashtable_insert(table, key);
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
 
-        switch (type) {
-            case Insert:
-                hashtable_insert(table, key);
+    for (int i = 0; i < warmup_ops; ++i) {
+        execute(table, trace != NULL ? trace[i] : workload_next(workload, &prng));
+    }
+    pthread_barrier_wait(&start_barrier);
 
-                clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-                args->accumulated_insert_latency += elapsed_ms(&begin, &end);
-                break;
-            case Delete:
-                hashtable_delete(table, key);
+    int sample_every = args->sample_every;
+    int width = args->group > 0 ? args->group : args->width;
+    Operation ops[BATCH_MAX_OPS];
+    bool succeeded[BATCH_MAX_OPS];
+    for (int i = 0; i < num_ops; i += width) {
+        int n = num_ops - i < width ? num_ops - i : width;
+        for (int j = 0; j < n; ++j) {
+            ops[j] = trace != NULL ? trace[warmup_ops + i + j] : workload_next(workload, &prng);
+        }
 
-                clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-                args->accumulated_delete_latency += elapsed_ms(&begin, &end);
-                break;
-            case Lookup:
-                hashtable_lookup(table, key);
+        // Time the batch if it holds a sampled operation, each of its operations takes the whole batch
+        int first_sampled = (i + sample_every - 1) / sample_every * sample_every;
+        if (first_sampled >= i + n) {
+            execute_batch(table, ops, succeeded, n, args);
+            continue;
+        }
 
-                clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-                args->accumulated_lookup_latency += elapsed_ms(&begin, &end);
-                break;
+        uint64_t begin = timer_now();
+        execute_batch(table, ops, succeeded, n, args);
+        uint64_t end = timer_now();
+        for (int j = first_sampled - i; j < n; j += sample_every) {
+            histogram_record(&args->latency[ops[j].type], timer_ticks_to_ns(end - begin));
         }
     }
 
+    free(trace);
     pthread_exit(NULL);
 }
@@ -1,10 +1,18 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "histogram.h"
+#include "prng.h"
 #include "queue.h"
 #include "shm.h"
+#include "timer.h"
+#include "transport.h"
 
 // For controlling the worker threads
 pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
@@ -20,8 +28,83 @@ typedef struct ThreadArgs {
     OperationQueue* queue;
     int num_ops;
     bool is_ready;
+    uint64_t seed;
+    bool pregenerate;  // draw the whole trace before the start
+    bool stamp;        // stamp operations with the enqueue time
+    int group;         // operations per compound request, 0 to send them one at a time
+    bool all_or_nothing;
+    long applied;  // compound requests the server applied
+
+    int fd;             // connection to the server's socket front end, -1 to use the shared memory
+    int depth;          // requests in flight on the connection
+    long writes;        // syscalls that sent requests
+    long reads;         // syscalls that returned answers
+    long succeeded;     // answers that said so
+    Histogram latency;  // round trips of the requests over the socket, in ns
 } ThreadArgs;
 
+static int send_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Keep up to depth requests in flight: top the window up with one write, then take whatever answers arrived with one
+// read. The answers come back in request order, so a ring of send times gives the round trip of each.
+static void send_pipelined(ThreadArgs* args, Prng* prng, const Operation* trace) {
+    int depth = args->depth;
+    WireRequest* requests = (WireRequest*)calloc(depth, sizeof(WireRequest));
+    uint8_t* answers = (uint8_t*)malloc(depth);
+    uint64_t* sent_at = (uint64_t*)malloc(sizeof(uint64_t) * depth);
+    if (requests == NULL || answers == NULL || sent_at == NULL) {
+        fprintf(stderr, "Failed to allocate the window of producer %d.\n", args->id);
+        exit(EXIT_FAILURE);
+    }
+
+    int sent = 0;
+    int answered = 0;
+    while (answered < args->num_ops) {
+        int n = 0;
+        uint64_t now = timer_now();
+        for (int i = sent; i < args->num_ops && i - answered < depth; ++i, ++n) {
+            requests[n].key = trace != NULL ? trace[i].key : (int)(prng_next(prng) >> 33);
+            requests[n].type = (uint8_t)(i % 3);
+            sent_at[i % depth] = now;
+        }
+        if (n > 0) {
+            if (send_all(args->fd, requests, n * sizeof(WireRequest)) != 0) {
+                perror("Failed to send the requests");
+                break;
+            }
+            args->writes++;
+            sent += n;
+        }
+
+        ssize_t got = recv(args->fd, answers, sent - answered, 0);
+        if (got <= 0) {
+            fprintf(stderr, "The server closed the connection of producer %d.\n", args->id);
+            break;
+        }
+        args->reads++;
+        now = timer_now();
+        for (int k = 0; k < got; ++k, ++answered) {
+            histogram_record(&args->latency, timer_ticks_to_ns(now - sent_at[answered % depth]));
+            args->succeeded += answers[k] == WireSucceeded;
+        }
+    }
+
+    free(requests);
+    free(answers);
+    free(sent_at);
+}
+
 // Works as workload producer
 void* thread_func(void* thd_args) {
     ThreadArgs* args = (ThreadArgs*)thd_args;
@@ -30,18 +113,54 @@ void* thread_func(void* thd_args) {
     OperationQueue* queue = args->queue;
     int num_ops = args->num_ops;
 
+    Prng prng;
+    prng_seed(&prng, args->seed, tid);
+
+    Operation* trace = NULL;
+    if (args->pregenerate) {
+        trace = (Operation*)malloc(sizeof(Operation) * num_ops);
+        if (trace == NULL) {
+            fprintf(stderr, "Failed to allocate the trace of producer %d, drawing keys during the run.\n", tid);
+        }
+        for (int i = 0; trace != NULL && i < num_ops; i++) {
+            trace[i].key = (int)(prng_next(&prng) >> 33);
+            trace[i].type = (OperationType)(i % 3);
+        }
+    }
+
     // Wait until all workers are generated
     pthread_mutex_lock(&worker_mutex);
     args->is_ready = true;  // This is necessary since main thread might surpass the worker thread sleep
     pthread_cond_wait(&worker_cond, &worker_mutex);  // Worker threads awoken while main_mutex held by main thread
     pthread_mutex_unlock(&worker_mutex);
 
+    if (args->fd >= 0) {
+        send_pipelined(args, &prng, trace);
+        num_ops = 0;
+    }
+
+    CompoundRequest* request = queue != NULL ? &queue->mailboxes[tid] : NULL;
     for (int i = 0; i < num_ops; i++) {
-        int key = rand();
-        OperationType type = (OperationType)(i % 3);  // Must match enum OperationType values
+        int key = trace != NULL ? trace[i].key : (int)(prng_next(&prng) >> 33);  // non-negative 31-bit keys
+        OperationType type = (OperationType)(i % 3);                             // Must match enum OperationType values
         // printf("[Client %d] type: %d, key: %d\n", tid, (int)type, key);
-        enqueue(queue, key, type);
+        if (args->group == 0) {
+            enqueue_at(queue, key, type, args->stamp ? timer_now() : 0);
+            continue;
+        }
+
+        // Gather the group in the mailbox and send it once full, or with the last operation
+        int j = i % args->group;
+        request->keys[j] = key;
+        request->types[j] = type;
+        if (j + 1 == args->group || i + 1 == num_ops) {
+            request->num_ops = j + 1;
+            request->all_or_nothing = args->all_or_nothing;
+            enqueue_compound(queue, tid, args->stamp ? timer_now() : 0);
+            args->applied += request->applied;
+        }
     }
+    free(trace);
 
     int order = __sync_sub_and_fetch(&left_over, 1);
     if (order == 0) {  // last thread exiting should wakeup the main thread
@@ -54,54 +173,212 @@ void* thread_func(void* thd_args) {
     pthread_exit(NULL);
 }
 
+#define DEFAULT_DEPTH (256)
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <num_threads> <num_ops_per_thread>\n", prog);
+    fprintf(stderr, "  -a <none|compact|scatter>  thread placement policy\n");
+    fprintf(stderr, "  -l <llc>                   only use the cpus of this LLC domain\n");
+    fprintf(stderr, "  -o <offset>                skip the first cpus of the placement order\n");
+    fprintf(stderr, "  -s <seed>                  seed of the per-thread generators (default: clock)\n");
+    fprintf(stderr, "  -T                         pre-generate each thread's operations before the start\n");
+    fprintf(stderr, "  -e                         stamp operations so the server reports the time spent queued\n");
+    fprintf(stderr, "  -m <n>                     send every n operations as one compound request (server -m)\n");
+    fprintf(stderr, "  -A                         undo a compound request if one of its operations fails\n");
+    fprintf(stderr, "  -Q <name>                  shared memory segment of the server (default: %s)\n", SHM_ID);
+    fprintf(stderr, "  -U <path>                  send over the server's Unix-domain socket instead (server -U)\n");
+    fprintf(stderr, "  -N <port>                  send over the server's loopback TCP port instead (server -N)\n");
+    fprintf(stderr, "  -D <depth>                 requests in flight per socket (default: %d)\n", DEFAULT_DEPTH);
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <num_threads> <num_ops_per_thread>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    PinPolicy pin_policy = PinNone;
+    int pin_llc = -1;
+    int pin_offset = 0;
+    uint64_t seed = prng_default_seed();
+    bool pregenerate = false;
+    bool stamp = false;
+    int group = 0;
+    bool all_or_nothing = false;
+    const char* unix_path = NULL;
+    int tcp_port = 0;
+    int depth = DEFAULT_DEPTH;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:l:o:s:Tem:AQ:U:N:D:")) != -1) {
+        switch (opt) {
+            case 'a':
+                if (placement_parse_policy(optarg, &pin_policy) != 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'l':
+                pin_llc = atoi(optarg);
+                break;
+            case 'o':
+                pin_offset = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'T':
+                pregenerate = true;
+                break;
+            case 'e':
+                stamp = true;
+                break;
+            case 'm':
+                group = atoi(optarg);
+                break;
+            case 'A':
+                all_or_nothing = true;
+                break;
+            case 'Q':
+                if (optarg[0] != '/') {
+                    usage(argv[0]);
+                }
+                shm_set_id(optarg);
+                break;
+            case 'U':
+                unix_path = optarg;
+                break;
+            case 'N':
+                tcp_port = atoi(optarg);
+                if (tcp_port <= 0 || tcp_port > 65535) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'D':
+                depth = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
     }
 
-    int num_threads = atoi(argv[1]);
-    int num_ops_per_thread = atoi(argv[2]);
+    int num_threads = atoi(argv[optind]);
+    int num_ops_per_thread = atoi(argv[optind + 1]);
     if (num_threads <= 0 || num_ops_per_thread <= 0) {
         fprintf(stderr, "<num_threads> and <num_ops_per_thread> must be an integer greater than 0.\n");
         exit(EXIT_FAILURE);
     }
+    if (group < 0 || group > COMPOUND_MAX_OPS) {
+        fprintf(stderr, "Compound requests hold between 1 and %d operations.\n", COMPOUND_MAX_OPS);
+        exit(EXIT_FAILURE);
+    }
+    if (group > 0 && num_threads > COMPOUND_MAILBOXES) {
+        fprintf(stderr, "At most %d threads may send compound requests.\n", COMPOUND_MAILBOXES);
+        exit(EXIT_FAILURE);
+    }
+    bool use_socket = unix_path != NULL || tcp_port != 0;
+    if (use_socket && (unix_path != NULL && tcp_port != 0)) {
+        fprintf(stderr, "Send over a Unix-domain socket or TCP, not both.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (use_socket && group > 0) {
+        fprintf(stderr, "Compound requests need the shared memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (use_socket && (depth <= 0 || depth > TRANSPORT_WINDOW || num_threads > TRANSPORT_MAX_CONNECTIONS)) {
+        fprintf(stderr, "Sockets take up to %d threads of up to %d requests in flight.\n", TRANSPORT_MAX_CONNECTIONS,
+                TRANSPORT_WINDOW);
+        exit(EXIT_FAILURE);
+    }
 
-    srand(time(NULL));
+    if (use_socket) {
+        timer_calibrate();  // for the round trips
+    }
 
-    SharedMem* area = (SharedMem*)shm_attach();
-    if (area == NULL) {
-        fprintf(stderr, "Failed to load shared memory. Please make sure that the server is running.\n");
+    Topology topo;
+    Placement placement;
+    if (topology_detect(&topo) != 0 || placement_init(&placement, &topo, pin_policy, pin_llc, pin_offset) != 0) {
+        fprintf(stderr, "Failed to place threads with the given affinity options.\n");
         exit(EXIT_FAILURE);
     }
 
-    fprintf(stdout, "Waiting for server...\n");
-
-    while (!area->server_is_ready) {
-        usleep(100000);  // sleep 100 ms
+    // A socket per thread, the hello tells the server the load of the run
+    SharedMem* area = NULL;
+    int fds[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        fds[i] = -1;
     }
+    if (use_socket) {
+        WireHello hello;
+        memset(&hello, 0, sizeof(hello));
+        hello.magic = WIRE_MAGIC;
+        hello.num_threads = num_threads;
+        hello.num_ops_per_thread = num_ops_per_thread;
+        for (int i = 0; i < num_threads; i++) {
+            fds[i] = transport_connect(unix_path, tcp_port);
+            if (fds[i] < 0 || send_all(fds[i], &hello, sizeof(hello)) != 0) {
+                fprintf(stderr, "Failed to connect. Please make sure that the server listens on the socket.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        fprintf(stdout, "Connected %d sockets, %d requests in flight each.\n", num_threads, depth);
+    } else {
+        area = (SharedMem*)shm_attach();
+        if (area == NULL) {
+            fprintf(stderr, "Failed to load shared memory. Please make sure that the server is running.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        fprintf(stdout, "Waiting for server...\n");
+
+        while (!area->server_is_ready) {
+            usleep(100000);  // sleep 100 ms
+        }
 
-    fprintf(stdout, "Server is ready, preparing client.\n");
+        fprintf(stdout, "Server is ready, preparing client.\n");
 
-    area->num_threads = num_threads;
-    area->num_ops_per_thread = num_ops_per_thread;
+        area->num_threads = num_threads;
+        // The server dequeues every compound request as one operation
+        area->num_ops_per_thread = group > 0 ? (num_ops_per_thread + group - 1) / group : num_ops_per_thread;
 
-    area->client_is_ready = true;
+        area->client_is_ready = true;
+    }
 
     fprintf(stdout, "Client is ready! Sending operations to server.\n");
+    fprintf(stdout, "Seed: %lu%s\n", seed, pregenerate ? ", pre-generated traces" : "");
+    placement_print(stdout, &placement, "producer", num_threads);
 
     pthread_t threads[num_threads];
-    ThreadArgs args[num_threads];
+    ThreadArgs* args = (ThreadArgs*)malloc(sizeof(ThreadArgs) * num_threads);  // too large for the stack
+    if (args == NULL) {
+        fprintf(stderr, "Failed to allocate the arguments of %d producers.\n", num_threads);
+        exit(EXIT_FAILURE);
+    }
 
     left_over = num_threads;
 
     for (int i = 0; i < num_threads; i++) {
         args[i].id = i;
-        args[i].queue = &area->queue;
+        args[i].queue = area != NULL ? &area->queue : NULL;
         args[i].num_ops = num_ops_per_thread;
         args[i].is_ready = false;
+        args[i].seed = seed;
+        args[i].pregenerate = pregenerate;
+        args[i].stamp = stamp;
+        args[i].group = group;
+        args[i].all_or_nothing = all_or_nothing;
+        args[i].applied = 0;
+        args[i].fd = fds[i];
+        args[i].depth = depth;
+        args[i].writes = 0;
+        args[i].reads = 0;
+        args[i].succeeded = 0;
+        histogram_init(&args[i].latency);
 
-        pthread_create(&threads[i], 0, thread_func, (void**)&args[i]);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        affinity_set_attr(&attr, placement_cpu(&placement, i));
+        pthread_create(&threads[i], &attr, thread_func, (void**)&args[i]);
+        pthread_attr_destroy(&attr);
 
         // Wait for the worker thread to fall asleep. Using spin wait seems enough
         while (!args[i].is_ready) {
@@ -109,6 +386,9 @@ int main(int argc, char** argv) {
         }
     }
 
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+
     // Wake the worker threads waiting on the condition variable
     pthread_mutex_lock(&worker_mutex);
 
@@ -128,5 +408,40 @@ int main(int argc, char** argv) {
         pthread_join(threads[i], NULL);
     }
 
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    double total_ms = (end.tv_nsec - begin.tv_nsec) / 1000000.0 + (end.tv_sec - begin.tv_sec) * 1000;
+    long total_ops = (long)num_threads * num_ops_per_thread;
+    fprintf(stdout, "%s %ld operations in %.3f ms (%.0f ops/s)\n", use_socket ? "Sent" : "Enqueued", total_ops,
+            total_ms, total_ops / total_ms * 1000);
+    if (use_socket) {
+        Histogram latency;
+        histogram_init(&latency);
+        long writes = 0, reads = 0, succeeded = 0;
+        for (int i = 0; i < num_threads; i++) {
+            histogram_merge(&latency, &args[i].latency);
+            writes += args[i].writes;
+            reads += args[i].reads;
+            succeeded += args[i].succeeded;
+            close(fds[i]);
+        }
+        fprintf(stdout, "%ld succeeded, %.1f requests per write, %.1f answers per read\n", succeeded,
+                writes == 0 ? 0.0 : (double)total_ops / writes, reads == 0 ? 0.0 : (double)total_ops / reads);
+        histogram_print_header(stdout);
+        histogram_print_summary(stdout, &latency, "round_trip");
+    }
+    if (group > 0) {
+        long applied = 0;
+        for (int i = 0; i < num_threads; i++) {
+            applied += args[i].applied;
+        }
+        fprintf(stdout, "Sent %ld compound requests of up to %d operations, %ld applied\n",
+                (long)num_threads * area->num_ops_per_thread, group, applied);
+    }
+
+    free(args);
+    if (area != NULL) {
+        shm_detach(area);
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,85 @@
+/**
+ * NOTE: Topology-aware thread placement. The topology is read from sysfs so
+ * that the module works without any extra dependency. When libnuma is found at
+ * build time (HAVE_LIBNUMA), memory can also be bound to a NUMA node. Otherwise
+ * only the thread affinity is controlled, and memory placement falls back to the
+ * kernel's first-touch policy of the pinned threads.
+ */
+
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define MAX_CPUS (1024)
+
+enum PinPolicy {
+    PinNone = 0,     // let the scheduler decide (default)
+    PinCompact = 1,  // fill the physical cores of one LLC, then the next LLC
+    PinScatter = 2,  // round-robin across sockets
+};
+
+typedef struct CpuInfo {
+    int cpu;      // logical cpu id
+    int core;     // physical core id within the package
+    int package;  // socket
+    int llc;      // dense id of the last level cache domain
+    int node;     // NUMA node
+    int sibling;  // rank among the SMT siblings of the same core
+} CpuInfo;
+
+typedef struct Topology {
+    CpuInfo cpus[MAX_CPUS];  // cpus the process is allowed to run on
+    int num_cpus;
+    int num_llcs;
+    int num_nodes;
+} Topology;
+
+typedef struct Placement {
+    PinPolicy policy;
+    int llc;             // restrict to this LLC domain, -1 for any
+    int offset;          // skip the first cpus of the ordered list (e.g., to co-locate with a peer process)
+    int cpus[MAX_CPUS];  // ordered list of cpus handed out to threads
+    int num_cpus;
+    const Topology* topo;
+} Placement;
+
+// Read the topology of the cpus the current process may run on.
+// Returns 0 on success, else -1.
+int topology_detect(Topology* topo);
+
+// Returns the NUMA node of the given cpu, else -1.
+int topology_node_of(const Topology* topo, int cpu);
+
+// Build the cpu order for a policy. Returns 0 on success, -1 if no cpu is left.
+int placement_init(Placement* placement, const Topology* topo, PinPolicy policy, int llc, int offset);
+
+// Returns the cpu for the idx-th thread, or -1 if the thread should not be pinned.
+int placement_cpu(const Placement* placement, int idx);
+
+// Returns the NUMA node threads of this placement run on, or -1 when unpinned.
+int placement_home_node(const Placement* placement);
+
+// Print the placement of num_threads threads (e.g., "worker 0 -> cpu 2 (llc 0, node 0)").
+void placement_print(FILE* out, const Placement* placement, const char* role, int num_threads);
+
+// Parse "none", "compact" or "scatter". Returns 0 on success, else -1.
+int placement_parse_policy(const char* str, PinPolicy* policy);
+
+// Set the cpu affinity of a thread attribute. A negative cpu leaves the attribute untouched.
+int affinity_set_attr(pthread_attr_t* attr, int cpu);
+
+// Pin the calling thread. A negative cpu leaves the thread untouched.
+int affinity_pin_self(int cpu);
+
+// Bind [addr, addr + len) to a NUMA node before it is touched.
+// Returns 0 on success, -1 when unsupported (no libnuma) or on failure.
+int affinity_bind_memory(void* addr, size_t len, int node);
+
+// Prefer allocations of the calling thread to come from the node.
+// Returns 0 on success, -1 when unsupported (no libnuma) or on failure.
+int affinity_prefer_node(int node);
+
+#endif /* AFFINITY_H_ */
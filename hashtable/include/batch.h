@@ -0,0 +1,31 @@
+/**
+ * NOTE: Executes a batch of dequeued operations in their order. Lookups
+ * between two writes are handed to hashtable_lookup_batch() together, which
+ * interleaves their chain walks so that the cache misses of up to width
+ * lookups overlap instead of stalling one after the other. A write flushes the
+ * pending lookups first, so every operation observes the effects of the
+ * operations before it in the batch, as if they were executed one at a time.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdbool.h>
+
+#include "hashtable.h"
+#include "queue.h"
+
+#define BATCH_MAX_OPS (LOOKUP_BATCH_MAX_WIDTH)
+
+// Execute n (at most BATCH_MAX_OPS) operations, storing whether ops[i] succeeded into succeeded[i].
+// A width of 1 executes them one at a time.
+void batch_execute(HashTable* table, const Operation* ops, bool* succeeded, int n, int width);
+
+// Applies a write in place of the table, e.g., to replicate it. Returns whether the write succeeded.
+typedef bool (*BatchWriter)(void* arg, int key, OperationType type);
+
+// Like batch_execute(), handing the writes to write(arg, key, type), or to the table if write is NULL.
+void batch_execute_writes(HashTable* table, const Operation* ops, bool* succeeded, int n, int width, BatchWriter write,
+                          void* arg);
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,51 @@
+/**
+ * NOTE: Reader-biased rwlock after BRAVO (Dice & Kogan, ATC '19). While a lock
+ * is read-biased, readers only publish themselves in a slot of a global table
+ * of visible readers and never write the lock's own cache line. A writer
+ * acquires the underlying lock, revokes the bias and waits until no slot holds
+ * the lock anymore. The bias stays off for a multiple of the time revocation
+ * took, which bounds the writers' overhead on write-heavy locks.
+ *
+ * Unlike BRAVO, which scans the whole table on revocation, the table is split
+ * into regions and a lock's readers only use the region of the lock, one cache
+ * line per thread. Revoking then costs BRAVO_REGION_SLOTS loads, which matters
+ * with a lock per bucket and frequent writes. Readers that collide on a slot
+ * simply take the underlying lock.
+ */
+
+#ifndef BRAVO_H_
+#define BRAVO_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BRAVO_TABLE_SIZE (4096)  // visible reader slots, shared by all locks
+#define BRAVO_REGION_SLOTS (16)  // slots a lock's readers may use
+
+// The bias stays off for this many times the revocation time
+#ifndef BRAVO_INHIBIT_MULTIPLIER
+#define BRAVO_INHIBIT_MULTIPLIER (9)
+#endif
+
+typedef struct BravoLock {
+    pthread_rwlock_t underlying;
+    bool read_bias;
+    uint64_t inhibit_until;  // timer_now() before which readers do not set the bias again
+} BravoLock;
+
+void bravo_init(BravoLock* lock);
+
+void bravo_destroy(BravoLock* lock);
+
+// Returns the visible reader slot taken on the fast path, or -1 if the underlying lock was read locked.
+// The value must be passed to bravo_read_unlock().
+int bravo_read_lock(BravoLock* lock);
+
+void bravo_read_unlock(BravoLock* lock, int slot);
+
+void bravo_write_lock(BravoLock* lock);
+
+void bravo_write_unlock(BravoLock* lock);
+
+#endif /* BRAVO_H_ */
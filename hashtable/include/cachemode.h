@@ -0,0 +1,99 @@
+/**
+ * NOTE: Bookkeeping of the cache mode, which bounds the number of keys in the
+ * table and expires keys after their TTL. The expiry of a key lives in its
+ * node, stamped on the cache clock: milliseconds since the cache mode was
+ * attached, read from the coarse monotonic clock.
+ *
+ * Eviction approximates LRU with CLOCK. Every bucket has a word of reference
+ * bits, and a key owns the bit picked by its hash. A lookup hit sets the bit
+ * of its key with an atomic OR, only if it is clear, so hits take no lock and
+ * rarely write. The clock hand sweeps the buckets: it evicts a key whose bit
+ * is clear, and clears the bits of a bucket that has no such key, its second
+ * chance. The bits live beside the buckets instead of in the nodes, since a
+ * pooled node may be freed under a lock-free reader and the pool links freed
+ * nodes through their first bytes.
+ *
+ * Expired keys count as missing. They are unlinked when an operation runs into
+ * them, and by a background sweeper that checks a few buckets per tick.
+ */
+
+#ifndef CACHEMODE_H_
+#define CACHEMODE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "counter.h"
+
+#define CACHE_SWEEP_INTERVAL_MS (10)  // default time between two sweeper ticks
+#define CACHE_SWEEP_BUCKETS (64)      // default buckets checked per tick
+
+typedef struct CacheConfig {
+    int max_keys;             // 0 for no key cap
+    size_t max_bytes;         // cap on the memory of the nodes, 0 for no memory cap
+    uint32_t default_ttl_ms;  // TTL of hashtable_insert(), 0 to never expire
+    int sweep_interval_ms;    // 0 for no sweeper
+    int sweep_buckets;        // buckets checked per sweeper tick
+} CacheConfig;
+
+typedef struct CacheMode {
+    CacheConfig config;
+    int64_t capacity;  // keys, the smaller of the two caps, INT64_MAX without one
+    struct timespec base;
+    uint64_t* refs;  // reference bits per bucket
+
+    alignas(CACHE_LINE_SIZE) int64_t entries;  // keys in the table
+    alignas(CACHE_LINE_SIZE) uint64_t hand;    // next bucket of the clock hand
+    alignas(CACHE_LINE_SIZE) uint64_t cursor;  // next bucket of the sweeper
+
+    StripedCounter evictions;
+    StripedCounter expirations;
+
+    pthread_t sweeper;
+    void (*sweep)(void*, int);
+    void* sweep_arg;
+    bool sweeping;  // the sweeper thread runs
+    bool stop;
+} CacheMode;
+
+// No caps, no TTL, the default sweeper.
+void cache_default_config(CacheConfig* config);
+
+// Create the bookkeeping for a table of the given number of buckets, whose keys take entry_bytes each.
+// Returns NULL on allocation failure.
+CacheMode* cache_mode_create(const CacheConfig* config, int num_buckets, size_t entry_bytes);
+
+// Stops the sweeper first.
+void cache_mode_free(CacheMode* cache);
+
+// Returns the current time on the cache clock, at least 1.
+uint32_t cache_now(const CacheMode* cache);
+
+// Returns the expiry of a key inserted now with the given TTL, 0 if the TTL is 0.
+uint32_t cache_expiry(const CacheMode* cache, uint32_t ttl_ms);
+
+// Whether an expiry has passed, the clock may wrap around.
+static inline bool cache_expired(uint32_t expires, uint32_t now) {
+    return expires != 0 && (int32_t)(expires - now) <= 0;
+}
+
+static inline uint64_t cache_ref_bit(int key) { return 1ULL << (((uint32_t)key * 0x9e3779b9U) >> 26); }
+
+// Mark the key of the bucket as recently used.
+static inline void cache_touch(CacheMode* cache, int index, int key) {
+    uint64_t bit = cache_ref_bit(key);
+    if ((__atomic_load_n(&cache->refs[index], __ATOMIC_RELAXED) & bit) == 0) {
+        __atomic_fetch_or(&cache->refs[index], bit, __ATOMIC_RELAXED);
+    }
+}
+
+// Run sweep(arg, sweep_buckets) every sweep_interval_ms in a background thread.
+// Returns 0 on success or without a sweeper, else -1.
+int cache_start_sweeper(CacheMode* cache, void (*sweep)(void*, int), void* arg);
+
+void cache_stop_sweeper(CacheMode* cache);
+
+#endif /* CACHEMODE_H_ */
@@ -0,0 +1,85 @@
+/**
+ * NOTE: Index over the sorted chain of a bucket that grew long, turning the
+ * chain into a two-level, B-tree-like structure. The index is a sorted array of
+ * entries, each pointing to a chain node with the node's last key, and the
+ * nodes between two entries form a gap of about CHAIN_INDEX_GAP nodes. A walk
+ * starts after the last entry whose key is less than the searched key, so it
+ * takes a binary search and at most one gap instead of the whole chain.
+ *
+ * The chain stays the source of truth: the first entry is the sentinel, and an
+ * entry's node is always linked. Writers of an indexed chain are serialized
+ * (by the bucket lock, or else by the index's lock), split a gap that grows
+ * past 2 * CHAIN_INDEX_GAP nodes, merge neighboring gaps that fit into one, and
+ * replace an entry before unlinking its node. They bracket every change with
+ * the index's version, so readers take no lock: they search a snapshot and
+ * retry if a writer interfered.
+ *
+ * Arrays replaced by a larger one are kept until the index is freed, so a
+ * reader never touches freed memory.
+ */
+
+#ifndef CHAININDEX_H_
+#define CHAININDEX_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define CHAIN_INDEX_TREEIFY (64)      // a chain of more nodes gets indexed
+#define CHAIN_INDEX_UNTREEIFY (16)    // an indexed chain of fewer nodes drops its index
+#define CHAIN_INDEX_GAP (16)          // nodes between two entries after a split
+#define CHAIN_INDEX_MAX_RETRIES (4)   // snapshots a reader tries before starting at the sentinel
+#define CHAIN_INDEX_MAX_RETIRED (32)  // arrays a growing index may replace
+
+struct Node;
+
+typedef struct IndexEntry {
+    int key;  // the last key of the node, -1 for the sentinel
+    int gap;  // nodes between this entry's node and the next entry's node
+    struct Node* node;
+} IndexEntry;
+
+typedef struct ChainIndex {
+    uint64_t version;  // odd while a writer changes the entries
+    int count;         // number of entries, 0 while the chain is not indexed
+    int capacity;
+    IndexEntry* entries;
+    pthread_mutex_t lock;  // serializes the writers of the indexed chain if the bucket has no lock
+    int num_retired;
+    IndexEntry* retired[CHAIN_INDEX_MAX_RETIRED];
+} ChainIndex;
+
+// Returns NULL on allocation failure.
+ChainIndex* chain_index_create(void);
+
+void chain_index_free(ChainIndex* index);
+
+// Returns the node a lookup of the key starts after, the sentinel if the chain is not indexed. Takes no lock.
+struct Node* chain_index_start(ChainIndex* index, struct Node* sentinel, int key);
+
+/*
+ * Writer functions, called by the only writer of the chain
+ */
+
+// Bracket the changes of the index and its chain, so that readers retry.
+void chain_index_write_begin(ChainIndex* index);
+void chain_index_write_end(ChainIndex* index);
+
+// Returns the entry a writer of the key starts after.
+int chain_index_find(const ChainIndex* index, int key);
+
+// Index the chain after the sentinel. Returns 0 on success, else -1 and the chain stays unindexed.
+int chain_index_build(ChainIndex* index, struct Node* sentinel);
+
+// Drop the index, the chain is walked from the sentinel again.
+void chain_index_clear(ChainIndex* index);
+
+// A node was linked after prev by a writer that started after the given entry.
+void chain_index_linked(ChainIndex* index, int entry, struct Node* prev);
+
+// The node after prev is about to be unlinked by a writer that started after the given entry.
+void chain_index_unlinking(ChainIndex* index, int entry, struct Node* node, struct Node* prev);
+
+// The last key of a node changed, for nodes of several keys.
+void chain_index_changed(ChainIndex* index, int entry, struct Node* node);
+
+#endif /* CHAININDEX_H_ */
@@ -0,0 +1,32 @@
+/**
+ * NOTE: Statistics counters that are bumped on hot paths. Each thread adds to
+ * its own cache line (stripe), so counting does not bounce a shared line across
+ * cores. Reading sums up all the stripes and is meant for reporting only.
+ */
+
+#ifndef COUNTER_H_
+#define COUNTER_H_
+
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE (64)
+#define COUNTER_STRIPES (64)
+
+typedef struct PaddedCounter {
+    alignas(CACHE_LINE_SIZE) uint64_t value;
+} PaddedCounter;
+
+typedef struct StripedCounter {
+    PaddedCounter stripes[COUNTER_STRIPES];
+} StripedCounter;
+
+void counter_init(StripedCounter* counter);
+
+void counter_add(StripedCounter* counter, uint64_t delta);
+
+uint64_t counter_read(StripedCounter* counter);
+
+// Returns the stripe of the calling thread, assigned round-robin on first use.
+int counter_stripe(void);
+
+#endif /* COUNTER_H_ */
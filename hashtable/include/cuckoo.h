@@ -0,0 +1,78 @@
+/**
+ * NOTE: Bucketized cuckoo hash table after MemC3 (Fan et al., NSDI '13) and
+ * libcuckoo (Li et al., EuroSys '14). Every key has two candidate buckets of
+ * CUCKOO_SLOTS slots, and a lookup reads only those two, so its worst case is
+ * two bucket probes no matter how keys collide.
+ *
+ * Buckets are protected by a striped array of versions that double as spin
+ * locks: a writer makes the versions of its buckets' stripes odd, modifies and
+ * makes them even again. Readers take no lock: they read both versions, both
+ * buckets and the versions again, and retry if a writer interfered.
+ *
+ * When both buckets of a new key are full, a breadth-first search finds the
+ * shortest path of displacements to a free slot without locks. The path is
+ * then executed backwards, one move at a time with both buckets of the moved
+ * key locked, so a moved key is always in one of its buckets. A move that no
+ * longer matches the table aborts the path, and the insert starts over. If no
+ * path is found, the table doubles its buckets. Arrays replaced by a resize are
+ * kept until the table is destroyed, so a reader never touches freed memory.
+ */
+
+#ifndef CUCKOO_H_
+#define CUCKOO_H_
+
+#include <stdint.h>
+
+#include "counter.h"
+#include "lockprof.h"
+
+#define CUCKOO_SLOTS (8)              // keys per bucket, a bucket takes half a cache line
+#define CUCKOO_STRIPES (4096)         // lock and version stripes, a power of two
+#define CUCKOO_BFS_MAX_BUCKETS (256)  // buckets a path search may visit
+#define CUCKOO_EMPTY (-1)
+
+typedef struct CuckooBucket {
+    alignas(CUCKOO_SLOTS * sizeof(int)) int keys[CUCKOO_SLOTS];  // CUCKOO_EMPTY for a free slot
+} CuckooBucket;
+
+typedef struct CuckooArray {
+    uint64_t mask;  // number of buckets - 1
+    CuckooBucket* buckets;
+    struct CuckooArray* retired;  // the array this one replaced
+} CuckooArray;
+
+typedef struct CuckooTable {
+    CuckooArray* array;
+    uint64_t* stripes;  // even when free, odd while a writer holds the stripe
+    int resizes;
+    StripedCounter displacements;  // keys moved to make room
+    StripedCounter read_retries;   // lookups that saw a concurrent write
+    StripedCounter path_aborts;    // displacement paths invalidated by a concurrent write
+    LockProfile* lockprof;         // sampled stripe lock waits, owned by the hash table, NULL unless attached
+} CuckooTable;
+
+// Create a table with at least the given number of buckets. Returns NULL on allocation failure.
+CuckooTable* cuckoo_create(int num_buckets);
+
+void cuckoo_destroy(CuckooTable* table);
+
+// Returns the slot that holds the key, else NULL. Keys move between slots, so the slot only tells that the key was
+// present.
+const int* cuckoo_lookup(CuckooTable* table, int key);
+
+// Returns the slot the key was put into, or NULL if the key is already present or the table cannot grow.
+const int* cuckoo_insert(CuckooTable* table, int key);
+
+// Returns 0 on success, -1 if the key is not present.
+int cuckoo_delete(CuckooTable* table, int key);
+
+// Number of keys, not synchronized with writers.
+int cuckoo_size(CuckooTable* table);
+
+// Store up to max keys into keys, not synchronized with writers. Returns the number of keys stored.
+int cuckoo_keys(CuckooTable* table, int* keys, int max);
+
+// Number of slots of the current array.
+int64_t cuckoo_capacity(CuckooTable* table);
+
+#endif /* CUCKOO_H_ */
@@ -3,25 +3,157 @@
 
 #include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
+#include "bravo.h"
+#include "cachemode.h"
+#include "chainindex.h"
+#include "counter.h"
+#include "cuckoo.h"
+#include "hotcache.h"
+#include "lockprof.h"
+#include "pool.h"
+#include "queue.h"
+#include "unrolled.h"
+
+// BRAVO is bucket locking with reader-biased bucket locks
+#ifdef BRAVO_LOCKING
+#define BUCKET_LOCKING
+#endif
+
+// Unrolled is bucket locking over chains of multi-key blocks
+#ifdef UNROLLED_LOCKING
+#define BUCKET_LOCKING 1
+#define UNROLLED_CHAINS
+#endif
+
+// Bucket and chain locking look up without locks, validated by a sequence counter per bucket, and fall back to the
+// read locks. Their nodes come from a type-stable pool, so such readers never touch freed memory.
+#if defined(BUCKET_LOCKING) || defined(CHAIN_LOCKING)
+#define SEQLOCK_READERS
+#endif
+
+// Nodes of a single key carry its expiry for the cache mode
+#if !defined(CUCKOO_LOCKING) && !defined(UNROLLED_CHAINS)
+#define NODE_EXPIRY
+#endif
+
+#ifdef CUCKOO_LOCKING
+// Keys live in the slots of a cuckoo table, see cuckoo.h. Inserts and lookups return the slot, which only tells that
+// the key was present: a concurrent insert may move the key to another slot.
+typedef struct Node {
+    int key;
+} Node;
+#elif defined(UNROLLED_CHAINS)
+// A node holds several sorted keys, see unrolled.h. The sentinel holds none.
+typedef struct Node {
+    int keys[BLOCK_KEYS];
+    int count;
+    struct Node* next;
+} Node;
+
+static_assert(sizeof(Node) == BLOCK_SEARCHED * sizeof(int), "a node must fill the searched ints");
+#else
 typedef struct Node {
     int key;            // currently supports integer key only
+    uint32_t expires;   // on the cache clock, 0 if the key never expires, see cachemode.h
     struct Node* next;  // next pointer for handling linked list style chaining
 #if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
     pthread_rwlock_t* lock;
 #endif
 } Node;
+#endif
 
+#ifndef CUCKOO_LOCKING
 Node* init_node(void);
+#endif
+
+#define LOOKUP_BATCH_MAX_WIDTH (64)  // lookups in flight of hashtable_lookup_batch()
+
+// Counting Bloom filter per bucket: 4-bit counters, each key counts in FILTER_PROBES of them
+#define FILTER_WORDS (2)
+#define FILTER_COUNTERS (FILTER_WORDS * 16)
+#define FILTER_PROBES (2)
+
+#define HASHTABLE_GATES (4096)                      // gates of hashtable_apply(), each in front of a stripe of buckets
+#define HASHTABLE_APPLY_MAX_OPS (COMPOUND_MAX_OPS)  // operations applied together by hashtable_apply()
+
+// Version, closed bit and writers passing, see hashtable_attach_gates()
+typedef struct Gate {
+    alignas(CACHE_LINE_SIZE) uint64_t word;
+} Gate;
+
+#define CHAIN_LENGTH_CLASSES (32)  // chains of length 0 to 30, the last class counts longer chains
+
+// Changes in the number of buckets per chain length, caused by one thread
+typedef struct ChainStats {
+    int64_t buckets[CHAIN_LENGTH_CLASSES];
+} ChainStats;
 
 typedef struct HashTable {
+#ifdef CUCKOO_LOCKING
+    CuckooTable* cuckoo;  // replaces the chained buckets
+#else
     Node** buckets;  // represents the table buckets
+#endif
     int size;        // represents the bucket size, not the number of items
-#ifdef BUCKET_LOCKING
+#ifdef BRAVO_LOCKING
+    BravoLock* bucket_locks;
+#elif BUCKET_LOCKING
     pthread_rwlock_t* bucket_locks;
+#endif
+    HotCache* hotcache;  // optional front cache for hot keys, NULL when disabled
+    int* chain_lengths;  // per bucket, NULL unless tracked
+    uint64_t* filters;   // FILTER_WORDS per bucket, NULL unless attached
+    StripedCounter filter_skips;            // lookups and deletes answered by the filter
+    StripedCounter filter_false_positives;  // lookups and deletes the filter let through that found nothing
+    ChainIndex** indexes;         // per bucket, created when its chain first grows long, NULL unless attached
+    int* index_lengths;           // nodes per bucket, NULL unless indexes are attached
+    StripedCounter index_builds;  // chains that got indexed
+    StripedCounter index_drops;   // indexed chains that shrank and dropped their index
+    Gate* gates;                  // HASHTABLE_GATES, NULL unless attached
+    StripedCounter gate_retries;  // lookups that overlapped a closed gate
+    StripedCounter applies;       // groups of operations applied atomically
+    StripedCounter rollbacks;     // all-or-nothing groups that were undone
+    CacheMode* cache;             // bounds and expires the keys, NULL unless attached
+    LockProfile* lockprof;        // sampled lock waits, NULL unless attached
+#ifdef SEQLOCK_READERS
+    uint64_t* bucket_seqs;  // high half counts begun modifications of the bucket, low half finished ones
+    Pool* node_pool;
+    StripedCounter read_failures;   // lock-free lookups that saw a concurrent modification
+    StripedCounter read_fallbacks;  // lookups that gave up and took the read lock
+#endif
+#ifdef OPTIMISTIC_LOCKING
+    StripedCounter validation_failures;
+    StripedCounter retries;    // optimistic attempts after a failed validation
+    StripedCounter fallbacks;  // operations that gave up and locked from the sentinel
 #endif
 } HashTable;
 
+typedef struct HashTableStats {
+    uint64_t hotcache_hits;
+    uint64_t hotcache_misses;
+    uint64_t validation_failures;
+    uint64_t retries;
+    uint64_t fallbacks;
+    uint64_t read_failures;
+    uint64_t read_fallbacks;
+    uint64_t filter_skips;
+    uint64_t filter_false_positives;
+    uint64_t index_builds;
+    uint64_t index_drops;
+    uint64_t gate_retries;
+    uint64_t applies;
+    uint64_t rollbacks;
+    uint64_t cache_evictions;
+    uint64_t cache_expirations;
+    uint64_t cuckoo_displacements;
+    uint64_t cuckoo_path_aborts;
+    uint64_t cuckoo_read_retries;
+    uint64_t cuckoo_resizes;
+} HashTableStats;
+
 /*
  * Hash table control functions
  */
@@ -34,26 +166,118 @@ HashTable* hashtable_create(int size);
 // Must be called at the termination process by the main thread.
 int hashtable_free(HashTable* table);
 
+// Free a hash table with num_threads threads, each freeing the chains and locks of a range of buckets.
+// Must be called at the termination process by the main thread.
+int hashtable_free_parallel(HashTable* table, int num_threads);
+
+// Load n keys into an empty table with num_threads threads, skipping duplicates. The keys are partitioned by bucket
+// and every chain is built at once in sorted order, without locks. With cuckoo hashing, the threads insert the keys.
+// Must be called before the table is shared with other threads.
+// Returns the number of keys loaded, else -1 on allocation failure and the table stays empty.
+int hashtable_bulk_load(HashTable* table, const int* keys, int n, int num_threads);
+
+// Put a hot-key cache of the given capacity in front of the buckets.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1.
+int hashtable_attach_hotcache(HashTable* table, int capacity);
+
+// Put a counting Bloom filter in front of every bucket, so that lookups and deletes of missing keys mostly return
+// after reading one filter, without locks or a chain walk.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1.
+int hashtable_attach_filter(HashTable* table);
+
+// Index the chain of every bucket that grows longer than CHAIN_INDEX_TREEIFY nodes, so that its operations take a
+// binary search and a short walk, and drop the index when it shrinks below CHAIN_INDEX_UNTREEIFY nodes.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1. Always fails with cuckoo hashing, which has no chains.
+int hashtable_attach_index(HashTable* table);
+
+// Put a gate in front of every stripe of buckets, so that hashtable_apply() can apply several operations atomically.
+// Every operation passes the gate of its bucket: writers wait while the gate is closed, lookups retry if it was closed
+// meanwhile. Lookups are not batched with gates.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1.
+int hashtable_attach_gates(HashTable* table);
+
+// Turn the table into a cache: bound its keys by config's caps, evicting approximately least recently used keys with
+// CLOCK, and expire keys after their TTL, lazily and with a background sweeper. Expired keys count as missing.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1. Always fails with cuckoo hashing and unrolled chains, whose nodes hold no expiry.
+int hashtable_attach_cache(HashTable* table, const CacheConfig* config);
+
+// Unlink the expired keys of the next num_buckets buckets, as one tick of the sweeper does.
+// Returns the number of keys that expired.
+int hashtable_cache_sweep(HashTable* table, int num_buckets);
+
+// Track the chain length of every bucket, reported to the threads' chain sinks.
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1. Always fails with cuckoo hashing, which has no chains.
+int hashtable_track_chains(HashTable* table);
+
+// Time one in sample_every lock acquisitions of every thread into a profile per bucket, per lock stripe with cuckoo
+// hashing, see lockprof.h. Only available when built with probes (cmake -DUSE_PROBES=ON).
+// Must be called before the table is shared with other threads.
+// Returns 0 on success, else -1.
+int hashtable_attach_lockprof(HashTable* table, int sample_every);
+
+// Report the chain length changes caused by the calling thread into sink, NULL to stop.
+// The sink is only written by the calling thread.
+void hashtable_set_chain_sink(ChainStats* sink);
+
 // Returns the hash value representing the bucket index;
 int hash_func(int key, int size);
 
-// Insert a new item into the hash table.
+// Insert a new item into the hash table. In cache mode, it expires after the default TTL, and an insert may evict
+// other items.
 // Returns NULL on duplicate item.
 Node* hashtable_insert(HashTable* table, int key);
 
+// Insert a new item that expires after ttl_ms, 0 to never expire. An expired duplicate is replaced.
+// Returns NULL on duplicate item. Without cache mode, the TTL is ignored.
+Node* hashtable_insert_ttl(HashTable* table, int key, uint32_t ttl_ms);
+
 // Lookup an item inside the hash table.
-// Returns the Node representing the item, else NULL.
+// Returns the Node representing the item, else NULL. With unrolled chains, the block that held the item.
 Node* hashtable_lookup(HashTable* table, int key);
 
+// Lookup n items, keeping up to width lookups in flight and interleaving their chain walks, so their cache misses
+// overlap (AMAC). Stores the node or NULL of keys[i] into results[i]. Falls back to one lookup at a time without a
+// lock-free read path or with a hot-key cache.
+void hashtable_lookup_batch(HashTable* table, const int* keys, Node** results, int n, int width);
+
 // Delete an item inside the hash table.
 // Returns 0 on success, else -1.
 int hashtable_delete(HashTable* table, int key);
 
+// Apply n (at most HASHTABLE_APPLY_MAX_OPS) operations in their order, atomically: the gates of their buckets are
+// closed in address order, so no other operation on those buckets interleaves and no lookup sees a part of them.
+// Stores whether types[i] of keys[i] succeeded into succeeded[i]. If all_or_nothing, the first operation that fails (a
+// duplicate insert, or a delete or lookup of a missing key) undoes the ones before it and the rest are not applied.
+// Requires the gates.
+// Returns true if the operations were applied, false if they were undone.
+bool hashtable_apply(HashTable* table, const int* keys, const OperationType* types, int n, bool all_or_nothing,
+                     bool* succeeded);
+
 // For debugging.
 void hashtable_print(HashTable* table);
 
 int hashtable_size(HashTable* table);
 
+// Store up to max keys of the table into keys, in no particular order. Like hashtable_size(), it does not synchronize
+// with writers, which must be paused.
+// Returns the number of keys stored.
+int hashtable_keys(HashTable* table, int* keys, int max);
+
+// Returns the name of the concurrency policy the library was built with.
+const char* hashtable_policy_name(void);
+
+// Collect the statistics counters of the table.
+void hashtable_stats(HashTable* table, HashTableStats* stats);
+
+// Print the statistics that apply to the table's configuration.
+void hashtable_stats_print(FILE* out, HashTable* table);
+
 #ifdef OPTIMISTIC_LOCKING
 bool validate(Node* bucket, Node* prev, Node* curr);
 #endif
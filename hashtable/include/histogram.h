@@ -0,0 +1,56 @@
+/**
+ * NOTE: HDR-style latency histogram. Values below 2^HISTOGRAM_SUB_BITS are
+ * counted exactly, larger values fall into log-linear buckets, i.e., every
+ * power of two is split into 2^(HISTOGRAM_SUB_BITS - 1) linear sub-buckets,
+ * which bounds the relative error to about 3%. A histogram is owned by a single
+ * thread while recording, so recording takes no lock. Per-thread histograms are
+ * merged once the threads are done.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTOGRAM_SUB_BITS (5)
+#define HISTOGRAM_MAX_BITS (42)  // values up to ~73 minutes in ns, larger values are clamped
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 3) << (HISTOGRAM_SUB_BITS - 1))
+
+typedef struct Histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+void histogram_init(Histogram* hist);
+
+void histogram_record(Histogram* hist, uint64_t value);
+
+// Add the counts of src to dst.
+void histogram_merge(Histogram* dst, const Histogram* src);
+
+// Returns the value below which the given percentage (e.g., 99.9) of the values fall.
+uint64_t histogram_percentile(const Histogram* hist, double percentile);
+
+double histogram_mean(const Histogram* hist);
+
+// Print the column names of histogram_print_summary().
+void histogram_print_header(FILE* out);
+
+// Print one row with the count, mean and tail percentiles (ns) of a histogram.
+void histogram_print_summary(FILE* out, const Histogram* hist, const char* name);
+
+// Write the non-empty buckets as "name,lower,upper,count" lines.
+void histogram_write_csv(FILE* out, const Histogram* hist, const char* name);
+
+// Write a JSON object with the summary and the non-empty buckets.
+void histogram_write_json(FILE* out, const Histogram* hist, const char* name);
+
+// Export histograms to a file, as JSON if the path ends with ".json", else as CSV.
+// Returns 0 on success, else -1.
+int histogram_export(const char* path, const Histogram* hists, const char* const* names, int num_hists);
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,67 @@
+/**
+ * NOTE: Small set-associative cache of hot keys placed in front of the hash
+ * table buckets. Readers never lock: each set is protected by a sequence lock
+ * and a reader that races with a writer simply treats the access as a miss and
+ * walks the chain. Only keys that are present are cached, so the table has to
+ * invalidate a key before (and after) unlinking it, see hashtable_delete().
+ *
+ * Admission is TinyLFU-like. Access frequencies are recorded in a count-min
+ * sketch whose counters of a key share one cache line. Counters saturate at 15,
+ * so the hottest keys only read the sketch, and the sketch is halved
+ * periodically to forget keys that cooled down. A candidate only replaces the
+ * least frequent way of its set when it was accessed more often, so one-off
+ * scans do not flush the hot keys.
+ */
+
+#ifndef HOTCACHE_H_
+#define HOTCACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "counter.h"
+
+#define HOTCACHE_WAYS (4)
+#define HOTCACHE_SKETCH_DEPTH (4)
+#define HOTCACHE_MAX_FREQUENCY (15)
+
+struct Node;
+
+typedef struct HotCacheSet {
+    alignas(CACHE_LINE_SIZE) uint32_t seq;  // odd while a writer updates the set
+    uint32_t epoch;                         // bumped on every invalidation of a key of this set
+    int keys[HOTCACHE_WAYS];                // -1 for an empty way
+    struct Node* nodes[HOTCACHE_WAYS];
+} HotCacheSet;
+
+typedef struct HotCache {
+    HotCacheSet* sets;
+    int num_sets;  // power of two
+
+    uint8_t* sketch;       // count-min sketch, a cache line holds the HOTCACHE_SKETCH_DEPTH counters of a key
+    int sketch_blocks;     // number of cache lines, power of two
+    uint64_t sample_size;  // number of recorded accesses between two halvings
+    uint64_t next_reset;   // halve the sketch when the accesses reach this value
+    StripedCounter accesses;
+
+    StripedCounter hits;
+    StripedCounter misses;
+} HotCache;
+
+// Create a cache holding roughly capacity keys.
+HotCache* hotcache_create(int capacity);
+
+void hotcache_free(HotCache* cache);
+
+// Returns true and the cached node on a hit. On a miss, returns the epoch of the
+// key's set, which has to be passed to hotcache_admit() after the chain walk.
+bool hotcache_lookup(HotCache* cache, int key, struct Node** node, uint32_t* epoch);
+
+// Offer a key found in the table. It is dropped if its set was invalidated since
+// the epoch was read, or if it is not accessed more often than the victim.
+void hotcache_admit(HotCache* cache, int key, struct Node* node, uint32_t epoch);
+
+// Remove the key from the cache and prevent in-flight admissions of its set.
+void hotcache_invalidate(HotCache* cache, int key);
+
+#endif /* HOTCACHE_H_ */
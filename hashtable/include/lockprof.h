@@ -0,0 +1,76 @@
+/**
+ * NOTE: Sampled lock-wait profile of a table. Every thread times one in
+ * sample_every of its lock acquisitions, from the call until the lock is held,
+ * and adds the wait to the slot of the lock: the bucket under the chained
+ * policies, the lock stripe under cuckoo hashing. A slot counts the sampled
+ * acquisitions and waits per mode and a histogram of the waits in power-of-two
+ * bins, so the hottest slots and their wait distributions can be reported.
+ *
+ * The table only feeds a profile when built with HASHTABLE_PROBES, see
+ * probe.h. Unsampled acquisitions cost a thread-local countdown.
+ */
+
+#ifndef LOCKPROF_H_
+#define LOCKPROF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOCKPROF_BINS (16)          // waits below 64 ns, then doubling up to 1 ms, the last bin counts longer waits
+#define LOCKPROF_FIRST_BIN_NS (64)  // upper bound of the first bin
+#define LOCKPROF_TOP (10)           // hottest slots printed
+
+enum LockMode { LockRead = 0, LockWrite = 1, LOCK_MODES = 2 };
+
+typedef struct LockSlot {
+    uint64_t acquisitions[LOCK_MODES];  // sampled
+    uint64_t wait_ns[LOCK_MODES];       // total of the sampled waits
+    uint32_t bins[LOCKPROF_BINS];
+} LockSlot;
+
+typedef struct LockProfile {
+    int num_slots;
+    int sample_every;
+    const char* unit;  // what a slot is, e.g. "bucket"
+    LockSlot* slots;
+} LockProfile;
+
+// Per thread, acquisitions left until the next sampled one
+extern thread_local int lockprof_countdown;
+
+// Create a profile of num_slots locks that samples every sample_every-th acquisition of a thread.
+// Returns NULL on failure.
+LockProfile* lockprof_create(int num_slots, int sample_every, const char* unit);
+
+void lockprof_destroy(LockProfile* profile);
+
+// Whether the calling thread times its current acquisition.
+static inline bool lockprof_sampled(const LockProfile* profile) {
+    if (--lockprof_countdown > 0) {
+        return false;
+    }
+    lockprof_countdown = profile->sample_every;
+    return true;
+}
+
+// Add a sampled acquisition of the slot's lock that waited wait_ns.
+void lockprof_record(LockProfile* profile, int slot, LockMode mode, uint64_t wait_ns);
+
+// Bin of a wait, see LOCKPROF_BINS.
+int lockprof_bin(uint64_t wait_ns);
+
+// Upper bound of the bin that holds the given percentile of the slot's waits, UINT64_MAX for the last bin.
+uint64_t lockprof_percentile(const LockSlot* slot, double percentile);
+
+// Sum of every slot.
+void lockprof_total(const LockProfile* profile, LockSlot* total);
+
+// Store up to max slots with the longest total wait into slots, longest first, skipping slots without waits.
+// Returns the number of slots stored.
+int lockprof_hottest(const LockProfile* profile, int* slots, int max);
+
+// Print the waits per mode, their histogram and the top hottest slots.
+void lockprof_print(FILE* out, const LockProfile* profile, int top);
+
+#endif /* LOCKPROF_H_ */
@@ -0,0 +1,56 @@
+/**
+ * NOTE: Type-stable pool of fixed-size objects. Objects are carved out of
+ * slabs and freed objects go back to a free list, never to the allocator, so
+ * memory that once held an object keeps holding one of that type until the
+ * pool is destroyed. Optimistic readers may thus follow a pointer to an object
+ * that was freed meanwhile: they read stale but well-formed fields and must
+ * validate what they read (e.g., with a sequence counter) before trusting it.
+ *
+ * A freed object's first 8 bytes link the free list, the rest stays intact.
+ * Free lists are striped per thread like the counters, so allocation and free
+ * rarely contend.
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "counter.h"
+
+#define POOL_SLAB_OBJECTS (256)
+
+typedef struct PoolSlab {
+    struct PoolSlab* next;
+    char* objects;
+} PoolSlab;
+
+typedef struct PoolStripe {
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    void* free_list;
+} PoolStripe;
+
+typedef struct Pool {
+    size_t object_size;
+    void (*init)(void*);  // called once per object when its slab is carved, may be NULL
+    PoolStripe stripes[COUNTER_STRIPES];
+    pthread_mutex_t slab_lock;
+    PoolSlab* slabs;
+} Pool;
+
+// Returns NULL on allocation failure.
+Pool* pool_create(size_t object_size, void (*init)(void*));
+
+// Free every slab, calling fini (may be NULL) once on every object ever carved.
+void pool_destroy(Pool* pool, void (*fini)(void*));
+
+// Like pool_destroy(), with num_threads threads each freeing a share of the slabs.
+void pool_destroy_parallel(Pool* pool, void (*fini)(void*), int num_threads);
+
+// Returns NULL on allocation failure.
+void* pool_alloc(Pool* pool);
+
+void pool_free(Pool* pool, void* object);
+
+#endif /* POOL_H_ */
@@ -0,0 +1,50 @@
+/**
+ * NOTE: Per-thread pseudo random number generator (xoshiro256**, seeded with
+ * splitmix64). Unlike rand(), the state is owned by the caller, so concurrent
+ * threads never share a lock or a cache line. Every thread seeds its own
+ * generator with the run seed and its thread id, which makes runs reproducible
+ * from a single seed while keeping the threads' sequences independent.
+ */
+
+#ifndef PRNG_H_
+#define PRNG_H_
+
+#include <stdint.h>
+
+typedef struct Prng {
+    uint64_t s[4];
+} Prng;
+
+// Seed the generator of the given stream (e.g., thread id) from the run seed.
+void prng_seed(Prng* prng, uint64_t seed, uint64_t stream);
+
+// Returns a seed taken from the clock, for runs that do not specify one.
+uint64_t prng_default_seed(void);
+
+static inline uint64_t prng_rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+// Returns the next 64 random bits.
+static inline uint64_t prng_next(Prng* prng) {
+    uint64_t* s = prng->s;
+    uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+
+    return result;
+}
+
+// Returns a double in [0, 1).
+static inline double prng_next_double(Prng* prng) { return (prng_next(prng) >> 11) * 0x1.0p-53; }
+
+// Returns an integer in [0, bound), bound > 0.
+static inline uint32_t prng_next_below(Prng* prng, uint32_t bound) {
+    return (uint32_t)(((prng_next(prng) >> 32) * bound) >> 32);
+}
+
+#endif /* PRNG_H_ */
@@ -0,0 +1,106 @@
+/**
+ * NOTE: Static tracepoints of the table, compiled in with HASHTABLE_PROBES
+ * (cmake -DUSE_PROBES=ON) and expanding to nothing otherwise. They are USDT
+ * probes of the provider "hashtable": a nop plus an ELF note that perf,
+ * bpftrace and SystemTap turn into a breakpoint once attached, e.g.
+ *
+ *     bpftrace -e 'usdt:./server:hashtable:validate_fail { @[arg0] = count(); }'
+ *
+ * Probes, with their arguments:
+ *     op_begin          type, key
+ *     op_end            type, key, succeeded
+ *     lock_acquire      slot, mode  before taking a lock of the slot (bucket, or stripe with cuckoo hashing)
+ *     lock_acquired     slot, mode  once it is held
+ *     validate_fail     bucket, attempt  an optimistic writer found its nodes changed
+ *     validate_fallback bucket           it gave up and locks from the sentinel
+ *     seq_retry         bucket, attempt  a lock-free lookup saw a concurrent write
+ *     node_alloc_begin  bucket
+ *     node_alloc_end    bucket, node
+ *
+ * <sys/sdt.h> is used if installed, else the notes are emitted the same way
+ * here on x86-64 and AArch64. The lock probes also feed the sampled profile of
+ * lockprof.h through PROBE_LOCK().
+ */
+
+#ifndef PROBE_H_
+#define PROBE_H_
+
+#ifdef HASHTABLE_PROBES
+
+#include <stdint.h>
+
+#include "lockprof.h"
+#include "timer.h"
+
+#if defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+
+#define PROBE1(name, a) DTRACE_PROBE1(hashtable, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(hashtable, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(hashtable, name, a, b, c)
+#elif defined(__x86_64__) || defined(__aarch64__)
+// The note layout of <sys/sdt.h>: the probe address, the base that tools use to detect prelinking, no semaphore,
+// the provider, the name and the arguments as "size@operand", every argument passed as a signed 64-bit value.
+#define PROBE_ARG_(x) "nor"((int64_t)(x))
+#define PROBE_NOTE_(name, args, ...)                                              \
+    __asm__ __volatile__(                                                         \
+        "990: nop\n"                                                              \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                             \
+        ".balign 4\n"                                                             \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                        \
+        "991: .asciz \"stapsdt\"\n"                                               \
+        "992: .balign 4\n"                                                        \
+        "993: .8byte 990b\n"                                                      \
+        ".8byte _.stapsdt.base\n"                                                 \
+        ".8byte 0\n"                                                              \
+        ".asciz \"hashtable\"\n"                                                  \
+        ".asciz \"" #name "\"\n"                                                  \
+        ".asciz \"" args "\"\n"                                                   \
+        "994: .balign 4\n"                                                        \
+        ".popsection\n"                                                           \
+        ".ifndef _.stapsdt.base\n"                                                \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"  \
+        ".weak _.stapsdt.base\n"                                                  \
+        ".hidden _.stapsdt.base\n"                                                \
+        "_.stapsdt.base: .space 1\n"                                              \
+        ".size _.stapsdt.base, 1\n"                                               \
+        ".popsection\n"                                                           \
+        ".endif\n"                                                                \
+        :                                                                         \
+        : __VA_ARGS__)
+
+#define PROBE1(name, a) PROBE_NOTE_(name, "-8@%0", PROBE_ARG_(a))
+#define PROBE2(name, a, b) PROBE_NOTE_(name, "-8@%0 -8@%1", PROBE_ARG_(a), PROBE_ARG_(b))
+#define PROBE3(name, a, b, c) PROBE_NOTE_(name, "-8@%0 -8@%1 -8@%2", PROBE_ARG_(a), PROBE_ARG_(b), PROBE_ARG_(c))
+#else
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#endif
+
+// Take a lock of the slot with the statement acquire, between the lock probes. Sampled acquisitions are timed into
+// the profile, if there is one.
+#define PROBE_LOCK(profile, slot, mode, acquire)                                                     \
+    do {                                                                                             \
+        LockProfile* probe_profile_ = (profile);                                                     \
+        PROBE2(lock_acquire, slot, mode);                                                            \
+        if (probe_profile_ != NULL && lockprof_sampled(probe_profile_)) {                            \
+            uint64_t probe_begin_ = timer_now();                                                     \
+            acquire;                                                                                 \
+            lockprof_record(probe_profile_, slot, mode, timer_ticks_to_ns(timer_now() - probe_begin_)); \
+        } else {                                                                                     \
+            acquire;                                                                                 \
+        }                                                                                            \
+        PROBE2(lock_acquired, slot, mode);                                                           \
+    } while (0)
+
+#else
+
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#define PROBE_LOCK(profile, slot, mode, acquire) acquire
+
+#endif
+
+#endif /* PROBE_H_ */
@@ -4,6 +4,18 @@
  * producer or consumer is extremely slower than the other, it may be a better
  * idea to use sleep wait using conditional variable. For now, we expect the
  * producer and consumer to be actively participating.
+ *
+ * The queue has two lanes, each such a ring. By default every operation takes
+ * the main lane. Once the consumer splits the lanes, lookups take a lane of
+ * their own, so they do not wait behind bursts of writes, and consumers pick
+ * between the lanes with strict priority or weighted fairness. Operations of
+ * one key still run in their enqueue order, both ways: producers count the
+ * operations queued or in progress per stripe of keys, with the lane they
+ * took, and consumers count them out once applied. An operation of a stripe
+ * with pending operations follows them into their lane, so a lookup stays
+ * behind a write in the main lane and a write behind a lookup in the lookup
+ * lane. A compound request waits until its keys have no lookups pending in
+ * the lookup lane.
  */
 
 #ifndef QUEUE_H_
@@ -13,32 +25,111 @@
 #include <stdint.h>
 
 #define QUEUE_SIZE (1024)
+#define COMPOUND_MAX_OPS (8)                 // operations of a compound request
+#define COMPOUND_MAILBOXES (64)              // producers that may send compound requests
+#define QUEUE_PENDING_STRIPES (4096)         // stripes of keys whose pending operations are counted, with split lanes
+#define QUEUE_PENDING_LOOKUP_LANE (1 << 30)  // flag of a pending count whose operations took the lookup lane
 
-enum OperationType { Undefined = -1, Insert = 0, Delete = 1, Lookup = 2 };
+// A Compound operation's key is the mailbox of its request
+enum OperationType { Undefined = -1, Insert = 0, Delete = 1, Lookup = 2, Compound = 3 };
 
 typedef struct Operation {
     int key;
     OperationType type;
-    uint64_t flag;  // for fairness
+    uint64_t flag;       // for fairness
+    uint64_t timestamp;  // producer's timer_now() at enqueue, 0 if not stamped
+    uint32_t tag;        // producer's reference for the answer, e.g. the socket request, see transport.h
 } Operation;
 
-typedef struct OperationQueue {
+// Operations a consumer applies atomically, and their results. The producer owns the mailbox until it sends the
+// request, and again once done is set.
+typedef struct CompoundRequest {
+    int num_ops;
+    bool all_or_nothing;  // undo the request if one of its operations fails
+    int keys[COMPOUND_MAX_OPS];
+    OperationType types[COMPOUND_MAX_OPS];
+    bool succeeded[COMPOUND_MAX_OPS];  // per operation, written by the consumer
+    bool applied;                      // false if the request was undone or refused
+    int done;
+} CompoundRequest;
+
+// The main lane carries every operation, except lookups once the lanes are split
+enum QueueLane { MainLane = 0, LookupLane = 1, QUEUE_LANES = 2 };
+
+typedef struct OperationLane {
     Operation instructions[QUEUE_SIZE];
     int front;
     int rear;
+} OperationLane;
+
+typedef struct OperationQueue {
+    OperationLane lanes[QUEUE_LANES];
     bool is_ready;
+    bool split_lanes;                    // set by queue_split_lanes()
+    int pending[QUEUE_PENDING_STRIPES];  // operations enqueued but not yet applied, per stripe of keys, and their lane
+    CompoundRequest mailboxes[COMPOUND_MAILBOXES];
 } OperationQueue;
 
+// How a consumer picks between the lanes when both hold operations
+enum LanePolicy { LaneStrict = 0, LaneWeighted = 1 };
+
+// Per consumer, see dequeue_lanes()
+typedef struct LaneScheduler {
+    LanePolicy policy;
+    int weight;  // lookups per write, with LaneWeighted
+    int credit;  // lookups left before a write is due
+} LaneScheduler;
+
 void init_queue(OperationQueue* queue);
 
 void enqueue(OperationQueue* queue, int key, OperationType type);
 
+// Enqueue an operation stamped with the given time, so consumers can measure how long it was queued.
+void enqueue_at(OperationQueue* queue, int key, OperationType type, uint64_t timestamp);
+
+// enqueue_at() with a tag the consumer hands back with the answer.
+void enqueue_tagged(OperationQueue* queue, int key, OperationType type, uint64_t timestamp, uint32_t tag);
+
+// Dequeue from the main lane, waiting until it holds an operation. Consumers of split lanes use dequeue_lanes().
 Operation dequeue(OperationQueue* queue);
 
+// Give lookups their own lane. Must be called by the consumer before producers start.
+void queue_split_lanes(OperationQueue* queue);
+
+void lane_scheduler_init(LaneScheduler* scheduler, LanePolicy policy, int weight);
+
+// Dequeue from whichever lane the scheduler picks, waiting until one holds an operation. With LaneStrict, lookups
+// always go first and may starve writes. With LaneWeighted, up to weight lookups go between two writes. Either way, an
+// empty lane never holds up the other.
+Operation dequeue_lanes(OperationQueue* queue, LaneScheduler* scheduler);
+
+// Dequeue up to max operations into ops, waiting for the first one only, so a batch never waits on operations that
+// producers hold back until they get answers. Ends the batch after a Compound operation. With a scheduler, dequeues
+// from the split lanes like dequeue_lanes(). Returns the number of operations, at least 1.
+int dequeue_batch(OperationQueue* queue, LaneScheduler* scheduler, Operation* ops, int max);
+
+// Tell producers that a dequeued operation was applied, so later operations of its key may take their own lane again.
+// Consumers of split lanes must call it for every Insert, Delete and Lookup.
+void queue_complete(OperationQueue* queue, const Operation* op);
+
+// Send the request in the producer's mailbox as one operation and wait until a consumer answered it with
+// compound_complete(). The producer's earlier operations are dequeued before it.
+void enqueue_compound(OperationQueue* queue, int mailbox, uint64_t timestamp);
+
+// Publish the results of a dequeued Compound operation's request to its producer.
+void compound_complete(CompoundRequest* request);
+
 // NOTE: If this function returns true, it means that the queue is empty for this moment.
 // If used properly with the should_terminate variable of struct SharedMem, we can detect
 // if the queue is actually empty and will be empty (i.e., no more enqueue). Remember that
 // this is a workaround and there might be a better way to determine the termination point.
 bool queue_is_empty(OperationQueue* queue);
 
+// Returns the number of claimed but not yet dequeued slots of both lanes, for monitoring. May exceed QUEUE_SIZE while
+// producers wait on a full queue.
+int queue_occupancy(OperationQueue* queue);
+
+// Like queue_occupancy(), for one lane.
+int queue_lane_occupancy(OperationQueue* queue, QueueLane lane);
+
 #endif /* QUEUE_H_ */
@@ -0,0 +1,177 @@
+/**
+ * NOTE: Log shipping from a primary server to read replicas on the same host.
+ * The primary appends every write it applied to a ring of records in a shared
+ * memory segment, numbered by log sequence numbers (LSNs). Followers tail the
+ * ring, apply the records to their own tables and serve lookups.
+ *
+ * A writer claims an LSN with a fetch-and-add on the head and publishes its
+ * record by storing LSN + 1 into the record's sequence word last. Followers
+ * read a record between two loads of that word, like the seqlocks of the
+ * buckets, so a record overwritten meanwhile is noticed. The ring never waits
+ * for followers: one that falls a whole ring behind finds newer sequence words
+ * and resynchronizes from a snapshot.
+ *
+ * The writes of a key are applied and appended under the lock of the key's
+ * stripe, so the records of a key are in the order its writes took effect and
+ * a follower ends up with the same keys. A snapshot takes every stripe lock,
+ * which pauses the writes (not the lookups) of the primary while it copies the
+ * keys and the head. It is written to a file when a follower asks for one,
+ * when the log advanced by half a ring since the last one, and on exit.
+ *
+ * The segment outlives the primary. A restarted primary loads the last
+ * snapshot and replays the records after it that the ring still holds, so the
+ * followers carry on where they were. If some are lost, it starts a new epoch
+ * and the followers resynchronize with what it recovered.
+ */
+
+#ifndef REPLICATION_H_
+#define REPLICATION_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "counter.h"
+#include "hashtable.h"
+#include "histogram.h"
+#include "queue.h"
+#include "stats.h"
+
+#define REPL_SHM_ID "/hashtable_replication_shm"
+#define REPL_LOG_RECORDS (1 << 20)       // records of the ring, a power of two
+#define REPL_STRIPES (4096)              // key stripes that order the writes, a power of two
+#define REPL_SNAPSHOT_PATH_MAX (256)     // including the terminating null byte
+#define REPL_POLL_US (1000)              // time between two checks of the primary's service thread
+#define REPL_IDLE_US (50)                // time a follower waits once it applied everything
+#define REPL_APPLY_RECORDS (1024)        // records a follower applies between two publications of its lag
+#define REPL_SNAPSHOT_TIMEOUT_MS (5000)  // wait of a follower for the snapshot it asked for
+
+typedef enum ReplRole { RoleStandalone = 0, RolePrimary = 1, RoleFollower = 2 } ReplRole;
+
+typedef struct ReplRecord {
+    uint64_t seq;   // LSN + 1 once published, 0 while being written
+    uint64_t time;  // timer_now() of the primary when appended
+    int key;
+    int type;  // Insert or Delete
+} ReplRecord;
+
+typedef struct ReplLog {
+    uint64_t magic;
+    uint64_t epoch;  // bumped whenever the records may no longer match the history a follower applied
+    bool primary_running;
+    char snapshot_path[REPL_SNAPSHOT_PATH_MAX];
+
+    alignas(CACHE_LINE_SIZE) uint64_t head;               // next LSN to claim
+    alignas(CACHE_LINE_SIZE) uint64_t snapshot_requests;  // bumped by followers that need a snapshot
+    uint64_t snapshot_served;                             // requests covered by the last snapshot
+    uint64_t snapshot_lsn;                                // head of the last snapshot
+
+    ReplRecord records[REPL_LOG_RECORDS];
+} ReplLog;
+
+typedef enum ReplRead { ReplReadOk, ReplReadPending, ReplReadOverrun } ReplRead;
+
+typedef struct ReplPrimary {
+    ReplLog* log;
+    HashTable* table;
+    ServerStats* stats;  // publishes the head, NULL if not published
+    pthread_mutex_t stripes[REPL_STRIPES];
+
+    int64_t recovered;   // keys loaded from the snapshot on open
+    int64_t replayed;    // records replayed after the snapshot on open
+    bool new_epoch;      // the history was not fully recovered on open
+    uint64_t snapshots;  // written since open
+
+    pthread_t service;
+    bool serving;
+    bool stop;
+} ReplPrimary;
+
+typedef struct ReplFollower {
+    ReplLog* log;
+    HashTable* table;
+    ServerStats* stats;  // publishes the lag, NULL if not published
+    int snapshot_timeout_ms;
+
+    uint64_t epoch;    // of the history the table follows
+    uint64_t next;     // LSN of the next record to apply
+    uint64_t applied;  // records applied
+    uint64_t resyncs;  // snapshots loaded after the bootstrap
+    Histogram lag;     // ns from the append of a record until it was applied
+
+    pthread_t applier;
+    bool applying;
+    bool stop;
+} ReplFollower;
+
+/*
+ * Log
+ */
+
+// Reset the log to an empty first epoch.
+void repl_log_init(ReplLog* log);
+
+// Open the log segment of the primary, creating and initializing it if there is none.
+// Returns NULL on failure.
+ReplLog* repl_log_open(void);
+
+// Attach the log segment of a follower.
+// Returns NULL if no primary created it yet.
+ReplLog* repl_log_attach(void);
+
+void repl_log_detach(ReplLog* log);
+
+// Read the record of the LSN into record. Pending if it is not published yet, overrun if the ring dropped it.
+ReplRead repl_log_read(const ReplLog* log, uint64_t lsn, ReplRecord* record);
+
+/*
+ * Primary
+ */
+
+// Recover the empty, not yet shared table from the snapshot file and the log, write a first snapshot and start the
+// service thread that answers the followers' requests.
+// Returns 0 on success, else -1.
+int repl_primary_open(ReplPrimary* primary, ReplLog* log, HashTable* table, const char* snapshot_path,
+                      ServerStats* stats);
+
+// Stop the service thread and write a last snapshot. The table is left to the caller.
+// Returns 0 on success, else -1 if the snapshot failed.
+int repl_primary_close(ReplPrimary* primary);
+
+// Apply an insert or delete to the table and append it to the log if it succeeded.
+// Returns whether it succeeded.
+bool repl_primary_write(ReplPrimary* primary, int key, OperationType type);
+
+// hashtable_apply() that appends the writes that succeeded if the operations were applied.
+bool repl_primary_apply(ReplPrimary* primary, const int* keys, const OperationType* types, int n, bool all_or_nothing,
+                        bool* succeeded);
+
+// Pause the writes while copying the keys and the head, then write the snapshot file.
+// Returns 0 on success, else -1.
+int repl_primary_snapshot(ReplPrimary* primary);
+
+/*
+ * Follower
+ */
+
+void repl_follower_init(ReplFollower* follower, ReplLog* log, HashTable* table, ServerStats* stats);
+
+// Load the empty, not yet shared table from a snapshot, asking the primary for a fresh one if it runs.
+// Returns the number of keys loaded, else -1 if there is no usable snapshot.
+int64_t repl_follower_bootstrap(ReplFollower* follower);
+
+// Apply up to max_records records, resynchronizing from a snapshot if the ring dropped records the follower needs or
+// the primary started a new epoch.
+// Returns the number of records applied, else -1 if a resynchronization failed.
+int repl_follower_poll(ReplFollower* follower, int max_records);
+
+// Records appended but not yet applied.
+uint64_t repl_follower_behind(const ReplFollower* follower);
+
+// Poll in a background thread until stopped.
+// Returns 0 on success, else -1.
+int repl_follower_start(ReplFollower* follower);
+
+void repl_follower_stop(ReplFollower* follower);
+
+#endif /* REPLICATION_H_ */
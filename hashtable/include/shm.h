@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include "queue.h"
+#include "stats.h"
 
 #define SHM_ID "/hashtable_program_shm"
 
@@ -16,11 +17,18 @@ typedef struct {
     int num_ops_per_thread;  // number of operations per thread
     bool client_is_ready;
     bool server_is_ready;
+    ServerStats stats;  // published by the server, see htstat
 } SharedMem;
 
+// Use another segment than SHM_ID, e.g., for a follower next to its primary (see replication.h). The name must start
+// with a slash and outlive the calls.
+void shm_set_id(const char* id);
+
 void* shm_create(void);
 void shm_init(SharedMem* area);
 void* shm_attach(void);
+void* shm_attach_readonly(void);
+void shm_detach(SharedMem* area);
 void shm_free(SharedMem* area);
 
 #endif /* SHM_H_ */
@@ -0,0 +1,70 @@
+/**
+ * NOTE: Live statistics of a running server, published inside the shared
+ * memory segment. Every worker owns a cache line aligned block and is its only
+ * writer, so updates are plain relaxed stores without contention. Readers
+ * (e.g., htstat) map the segment read-only and sum up the blocks, so reading
+ * never touches the workers' lines for writing. A snapshot is not atomic
+ * across workers, which is fine for monitoring.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "counter.h"
+#include "hashtable.h"
+#include "queue.h"
+
+#define STATS_MAX_WORKERS (256)
+#define STATS_POLICY_LEN (16)
+
+typedef struct WorkerStats {
+    alignas(CACHE_LINE_SIZE) uint64_t ops[3];  // indexed by OperationType
+    uint64_t succeeded[3];                     // inserts that added, deletes that removed, lookups that found a key
+    ChainStats chains;                         // chain length changes caused by this worker
+} WorkerStats;
+
+typedef struct ServerStats {
+    bool running;
+    int num_workers;
+    int num_buckets;
+    char policy[STATS_POLICY_LEN];
+    bool chains_tracked;                       // the chain lengths below are only kept up to date if set
+    int64_t chain_base[CHAIN_LENGTH_CLASSES];  // buckets per chain length when the workers started
+    int active_workers;                        // workers not parked by the elastic pool, all of them without one
+    uint64_t scale_ups;                        // decisions of the elastic pool to add workers
+    uint64_t scale_downs;                      // decisions of the elastic pool to park a worker
+    int repl_role;                             // ReplRole, see replication.h
+    uint64_t repl_head;                        // next LSN of the replication log
+    uint64_t repl_applied;                     // next LSN a follower applies
+    uint64_t repl_lag_ns;                      // from append to apply of a follower's last record, 0 once caught up
+    uint64_t repl_resyncs;                     // snapshots a follower loaded after its bootstrap
+    WorkerStats workers[STATS_MAX_WORKERS];
+} ServerStats;
+
+// Aggregated view of the workers
+typedef struct StatsSnapshot {
+    uint64_t ops[3];
+    uint64_t succeeded[3];
+    int64_t elements;
+    double load_factor;
+    int64_t chains[CHAIN_LENGTH_CLASSES];  // number of buckets per chain length
+} StatsSnapshot;
+
+// Reset the statistics for a table of the given size.
+void stats_init(ServerStats* stats, int num_buckets, const char* policy);
+
+// Record an operation of a worker.
+static inline void stats_record(WorkerStats* worker, OperationType type, bool succeeded) {
+    __atomic_store_n(&worker->ops[type], worker->ops[type] + 1, __ATOMIC_RELAXED);
+    if (succeeded) {
+        __atomic_store_n(&worker->succeeded[type], worker->succeeded[type] + 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Sum up the workers' statistics.
+void stats_snapshot(const ServerStats* stats, StatsSnapshot* snapshot);
+
+#endif /* STATS_H_ */
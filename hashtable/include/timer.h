@@ -0,0 +1,36 @@
+/**
+ * NOTE: Low overhead timestamps for latency measurements. On x86 the time
+ * stamp counter is read directly and converted to nanoseconds with a factor
+ * calibrated against CLOCK_MONOTONIC, elsewhere the clock is read instead.
+ * The TSC is assumed to be invariant (constant rate, synchronized across
+ * cores), which holds on the hosts we run on.
+ */
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Measure the timer frequency. Must be called once before converting ticks.
+void timer_calibrate(void);
+
+// Convert a number of ticks into nanoseconds.
+uint64_t timer_ticks_to_ns(uint64_t ticks);
+
+// Returns the current time in ticks.
+static inline uint64_t timer_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+#endif /* TIMER_H_ */
@@ -0,0 +1,107 @@
+/**
+ * NOTE: Binary traces of the operations a server executed, for replaying real
+ * traffic offline. Each worker fills its own buffer and appends it to the file
+ * as one chunk when full, so capturing only takes the writer's lock once every
+ * TRACE_BUFFER_RECORDS operations. The records of a chunk belong to a single
+ * worker and are in the order it executed them, chunks of different workers
+ * are interleaved. Readers map the file and walk the chunks in place.
+ *
+ * Layout: TraceHeader, then chunks of a TraceChunk header followed by its
+ * records. Times are in ns since the capture started.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "queue.h"
+
+#define TRACE_MAGIC "HTTRACE"
+#define TRACE_VERSION (1)
+#define TRACE_BUFFER_RECORDS (4096)
+
+typedef struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_workers;
+    uint64_t num_records;
+    uint64_t num_chunks;
+} TraceHeader;
+
+typedef struct TraceChunk {
+    uint32_t worker;
+    uint32_t num_records;
+} TraceChunk;
+
+typedef struct TraceRecord {
+    uint64_t time_ns;  // arrival, i.e., the enqueue stamp if the producer set one, else the dequeue
+    int32_t key;
+    int32_t type;  // OperationType
+} TraceRecord;
+
+typedef struct TraceWriter {
+    int fd;
+    uint64_t start;  // timer_now() at open
+    TraceHeader header;
+    bool failed;
+    pthread_mutex_t lock;
+} TraceWriter;
+
+// Per-worker staging buffer, only used by its worker.
+typedef struct TraceBuffer {
+    TraceWriter* writer;
+    TraceChunk chunk;
+    TraceRecord records[TRACE_BUFFER_RECORDS];
+} TraceBuffer;
+
+// A trace mapped for reading.
+typedef struct Trace {
+    const TraceHeader* header;
+    const char* data;
+    size_t size;
+} Trace;
+
+/*
+ * Capture
+ */
+
+// Create the trace file, truncating an existing one.
+// Returns 0 on success, else -1.
+int trace_writer_open(TraceWriter* writer, const char* path, int num_workers);
+
+// Write the remaining header fields and close the file. The buffers must be flushed before.
+// Returns 0 if every record was written, else -1.
+int trace_writer_close(TraceWriter* writer);
+
+void trace_buffer_init(TraceBuffer* buffer, TraceWriter* writer, int worker);
+
+// Append the buffered records to the file as one chunk.
+void trace_buffer_flush(TraceBuffer* buffer);
+
+// Record an executed operation. now is the timer_now() of its dequeue.
+void trace_record(TraceBuffer* buffer, const Operation* op, uint64_t now);
+
+/*
+ * Replay
+ */
+
+// Map a trace file and check its header and chunk boundaries.
+// Returns 0 on success, else -1.
+int trace_open(Trace* trace, const char* path);
+
+void trace_close(Trace* trace);
+
+// Returns the first chunk, or NULL if the trace is empty.
+const TraceChunk* trace_first_chunk(const Trace* trace);
+
+// Returns the chunk after the given one, or NULL at the end.
+const TraceChunk* trace_next_chunk(const Trace* trace, const TraceChunk* chunk);
+
+static inline const TraceRecord* trace_chunk_records(const TraceChunk* chunk) {
+    return (const TraceRecord*)(chunk + 1);
+}
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,111 @@
+/**
+ * NOTE: Socket front end of the server, for clients that do not map its
+ * shared memory: Unix-domain sockets, or TCP on the loopback interface. One
+ * thread runs an epoll loop over the listening socket and the connections. It
+ * enqueues every request a read() returned for the workers, so one syscall
+ * carries many requests. Requests are pipelined: a client sends up to its
+ * window without waiting, and the answers come back in request order, one
+ * byte each.
+ *
+ * Every connection has a ring of TRANSPORT_WINDOW requests in flight, and the
+ * operations are tagged with their connection and slot. Workers answer into
+ * the slots and wake the loop through an eventfd, only if no wakeup is pending
+ * yet, so a busy loop is not woken once per answer. The loop then sends the
+ * answered prefix of every ring with one send(). A connection whose ring is
+ * full is not read until its answers drain, which pushes back on the client
+ * through the socket buffers.
+ */
+
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "queue.h"
+
+#define TRANSPORT_MAX_CONNECTIONS (256)
+#define TRANSPORT_WINDOW (4096)  // requests in flight per connection, a power of two
+#define TRANSPORT_BACKLOG (64)
+
+#define WIRE_MAGIC (0x31535448)  // "HTS1"
+
+// First message of every connection. The server takes the load of the run from the first one, and closes any
+// connection that sends a request past num_threads * num_ops_per_thread requests over all connections.
+typedef struct WireHello {
+    uint32_t magic;
+    int32_t num_threads;
+    int32_t num_ops_per_thread;
+    int32_t reserved;
+} WireHello;
+
+typedef struct WireRequest {
+    int32_t key;   // non-negative
+    uint8_t type;  // Insert, Delete or Lookup
+    uint8_t reserved[3];
+} WireRequest;
+
+// One byte per request, in request order
+enum WireAnswer { WireFailed = 0, WireSucceeded = 1 };
+
+typedef struct Connection {
+    int fd;  // -1 if the slot is free
+    bool greeted;
+    bool reading;     // wants input, false while the ring is full or after the client closed
+    bool writing;     // wants output, while answers wait for socket buffer space
+    bool closed;      // by the client, the slot is freed once the requests in flight are answered
+    uint32_t events;  // registered with epoll
+
+    char* in;  // bytes read but not parsed yet, a partial message
+    int in_bytes;
+    uint64_t received;   // requests enqueued
+    uint64_t collected;  // requests whose answers were moved into out
+    uint64_t sent;       // answers sent
+    uint8_t* results;    // per slot of the ring, 0 while in flight, else 1 + the WireAnswer
+    uint8_t* out;        // answers not sent yet, a ring of TRANSPORT_WINDOW
+} Connection;
+
+typedef struct Transport {
+    OperationQueue* queue;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    char unix_path[108];  // unlinked on close, empty for TCP
+    Connection connections[TRANSPORT_MAX_CONNECTIONS];
+
+    bool wake_pending;
+    bool ready;  // a client said hello
+    int num_threads;
+    int num_ops_per_thread;
+
+    uint64_t reads;     // syscalls that returned requests
+    uint64_t sends;     // syscalls that sent answers
+    uint64_t requests;  // requests enqueued
+
+    pthread_t loop;
+    bool running;
+    bool stop;
+} Transport;
+
+// Listen on a Unix-domain socket at unix_path, or on TCP port of the loopback interface if unix_path is NULL, and
+// start the event loop that enqueues the requests into the queue. The operations are stamped when they are read.
+// Returns 0 on success, else -1.
+int transport_open(Transport* transport, OperationQueue* queue, const char* unix_path, int port);
+
+// Send the answers left, then stop the event loop and close the sockets. The workers must be done.
+void transport_close(Transport* transport);
+
+// Whether a client said hello, the load of the run is then known.
+static inline bool transport_ready(Transport* transport) {
+    return __atomic_load_n(&transport->ready, __ATOMIC_ACQUIRE);
+}
+
+// Answer n dequeued operations that came from sockets, and wake the event loop once.
+void transport_answer(Transport* transport, const Operation* ops, const bool* succeeded, int n);
+
+// Connect to a server listening on unix_path, or on the loopback TCP port if unix_path is NULL.
+// Returns the blocking socket, else -1.
+int transport_connect(const char* unix_path, int port);
+
+#endif /* TRANSPORT_H_ */
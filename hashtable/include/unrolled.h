@@ -0,0 +1,36 @@
+/**
+ * NOTE: Key arrays of unrolled chains. A chain node holds up to BLOCK_KEYS
+ * sorted keys and the link to the next node in one cache line, so a walk over n
+ * keys takes about n / BLOCK_KEYS dependent cache misses instead of n. Keys are
+ * searched with SIMD compares (AVX2, else SSE2, else a scalar loop).
+ *
+ * Nodes split when full and merge with their successor when they fall below
+ * half full, so a chain stays sorted across nodes and no node is empty. Linking
+ * nodes into chains and synchronizing with readers is up to the table.
+ */
+
+#ifndef UNROLLED_H_
+#define UNROLLED_H_
+
+#include <stdbool.h>
+
+#define BLOCK_KEYS (13)      // 13 keys, the count and the link fill 64 bytes
+#define BLOCK_SEARCHED (16)  // ints read by a search, those past the count are ignored
+
+// Returns the number of the count keys less than the key, i.e., the key's position. BLOCK_SEARCHED ints must be
+// readable from keys on.
+int block_rank(const int* keys, int count, int key);
+
+// Insert the key at its rank. The keys must not be full.
+void block_insert_at(int* keys, int* count, int rank, int key);
+
+// Remove the key at the given rank.
+void block_remove_at(int* keys, int* count, int rank);
+
+// Move the upper half of full keys into empty ones.
+void block_split(int* keys, int* count, int* upper, int* upper_count);
+
+// Append the following keys, which must fit, leaving them empty.
+void block_merge(int* keys, int* count, int* next, int* next_count);
+
+#endif /* UNROLLED_H_ */
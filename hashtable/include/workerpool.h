@@ -0,0 +1,91 @@
+/**
+ * NOTE: Elastic pool of the server's workers. The server starts up to
+ * max_workers threads, but only the first active ones run, the others park
+ * on a condition variable instead of spinning on the queue. A controller
+ * samples the queue occupancy and the service rate at a fixed interval: a
+ * deep queue, or one whose expected wait (occupancy over the service rate,
+ * Little's law) is too long, doubles the active workers at once, while a
+ * shallow queue parks one worker only after several calm samples in a row.
+ * The gap between the two thresholds and the calm samples keep the pool from
+ * flapping.
+ *
+ * The workers share the number of operations left to dequeue, so the ops are
+ * served exactly once whichever workers are active.
+ */
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "counter.h"
+
+#define ELASTIC_INTERVAL_US (1000)    // default time between two samples
+#define ELASTIC_HIGH_OCCUPANCY (256)  // default queued operations that add workers
+#define ELASTIC_LOW_OCCUPANCY (4)     // default queued operations under which a worker may park
+#define ELASTIC_TARGET_WAIT_US (200)  // default expected wait in the queue that adds workers
+#define ELASTIC_CALM_SAMPLES (20)     // default shallow samples in a row before a worker parks
+
+typedef struct ElasticConfig {
+    int min_workers;
+    int max_workers;
+    int interval_us;
+    int high_occupancy;
+    int low_occupancy;
+    int target_wait_us;
+    int calm_samples;
+} ElasticConfig;
+
+typedef struct WorkerPool {
+    ElasticConfig config;
+    alignas(CACHE_LINE_SIZE) int64_t remaining;  // operations no worker claimed yet
+    alignas(CACHE_LINE_SIZE) uint64_t served;    // operations done, for the service rate
+    alignas(CACHE_LINE_SIZE) int active;         // workers with a lower id run, the others park
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    // Controller only
+    int calm;  // shallow samples in a row
+    uint64_t last_served;
+    uint64_t scale_ups;
+    uint64_t scale_downs;
+    uint64_t samples;
+    uint64_t active_samples;  // sum of the active workers over the samples
+} WorkerPool;
+
+// The defaults, between 1 and max_workers workers.
+void elastic_default_config(ElasticConfig* config, int max_workers);
+
+// Start with min_workers active workers, which will dequeue total_ops operations together.
+// Returns 0 on success, else -1.
+int worker_pool_init(WorkerPool* pool, const ElasticConfig* config, int64_t total_ops);
+
+void worker_pool_destroy(WorkerPool* pool);
+
+// Claim one operation to dequeue. Returns false once every operation is claimed.
+static inline bool worker_pool_claim(WorkerPool* pool) {
+    if (__atomic_load_n(&pool->remaining, __ATOMIC_RELAXED) <= 0) {
+        return false;
+    }
+    return __atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_RELAXED) >= 0;
+}
+
+// Count n served operations.
+static inline void worker_pool_served(WorkerPool* pool, int n) {
+    __atomic_fetch_add(&pool->served, n, __ATOMIC_RELAXED);
+}
+
+// Park the worker while its id is beyond the active workers. Returns false once every operation is claimed, so the
+// worker should exit.
+bool worker_pool_checkpoint(WorkerPool* pool, int id);
+
+// One sample of the controller, elapsed_ns after the previous one. Returns the active workers after the decision.
+int worker_pool_sample(WorkerPool* pool, int occupancy, uint64_t elapsed_ns);
+
+// Wake the parked workers, e.g., once every operation is claimed.
+void worker_pool_wake_all(WorkerPool* pool);
+
+#endif /* WORKERPOOL_H_ */
@@ -0,0 +1,78 @@
+/**
+ * NOTE: Workload generator for benchmarks. Keys are drawn from a bounded key
+ * space with one of the following distributions, and every thread mixes the
+ * operation types with the configured ratio.
+ *  - uniform: every key is equally likely.
+ *  - zipfian: ranks follow a Zipfian distribution (YCSB's generator), ranks
+ *    are scrambled over the key space so hot keys do not share a bucket.
+ *  - latest: like zipfian, but ranks count back from the most recently inserted
+ *    key. Inserts append new keys after the key space.
+ *  - hotspot: hot_op_fraction of the operations go to the first hot_fraction of
+ *    the key space.
+ *
+ * The YCSB core workloads are mapped onto insert/delete/lookup. An update is
+ * issued as an insert or a delete with equal probability, which keeps the
+ * population close to the prefilled one. Scans (E) are issued as lookups and a
+ * read-modify-write (F) counts as one lookup plus one update.
+ */
+
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "prng.h"
+#include "queue.h"
+
+enum KeyDistribution { DistUniform = 0, DistZipfian = 1, DistLatest = 2, DistHotspot = 3 };
+
+typedef struct WorkloadConfig {
+    KeyDistribution distribution;
+    double theta;            // Zipfian skew, in (0, 1)
+    int key_space;           // keys are drawn from [0, key_space)
+    double hot_fraction;     // hotspot: fraction of the key space that is hot
+    double hot_op_fraction;  // hotspot: fraction of the operations on hot keys
+    int lookup_permille;     // operation mix in 1/1000, must sum up to 1000
+    int insert_permille;
+    int delete_permille;
+    double prefill;         // fraction of the key space inserted before the run
+    int warmup_ops;         // operations per thread before the measurement starts
+} WorkloadConfig;
+
+typedef struct Workload {
+    WorkloadConfig config;
+
+    // Zipfian constants, see "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.)
+    double zeta_n;
+    double zeta_2;
+    double alpha;
+    double eta;
+
+    int latest;  // next key to insert for the latest distribution
+} Workload;
+
+// Default configuration: uniform keys over 1M keys, YCSB-A mix, half prefilled.
+void workload_default_config(WorkloadConfig* config);
+
+// Precompute the distribution constants. Returns 0 on success, -1 on an invalid config.
+int workload_init(Workload* workload, const WorkloadConfig* config);
+
+// Parse "uniform", "zipfian", "latest" or "hotspot". Returns 0 on success, else -1.
+int workload_parse_distribution(const char* str, KeyDistribution* distribution);
+
+// Parse a YCSB core workload ("a" to "f") or a custom "lookup:insert:delete" percentage mix.
+// Workload "d" also switches to the latest distribution. Returns 0 on success, else -1.
+int workload_parse_mix(const char* str, WorkloadConfig* config);
+
+// Returns true if the key belongs to the prefilled population.
+bool workload_is_prefilled(const Workload* workload, int key);
+
+// Draw the next operation of a thread from its own generator.
+Operation workload_next(Workload* workload, Prng* prng);
+
+// Draw a thread's next num_ops operations into a new array, to be freed by the caller.
+// Inserts of the latest distribution advance the latest key while generating. Returns NULL if out of memory.
+Operation* workload_generate(Workload* workload, Prng* prng, int num_ops);
+
+#endif /* WORKLOAD_H_ */
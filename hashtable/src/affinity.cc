@@ -0,0 +1,334 @@
+#include "affinity.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+#define SYSFS_CPU_DIR "/sys/devices/system/cpu"
+
+// Returns the first integer of a sysfs file (also works for cpu lists, e.g., "0-3,8-11"), else fallback.
+static int read_sysfs_int(const char* path, int fallback) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return fallback;
+    }
+
+    int value;
+    if (fscanf(fp, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(fp);
+
+    return value;
+}
+
+// The LLC is identified by the first cpu sharing the highest level cache.
+static int read_llc_key(int cpu) {
+    char path[256];
+    int best_level = -1;
+    int key = cpu;
+
+    for (int i = 0;; ++i) {
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/cache/index%d/level", cpu, i);
+        int level = read_sysfs_int(path, -1);
+        if (level < 0) {
+            break;
+        }
+        if (level > best_level) {
+            best_level = level;
+            snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+            key = read_sysfs_int(path, cpu);
+        }
+    }
+
+    return key;
+}
+
+static int read_node(int cpu) {
+    char path[256];
+    snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    return node;
+}
+
+int topology_detect(Topology* topo) {
+    assert(topo != NULL);
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+
+    int llc_keys[MAX_CPUS];
+    int max_node = 0;
+    char path[256];
+
+    topo->num_cpus = 0;
+    for (int cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+
+        CpuInfo* info = &topo->cpus[topo->num_cpus];
+        info->cpu = cpu;
+
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/core_id", cpu);
+        info->core = read_sysfs_int(path, cpu);
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/physical_package_id", cpu);
+        info->package = read_sysfs_int(path, 0);
+        info->node = read_node(cpu);
+
+        info->sibling = 0;
+        for (int i = 0; i < topo->num_cpus; ++i) {
+            if (topo->cpus[i].package == info->package && topo->cpus[i].core == info->core) {
+                ++info->sibling;
+            }
+        }
+
+        llc_keys[topo->num_cpus] = read_llc_key(cpu);
+        if (info->node > max_node) {
+            max_node = info->node;
+        }
+        ++topo->num_cpus;
+    }
+
+    if (topo->num_cpus == 0) {
+        return -1;
+    }
+
+    // Turn LLC keys into dense ids in the order of first appearance
+    topo->num_llcs = 0;
+    for (int i = 0; i < topo->num_cpus; ++i) {
+        int id = -1;
+        for (int j = 0; j < i; ++j) {
+            if (llc_keys[j] == llc_keys[i]) {
+                id = topo->cpus[j].llc;
+                break;
+            }
+        }
+        if (id == -1) {
+            id = topo->num_llcs++;
+        }
+        topo->cpus[i].llc = id;
+    }
+
+    topo->num_nodes = max_node + 1;
+
+    return 0;
+}
+
+int topology_node_of(const Topology* topo, int cpu) {
+    for (int i = 0; i < topo->num_cpus; ++i) {
+        if (topo->cpus[i].cpu == cpu) {
+            return topo->cpus[i].node;
+        }
+    }
+    return -1;
+}
+
+static int compare_compact(const void* a, const void* b) {
+    const CpuInfo* x = (const CpuInfo*)a;
+    const CpuInfo* y = (const CpuInfo*)b;
+
+    // One LLC after another, physical cores before their SMT siblings
+    if (x->llc != y->llc) return x->llc - y->llc;
+    if (x->sibling != y->sibling) return x->sibling - y->sibling;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+int placement_init(Placement* placement, const Topology* topo, PinPolicy policy, int llc, int offset) {
+    assert(placement != NULL);
+    assert(topo != NULL);
+
+    placement->policy = policy;
+    placement->llc = llc;
+    placement->offset = offset;
+    placement->num_cpus = 0;
+    placement->topo = topo;
+
+    if (policy == PinNone) {
+        return 0;
+    }
+
+    CpuInfo sorted[MAX_CPUS];
+    int n = 0;
+    for (int i = 0; i < topo->num_cpus; ++i) {
+        if (llc < 0 || topo->cpus[i].llc == llc) {
+            sorted[n++] = topo->cpus[i];
+        }
+    }
+    qsort(sorted, n, sizeof(CpuInfo), compare_compact);
+
+    int ordered[MAX_CPUS];
+    if (policy == PinScatter) {
+        // Take the next cpu (in compact order) of each package in turn
+        bool taken[MAX_CPUS] = {false};
+        int count = 0;
+        while (count < n) {
+            int visited[MAX_CPUS];
+            int num_visited = 0;
+            for (int i = 0; i < n; ++i) {
+                if (taken[i]) {
+                    continue;
+                }
+                bool seen = false;
+                for (int j = 0; j < num_visited; ++j) {
+                    if (visited[j] == sorted[i].package) {
+                        seen = true;
+                        break;
+                    }
+                }
+                if (!seen) {
+                    visited[num_visited++] = sorted[i].package;
+                    taken[i] = true;
+                    ordered[count++] = sorted[i].cpu;
+                }
+            }
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            ordered[i] = sorted[i].cpu;
+        }
+    }
+
+    for (int i = offset; i < n; ++i) {
+        placement->cpus[placement->num_cpus++] = ordered[i];
+    }
+
+    return placement->num_cpus > 0 ? 0 : -1;
+}
+
+int placement_cpu(const Placement* placement, int idx) {
+    if (placement->policy == PinNone || placement->num_cpus == 0) {
+        return -1;
+    }
+    return placement->cpus[idx % placement->num_cpus];
+}
+
+int placement_home_node(const Placement* placement) {
+    int cpu = placement_cpu(placement, 0);
+    if (cpu < 0) {
+        return -1;
+    }
+    return topology_node_of(placement->topo, cpu);
+}
+
+void placement_print(FILE* out, const Placement* placement, const char* role, int num_threads) {
+    static const char* names[] = {"none", "compact", "scatter"};
+    const Topology* topo = placement->topo;
+
+    fprintf(out, "Placement: policy=%s, llc=", names[placement->policy]);
+    if (placement->llc < 0) {
+        fprintf(out, "any");
+    } else {
+        fprintf(out, "%d", placement->llc);
+    }
+    fprintf(out, ", %d cpus / %d llcs / %d nodes", topo->num_cpus, topo->num_llcs, topo->num_nodes);
+#ifdef HAVE_LIBNUMA
+    fprintf(out, ", numa binding enabled\n");
+#else
+    fprintf(out, ", affinity only\n");
+#endif
+
+    if (placement->policy == PinNone) {
+        return;
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+        int cpu = placement_cpu(placement, i);
+        for (int j = 0; j < topo->num_cpus; ++j) {
+            if (topo->cpus[j].cpu == cpu) {
+                fprintf(out, "\t%s %d -> cpu %d (core %d, llc %d, node %d)\n", role, i, cpu, topo->cpus[j].core,
+                        topo->cpus[j].llc, topo->cpus[j].node);
+                break;
+            }
+        }
+    }
+}
+
+int placement_parse_policy(const char* str, PinPolicy* policy) {
+    if (strcmp(str, "none") == 0) {
+        *policy = PinNone;
+    } else if (strcmp(str, "compact") == 0) {
+        *policy = PinCompact;
+    } else if (strcmp(str, "scatter") == 0) {
+        *policy = PinScatter;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_set_attr(pthread_attr_t* attr, int cpu) {
+    if (cpu < 0) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int affinity_pin_self(int cpu) {
+    if (cpu < 0) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int affinity_bind_memory(void* addr, size_t len, int node) {
+#ifdef HAVE_LIBNUMA
+    if (node < 0 || numa_available() < 0) {
+        return -1;
+    }
+    numa_tonode_memory(addr, len, node);
+    return 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return -1;
+#endif
+}
+
+int affinity_prefer_node(int node) {
+#ifdef HAVE_LIBNUMA
+    if (node < 0 || numa_available() < 0) {
+        return -1;
+    }
+    numa_set_preferred(node);
+    return 0;
+#else
+    (void)node;
+    return -1;
+#endif
+}
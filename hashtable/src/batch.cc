@@ -0,0 +1,60 @@
+#include "batch.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+// Run the pending lookups ops[first, last)
+static void flush_lookups(HashTable* table, const Operation* ops, bool* succeeded, int first, int last, int width) {
+    int keys[BATCH_MAX_OPS];
+    Node* results[BATCH_MAX_OPS];
+    // batch_execute_writes() checked the bound already, repeated so that the compiler sees every key written
+    int n = last - first;
+    if (n <= 0 || n > BATCH_MAX_OPS) {
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        keys[i] = ops[first + i].key;
+    }
+    hashtable_lookup_batch(table, keys, results, n, width);
+    for (int i = 0; i < n; ++i) {
+        succeeded[first + i] = results[i] != NULL;
+    }
+}
+
+void batch_execute(HashTable* table, const Operation* ops, bool* succeeded, int n, int width) {
+    batch_execute_writes(table, ops, succeeded, n, width, NULL, NULL);
+}
+
+void batch_execute_writes(HashTable* table, const Operation* ops, bool* succeeded, int n, int width, BatchWriter write,
+                          void* arg) {
+    assert(table != NULL);
+    assert(n >= 0 && n <= BATCH_MAX_OPS);
+
+    int pending = 0;  // first lookup not executed yet
+    for (int i = 0; i < n; ++i) {
+        if (ops[i].type == Lookup) {
+            continue;
+        }
+
+        flush_lookups(table, ops, succeeded, pending, i, width);
+        pending = i + 1;
+
+        if (write != NULL) {
+            succeeded[i] = write(arg, ops[i].key, ops[i].type);
+            continue;
+        }
+        switch (ops[i].type) {
+            case Insert:
+                succeeded[i] = hashtable_insert(table, ops[i].key) != NULL;
+                break;
+            case Delete:
+                succeeded[i] = hashtable_delete(table, ops[i].key) == 0;
+                break;
+            default:
+                assert(false);  // should never happen
+                succeeded[i] = false;
+        }
+    }
+    flush_lookups(table, ops, succeeded, pending, n, width);
+}
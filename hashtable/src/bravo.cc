@@ -0,0 +1,106 @@
+#include "bravo.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "counter.h"
+#include "timer.h"
+
+// Which lock each slot's reader holds, NULL if free. Padded, so readers of one lock do not share a line.
+typedef struct ReaderSlot {
+    alignas(CACHE_LINE_SIZE) BravoLock* lock;
+} ReaderSlot;
+
+static ReaderSlot visible_readers[BRAVO_TABLE_SIZE];
+
+static uint64_t next_thread_id = 0;
+static thread_local uint64_t thread_id = 0;  // 0 until the thread's first read
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// The first slot of the lock's region
+static int region_of(BravoLock* lock) {
+    // Fibonacci hashing, the low bits of the address are always zero
+    uint64_t hash = ((uintptr_t)lock >> 4) * 0x9E3779B97F4A7C15ULL;
+    int num_regions = BRAVO_TABLE_SIZE / BRAVO_REGION_SLOTS;
+    return (int)(hash >> (64 - __builtin_ctz(num_regions))) * BRAVO_REGION_SLOTS;
+}
+
+static int slot_of(BravoLock* lock) {
+    if (thread_id == 0) {
+        thread_id = __atomic_add_fetch(&next_thread_id, 1, __ATOMIC_RELAXED);
+    }
+    return region_of(lock) + (int)(thread_id % BRAVO_REGION_SLOTS);
+}
+
+void bravo_init(BravoLock* lock) {
+    assert(lock != NULL);
+    static_assert((BRAVO_TABLE_SIZE & (BRAVO_TABLE_SIZE - 1)) == 0 && BRAVO_TABLE_SIZE % BRAVO_REGION_SLOTS == 0 &&
+                      ((BRAVO_TABLE_SIZE / BRAVO_REGION_SLOTS) & (BRAVO_TABLE_SIZE / BRAVO_REGION_SLOTS - 1)) == 0,
+                  "BRAVO_TABLE_SIZE must be a power of two with a power of two number of regions");
+
+    pthread_rwlock_init(&lock->underlying, NULL);
+    lock->read_bias = false;  // set by the first reader, so locks that are only written never pay for revocation
+    lock->inhibit_until = 0;
+}
+
+void bravo_destroy(BravoLock* lock) { pthread_rwlock_destroy(&lock->underlying); }
+
+int bravo_read_lock(BravoLock* lock) {
+    if (__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED)) {
+        int slot = slot_of(lock);
+        BravoLock* expected = NULL;
+        if (__atomic_compare_exchange_n(&visible_readers[slot].lock, &expected, lock, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+            // Pairs with the writer clearing the bias before it scans the slots
+            if (__atomic_load_n(&lock->read_bias, __ATOMIC_SEQ_CST)) {
+                return slot;
+            }
+            __atomic_store_n(&visible_readers[slot].lock, NULL, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_rwlock_rdlock(&lock->underlying);
+
+    // Writers are excluded here, so the bias cannot be set while one revokes it
+    if (!__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED) &&
+        timer_now() >= __atomic_load_n(&lock->inhibit_until, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&lock->read_bias, true, __ATOMIC_RELAXED);
+    }
+
+    return -1;
+}
+
+void bravo_read_unlock(BravoLock* lock, int slot) {
+    if (slot >= 0) {
+        assert(visible_readers[slot].lock == lock);
+        __atomic_store_n(&visible_readers[slot].lock, NULL, __ATOMIC_RELEASE);
+    } else {
+        pthread_rwlock_unlock(&lock->underlying);
+    }
+}
+
+void bravo_write_lock(BravoLock* lock) {
+    pthread_rwlock_wrlock(&lock->underlying);
+
+    if (__atomic_load_n(&lock->read_bias, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&lock->read_bias, false, __ATOMIC_SEQ_CST);
+
+        // Wait for the fast path readers to leave
+        uint64_t start = timer_now();
+        int region = region_of(lock);
+        for (int i = region; i < region + BRAVO_REGION_SLOTS; ++i) {
+            while (__atomic_load_n(&visible_readers[i].lock, __ATOMIC_SEQ_CST) == lock) {
+                cpu_relax();
+            }
+        }
+        uint64_t now = timer_now();
+        __atomic_store_n(&lock->inhibit_until, now + (now - start) * BRAVO_INHIBIT_MULTIPLIER, __ATOMIC_RELAXED);
+    }
+}
+
+void bravo_write_unlock(BravoLock* lock) { pthread_rwlock_unlock(&lock->underlying); }
@@ -0,0 +1,121 @@
+#include "cachemode.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CLOCK_MONOTONIC_COARSE
+#define CACHE_CLOCK CLOCK_MONOTONIC_COARSE  // a few ms of resolution is plenty for TTLs, and cheaper to read
+#else
+#define CACHE_CLOCK CLOCK_MONOTONIC
+#endif
+
+void cache_default_config(CacheConfig* config) {
+    config->max_keys = 0;
+    config->max_bytes = 0;
+    config->default_ttl_ms = 0;
+    config->sweep_interval_ms = CACHE_SWEEP_INTERVAL_MS;
+    config->sweep_buckets = CACHE_SWEEP_BUCKETS;
+}
+
+CacheMode* cache_mode_create(const CacheConfig* config, int num_buckets, size_t entry_bytes) {
+    assert(config != NULL);
+    assert(num_buckets > 0);
+
+    CacheMode* cache = (CacheMode*)aligned_alloc(CACHE_LINE_SIZE, sizeof(CacheMode));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->refs = (uint64_t*)calloc(num_buckets, sizeof(uint64_t));
+    if (cache->refs == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->config = *config;
+    cache->capacity = INT64_MAX;
+    if (config->max_keys > 0) {
+        cache->capacity = config->max_keys;
+    }
+    if (config->max_bytes > 0 && (int64_t)(config->max_bytes / entry_bytes) < cache->capacity) {
+        cache->capacity = config->max_bytes / entry_bytes;
+    }
+    clock_gettime(CACHE_CLOCK, &cache->base);
+
+    cache->entries = 0;
+    cache->hand = 0;
+    cache->cursor = 0;
+    counter_init(&cache->evictions);
+    counter_init(&cache->expirations);
+    cache->sweep = NULL;
+    cache->sweep_arg = NULL;
+    cache->sweeping = false;
+    cache->stop = false;
+
+    return cache;
+}
+
+void cache_mode_free(CacheMode* cache) {
+    assert(cache != NULL);
+
+    cache_stop_sweeper(cache);
+    free(cache->refs);
+    free(cache);
+}
+
+uint32_t cache_now(const CacheMode* cache) {
+    struct timespec now;
+    clock_gettime(CACHE_CLOCK, &now);
+    int64_t ms = (now.tv_sec - cache->base.tv_sec) * 1000 + (now.tv_nsec - cache->base.tv_nsec) / 1000000;
+    return (uint32_t)ms + 1;
+}
+
+uint32_t cache_expiry(const CacheMode* cache, uint32_t ttl_ms) {
+    if (ttl_ms == 0) {
+        return 0;
+    }
+    uint32_t expires = cache_now(cache) + ttl_ms;
+    return expires != 0 ? expires : 1;  // 0 stands for no expiry
+}
+
+static void* sweeper_func(void* arg) {
+    CacheMode* cache = (CacheMode*)arg;
+
+    struct timespec interval;
+    interval.tv_sec = cache->config.sweep_interval_ms / 1000;
+    interval.tv_nsec = (long)(cache->config.sweep_interval_ms % 1000) * 1000000;
+    while (!__atomic_load_n(&cache->stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+        cache->sweep(cache->sweep_arg, cache->config.sweep_buckets);
+    }
+
+    return NULL;
+}
+
+int cache_start_sweeper(CacheMode* cache, void (*sweep)(void*, int), void* arg) {
+    assert(cache != NULL);
+    assert(!cache->sweeping);
+
+    if (cache->config.sweep_interval_ms <= 0 || cache->config.sweep_buckets <= 0) {
+        return 0;
+    }
+
+    cache->sweep = sweep;
+    cache->sweep_arg = arg;
+    cache->stop = false;
+    if (pthread_create(&cache->sweeper, NULL, sweeper_func, cache) != 0) {
+        return -1;
+    }
+    cache->sweeping = true;
+    return 0;
+}
+
+void cache_stop_sweeper(CacheMode* cache) {
+    if (!cache->sweeping) {
+        return;
+    }
+
+    __atomic_store_n(&cache->stop, true, __ATOMIC_RELEASE);
+    pthread_join(cache->sweeper, NULL);
+    cache->sweeping = false;
+}
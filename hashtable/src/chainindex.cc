@@ -0,0 +1,226 @@
+#include "chainindex.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtable.h"
+
+#define CHAIN_INDEX_INITIAL_CAPACITY (16)
+
+ChainIndex* chain_index_create(void) {
+    ChainIndex* index = (ChainIndex*)malloc(sizeof(ChainIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+
+    index->entries = (IndexEntry*)malloc(sizeof(IndexEntry) * CHAIN_INDEX_INITIAL_CAPACITY);
+    if (index->entries == NULL) {
+        free(index);
+        return NULL;
+    }
+    index->version = 0;
+    index->count = 0;
+    index->capacity = CHAIN_INDEX_INITIAL_CAPACITY;
+    pthread_mutex_init(&index->lock, NULL);
+    index->num_retired = 0;
+
+    return index;
+}
+
+void chain_index_free(ChainIndex* index) {
+    assert(index != NULL);
+
+    for (int i = 0; i < index->num_retired; ++i) {
+        free(index->retired[i]);
+    }
+    free(index->entries);
+    pthread_mutex_destroy(&index->lock);
+    free(index);
+}
+
+// Cuckoo hashing has no chains
+#ifndef CUCKOO_LOCKING
+
+static inline int last_key(const Node* node) {
+#ifdef UNROLLED_CHAINS
+    return node->keys[node->count - 1];
+#else
+    return node->key;
+#endif
+}
+
+Node* chain_index_start(ChainIndex* index, Node* sentinel, int key) {
+    for (int attempt = 0; attempt < CHAIN_INDEX_MAX_RETRIES; ++attempt) {
+        uint64_t version = __atomic_load_n(&index->version, __ATOMIC_ACQUIRE);
+        if (version & 1) {
+            continue;
+        }
+
+        // The count is published after a larger array, so the array read after it holds at least count entries
+        int count = __atomic_load_n(&index->count, __ATOMIC_ACQUIRE);
+        if (count == 0) {
+            return sentinel;
+        }
+        IndexEntry* entries = __atomic_load_n(&index->entries, __ATOMIC_ACQUIRE);
+
+        // The last entry with a key less than the key, the sentinel's -1 is less than every key
+        int low = 0;
+        int high = count - 1;
+        while (low < high) {
+            int mid = (low + high + 1) / 2;
+            if (__atomic_load_n(&entries[mid].key, __ATOMIC_RELAXED) < key) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+        Node* node = __atomic_load_n(&entries[low].node, __ATOMIC_RELAXED);
+
+        // Everything read above happened before the version is read again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&index->version, __ATOMIC_RELAXED) == version) {
+            return node;
+        }
+    }
+
+    return sentinel;
+}
+
+void chain_index_write_begin(ChainIndex* index) {
+    __atomic_store_n(&index->version, index->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void chain_index_write_end(ChainIndex* index) {
+    __atomic_store_n(&index->version, index->version + 1, __ATOMIC_RELEASE);
+}
+
+int chain_index_find(const ChainIndex* index, int key) {
+    int low = 0;
+    int high = index->count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (index->entries[mid].key < key) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// Make room for one more entry after the used ones. Returns -1 on allocation failure.
+static int reserve(ChainIndex* index, int used) {
+    if (used < index->capacity) {
+        return 0;
+    }
+    if (index->num_retired == CHAIN_INDEX_MAX_RETIRED) {
+        return -1;
+    }
+
+    IndexEntry* entries = (IndexEntry*)malloc(sizeof(IndexEntry) * index->capacity * 2);
+    if (entries == NULL) {
+        return -1;
+    }
+    memcpy(entries, index->entries, sizeof(IndexEntry) * used);
+
+    // Readers may still search the old array
+    index->retired[index->num_retired++] = index->entries;
+    __atomic_store_n(&index->entries, entries, __ATOMIC_RELEASE);
+    index->capacity *= 2;
+    return 0;
+}
+
+static void insert_entry(ChainIndex* index, int position, int key, int gap, Node* node) {
+    memmove(&index->entries[position + 1], &index->entries[position], sizeof(IndexEntry) * (index->count - position));
+    index->entries[position] = {key, gap, node};
+    __atomic_store_n(&index->count, index->count + 1, __ATOMIC_RELEASE);
+}
+
+static void remove_entry(ChainIndex* index, int position) {
+    memmove(&index->entries[position], &index->entries[position + 1],
+            sizeof(IndexEntry) * (index->count - position - 1));
+    __atomic_store_n(&index->count, index->count - 1, __ATOMIC_RELEASE);
+}
+
+// The entry whose gap holds the node after prev
+static inline int gap_of(const ChainIndex* index, int entry, const Node* prev) {
+    return entry + 1 < index->count && index->entries[entry + 1].node == prev ? entry + 1 : entry;
+}
+
+int chain_index_build(ChainIndex* index, Node* sentinel) {
+    assert(index->count == 0);
+
+    int count = 1;
+    index->entries[0] = {-1, 0, sentinel};
+    for (Node* node = sentinel->next; node != NULL; node = node->next) {
+        IndexEntry* last = &index->entries[count - 1];
+        if (last->gap < CHAIN_INDEX_GAP) {
+            last->gap++;
+            continue;
+        }
+
+        // Entries past the count are invisible to readers, so the array is filled before the count is published
+        if (reserve(index, count) != 0) {
+            return -1;
+        }
+        index->entries[count++] = {last_key(node), 0, node};
+    }
+
+    __atomic_store_n(&index->count, count, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void chain_index_clear(ChainIndex* index) { __atomic_store_n(&index->count, 0, __ATOMIC_RELEASE); }
+
+void chain_index_linked(ChainIndex* index, int entry, Node* prev) {
+    int gap = gap_of(index, entry, prev);
+    IndexEntry* split = &index->entries[gap];
+    if (++split->gap <= 2 * CHAIN_INDEX_GAP || reserve(index, index->count) != 0) {
+        return;
+    }
+
+    // Split the gap, the new entry takes the node after the first CHAIN_INDEX_GAP nodes
+    split = &index->entries[gap];
+    Node* node = split->node;
+    for (int i = 0; i <= CHAIN_INDEX_GAP; ++i) {
+        node = node->next;
+    }
+    insert_entry(index, gap + 1, last_key(node), split->gap - CHAIN_INDEX_GAP - 1, node);
+    index->entries[gap].gap = CHAIN_INDEX_GAP;
+}
+
+void chain_index_unlinking(ChainIndex* index, int entry, Node* node, Node* prev) {
+    int gap = gap_of(index, entry, prev);
+    IndexEntry* entries = index->entries;
+    if (gap + 1 < index->count && entries[gap + 1].node == node) {
+        if (prev == entries[gap].node) {
+            // The next gap joins this empty one
+            entries[gap].gap += entries[gap + 1].gap;
+            remove_entry(index, gap + 1);
+        } else {
+            // The last node of the gap takes the entry
+            entries[gap + 1].key = last_key(prev);
+            entries[gap + 1].node = prev;
+            entries[gap].gap--;
+        }
+    } else {
+        entries[gap].gap--;
+    }
+
+    if (gap + 1 < index->count && entries[gap].gap + entries[gap + 1].gap + 1 <= CHAIN_INDEX_GAP) {
+        entries[gap].gap += entries[gap + 1].gap + 1;
+        remove_entry(index, gap + 1);
+    }
+}
+
+void chain_index_changed(ChainIndex* index, int entry, Node* node) {
+    for (int i = entry; i <= entry + 1 && i < index->count; ++i) {
+        if (i > 0 && index->entries[i].node == node) {
+            index->entries[i].key = last_key(node);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include "counter.h"
+
+static int next_stripe = 0;
+static thread_local int thread_stripe = -1;
+
+void counter_init(StripedCounter* counter) {
+    for (int i = 0; i < COUNTER_STRIPES; ++i) {
+        counter->stripes[i].value = 0;
+    }
+}
+
+void counter_add(StripedCounter* counter, uint64_t delta) {
+    __atomic_fetch_add(&counter->stripes[counter_stripe()].value, delta, __ATOMIC_RELAXED);
+}
+
+uint64_t counter_read(StripedCounter* counter) {
+    uint64_t sum = 0;
+    for (int i = 0; i < COUNTER_STRIPES; ++i) {
+        sum += __atomic_load_n(&counter->stripes[i].value, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+int counter_stripe(void) {
+    if (thread_stripe == -1) {
+        thread_stripe = __sync_fetch_and_add(&next_stripe, 1) % COUNTER_STRIPES;
+    }
+    return thread_stripe;
+}
@@ -0,0 +1,427 @@
+#include "cuckoo.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "probe.h"
+
+#define CUCKOO_REHASH_KICKS (512)  // evictions before a rehash into a new array gives up
+
+// A bucket reached by the path search. The key in slot of the parent's bucket moves into this bucket.
+typedef struct PathNode {
+    uint64_t bucket;
+    int parent;  // -1 for the new key's own buckets
+    int slot;
+    int key;
+} PathNode;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Independent of hash_func(), so keys that share a chain do not share buckets
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline void candidates(const CuckooArray* array, int key, uint64_t* first, uint64_t* second) {
+    uint64_t hash = mix((uint64_t)(uint32_t)key);
+    *first = hash & array->mask;
+    *second = (hash >> 32) & array->mask;
+    if (*second == *first) {
+        *second = (*first + 1) & array->mask;
+    }
+}
+
+// The other candidate bucket of a key in the given bucket
+static inline uint64_t alternate(const CuckooArray* array, int key, uint64_t bucket) {
+    uint64_t first, second;
+    candidates(array, key, &first, &second);
+    return bucket == first ? second : first;
+}
+
+static inline uint64_t* stripe_of(CuckooTable* table, uint64_t bucket) {
+    return &table->stripes[bucket & (CUCKOO_STRIPES - 1)];
+}
+
+static void lock_stripe(uint64_t* stripe) {
+    for (;;) {
+        uint64_t version = __atomic_load_n(stripe, __ATOMIC_RELAXED);
+        if ((version & 1) == 0 &&
+            __atomic_compare_exchange_n(stripe, &version, version + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        cpu_relax();
+    }
+}
+
+static void unlock_stripe(uint64_t* stripe) { __atomic_fetch_add(stripe, 1, __ATOMIC_RELEASE); }
+
+// Lock the stripes of two buckets in address order, once if they share a stripe
+static void lock_pair(CuckooTable* table, uint64_t first, uint64_t second) {
+    uint64_t* low = stripe_of(table, first);
+    uint64_t* high = stripe_of(table, second);
+    if (low > high) {
+        uint64_t* swap = low;
+        low = high;
+        high = swap;
+    }
+    PROBE_LOCK(table->lockprof, (int)(low - table->stripes), LockWrite, lock_stripe(low));
+    if (high != low) {
+        PROBE_LOCK(table->lockprof, (int)(high - table->stripes), LockWrite, lock_stripe(high));
+    }
+}
+
+static void unlock_pair(CuckooTable* table, uint64_t first, uint64_t second) {
+    uint64_t* low = stripe_of(table, first);
+    uint64_t* high = stripe_of(table, second);
+    unlock_stripe(low);
+    if (high != low) {
+        unlock_stripe(high);
+    }
+}
+
+// Lock both buckets of the key in the current array
+static CuckooArray* lock_candidates(CuckooTable* table, int key, uint64_t* first, uint64_t* second) {
+    for (;;) {
+        CuckooArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+        candidates(array, key, first, second);
+        lock_pair(table, *first, *second);
+
+        // A resize holds every stripe, so the array cannot change anymore
+        if (__atomic_load_n(&table->array, __ATOMIC_RELAXED) == array) {
+            return array;
+        }
+        unlock_pair(table, *first, *second);
+    }
+}
+
+static int* bucket_find(CuckooBucket* bucket, int key) {
+    for (int i = 0; i < CUCKOO_SLOTS; ++i) {
+        if (__atomic_load_n(&bucket->keys[i], __ATOMIC_RELAXED) == key) {
+            return &bucket->keys[i];
+        }
+    }
+    return NULL;
+}
+
+static CuckooArray* array_create(uint64_t num_buckets) {
+    CuckooArray* array = (CuckooArray*)malloc(sizeof(CuckooArray));
+    if (array == NULL) {
+        return NULL;
+    }
+
+    size_t bytes = sizeof(CuckooBucket) * num_buckets;
+    bytes = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    array->buckets = (CuckooBucket*)aligned_alloc(CACHE_LINE_SIZE, bytes);
+    if (array->buckets == NULL) {
+        free(array);
+        return NULL;
+    }
+    memset(array->buckets, 0xFF, bytes);  // every slot CUCKOO_EMPTY
+    array->mask = num_buckets - 1;
+    array->retired = NULL;
+
+    return array;
+}
+
+static void array_destroy(CuckooArray* array) {
+    free(array->buckets);
+    free(array);
+}
+
+CuckooTable* cuckoo_create(int num_buckets) {
+    assert(num_buckets > 0);
+    static_assert((CUCKOO_STRIPES & (CUCKOO_STRIPES - 1)) == 0, "CUCKOO_STRIPES must be a power of two");
+
+    CuckooTable* table = (CuckooTable*)aligned_alloc(CACHE_LINE_SIZE, sizeof(CuckooTable));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    uint64_t buckets = 1;
+    while (buckets < (uint64_t)num_buckets) {
+        buckets *= 2;
+    }
+    table->array = array_create(buckets);
+    table->stripes = (uint64_t*)calloc(CUCKOO_STRIPES, sizeof(uint64_t));
+    if (table->array == NULL || table->stripes == NULL) {
+        return NULL;
+    }
+
+    table->resizes = 0;
+    counter_init(&table->displacements);
+    counter_init(&table->read_retries);
+    counter_init(&table->path_aborts);
+    table->lockprof = NULL;
+
+    return table;
+}
+
+void cuckoo_destroy(CuckooTable* table) {
+    assert(table != NULL);
+
+    CuckooArray* array = table->array;
+    while (array != NULL) {
+        CuckooArray* retired = array->retired;
+        array_destroy(array);
+        array = retired;
+    }
+    free(table->stripes);
+    free(table);
+}
+
+const int* cuckoo_lookup(CuckooTable* table, int key) {
+    for (;;) {
+        CuckooArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+        uint64_t first, second;
+        candidates(array, key, &first, &second);
+
+        uint64_t* first_stripe = stripe_of(table, first);
+        uint64_t* second_stripe = stripe_of(table, second);
+        uint64_t first_version = __atomic_load_n(first_stripe, __ATOMIC_ACQUIRE);
+        uint64_t second_version = __atomic_load_n(second_stripe, __ATOMIC_ACQUIRE);
+
+        // Not being written, and the array was not replaced before the versions were read
+        if (((first_version | second_version) & 1) == 0 && __atomic_load_n(&table->array, __ATOMIC_RELAXED) == array) {
+            const int* slot = bucket_find(&array->buckets[first], key);
+            if (slot == NULL) {
+                slot = bucket_find(&array->buckets[second], key);
+            }
+
+            // Everything read above happened before the versions are read again
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(first_stripe, __ATOMIC_RELAXED) == first_version &&
+                __atomic_load_n(second_stripe, __ATOMIC_RELAXED) == second_version) {
+                return slot;
+            }
+        }
+
+        counter_add(&table->read_retries, 1);
+        cpu_relax();
+    }
+}
+
+// Breadth-first search for the bucket with a free slot closest to the key's buckets, reading without locks.
+// Returns the index of that bucket's node and stores its free slot, or -1 if none was found within the limit.
+static int find_path(CuckooArray* array, uint64_t first, uint64_t second, PathNode* nodes, int* free_slot) {
+    int num_nodes = 0;
+    nodes[num_nodes++] = {first, -1, -1, CUCKOO_EMPTY};
+    if (second != first) {
+        nodes[num_nodes++] = {second, -1, -1, CUCKOO_EMPTY};
+    }
+
+    for (int head = 0; head < num_nodes; ++head) {
+        CuckooBucket* bucket = &array->buckets[nodes[head].bucket];
+        int keys[CUCKOO_SLOTS];
+        for (int i = 0; i < CUCKOO_SLOTS; ++i) {
+            keys[i] = __atomic_load_n(&bucket->keys[i], __ATOMIC_RELAXED);
+            if (keys[i] == CUCKOO_EMPTY) {
+                *free_slot = i;
+                return head;
+            }
+        }
+
+        for (int i = 0; i < CUCKOO_SLOTS && num_nodes < CUCKOO_BFS_MAX_BUCKETS; ++i) {
+            nodes[num_nodes++] = {alternate(array, keys[i], nodes[head].bucket), head, i, keys[i]};
+        }
+    }
+
+    return -1;
+}
+
+// Move the keys along the path from its end backwards, so that every move fills the slot freed by the previous one.
+// Returns false if a move no longer matches the table.
+static bool execute_path(CuckooTable* table, CuckooArray* array, const PathNode* nodes, int end, int free_slot) {
+    for (int target = end; nodes[target].parent >= 0; target = nodes[target].parent) {
+        const PathNode* node = &nodes[target];
+        uint64_t from = nodes[node->parent].bucket;
+        uint64_t to = node->bucket;
+
+        // Both buckets of the moved key, so a concurrent insert or delete of it waits
+        lock_pair(table, from, to);
+        int* source = &array->buckets[from].keys[node->slot];
+        int* destination = &array->buckets[to].keys[free_slot];
+        bool valid = __atomic_load_n(&table->array, __ATOMIC_RELAXED) == array && *source == node->key &&
+                     *destination == CUCKOO_EMPTY;
+        if (valid) {
+            __atomic_store_n(destination, node->key, __ATOMIC_RELAXED);
+            __atomic_store_n(source, CUCKOO_EMPTY, __ATOMIC_RELAXED);
+        }
+        unlock_pair(table, from, to);
+
+        if (!valid) {
+            return false;
+        }
+        counter_add(&table->displacements, 1);
+        free_slot = node->slot;
+    }
+    return true;
+}
+
+// Put a key into a private array by random-walk displacement. On failure, a displaced key may be lost.
+static bool place(CuckooArray* array, int key) {
+    uint64_t first, second;
+    candidates(array, key, &first, &second);
+    uint64_t bucket = first;
+
+    for (int kick = 0; kick < CUCKOO_REHASH_KICKS; ++kick) {
+        candidates(array, key, &first, &second);
+        int* slot = bucket_find(&array->buckets[first], CUCKOO_EMPTY);
+        if (slot == NULL) {
+            slot = bucket_find(&array->buckets[second], CUCKOO_EMPTY);
+        }
+        if (slot != NULL) {
+            *slot = key;
+            return true;
+        }
+
+        // Evict a victim from the bucket the key is headed to, which then moves to its other bucket
+        int* victim = &array->buckets[bucket].keys[(uint32_t)(key ^ kick) % CUCKOO_SLOTS];
+        int evicted = *victim;
+        *victim = key;
+        key = evicted;
+        bucket = alternate(array, key, bucket);
+    }
+
+    return false;
+}
+
+// Double the buckets until every key fits, holding every stripe. Returns false if memory ran out.
+static bool grow(CuckooTable* table, CuckooArray* seen) {
+    for (int i = 0; i < CUCKOO_STRIPES; ++i) {
+        lock_stripe(&table->stripes[i]);
+    }
+
+    bool grown = true;
+    CuckooArray* old = table->array;
+    if (old == seen) {  // else another insert grew it meanwhile
+        CuckooArray* fresh = NULL;
+        for (uint64_t buckets = (old->mask + 1) * 2; fresh == NULL; buckets *= 2) {
+            fresh = array_create(buckets);
+            if (fresh == NULL) {
+                grown = false;
+                break;
+            }
+
+            for (uint64_t b = 0; b <= old->mask && fresh != NULL; ++b) {
+                for (int i = 0; i < CUCKOO_SLOTS; ++i) {
+                    int key = old->buckets[b].keys[i];
+                    if (key != CUCKOO_EMPTY && !place(fresh, key)) {
+                        array_destroy(fresh);
+                        fresh = NULL;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (grown) {
+            fresh->retired = old;
+            __atomic_store_n(&table->array, fresh, __ATOMIC_RELEASE);
+            table->resizes++;
+        }
+    }
+
+    for (int i = 0; i < CUCKOO_STRIPES; ++i) {
+        unlock_stripe(&table->stripes[i]);
+    }
+    return grown;
+}
+
+const int* cuckoo_insert(CuckooTable* table, int key) {
+    assert(key != CUCKOO_EMPTY);
+
+    PathNode nodes[CUCKOO_BFS_MAX_BUCKETS];
+    for (;;) {
+        uint64_t first, second;
+        CuckooArray* array = lock_candidates(table, key, &first, &second);
+        CuckooBucket* first_bucket = &array->buckets[first];
+        CuckooBucket* second_bucket = &array->buckets[second];
+
+        if (bucket_find(first_bucket, key) != NULL || bucket_find(second_bucket, key) != NULL) {
+            // Found a duplicate key, just announce failure
+            unlock_pair(table, first, second);
+            return NULL;
+        }
+
+        int* slot = bucket_find(first_bucket, CUCKOO_EMPTY);
+        if (slot == NULL) {
+            slot = bucket_find(second_bucket, CUCKOO_EMPTY);
+        }
+        if (slot != NULL) {
+            __atomic_store_n(slot, key, __ATOMIC_RELAXED);
+            unlock_pair(table, first, second);
+            return slot;
+        }
+        unlock_pair(table, first, second);
+
+        // Both buckets are full, make room and start over
+        int free_slot;
+        int end = find_path(array, first, second, nodes, &free_slot);
+        if (end >= 0) {
+            if (!execute_path(table, array, nodes, end, free_slot)) {
+                counter_add(&table->path_aborts, 1);
+            }
+        } else if (!grow(table, array)) {
+            return NULL;
+        }
+    }
+}
+
+int cuckoo_delete(CuckooTable* table, int key) {
+    uint64_t first, second;
+    CuckooArray* array = lock_candidates(table, key, &first, &second);
+
+    int* slot = bucket_find(&array->buckets[first], key);
+    if (slot == NULL) {
+        slot = bucket_find(&array->buckets[second], key);
+    }
+    if (slot != NULL) {
+        __atomic_store_n(slot, CUCKOO_EMPTY, __ATOMIC_RELAXED);
+    }
+
+    unlock_pair(table, first, second);
+    return slot != NULL ? 0 : -1;
+}
+
+int cuckoo_size(CuckooTable* table) {
+    CuckooArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+
+    int count = 0;
+    for (uint64_t b = 0; b <= array->mask; ++b) {
+        for (int i = 0; i < CUCKOO_SLOTS; ++i) {
+            count += __atomic_load_n(&array->buckets[b].keys[i], __ATOMIC_RELAXED) != CUCKOO_EMPTY;
+        }
+    }
+    return count;
+}
+
+int cuckoo_keys(CuckooTable* table, int* keys, int max) {
+    CuckooArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+
+    int count = 0;
+    for (uint64_t b = 0; b <= array->mask && count < max; ++b) {
+        for (int i = 0; i < CUCKOO_SLOTS && count < max; ++i) {
+            int key = __atomic_load_n(&array->buckets[b].keys[i], __ATOMIC_RELAXED);
+            if (key != CUCKOO_EMPTY) {
+                keys[count++] = key;
+            }
+        }
+    }
+    return count;
+}
+
+int64_t cuckoo_capacity(CuckooTable* table) {
+    CuckooArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+    return (int64_t)(array->mask + 1) * CUCKOO_SLOTS;
+}
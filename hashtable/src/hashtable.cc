@@ -1,15 +1,118 @@
 #include "hashtable.h"
 
 #include <assert.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "probe.h"
+#include "timer.h"
+
+#ifdef OPTIMISTIC_LOCKING
+// Failed validations before an operation falls back to lock coupling from the sentinel
+#ifndef OPTIMISTIC_MAX_RETRIES
+#define OPTIMISTIC_MAX_RETRIES (8)
+#endif
+#if OPTIMISTIC_MAX_RETRIES < 1
+#error "OPTIMISTIC_MAX_RETRIES must be at least 1"
+#endif
+
+#define BACKOFF_MIN_SPINS (16)
+#define BACKOFF_MAX_SPINS (4096)
+#endif
+
+#ifdef SEQLOCK_READERS
+// Lock-free lookup attempts before a lookup takes the read lock, 0 to always lock
+#ifndef SEQLOCK_MAX_RETRIES
+#define SEQLOCK_MAX_RETRIES (4)
+#endif
+
+#define SEQ_BEGIN (1ULL << 32)
+#define SEQ_END (1ULL)
+#define SEQ_CHECK_STEPS (64)  // a walk through recycled nodes may be long, re-check this often
+#endif
+
+// Chain length changes of the calling thread, see hashtable_set_chain_sink()
+static thread_local ChainStats* chain_sink = NULL;
+
+#ifdef HASHTABLE_PROBES
+// Bucket of the calling thread's current operation, its node locks are traced and profiled under it
+static thread_local int probe_bucket = -1;
+static thread_local LockProfile* probe_profile = NULL;
+#endif
+
+static inline void probe_enter(HashTable* table, int index) {
+#ifdef HASHTABLE_PROBES
+    probe_bucket = index;
+    probe_profile = table->lockprof;
+#else
+    (void)table;
+    (void)index;
+#endif
+}
+
+#ifdef BUCKET_LOCKING
+// Bucket lock helpers. The read lock returns a token for the read unlock, i.e., the BRAVO reader slot.
+static inline int bucket_read_lock(HashTable* table, int index) {
+#ifdef BRAVO_LOCKING
+    int token;
+    PROBE_LOCK(table->lockprof, index, LockRead, token = bravo_read_lock(&table->bucket_locks[index]));
+    return token;
+#else
+    PROBE_LOCK(table->lockprof, index, LockRead, pthread_rwlock_rdlock(&table->bucket_locks[index]));
+    return -1;
+#endif
+}
+
+static inline void bucket_read_unlock(HashTable* table, int index, int token) {
+#ifdef BRAVO_LOCKING
+    bravo_read_unlock(&table->bucket_locks[index], token);
+#else
+    (void)token;
+    pthread_rwlock_unlock(&table->bucket_locks[index]);
+#endif
+}
+
+static inline void bucket_write_lock(HashTable* table, int index) {
+#ifdef BRAVO_LOCKING
+    PROBE_LOCK(table->lockprof, index, LockWrite, bravo_write_lock(&table->bucket_locks[index]));
+#else
+    PROBE_LOCK(table->lockprof, index, LockWrite, pthread_rwlock_wrlock(&table->bucket_locks[index]));
+#endif
+}
+
+static inline void bucket_write_unlock(HashTable* table, int index) {
+#ifdef BRAVO_LOCKING
+    bravo_write_unlock(&table->bucket_locks[index]);
+#else
+    pthread_rwlock_unlock(&table->bucket_locks[index]);
+#endif
+}
+#endif
+
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+// Node lock helpers, traced and profiled under the current bucket of the thread, see probe_enter()
+static inline void node_read_lock(Node* node) {
+    PROBE_LOCK(probe_profile, probe_bucket, LockRead, pthread_rwlock_rdlock(node->lock));
+}
+
+static inline void node_write_lock(Node* node) {
+    PROBE_LOCK(probe_profile, probe_bucket, LockWrite, pthread_rwlock_wrlock(node->lock));
+}
+#endif
+
+#ifndef CUCKOO_LOCKING
 Node* init_node() {
     Node* node = (Node*)malloc(sizeof(Node));
     assert(node != NULL);
 
+#ifdef UNROLLED_CHAINS
+    node->count = 0;
+#else
     node->key = -1;
+    node->expires = 0;
+#endif
     node->next = NULL;
 
 #if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
@@ -22,183 +125,1136 @@ Node* init_node() {
     return node;
 }
 
+#ifdef SEQLOCK_READERS
+#ifdef CHAIN_LOCKING
+// Pooled nodes keep their lock while recycled
+static void init_pooled_node(void* object) {
+    Node* node = (Node*)object;
+    node->lock = (pthread_rwlock_t*)malloc(sizeof(pthread_rwlock_t));
+    assert(node->lock != NULL);
+
+    pthread_rwlock_init(node->lock, NULL);
+}
+
+static void fini_pooled_node(void* object) {
+    Node* node = (Node*)object;
+    pthread_rwlock_destroy(node->lock);
+    free(node->lock);
+}
+#else
+#define init_pooled_node NULL
+#define fini_pooled_node NULL
+#endif
+#endif
+
+static Node* alloc_node(HashTable* table) {
+    PROBE1(node_alloc_begin, probe_bucket);
+#ifdef SEQLOCK_READERS
+    Node* node = (Node*)pool_alloc(table->node_pool);
+    assert(node != NULL);
+    PROBE2(node_alloc_end, probe_bucket, (intptr_t)node);
+
+#ifdef UNROLLED_CHAINS
+    node->count = 0;
+#else
+    node->key = -1;
+    node->expires = 0;
+#endif
+    node->next = NULL;
+    return node;
+#else
+    (void)table;
+    Node* node = init_node();
+    PROBE2(node_alloc_end, probe_bucket, (intptr_t)node);
+    return node;
+#endif
+}
+
+// Where the key is relative to a node of a sorted chain: -1 if it comes after the node, 1 if the node holds it, else 0
+// (not in the chain). Only reads with relaxed loads, so lock-free lookups may call it.
+static inline int chain_step(const Node* node, int key) {
+#ifdef UNROLLED_CHAINS
+    int count = __atomic_load_n(&node->count, __ATOMIC_RELAXED);
+    if (count == 0 || __atomic_load_n(&node->keys[count - 1], __ATOMIC_RELAXED) < key) {
+        return -1;
+    }
+    int rank = block_rank(node->keys, count, key);
+    return rank < count && __atomic_load_n(&node->keys[rank], __ATOMIC_RELAXED) == key;
+#else
+    int node_key = __atomic_load_n(&node->key, __ATOMIC_RELAXED);
+    return node_key < key ? -1 : node_key == key;
+#endif
+}
+
+// The bucket's index if its chain is indexed, else NULL
+static inline ChainIndex* indexed_chain(HashTable* table, int index) {
+    if (table->indexes == NULL) {
+        return NULL;
+    }
+    ChainIndex* chain_index = __atomic_load_n(&table->indexes[index], __ATOMIC_ACQUIRE);
+    return chain_index != NULL && __atomic_load_n(&chain_index->count, __ATOMIC_ACQUIRE) > 0 ? chain_index : NULL;
+}
+
+// The node a lookup of the key starts after, found without locks
+static inline Node* lookup_origin(HashTable* table, int index, int key) {
+    Node* bucket = table->buckets[index];
+    if (table->indexes == NULL) {
+        return bucket;
+    }
+    ChainIndex* chain_index = __atomic_load_n(&table->indexes[index], __ATOMIC_ACQUIRE);
+    return chain_index != NULL ? chain_index_start(chain_index, bucket, key) : bucket;
+}
+#endif
+
+#ifdef SEQLOCK_READERS
+// Modifications of a bucket are bracketed by these. Chain locking allows concurrent writers in a bucket, so begun and
+// finished modifications are counted separately instead of keeping a single counter odd while writing.
+static inline void seq_write_begin(HashTable* table, int index) {
+    __atomic_fetch_add(&table->bucket_seqs[index], SEQ_BEGIN, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seq_write_end(HashTable* table, int index) {
+    __atomic_fetch_add(&table->bucket_seqs[index], SEQ_END, __ATOMIC_RELEASE);
+}
+
+static inline bool seq_is_writing(uint64_t seq) { return (uint32_t)(seq >> 32) != (uint32_t)seq; }
+
+// Look up without locks or stores. Returns false if a modification of the bucket interfered, else stores the node
+// (or NULL if not found) into result.
+static bool seq_lookup(HashTable* table, int index, int key, Node** result) {
+    uint64_t* seq = &table->bucket_seqs[index];
+    uint64_t before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    if (seq_is_writing(before)) {
+        return false;
+    }
+
+    int steps = 0;
+    Node* found = NULL;
+    Node* curr = __atomic_load_n(&lookup_origin(table, index, key)->next, __ATOMIC_RELAXED);
+    while (curr != NULL) {
+        int step = chain_step(curr, key);
+        if (step >= 0) {
+            found = step > 0 ? curr : NULL;
+            break;
+        }
+        curr = __atomic_load_n(&curr->next, __ATOMIC_RELAXED);
+
+        if (++steps % SEQ_CHECK_STEPS == 0 && __atomic_load_n(seq, __ATOMIC_RELAXED) != before) {
+            return false;
+        }
+    }
+
+    // Everything read above happened before the sequence is read again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(seq, __ATOMIC_RELAXED) != before) {
+        return false;
+    }
+
+    *result = found;
+    return true;
+}
+#endif
+
+#ifdef NODE_EXPIRY
+// Whether the key of the node expired, in cache mode. A lock-free reader may read the expiry of a node that was freed
+// meanwhile, so it has to check again under the lock before it acts on an expiry.
+static inline bool node_expired(HashTable* table, const Node* node) {
+    uint32_t expires = __atomic_load_n(&node->expires, __ATOMIC_RELAXED);
+    return expires != 0 && cache_expired(expires, cache_now(table->cache));
+}
+
+// A duplicate whose key expired takes the new expiry, as if the key was inserted again. Returns the node if so, else
+// NULL. Called under the write lock of the node.
+static Node* revive_expired(HashTable* table, Node* node, uint32_t expires) {
+    if (table->cache == NULL || !node_expired(table, node)) {
+        return NULL;
+    }
+
+    __atomic_store_n(&node->expires, expires, __ATOMIC_RELAXED);
+    counter_add(&table->cache->expirations, 1);
+    return node;
+}
+#endif
+
+// Optimistic locking never frees its nodes, see chain_delete()
+#if !defined(CUCKOO_LOCKING) && !defined(OPTIMISTIC_LOCKING)
+static void free_node(HashTable* table, Node* node) {
+#ifdef SEQLOCK_READERS
+    pool_free(table->node_pool, node);
+#else
+    (void)table;
+    free(node);
+#endif
+}
+#endif
+
 HashTable* hashtable_create(int size) {
     assert(size > 0);
 
-    HashTable* table = (HashTable*)malloc(sizeof(HashTable));
+    // Aligned for the striped counters
+    HashTable* table = (HashTable*)aligned_alloc(CACHE_LINE_SIZE, sizeof(HashTable));
     if (table == NULL) {
         return NULL;
     }
 
+#ifdef CUCKOO_LOCKING
+    table->cuckoo = cuckoo_create(size);
+    if (table->cuckoo == NULL) {
+        return NULL;
+    }
+#else
     table->buckets = (Node**)malloc(sizeof(Node*) * size);
     if (table->buckets == NULL) {
         return NULL;
     }
+#endif
 
 #ifdef BUCKET_LOCKING
-    table->bucket_locks = (pthread_rwlock_t*)malloc(sizeof(pthread_rwlock_t) * size);
+    table->bucket_locks = (decltype(table->bucket_locks))malloc(sizeof(*table->bucket_locks) * size);
     if (table->bucket_locks == NULL) {
         return NULL;
     }
 #endif
 
+#ifdef SEQLOCK_READERS
+    table->bucket_seqs = (uint64_t*)calloc(size, sizeof(uint64_t));
+    table->node_pool = pool_create(sizeof(Node), init_pooled_node);
+    if (table->bucket_seqs == NULL || table->node_pool == NULL) {
+        return NULL;
+    }
+    counter_init(&table->read_failures);
+    counter_init(&table->read_fallbacks);
+#endif
+
     table->size = size;
+    table->hotcache = NULL;
+    table->chain_lengths = NULL;
+    table->filters = NULL;
+    counter_init(&table->filter_skips);
+    counter_init(&table->filter_false_positives);
+    table->indexes = NULL;
+    table->index_lengths = NULL;
+    counter_init(&table->index_builds);
+    counter_init(&table->index_drops);
+    table->gates = NULL;
+    counter_init(&table->gate_retries);
+    counter_init(&table->applies);
+    counter_init(&table->rollbacks);
+    table->cache = NULL;
+    table->lockprof = NULL;
+
+#ifdef OPTIMISTIC_LOCKING
+    counter_init(&table->validation_failures);
+    counter_init(&table->retries);
+    counter_init(&table->fallbacks);
+#endif
 
+#ifndef CUCKOO_LOCKING
     for (int i = 0; i < size; ++i) {
         // For each bucket, we include an empty head (sentinel) node for convenience
         Node* head = init_node();
         table->buckets[i] = head;
 
-#ifdef BUCKET_LOCKING
+#ifdef BRAVO_LOCKING
+        bravo_init(&table->bucket_locks[i]);
+#elif BUCKET_LOCKING
         pthread_rwlock_init(&table->bucket_locks[i], NULL);
 #endif
     }
+#endif
 
     return table;
 }
 
-int hashtable_free(HashTable* table) {
-    assert(table != NULL);
+#ifndef CUCKOO_LOCKING
+// Free a node that does not come from the pool, with its lock
+static void fini_node(Node* node) {
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    pthread_rwlock_destroy(node->lock);
+    free(node->lock);
+#endif
+    free(node);
+}
+#endif
 
-    for (int i = 0; i < table->size; ++i) {
+#ifndef CUCKOO_LOCKING
+typedef struct FreeRange {
+    HashTable* table;
+    int begin;  // first bucket
+    int end;    // bucket past the last
+} FreeRange;
+
+// Free the chains, locks and indexes of a range of buckets
+static void* free_range(void* arg) {
+    FreeRange* range = (FreeRange*)arg;
+    HashTable* table = range->table;
+
+    for (int i = range->begin; i < range->end; ++i) {
+#ifdef SEQLOCK_READERS
+        // Only the sentinel is not pooled
+        fini_node(table->buckets[i]);
+#else
         Node* curr = table->buckets[i];
         Node* next;
         while (curr != NULL) {
             next = curr->next;
-            free(curr);
+            fini_node(curr);
             curr = next;
         }
+#endif
+
+#ifdef BRAVO_LOCKING
+        bravo_destroy(&table->bucket_locks[i]);
+#elif BUCKET_LOCKING
+        pthread_rwlock_destroy(&table->bucket_locks[i]);
+#endif
+
+        if (table->indexes != NULL && table->indexes[i] != NULL) {
+            chain_index_free(table->indexes[i]);
+        }
     }
 
-    return 0;
+    return NULL;
 }
+#endif
 
-int hash_func(int key, int size) {
-    // currently use modulo operation
-    return key % size;
-}
+int hashtable_free(HashTable* table) { return hashtable_free_parallel(table, 1); }
 
-Node* hashtable_insert(HashTable* table, int key) {
+int hashtable_free_parallel(HashTable* table, int num_threads) {
     assert(table != NULL);
-    assert(key >= 0);
+    assert(num_threads > 0);
 
-    int index = hash_func(key, table->size);
-    Node* bucket = table->buckets[index];
+    // The sweeper walks the chains
+    if (table->cache != NULL) {
+        cache_mode_free(table->cache);
+    }
 
-#ifdef BUCKET_LOCKING
-    pthread_rwlock_wrlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-    pthread_rwlock_wrlock(bucket->lock);
+#ifdef CUCKOO_LOCKING
+    cuckoo_destroy(table->cuckoo);
+#else
+    if (num_threads > table->size) {
+        num_threads = table->size;
+    }
+
+    pthread_t threads[num_threads];
+    FreeRange ranges[num_threads];
+    for (int i = 0; i < num_threads; ++i) {
+        ranges[i] = {table, (int)((int64_t)table->size * i / num_threads),
+                     (int)((int64_t)table->size * (i + 1) / num_threads)};
+        if (i > 0) {
+            pthread_create(&threads[i], NULL, free_range, &ranges[i]);
+        }
+    }
+    free_range(&ranges[0]);
+    for (int i = 1; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
 #endif
 
-    Node* curr = bucket->next;
-    Node* prev = bucket;
-    while (curr != NULL) {
-#ifdef CHAIN_LOCKING
-        pthread_rwlock_wrlock(curr->lock);
+#ifdef SEQLOCK_READERS
+    pool_destroy_parallel(table->node_pool, fini_pooled_node, num_threads);
+    free(table->bucket_seqs);
 #endif
-        if (curr->key == key) {
-            // Found a duplicate key, just announce failure
 #ifdef BUCKET_LOCKING
-            pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-            pthread_rwlock_unlock(prev->lock);
-            pthread_rwlock_unlock(curr->lock);
+    free(table->bucket_locks);
 #endif
-            return NULL;
-        } else if (curr->key > key) {
-            // Found a position to insert
-            break;
-        }
-
-#ifdef CHAIN_LOCKING
-        pthread_rwlock_unlock(prev->lock);
+#ifndef CUCKOO_LOCKING
+    free(table->buckets);
 #endif
-        prev = curr;
-        curr = curr->next;
+
+    if (table->hotcache != NULL) {
+        hotcache_free(table->hotcache);
+    }
+    free(table->chain_lengths);
+    free(table->filters);
+    free(table->indexes);
+    free(table->index_lengths);
+    free(table->gates);
+    if (table->lockprof != NULL) {
+        lockprof_destroy(table->lockprof);
     }
+    free(table);
 
-    assert(prev != NULL);
+    return 0;
+}
 
-#ifdef OPTIMISTIC_LOCKING
-    pthread_rwlock_wrlock(prev->lock);
-    if (curr != NULL) {
-        pthread_rwlock_wrlock(curr->lock);
+int hashtable_attach_hotcache(HashTable* table, int capacity) {
+    assert(table != NULL);
+    assert(table->hotcache == NULL);
+
+    table->hotcache = hotcache_create(capacity);
+    return table->hotcache != NULL ? 0 : -1;
+}
+
+int hashtable_attach_filter(HashTable* table) {
+    assert(table != NULL);
+    assert(table->filters == NULL);
+
+    size_t bytes = sizeof(uint64_t) * FILTER_WORDS * table->size;
+    bytes = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    table->filters = (uint64_t*)aligned_alloc(CACHE_LINE_SIZE, bytes);
+    if (table->filters == NULL) {
+        return -1;
     }
+    memset(table->filters, 0, bytes);
+    return 0;
+}
 
-    if (!validate(bucket, prev, curr)) {
-        pthread_rwlock_unlock(prev->lock);
-        if (curr != NULL) {
-            pthread_rwlock_unlock(curr->lock);
+int hashtable_attach_index(HashTable* table) {
+    assert(table != NULL);
+    assert(table->indexes == NULL);
+
+#ifdef CUCKOO_LOCKING
+    return -1;
+#else
+    table->indexes = (ChainIndex**)calloc(table->size, sizeof(ChainIndex*));
+    table->index_lengths = (int*)calloc(table->size, sizeof(int));
+    if (table->indexes == NULL || table->index_lengths == NULL) {
+        free(table->indexes);
+        free(table->index_lengths);
+        table->indexes = NULL;
+        table->index_lengths = NULL;
+        return -1;
+    }
+
+    // Chains that are long already get indexed by their next insert
+    for (int i = 0; i < table->size; ++i) {
+        for (Node* node = table->buckets[i]->next; node != NULL; node = node->next) {
+            table->index_lengths[i]++;
         }
-        return NULL;
     }
+    return 0;
 #endif
+}
 
-    Node* new_node = init_node();
-    new_node->key = key;
-    new_node->next = curr;
-    prev->next = new_node;
+int hashtable_track_chains(HashTable* table) {
+    assert(table != NULL);
+    assert(table->chain_lengths == NULL);
 
-#ifdef BUCKET_LOCKING
-    pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
-    pthread_rwlock_unlock(prev->lock);
-    if (curr != NULL) {
-        pthread_rwlock_unlock(curr->lock);
-    }
+#ifdef CUCKOO_LOCKING
+    return -1;
+#else
+    table->chain_lengths = (int*)calloc(table->size, sizeof(int));
+    return table->chain_lengths != NULL ? 0 : -1;
 #endif
-
-    return new_node;
 }
 
-Node* hashtable_lookup(HashTable* table, int key) {
+int hashtable_attach_lockprof(HashTable* table, int sample_every) {
     assert(table != NULL);
-    assert(key >= 0);
+    assert(table->lockprof == NULL);
 
-    int index = hash_func(key, table->size);
-    Node* bucket = table->buckets[index];
+#ifndef HASHTABLE_PROBES
+    (void)sample_every;
+    return -1;
+#elif defined(CUCKOO_LOCKING)
+    table->lockprof = lockprof_create(CUCKOO_STRIPES, sample_every, "stripe");
+    table->cuckoo->lockprof = table->lockprof;
+    return table->lockprof != NULL ? 0 : -1;
+#else
+    table->lockprof = lockprof_create(table->size, sample_every, "bucket");
+    return table->lockprof != NULL ? 0 : -1;
+#endif
+}
 
-#ifdef BUCKET_LOCKING
-    pthread_rwlock_rdlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-    pthread_rwlock_rdlock(bucket->lock);
+void hashtable_set_chain_sink(ChainStats* sink) { chain_sink = sink; }
 
-    Node* prev = bucket;
-#endif
+#ifndef CUCKOO_LOCKING
+static int length_class(int length) { return length < CHAIN_LENGTH_CLASSES - 1 ? length : CHAIN_LENGTH_CLASSES - 1; }
 
-    Node* curr = bucket->next;
-    while (curr != NULL) {
-#ifdef CHAIN_LOCKING
-        pthread_rwlock_rdlock(curr->lock);
-#endif
-        if (curr->key == key) {
-            // Found a match
-#ifdef BUCKET_LOCKING
-            // NOTE: there's still a problem between the deletion where a node
-            // may be found, but after return, the node might be deleted by a
-            // concurrent operation. However, returning the node is considered
-            // the linearization point for success of lookup in this project.
-            pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-            pthread_rwlock_unlock(prev->lock);
-            pthread_rwlock_unlock(curr->lock);
-#endif
-            return curr;
-        } else if (curr->key > key) {
-            // Key Not found
-            break;
-        }
+// Move the bucket from its old to its new chain length class. The sink has a single writer, but is read concurrently.
+static void track_chain(HashTable* table, int index, int delta) {
+    int length = __atomic_fetch_add(&table->chain_lengths[index], delta, __ATOMIC_RELAXED);
 
-#ifdef CHAIN_LOCKING
-        pthread_rwlock_unlock(prev->lock);
-        prev = curr;
+    ChainStats* sink = chain_sink;
+    if (sink != NULL) {
+        int64_t* from = &sink->buckets[length_class(length)];
+        int64_t* to = &sink->buckets[length_class(length + delta)];
+        __atomic_store_n(from, *from - 1, __ATOMIC_RELAXED);
+        __atomic_store_n(to, *to + 1, __ATOMIC_RELAXED);
+    }
+}
 #endif
-        curr = curr->next;
+
+int hash_func(int key, int size) {
+    // currently use modulo operation
+    return key % size;
+}
+
+// The filter counters of a key. Independent of hash_func(), which puts the keys of a bucket into one residue class.
+static inline void filter_probes(int key, int probes[FILTER_PROBES]) {
+    uint64_t hash = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        probes[i] = (int)(hash >> (59 - 5 * i)) & (FILTER_COUNTERS - 1);
     }
+}
 
+static inline uint64_t* filter_word(HashTable* table, int index, int counter) {
+    return &table->filters[index * FILTER_WORDS + counter / 16];
+}
+
+// Returns true if the key is certainly not in the bucket, counting the skip.
+static bool filter_rejects(HashTable* table, int index, int key) {
+    int probes[FILTER_PROBES];
+    filter_probes(key, probes);
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        uint64_t word = __atomic_load_n(filter_word(table, index, probes[i]), __ATOMIC_ACQUIRE);
+        if (((word >> (probes[i] % 16 * 4)) & 0xF) == 0) {
+            counter_add(&table->filter_skips, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Count the key in or out of its counters. Inserts count in before linking and deletes count out after unlinking,
+// so a counter is never zero while a key using it is reachable. A saturated counter stays saturated.
+static void filter_adjust(HashTable* table, int index, int key, int delta) {
+    int probes[FILTER_PROBES];
+    filter_probes(key, probes);
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        uint64_t* word = filter_word(table, index, probes[i]);
+        int shift = probes[i] % 16 * 4;
+        uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+        uint64_t updated;
+        do {
+            if (((old >> shift) & 0xF) == 0xF) {
+                break;
+            }
+            updated = delta > 0 ? old + (1ULL << shift) : old - (1ULL << shift);
+        } while (!__atomic_compare_exchange_n(word, &old, updated, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+}
+
+#ifdef OPTIMISTIC_LOCKING
+static void backoff(int attempt) {
+    int limit = BACKOFF_MIN_SPINS << attempt;
+    if (limit > BACKOFF_MAX_SPINS) {
+        limit = BACKOFF_MAX_SPINS;
+    }
+
+    // Randomize the wait, so that conflicting threads do not retry in lockstep
+    int spins = limit / 2 + (int)(timer_now() % (limit / 2));
+    for (int i = 0; i < spins; ++i) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+static void unlock_pair(Node* prev, Node* curr) {
+    pthread_rwlock_unlock(prev->lock);
+    if (curr != NULL) {
+        pthread_rwlock_unlock(curr->lock);
+    }
+}
+
+// Find the first node with a key not less than the given key (curr, NULL at the end of the chain)
+// and its predecessor (prev). Returns with both write locked and validated.
+static void optimistic_locate(HashTable* table, Node* bucket, int key, Node** prev_out, Node** curr_out) {
+    for (int attempt = 0; attempt < OPTIMISTIC_MAX_RETRIES; ++attempt) {
+        if (attempt > 0) {
+            counter_add(&table->retries, 1);
+            backoff(attempt - 1);
+        }
+
+        Node* prev = bucket;
+        Node* curr = bucket->next;
+        while (curr != NULL && curr->key < key) {
+            prev = curr;
+            curr = curr->next;
+        }
+
+        node_write_lock(prev);
+        if (curr != NULL) {
+            node_write_lock(curr);
+        }
+
+        if (validate(bucket, prev, curr)) {
+            *prev_out = prev;
+            *curr_out = curr;
+            return;
+        }
+
+        unlock_pair(prev, curr);
+        counter_add(&table->validation_failures, 1);
+        PROBE2(validate_fail, probe_bucket, attempt);
+    }
+
+    // Too much contention, lock coupling from the sentinel cannot fail. Locks are taken in
+    // chain order like the optimistic path does, and a locked node cannot be unlinked, so
+    // the nodes need no validation.
+    counter_add(&table->fallbacks, 1);
+    PROBE1(validate_fallback, probe_bucket);
+
+    Node* prev = bucket;
+    node_write_lock(prev);
+    Node* curr = prev->next;
+    while (curr != NULL) {
+        node_write_lock(curr);
+        if (curr->key >= key) {
+            break;
+        }
+        pthread_rwlock_unlock(prev->lock);
+        prev = curr;
+        curr = curr->next;
+    }
+
+    *prev_out = prev;
+    *curr_out = curr;
+}
+#endif
+
+#ifndef CUCKOO_LOCKING
+// The node a writer of the key starts after and its entry, the sentinel if the chain is not indexed. The writer
+// excludes the other writers of an indexed chain.
+static inline Node* writer_origin(HashTable* table, int index, ChainIndex* chain_index, int key, int* entry) {
+    if (chain_index == NULL) {
+        *entry = 0;
+        return table->buckets[index];
+    }
+    *entry = chain_index_find(chain_index, key);
+    return chain_index->entries[*entry].node;
+}
+
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+// Writers of an indexed chain hold its index lock instead of locking from the sentinel, because the bucket has no
+// lock. Returns the locked index if the chain is indexed, else NULL.
+static ChainIndex* index_lock(HashTable* table, int index) {
+    ChainIndex* chain_index = indexed_chain(table, index);
+    if (chain_index == NULL) {
+        return NULL;
+    }
+
+    PROBE_LOCK(table->lockprof, index, LockWrite, pthread_mutex_lock(&chain_index->lock));
+    if (chain_index->count == 0) {
+        // Dropped meanwhile
+        pthread_mutex_unlock(&chain_index->lock);
+        return NULL;
+    }
+    return chain_index;
+}
+#endif
+
+static inline void index_unlock(ChainIndex* chain_index) {
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    if (chain_index != NULL) {
+        pthread_mutex_unlock(&chain_index->lock);
+    }
+#else
+    (void)chain_index;
+#endif
+}
+
+#ifdef CHAIN_LOCKING
+// Write lock the node a writer of the key starts after. Returns it with the chain's index and its entry, see
+// writer_origin().
+static Node* chain_lock_origin(HashTable* table, int index, int key, ChainIndex** chain_index, int* entry) {
+    for (;;) {
+        *chain_index = index_lock(table, index);
+        Node* origin = writer_origin(table, index, *chain_index, key, entry);
+        node_write_lock(origin);
+
+        // The index is built with the sentinel locked
+        if (*chain_index != NULL || indexed_chain(table, index) == NULL) {
+            return origin;
+        }
+        pthread_rwlock_unlock(origin->lock);
+    }
+}
+#endif
+
+#ifdef OPTIMISTIC_LOCKING
+// Like optimistic_locate(), with the chain's index and the entry the walk started after, see writer_origin().
+static void index_locate(HashTable* table, int index, int key, ChainIndex** chain_index, int* entry, Node** prev_out,
+                         Node** curr_out) {
+    for (;;) {
+        *chain_index = index_lock(table, index);
+        if (*chain_index != NULL) {
+            // The only writer of the chain, so the nodes need no validation
+            Node* prev = writer_origin(table, index, *chain_index, key, entry);
+            Node* curr = prev->next;
+            while (curr != NULL && curr->key < key) {
+                prev = curr;
+                curr = curr->next;
+            }
+
+            node_write_lock(prev);
+            if (curr != NULL) {
+                node_write_lock(curr);
+            }
+            *prev_out = prev;
+            *curr_out = curr;
+            return;
+        }
+
+        // The index is built with every node locked
+        *entry = 0;
+        optimistic_locate(table, table->buckets[index], key, prev_out, curr_out);
+        if (indexed_chain(table, index) == NULL) {
+            return;
+        }
+        unlock_pair(*prev_out, *curr_out);
+    }
+}
+#endif
+
+// Index the chain. Writers under bucket locking hold the bucket lock, the others hold no lock.
+static void index_build(HashTable* table, int index) {
+    Node* bucket = table->buckets[index];
+
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    if (indexed_chain(table, index) != NULL) {
+        return;
+    }
+
+    // Lock the whole chain in order behind the writers in it, the writers that come later find the index
+    Node* last = bucket;
+    node_write_lock(last);
+    while (last->next != NULL) {
+        last = last->next;
+        node_write_lock(last);
+    }
+#endif
+
+    ChainIndex* chain_index = table->indexes[index];
+    if (chain_index == NULL) {
+        chain_index = chain_index_create();
+        __atomic_store_n(&table->indexes[index], chain_index, __ATOMIC_RELEASE);
+    }
+    if (chain_index != NULL && chain_index->count == 0) {
+        chain_index_write_begin(chain_index);
+        if (chain_index_build(chain_index, bucket) == 0) {
+            counter_add(&table->index_builds, 1);
+        }
+        chain_index_write_end(chain_index);
+    }
+
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    Node* node = bucket;
+    while (node != NULL) {
+        Node* next = node->next;
+        pthread_rwlock_unlock(node->lock);
+        node = next;
+    }
+#endif
+}
+
+// Count a node in or out of the chain, and index the chain or drop its index when its length crosses the thresholds.
+// The writer holds the bucket lock, or else the index lock if the chain was indexed and no lock if it was not.
+static void index_track(HashTable* table, int index, ChainIndex* chain_index, int delta) {
+    int length = __atomic_add_fetch(&table->index_lengths[index], delta, __ATOMIC_RELAXED);
+    if (chain_index == NULL) {
+        if (length > CHAIN_INDEX_TREEIFY) {
+            index_build(table, index);
+        }
+    } else if (length < CHAIN_INDEX_UNTREEIFY) {
+        chain_index_write_begin(chain_index);
+        chain_index_clear(chain_index);
+        chain_index_write_end(chain_index);
+        counter_add(&table->index_drops, 1);
+    }
+}
+#endif
+
+#ifdef CUCKOO_LOCKING
+static Node* cuckoo_insert_key(HashTable* table, int index, int key) {
+    // Count the key in before it can be found, and out again if it was not inserted
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, 1);
+    }
+
+    Node* node = (Node*)cuckoo_insert(table->cuckoo, key);
+    if (node == NULL && table->filters != NULL) {
+        filter_adjust(table, index, key, -1);
+    }
+
+    if (node != NULL && table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    return node;
+}
+
+static int cuckoo_delete_key(HashTable* table, int index, int key) {
+    // Invalidate around the removal, like the chains do
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    if (cuckoo_delete(table->cuckoo, key) != 0) {
+        return -1;
+    }
+
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, -1);
+    }
+
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    return 0;
+}
+#endif
+
+#ifdef UNROLLED_CHAINS
+// Insert into the block that covers the key, else into the last block. A full block is split first.
+static Node* unrolled_insert(HashTable* table, int index, int key) {
+    bucket_write_lock(table, index);
+
+    Node* bucket = table->buckets[index];
+    ChainIndex* chain_index = indexed_chain(table, index);
+    int entry;
+    Node* origin = writer_origin(table, index, chain_index, key, &entry);
+    Node* curr = origin->next;
+    if (curr == NULL && origin != bucket) {
+        // The key comes after the last block
+        curr = origin;
+    }
+    while (curr != NULL && curr->next != NULL && curr->keys[curr->count - 1] < key) {
+        curr = curr->next;
+    }
+
+    int rank = curr != NULL ? block_rank(curr->keys, curr->count, key) : 0;
+    if (curr != NULL && rank < curr->count && curr->keys[rank] == key) {
+        // Found a duplicate key, just announce failure
+        bucket_write_unlock(table, index);
+        return NULL;
+    }
+
+    Node* block = curr;
+    if (curr == NULL || curr->count == BLOCK_KEYS) {
+        block = alloc_node(table);
+    }
+
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, 1);
+    }
+
+    bool linked = block != curr;
+    if (chain_index != NULL) {
+        chain_index_write_begin(chain_index);
+    }
+    seq_write_begin(table, index);
+    if (curr == NULL) {
+        bucket->next = block;
+    } else if (block != curr) {
+        block->next = curr->next;
+        block_split(curr->keys, &curr->count, block->keys, &block->count);
+        curr->next = block;
+        if (rank <= curr->count) {
+            block = curr;
+        } else {
+            rank -= curr->count;
+        }
+    }
+    block_insert_at(block->keys, &block->count, rank, key);
+    if (chain_index != NULL) {
+        // Once the keys are in place, since a split of the index reads the last keys
+        if (linked) {
+            chain_index_linked(chain_index, entry, curr);
+        }
+        chain_index_changed(chain_index, entry, curr);
+    }
+    seq_write_end(table, index);
+    if (chain_index != NULL) {
+        chain_index_write_end(chain_index);
+    }
+
+    if (table->chain_lengths != NULL) {
+        track_chain(table, index, 1);
+    }
+
+    if (linked && table->index_lengths != NULL) {
+        index_track(table, index, chain_index, 1);
+    }
+
+    bucket_write_unlock(table, index);
+
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    return block;
+}
+
+// Remove the key from its block. An empty block is unlinked, and a block that fell below half full absorbs its
+// successor if both fit.
+static int unrolled_delete(HashTable* table, int index, int key) {
+    bucket_write_lock(table, index);
+
+    ChainIndex* chain_index = indexed_chain(table, index);
+    int entry;
+    Node* prev = writer_origin(table, index, chain_index, key, &entry);
+    Node* curr = prev->next;
+    while (curr != NULL && curr->keys[curr->count - 1] < key) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    int rank = curr != NULL ? block_rank(curr->keys, curr->count, key) : 0;
+    if (curr == NULL || rank == curr->count || curr->keys[rank] != key) {
+        // Could not find a matching key
+        bucket_write_unlock(table, index);
+        return -1;
+    }
+
+    // Invalidate around the removal, like the linked chains do
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    Node* unlinked = NULL;
+    if (chain_index != NULL) {
+        chain_index_write_begin(chain_index);
+    }
+    seq_write_begin(table, index);
+    block_remove_at(curr->keys, &curr->count, rank);
+    Node* next = curr->next;
+    if (curr->count == 0) {
+        if (chain_index != NULL) {
+            chain_index_unlinking(chain_index, entry, curr, prev);
+        }
+        prev->next = next;
+        unlinked = curr;
+    } else if (next != NULL && curr->count < BLOCK_KEYS / 2 && curr->count + next->count <= BLOCK_KEYS) {
+        if (chain_index != NULL) {
+            chain_index_unlinking(chain_index, entry, next, curr);
+        }
+        block_merge(curr->keys, &curr->count, next->keys, &next->count);
+        curr->next = next->next;
+        unlinked = next;
+    }
+    if (chain_index != NULL && unlinked != curr) {
+        chain_index_changed(chain_index, entry, curr);
+    }
+    seq_write_end(table, index);
+    if (chain_index != NULL) {
+        chain_index_write_end(chain_index);
+    }
+
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, -1);
+    }
+
+    if (table->chain_lengths != NULL) {
+        track_chain(table, index, -1);
+    }
+
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    if (unlinked != NULL && table->index_lengths != NULL) {
+        index_track(table, index, chain_index, -1);
+    }
+
+    bucket_write_unlock(table, index);
+
+    if (unlinked != NULL) {
+        free_node(table, unlinked);
+    }
+
+    return 0;
+}
+#endif
+
+// Insert the key with the given expiry, ignored without cache mode
+static Node* insert_key(HashTable* table, int key, uint32_t expires) {
+    int index = hash_func(key, table->size);
+    probe_enter(table, index);
+#ifdef CUCKOO_LOCKING
+    (void)expires;
+    return cuckoo_insert_key(table, index, key);
+#elif defined(UNROLLED_CHAINS)
+    (void)expires;
+    return unrolled_insert(table, index, key);
+#else
+    ChainIndex* chain_index;  // set if the chain is indexed, the walk then starts after the entry's node
+    int entry;
+
+#ifdef OPTIMISTIC_LOCKING
+    Node* prev;
+    Node* curr;
+    index_locate(table, index, key, &chain_index, &entry, &prev, &curr);
+
+    if (curr != NULL && curr->key == key) {
+        // Found a duplicate key, just announce failure unless it expired
+        Node* revived = revive_expired(table, curr, expires);
+        unlock_pair(prev, curr);
+        index_unlock(chain_index);
+        return revived;
+    }
+#else
+#ifdef BUCKET_LOCKING
+    bucket_write_lock(table, index);
+    chain_index = indexed_chain(table, index);
+    Node* origin = writer_origin(table, index, chain_index, key, &entry);
+#elif CHAIN_LOCKING
+    Node* origin = chain_lock_origin(table, index, key, &chain_index, &entry);
+#endif
+
+    Node* curr = origin->next;
+    Node* prev = origin;
+    while (curr != NULL) {
+#ifdef CHAIN_LOCKING
+        node_write_lock(curr);
+#endif
+        if (curr->key == key) {
+            // Found a duplicate key, just announce failure unless it expired
+            Node* revived = revive_expired(table, curr, expires);
+#ifdef BUCKET_LOCKING
+            bucket_write_unlock(table, index);
+#elif CHAIN_LOCKING
+            pthread_rwlock_unlock(prev->lock);
+            pthread_rwlock_unlock(curr->lock);
+            index_unlock(chain_index);
+#endif
+            return revived;
+        } else if (curr->key > key) {
+            // Found a position to insert
+            break;
+        }
+
+#ifdef CHAIN_LOCKING
+        pthread_rwlock_unlock(prev->lock);
+#endif
+        prev = curr;
+        curr = curr->next;
+    }
+#endif
+
+    assert(prev != NULL);
+
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, 1);
+    }
+
+    Node* new_node = alloc_node(table);
+    new_node->key = key;
+    new_node->expires = expires;
+    new_node->next = curr;
+
+    if (chain_index != NULL) {
+        chain_index_write_begin(chain_index);
+    }
+#ifdef SEQLOCK_READERS
+    seq_write_begin(table, index);
+#endif
+    prev->next = new_node;
+    if (chain_index != NULL) {
+        chain_index_linked(chain_index, entry, prev);
+    }
+#ifdef SEQLOCK_READERS
+    seq_write_end(table, index);
+#endif
+    if (chain_index != NULL) {
+        chain_index_write_end(chain_index);
+    }
+
+    if (table->chain_lengths != NULL) {
+        track_chain(table, index, 1);
+    }
+
+    if (table->cache != NULL) {
+        // Counted but not marked as used, so a key that is never looked up goes before the keys that are
+        __atomic_fetch_add(&table->cache->entries, 1, __ATOMIC_RELAXED);
+    }
+
+#ifdef BUCKET_LOCKING
+    if (table->index_lengths != NULL) {
+        index_track(table, index, chain_index, 1);
+    }
+    bucket_write_unlock(table, index);
+#elif defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    pthread_rwlock_unlock(prev->lock);
+    if (curr != NULL) {
+        pthread_rwlock_unlock(curr->lock);
+    }
+    if (table->index_lengths != NULL) {
+        index_track(table, index, chain_index, 1);
+    }
+    index_unlock(chain_index);
+#endif
+
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    return new_node;
+#endif
+}
+
+static Node* chain_lookup(HashTable* table, int key) {
+#ifdef CUCKOO_LOCKING
+    return (Node*)cuckoo_lookup(table->cuckoo, key);
+#else
+    int index = hash_func(key, table->size);
+    probe_enter(table, index);
+
+#ifdef SEQLOCK_READERS
+    for (int attempt = 0; attempt < SEQLOCK_MAX_RETRIES; ++attempt) {
+        Node* node;
+        if (seq_lookup(table, index, key, &node)) {
+            return node;
+        }
+        counter_add(&table->read_failures, 1);
+        PROBE2(seq_retry, index, attempt);
+    }
+    if (SEQLOCK_MAX_RETRIES > 0) {
+        counter_add(&table->read_fallbacks, 1);
+    }
+#endif
+
+#ifdef BUCKET_LOCKING
+    int token = bucket_read_lock(table, index);
+#elif CHAIN_LOCKING
+    Node* bucket = table->buckets[index];
+    node_read_lock(bucket);
+
+    Node* prev = bucket;
+#endif
+
+#ifdef CHAIN_LOCKING
+    Node* curr = bucket->next;
+#else
+    // Writers keep the index in step under the bucket lock. Optimistic walks may start after a node that is unlinked
+    // meanwhile, like they may stand on one.
+    Node* curr = lookup_origin(table, index, key)->next;
+#endif
+    while (curr != NULL) {
+#ifdef CHAIN_LOCKING
+        node_read_lock(curr);
+#endif
+        int step = chain_step(curr, key);
+        if (step > 0) {
+            // Found a match
 #ifdef BUCKET_LOCKING
-    pthread_rwlock_unlock(&table->bucket_locks[index]);
+            // NOTE: there's still a problem between the deletion where a node
+            // may be found, but after return, the node might be deleted by a
+            // concurrent operation. However, returning the node is considered
+            // the linearization point for success of lookup in this project.
+            bucket_read_unlock(table, index, token);
+#elif CHAIN_LOCKING
+            pthread_rwlock_unlock(prev->lock);
+            pthread_rwlock_unlock(curr->lock);
+#endif
+            return curr;
+        } else if (step == 0) {
+            // Key Not found
+            break;
+        }
+
+#ifdef CHAIN_LOCKING
+        pthread_rwlock_unlock(prev->lock);
+        prev = curr;
+#endif
+        curr = curr->next;
+    }
+
+#ifdef BUCKET_LOCKING
+    bucket_read_unlock(table, index, token);
 #elif CHAIN_LOCKING
     pthread_rwlock_unlock(prev->lock);
     if (curr != NULL) {
@@ -206,118 +1262,1349 @@ Node* hashtable_lookup(HashTable* table, int key) {
     }
 #endif
 
-    return NULL;
+    return NULL;
+#endif
+}
+
+// A lookup found the node in cache mode: the key counts as missing if it expired, else it was recently used
+static Node* cache_hit(HashTable* table, int key, Node* node, bool* expired) {
+#ifdef NODE_EXPIRY
+    if (node_expired(table, node)) {
+        *expired = true;
+        return NULL;
+    }
+    cache_touch(table->cache, hash_func(key, table->size), key);
+#else
+    (void)table;
+    (void)key;
+    (void)expired;
+#endif
+    return node;
+}
+
+// Sets expired if the key was found but expired, so the caller can unlink it outside of the gates
+static Node* lookup_key(HashTable* table, int key, bool* expired) {
+    *expired = false;
+    if (table->filters != NULL && filter_rejects(table, hash_func(key, table->size), key)) {
+        return NULL;
+    }
+
+    Node* node;
+    uint32_t epoch = 0;
+    if (table->hotcache != NULL && hotcache_lookup(table->hotcache, key, &node, &epoch)) {
+        return table->cache != NULL ? cache_hit(table, key, node, expired) : node;
+    }
+
+    node = chain_lookup(table, key);
+    if (node != NULL && table->cache != NULL) {
+        node = cache_hit(table, key, node, expired);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    if (node != NULL && table->hotcache != NULL) {
+        hotcache_admit(table->hotcache, key, node, epoch);
+    } else if (node == NULL && table->filters != NULL) {
+        counter_add(&table->filter_false_positives, 1);
+    }
+
+    return node;
+}
+
+#if defined(SEQLOCK_READERS) || defined(OPTIMISTIC_LOCKING)
+// Progress of one in-flight lookup of hashtable_lookup_batch()
+enum LookupStage { LookupHead = 0, LookupFirst = 1, LookupWalk = 2 };
+
+typedef struct LookupState {
+    int i;  // index into the keys, -1 while the slot is idle
+    int index;
+    LookupStage stage;
+    Node* curr;
+    int steps;
+#ifdef SEQLOCK_READERS
+    uint64_t seq;
+#endif
+} LookupState;
+
+static inline void prefetch(const void* addr) { __builtin_prefetch(addr, 0, 3); }
+
+// Start the lookup of keys[i], only touching memory through prefetches
+static void lookup_start(HashTable* table, LookupState* state, int i, int key) {
+    state->i = i;
+    state->index = hash_func(key, table->size);
+    state->stage = LookupHead;
+    state->steps = 0;
+
+    prefetch(&table->buckets[state->index]);
+#ifdef SEQLOCK_READERS
+    prefetch(&table->bucket_seqs[state->index]);
+#endif
+    if (table->filters != NULL) {
+        prefetch(&table->filters[state->index * FILTER_WORDS]);
+    }
+}
+
+#ifdef SEQLOCK_READERS
+static Node* lookup_fallback(HashTable* table, int key) {
+    counter_add(&table->read_failures, 1);
+    Node* node = chain_lookup(table, key);
+    if (node == NULL && table->filters != NULL) {
+        counter_add(&table->filter_false_positives, 1);
+    }
+    return node;
+}
+#endif
+
+// Advance a lookup by one dependent load, prefetching the next one. Returns true when it is done, with the node (or
+// NULL) stored into result.
+static bool lookup_step(HashTable* table, LookupState* state, int key, Node** result) {
+    switch (state->stage) {
+        case LookupHead: {
+            if (table->filters != NULL && filter_rejects(table, state->index, key)) {
+                *result = NULL;
+                return true;
+            }
+#ifdef SEQLOCK_READERS
+            // Before the origin is picked, like seq_lookup(): an indexed origin is a chain node, which a writer may
+            // unlink and recycle while the other lookups of the batch run
+            state->seq = __atomic_load_n(&table->bucket_seqs[state->index], __ATOMIC_ACQUIRE);
+            if (seq_is_writing(state->seq)) {
+                *result = lookup_fallback(table, key);
+                return true;
+            }
+#endif
+            state->curr = lookup_origin(table, state->index, key);
+            state->stage = LookupFirst;
+            prefetch(state->curr);
+            return false;
+        }
+        case LookupFirst: {
+            state->curr = __atomic_load_n(&state->curr->next, __ATOMIC_RELAXED);
+            state->stage = LookupWalk;
+            if (state->curr != NULL) {
+                prefetch(state->curr);
+                return false;
+            }
+            break;
+        }
+        case LookupWalk: {
+            int step = chain_step(state->curr, key);
+            if (step < 0) {
+                state->curr = __atomic_load_n(&state->curr->next, __ATOMIC_RELAXED);
+                if (state->curr != NULL) {
+#ifdef SEQLOCK_READERS
+                    if (++state->steps % SEQ_CHECK_STEPS == 0 &&
+                        __atomic_load_n(&table->bucket_seqs[state->index], __ATOMIC_RELAXED) != state->seq) {
+                        *result = lookup_fallback(table, key);
+                        return true;
+                    }
+#endif
+                    prefetch(state->curr);
+                    return false;
+                }
+            } else if (step == 0) {
+                state->curr = NULL;
+            }
+            break;
+        }
+    }
+
+#ifdef SEQLOCK_READERS
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&table->bucket_seqs[state->index], __ATOMIC_RELAXED) != state->seq) {
+        *result = lookup_fallback(table, key);
+        return true;
+    }
+#endif
+    if (state->curr == NULL && table->filters != NULL) {
+        counter_add(&table->filter_false_positives, 1);
+    }
+    *result = state->curr;
+    return true;
+}
+#endif
+
+void hashtable_lookup_batch(HashTable* table, const int* keys, Node** results, int n, int width) {
+    assert(table != NULL);
+    assert(n >= 0);
+
+#if defined(SEQLOCK_READERS) || defined(OPTIMISTIC_LOCKING)
+    if (table->hotcache == NULL && table->gates == NULL && table->cache == NULL && width > 1) {
+        if (width > LOOKUP_BATCH_MAX_WIDTH) {
+            width = LOOKUP_BATCH_MAX_WIDTH;
+        }
+
+        // Round-robin over the in-flight lookups, so each one's next node arrives while the others are advanced
+        LookupState states[LOOKUP_BATCH_MAX_WIDTH];
+        int next = 0;
+        int active = 0;
+        for (int s = 0; s < width; ++s) {
+            states[s].i = -1;
+            if (next < n) {
+                lookup_start(table, &states[s], next, keys[next]);
+                next++;
+                active++;
+            }
+        }
+
+        while (active > 0) {
+            for (int s = 0; s < width; ++s) {
+                LookupState* state = &states[s];
+                if (state->i < 0 || !lookup_step(table, state, keys[state->i], &results[state->i])) {
+                    continue;
+                }
+                if (next < n) {
+                    lookup_start(table, state, next, keys[next]);
+                    next++;
+                } else {
+                    state->i = -1;
+                    active--;
+                }
+            }
+        }
+        return;
+    }
+#else
+    (void)width;
+#endif
+
+    // One at a time, through the hot-key cache if there is one
+    for (int i = 0; i < n; ++i) {
+        results[i] = hashtable_lookup(table, keys[i]);
+    }
+}
+
+// Returns 0 if a key was unlinked that had not expired, 1 if an expired one was, else -1. With only_expired, keys
+// that did not expire stay in place. The expiry of the unlinked node is stored into expires, if not NULL.
+static int chain_delete(HashTable* table, int index, int key, bool only_expired, uint32_t* expires) {
+    probe_enter(table, index);
+#ifdef CUCKOO_LOCKING
+    (void)only_expired;
+    if (expires != NULL) {
+        *expires = 0;
+    }
+    return cuckoo_delete_key(table, index, key);
+#elif defined(UNROLLED_CHAINS)
+    (void)only_expired;
+    if (expires != NULL) {
+        *expires = 0;
+    }
+    return unrolled_delete(table, index, key);
+#else
+    ChainIndex* chain_index;  // set if the chain is indexed, the walk then starts after the entry's node
+    int entry;
+
+#ifdef OPTIMISTIC_LOCKING
+    Node* prev;
+    Node* curr;
+    index_locate(table, index, key, &chain_index, &entry, &prev, &curr);
+
+    bool expired = curr != NULL && curr->key == key && table->cache != NULL && node_expired(table, curr);
+    if (curr == NULL || curr->key != key || (only_expired && !expired)) {
+        // Could not find a matching key
+        unlock_pair(prev, curr);
+        index_unlock(chain_index);
+        return -1;
+    }
+#else
+#ifdef BUCKET_LOCKING
+    bucket_write_lock(table, index);
+    chain_index = indexed_chain(table, index);
+    Node* origin = writer_origin(table, index, chain_index, key, &entry);
+#elif CHAIN_LOCKING
+    Node* origin = chain_lock_origin(table, index, key, &chain_index, &entry);
+#endif
+
+    Node* curr = origin->next;
+    Node* prev = origin;
+    while (curr != NULL) {
+#ifdef CHAIN_LOCKING
+        node_write_lock(curr);
+#endif
+        if (curr->key == key) {
+            break;
+        } else if (curr->key > key) {
+            // Key not found.
+#ifdef BUCKET_LOCKING
+            bucket_write_unlock(table, index);
+#elif CHAIN_LOCKING
+            pthread_rwlock_unlock(prev->lock);
+            pthread_rwlock_unlock(curr->lock);
+            index_unlock(chain_index);
+#endif
+            return -1;
+        }
+#if CHAIN_LOCKING
+        pthread_rwlock_unlock(prev->lock);
+#endif
+        prev = curr;
+        curr = curr->next;
+    }
+
+    assert(prev != NULL);
+
+    bool expired = curr != NULL && table->cache != NULL && node_expired(table, curr);
+    if (curr == NULL || (only_expired && !expired)) {
+        // Could not find a matching key
+#ifdef BUCKET_LOCKING
+        bucket_write_unlock(table, index);
+#elif CHAIN_LOCKING
+        pthread_rwlock_unlock(prev->lock);
+        if (curr != NULL) {
+            pthread_rwlock_unlock(curr->lock);
+        }
+        index_unlock(chain_index);
+#endif
+        return -1;
+    }
+#endif
+
+    if (expires != NULL) {
+        *expires = __atomic_load_n(&curr->expires, __ATOMIC_RELAXED);
+    }
+
+    // Invalidate around the unlink, so that a lookup that walked the chain
+    // before the unlink cannot admit the node to the cache afterwards
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+    // logical deletion, after the index let go of the node
+    if (chain_index != NULL) {
+        chain_index_write_begin(chain_index);
+    }
+#ifdef SEQLOCK_READERS
+    seq_write_begin(table, index);
+#endif
+    if (chain_index != NULL) {
+        chain_index_unlinking(chain_index, entry, curr, prev);
+    }
+    prev->next = curr->next;
+#ifndef OPTIMISTIC_LOCKING
+    // Unvalidated optimistic lookups standing on the unlinked node must still reach the rest of the chain
+    curr->next = NULL;
+#endif
+#ifdef SEQLOCK_READERS
+    seq_write_end(table, index);
+#endif
+    if (chain_index != NULL) {
+        chain_index_write_end(chain_index);
+    }
+
+    if (table->filters != NULL) {
+        filter_adjust(table, index, key, -1);
+    }
+
+    if (table->chain_lengths != NULL) {
+        track_chain(table, index, -1);
+    }
+
+    if (table->cache != NULL) {
+        __atomic_fetch_sub(&table->cache->entries, 1, __ATOMIC_RELAXED);
+        if (expired) {
+            counter_add(&table->cache->expirations, 1);
+        }
+    }
+
+    if (table->hotcache != NULL) {
+        hotcache_invalidate(table->hotcache, key);
+    }
+
+#ifdef BUCKET_LOCKING
+    if (table->index_lengths != NULL) {
+        index_track(table, index, chain_index, -1);
+    }
+    // release before physical deletion
+    bucket_write_unlock(table, index);
+#elif defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    pthread_rwlock_unlock(prev->lock);
+    pthread_rwlock_unlock(curr->lock);
+    if (table->index_lengths != NULL) {
+        index_track(table, index, chain_index, -1);
+    }
+    index_unlock(chain_index);
+#endif
+
+// TODO: Handle separate garbage collection for optimistic locking.
+// The traversals do not acquire lock, creating memory access issues when free.
+#ifndef OPTIMISTIC_LOCKING
+    // phyisical deletion
+    free_node(table, curr);
+#endif
+
+    return expired ? 1 : 0;
+#endif
+}
+
+// Returns 0 if the key was deleted, else -1. The expiry of its node is stored into expires, if not NULL.
+static int delete_key(HashTable* table, int key, uint32_t* expires) {
+    int index = hash_func(key, table->size);
+    // An expired key was unlinked, but counts as missing
+    if (table->filters == NULL) {
+        return chain_delete(table, index, key, false, expires) == 0 ? 0 : -1;
+    }
+
+    if (filter_rejects(table, index, key)) {
+        return -1;
+    }
+    int deleted = chain_delete(table, index, key, false, expires);
+    if (deleted < 0) {
+        counter_add(&table->filter_false_positives, 1);
+    }
+    return deleted == 0 ? 0 : -1;
+}
+
+/*
+ * Gates: the gate of a stripe of buckets counts the writers passing it in its low half. A thread that applies several
+ * operations atomically closes the gates of their buckets, waits for the writers to leave and opens the gates again
+ * with a new version. Lookups take no part: they retry if the gate was closed or reopened meanwhile.
+ */
+
+#define GATE_WRITERS (0xFFFFFFFFULL)
+#define GATE_CLOSED (1ULL << 32)
+#define GATE_VERSION (1ULL << 33)
+#define GATE_SPINS (64)  // spins of a waiter before it yields, the closer may be descheduled
+
+static inline Gate* gate_of(HashTable* table, int key) {
+    return &table->gates[hash_func(key, table->size) % HASHTABLE_GATES];
+}
+
+static inline void gate_wait(int* spins) {
+    if (++*spins % GATE_SPINS != 0) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+static void gate_enter(Gate* gate) {
+    int spins = 0;
+    for (;;) {
+        uint64_t word = __atomic_fetch_add(&gate->word, 1, __ATOMIC_ACQUIRE);
+        if ((word & GATE_CLOSED) == 0) {
+            return;
+        }
+
+        // Step back, so that the closer sees the writers drain
+        __atomic_fetch_sub(&gate->word, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(&gate->word, __ATOMIC_RELAXED) & GATE_CLOSED) {
+            gate_wait(&spins);
+        }
+    }
+}
+
+static inline void gate_leave(Gate* gate) { __atomic_fetch_sub(&gate->word, 1, __ATOMIC_RELEASE); }
+
+static void gate_close(Gate* gate) {
+    int spins = 0;
+    while (__atomic_fetch_or(&gate->word, GATE_CLOSED, __ATOMIC_ACQUIRE) & GATE_CLOSED) {
+        // Closed by another thread
+        while (__atomic_load_n(&gate->word, __ATOMIC_RELAXED) & GATE_CLOSED) {
+            gate_wait(&spins);
+        }
+    }
+    while (__atomic_load_n(&gate->word, __ATOMIC_ACQUIRE) & GATE_WRITERS) {
+        gate_wait(&spins);
+    }
+
+    // The closed gate is visible before any change behind it, like a sequence counter
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Clear the closed bit and bump the version at once, no writer passes a closed gate
+static inline void gate_open(Gate* gate) {
+    __atomic_fetch_add(&gate->word, GATE_VERSION - GATE_CLOSED, __ATOMIC_RELEASE);
+}
+
+int hashtable_attach_gates(HashTable* table) {
+    assert(table != NULL);
+    assert(table->gates == NULL);
+
+    table->gates = (Gate*)aligned_alloc(CACHE_LINE_SIZE, sizeof(Gate) * HASHTABLE_GATES);
+    if (table->gates == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < HASHTABLE_GATES; ++i) {
+        table->gates[i].word = 0;
+    }
+    return 0;
+}
+
+/*
+ * Cache mode: the clock hand and the sweeper read a snapshot of a bucket's keys and unlink their victims like deletes,
+ * outside of any gate, since a writer must not wait for a gate while it passes another one.
+ */
+
+#define CACHE_SNAPSHOT_KEYS (64)     // keys of a bucket the clock hand and the sweeper consider
+#define CACHE_SNAPSHOT_RETRIES (4)  // snapshots of a bucket tried before it is skipped
+
+#ifdef NODE_EXPIRY
+// Unlink the key like a delete, but only if it expired when only_expired. Returns like chain_delete().
+static int remove_key(HashTable* table, int key, bool only_expired) {
+    int index = hash_func(key, table->size);
+    if (table->gates == NULL) {
+        return chain_delete(table, index, key, only_expired, NULL);
+    }
+
+    Gate* gate = gate_of(table, key);
+    gate_enter(gate);
+    int removed = chain_delete(table, index, key, only_expired, NULL);
+    gate_leave(gate);
+    return removed;
+}
+
+// Copy the first keys of a bucket and their expiries. Returns the number of keys, or -1 if writers kept interfering.
+static int bucket_snapshot(HashTable* table, int index, int* keys, uint32_t* expires) {
+#ifdef SEQLOCK_READERS
+    uint64_t* seq = &table->bucket_seqs[index];
+    for (int attempt = 0; attempt < CACHE_SNAPSHOT_RETRIES; ++attempt) {
+        uint64_t before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (seq_is_writing(before)) {
+            continue;
+        }
+
+        int n = 0;
+        Node* curr = __atomic_load_n(&table->buckets[index]->next, __ATOMIC_RELAXED);
+        for (; curr != NULL && n < CACHE_SNAPSHOT_KEYS; curr = __atomic_load_n(&curr->next, __ATOMIC_RELAXED)) {
+            keys[n] = __atomic_load_n(&curr->key, __ATOMIC_RELAXED);
+            expires[n++] = __atomic_load_n(&curr->expires, __ATOMIC_RELAXED);
+        }
+
+        // Everything read above happened before the sequence is read again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+            return n;
+        }
+    }
+    return -1;
+#else
+    // Optimistic nodes are never freed, a stale key is at worst not found by the unlink
+    int n = 0;
+    Node* curr = __atomic_load_n(&table->buckets[index]->next, __ATOMIC_ACQUIRE);
+    for (; curr != NULL && n < CACHE_SNAPSHOT_KEYS; curr = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE)) {
+        keys[n] = __atomic_load_n(&curr->key, __ATOMIC_RELAXED);
+        expires[n++] = __atomic_load_n(&curr->expires, __ATOMIC_RELAXED);
+    }
+    return n;
+#endif
+}
+
+// Advance the clock hand to a victim and unlink it: an expired key, else a key that was not used since the hand last
+// passed its bucket. Returns false if the hand went around twice without finding one.
+static bool evict_one(HashTable* table) {
+    CacheMode* cache = table->cache;
+    int keys[CACHE_SNAPSHOT_KEYS];
+    uint32_t expires[CACHE_SNAPSHOT_KEYS];
+
+    for (int64_t scanned = 0; scanned <= 2 * (int64_t)table->size; ++scanned) {
+        int index = (int)(__atomic_fetch_add(&cache->hand, 1, __ATOMIC_RELAXED) % table->size);
+        uint64_t refs = __atomic_load_n(&cache->refs[index], __ATOMIC_RELAXED);
+        int n = bucket_snapshot(table, index, keys, expires);
+        if (n <= 0) {
+            continue;
+        }
+
+        uint32_t now = cache_now(cache);
+        int victim = -1;
+        for (int i = 0; i < n && victim < 0; ++i) {
+            if (cache_expired(expires[i], now)) {
+                victim = keys[i];
+            }
+        }
+        for (int i = 0; i < n && victim < 0; ++i) {
+            if ((refs & cache_ref_bit(keys[i])) == 0) {
+                victim = keys[i];
+            }
+        }
+        if (victim < 0) {
+            // Second chance, the keys used since the snapshot keep their bits
+            __atomic_fetch_and(&cache->refs[index], ~refs, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // An expired victim counts as expired
+        if (remove_key(table, victim, false) == 0) {
+            counter_add(&cache->evictions, 1);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Evict until the keys fit the capacity again
+static void cache_evict(HashTable* table) {
+    CacheMode* cache = table->cache;
+    while (__atomic_load_n(&cache->entries, __ATOMIC_RELAXED) > cache->capacity && evict_one(table)) {
+    }
+}
+
+static void sweep_tick(void* table, int num_buckets) { hashtable_cache_sweep((HashTable*)table, num_buckets); }
+#else
+static inline int remove_key(HashTable*, int, bool) { return -1; }
+static inline void cache_evict(HashTable*) {}
+#endif
+
+int hashtable_attach_cache(HashTable* table, const CacheConfig* config) {
+    assert(table != NULL);
+    assert(table->cache == NULL);
+    assert(config != NULL);
+
+#ifdef NODE_EXPIRY
+    // The memory of a key is its node and, with locks per node, the lock
+    size_t entry_bytes = sizeof(Node);
+#if defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
+    entry_bytes += sizeof(pthread_rwlock_t);
+#endif
+
+    CacheMode* cache = cache_mode_create(config, table->size, entry_bytes);
+    if (cache == NULL) {
+        return -1;
+    }
+    cache->entries = hashtable_size(table);
+    table->cache = cache;
+
+    if (cache_start_sweeper(cache, sweep_tick, table) != 0) {
+        table->cache = NULL;
+        cache_mode_free(cache);
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int hashtable_cache_sweep(HashTable* table, int num_buckets) {
+    assert(table != NULL);
+    assert(num_buckets >= 0);
+
+    int expired = 0;
+#ifdef NODE_EXPIRY
+    CacheMode* cache = table->cache;
+    if (cache == NULL) {
+        return 0;
+    }
+
+    int keys[CACHE_SNAPSHOT_KEYS];
+    uint32_t expires[CACHE_SNAPSHOT_KEYS];
+    for (int i = 0; i < num_buckets; ++i) {
+        int index = (int)(__atomic_fetch_add(&cache->cursor, 1, __ATOMIC_RELAXED) % table->size);
+        int n = bucket_snapshot(table, index, keys, expires);
+        uint32_t now = cache_now(cache);
+        for (int j = 0; j < n; ++j) {
+            if (!cache_expired(expires[j], now)) {
+                continue;
+            }
+            // Unlinks the key only if it still expired, it may have been replaced meanwhile
+            if (remove_key(table, keys[j], true) == 1) {
+                expired++;
+            }
+        }
+    }
+#endif
+    return expired;
+}
+
+Node* hashtable_insert(HashTable* table, int key) {
+    return hashtable_insert_ttl(table, key, table->cache != NULL ? table->cache->config.default_ttl_ms : 0);
+}
+
+Node* hashtable_insert_ttl(HashTable* table, int key, uint32_t ttl_ms) {
+    assert(table != NULL);
+    assert(key >= 0);
+
+    uint32_t expires = 0;
+    if (table->cache != NULL) {
+        expires = cache_expiry(table->cache, ttl_ms);
+    }
+
+    PROBE2(op_begin, Insert, key);
+    Node* node;
+    if (table->gates == NULL) {
+        node = insert_key(table, key, expires);
+    } else {
+        Gate* gate = gate_of(table, key);
+        gate_enter(gate);
+        node = insert_key(table, key, expires);
+        gate_leave(gate);
+    }
+
+    if (table->cache != NULL) {
+        cache_evict(table);
+    }
+    PROBE3(op_end, Insert, key, node != NULL);
+    return node;
 }
 
 int hashtable_delete(HashTable* table, int key) {
     assert(table != NULL);
     assert(key >= 0);
 
-    int index = hash_func(key, table->size);
+    PROBE2(op_begin, Delete, key);
+    int deleted;
+    if (table->gates == NULL) {
+        deleted = delete_key(table, key, NULL);
+    } else {
+        Gate* gate = gate_of(table, key);
+        gate_enter(gate);
+        deleted = delete_key(table, key, NULL);
+        gate_leave(gate);
+    }
+    PROBE3(op_end, Delete, key, deleted == 0);
+    return deleted;
+}
+
+// Look up through the gate of the key's bucket
+static Node* gated_lookup(HashTable* table, int key, bool* expired) {
+    Gate* gate = gate_of(table, key);
+    int spins = 0;
+    for (;;) {
+        uint64_t word = __atomic_load_n(&gate->word, __ATOMIC_ACQUIRE);
+        if (word & GATE_CLOSED) {
+            gate_wait(&spins);
+            continue;
+        }
+
+        Node* node = lookup_key(table, key, expired);
+
+        // Everything read above happened before the gate is read again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ((__atomic_load_n(&gate->word, __ATOMIC_RELAXED) & ~GATE_WRITERS) == (word & ~GATE_WRITERS)) {
+            return node;
+        }
+        counter_add(&table->gate_retries, 1);
+    }
+}
+
+Node* hashtable_lookup(HashTable* table, int key) {
+    assert(table != NULL);
+    assert(key >= 0);
+
+    PROBE2(op_begin, Lookup, key);
+    bool expired;
+    Node* node = table->gates == NULL ? lookup_key(table, key, &expired) : gated_lookup(table, key, &expired);
+    if (expired) {
+        // Lazy expiry, unless the key was replaced meanwhile
+        remove_key(table, key, true);
+    }
+    PROBE3(op_end, Lookup, key, node != NULL);
+    return node;
+}
+
+static int compare_gates(const void* a, const void* b) {
+    Gate* x = *(Gate* const*)a;
+    Gate* y = *(Gate* const*)b;
+    return (x > y) - (x < y);
+}
+
+bool hashtable_apply(HashTable* table, const int* keys, const OperationType* types, int n, bool all_or_nothing,
+                     bool* succeeded) {
+    assert(table != NULL);
+    assert(table->gates != NULL);
+    assert(n >= 0 && n <= HASHTABLE_APPLY_MAX_OPS);
+
+    // Close every gate once, in address order, so that two groups never wait for each other in a cycle
+    Gate* gates[HASHTABLE_APPLY_MAX_OPS];
+    for (int i = 0; i < n; ++i) {
+        assert(keys[i] >= 0);
+        gates[i] = gate_of(table, keys[i]);
+    }
+    qsort(gates, n, sizeof(Gate*), compare_gates);
+    int num_gates = 0;
+    for (int i = 0; i < n; ++i) {
+        if (num_gates == 0 || gates[num_gates - 1] != gates[i]) {
+            gates[num_gates++] = gates[i];
+        }
+    }
+    for (int i = 0; i < num_gates; ++i) {
+        gate_close(gates[i]);
+    }
+
+    // Expired keys a lookup runs into stay until the sweeper or a later operation unlinks them, the gates are closed
+    uint32_t expires = 0;
+    bool expired;
+    if (table->cache != NULL) {
+        expires = cache_expiry(table->cache, table->cache->config.default_ttl_ms);
+    }
+
+    uint32_t deleted_expires[HASHTABLE_APPLY_MAX_OPS];  // of the deleted nodes, restored by an undo
+    int failed = -1;
+    for (int i = 0; i < n; ++i) {
+        switch (types[i]) {
+            case Insert:
+                succeeded[i] = insert_key(table, keys[i], expires) != NULL;
+                break;
+            case Delete:
+                succeeded[i] = delete_key(table, keys[i], &deleted_expires[i]) == 0;
+                break;
+            case Lookup:
+                succeeded[i] = lookup_key(table, keys[i], &expired) != NULL;
+                break;
+            default:
+                succeeded[i] = false;
+                break;
+        }
+        if (all_or_nothing && !succeeded[i]) {
+            failed = i;
+            break;
+        }
+    }
+
+    if (failed >= 0) {
+        // Undo in reverse order behind the closed gates, nobody saw the changes
+        for (int i = failed - 1; i >= 0; --i) {
+            if (types[i] == Insert) {
+                delete_key(table, keys[i], NULL);
+            } else if (types[i] == Delete) {
+                insert_key(table, keys[i], deleted_expires[i]);
+            }
+        }
+        for (int i = failed + 1; i < n; ++i) {
+            succeeded[i] = false;
+        }
+        counter_add(&table->rollbacks, 1);
+    } else {
+        counter_add(&table->applies, 1);
+    }
+
+    for (int i = num_gates - 1; i >= 0; --i) {
+        gate_open(gates[i]);
+    }
+    if (table->cache != NULL) {
+        cache_evict(table);
+    }
+
+    return failed < 0;
+}
+
+/*
+ * Bulk load: the keys are partitioned into ranges of buckets, and every range is sorted by bucket and key and built
+ * into chains by one thread at a time, without locks.
+ */
+
+#define BULK_RANGES_PER_THREAD (8)  // ranges of buckets per thread, so that uneven ranges even out
+
+typedef struct BulkLoad {
+    HashTable* table;
+    const int* keys;
+    int n;
+    int num_threads;
+    int num_ranges;
+    int buckets_per_range;
+    int* offsets;      // per thread and range, where the thread's keys of the range go
+    int* range_start;  // per range and one past the last, where its keys begin in the partitioned keys
+    int* partitioned;  // the keys grouped by range
+    int next_range;    // ranges are claimed by the threads that are done with theirs
+} BulkLoad;
+
+typedef struct BulkWorker {
+    BulkLoad* load;
+    int id;
+    int* counts;        // per bucket of a range and one past the last, where its keys begin in sorted
+    int* sorted;        // the keys of a range, sorted by bucket
+    int loaded;         // keys put into the table
+    ChainStats chains;  // chain length changes to report to the caller's sink
+} BulkWorker;
+
+// Run func on every worker, the first one on the calling thread
+static void bulk_run(BulkWorker* workers, int num_threads, void* (*func)(void*)) {
+    pthread_t threads[num_threads];
+    for (int i = 1; i < num_threads; ++i) {
+        pthread_create(&threads[i], NULL, func, &workers[i]);
+    }
+    func(&workers[0]);
+    for (int i = 1; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// The first key of the thread's slice of the input
+static inline int bulk_slice_begin(const BulkLoad* load, int id) {
+    return (int)((int64_t)load->n * id / load->num_threads);
+}
+
+static inline int bulk_range_of(const BulkLoad* load, int key) {
+    return hash_func(key, load->table->size) / load->buckets_per_range;
+}
+
+#ifdef CUCKOO_LOCKING
+// Cuckoo buckets take concurrent inserts, which drop the duplicates
+static void* bulk_insert_slice(void* arg) {
+    BulkWorker* worker = (BulkWorker*)arg;
+    BulkLoad* load = worker->load;
+    HashTable* table = load->table;
+
+    int end = bulk_slice_begin(load, worker->id + 1);
+    for (int i = bulk_slice_begin(load, worker->id); i < end; ++i) {
+        int key = load->keys[i];
+        if (cuckoo_insert_key(table, hash_func(key, table->size), key) != NULL) {
+            worker->loaded++;
+        }
+    }
+    return NULL;
+}
+#else
+// Count the keys of the thread's slice per range
+static void* bulk_count(void* arg) {
+    BulkWorker* worker = (BulkWorker*)arg;
+    BulkLoad* load = worker->load;
+
+    int* counts = &load->offsets[worker->id * load->num_ranges];
+    int end = bulk_slice_begin(load, worker->id + 1);
+    for (int i = bulk_slice_begin(load, worker->id); i < end; ++i) {
+        counts[bulk_range_of(load, load->keys[i])]++;
+    }
+    return NULL;
+}
+
+// Move the keys of the thread's slice to their ranges
+static void* bulk_scatter(void* arg) {
+    BulkWorker* worker = (BulkWorker*)arg;
+    BulkLoad* load = worker->load;
+
+    int* offsets = &load->offsets[worker->id * load->num_ranges];
+    int end = bulk_slice_begin(load, worker->id + 1);
+    for (int i = bulk_slice_begin(load, worker->id); i < end; ++i) {
+        int key = load->keys[i];
+        load->partitioned[offsets[bulk_range_of(load, key)]++] = key;
+    }
+    return NULL;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Sort the keys of one bucket, which are mostly a few
+static void bulk_sort(int* keys, int n) {
+    if (n > 16) {
+        qsort(keys, n, sizeof(int), compare_keys);
+        return;
+    }
+    for (int i = 1; i < n; ++i) {
+        int key = keys[i];
+        int j = i;
+        while (j > 0 && keys[j - 1] > key) {
+            keys[j] = keys[j - 1];
+            --j;
+        }
+        keys[j] = key;
+    }
+}
+
+// Build the chain of an empty bucket from its sorted keys, skipping duplicates. Returns the number of keys loaded.
+static int bulk_build_chain(HashTable* table, int index, const int* keys, int n, ChainStats* chains) {
     Node* bucket = table->buckets[index];
+    assert(bucket->next == NULL);
 
-#ifdef BUCKET_LOCKING
-    pthread_rwlock_wrlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-    pthread_rwlock_wrlock(bucket->lock);
+    Node* tail = bucket;
+    int loaded = 0;
+    int nodes = 0;
+#ifdef NODE_EXPIRY
+    uint32_t expires = 0;
+    if (table->cache != NULL && n > 0) {
+        expires = cache_expiry(table->cache, table->cache->config.default_ttl_ms);
+    }
 #endif
+    for (int i = 0; i < n; ++i) {
+        int key = keys[i];
+        if (i > 0 && key == keys[i - 1]) {
+            continue;
+        }
 
-    Node* curr = bucket->next;
-    Node* prev = bucket;
-    while (curr != NULL) {
-#ifdef CHAIN_LOCKING
-        pthread_rwlock_wrlock(curr->lock);
+#ifdef UNROLLED_CHAINS
+        // Full blocks, the next insert into one splits it
+        if (tail == bucket || tail->count == BLOCK_KEYS) {
+            tail->next = alloc_node(table);
+            tail = tail->next;
+            ++nodes;
+        }
+        tail->keys[tail->count++] = key;
+#else
+        Node* node = alloc_node(table);
+        node->key = key;
+#ifdef NODE_EXPIRY
+        node->expires = expires;
 #endif
-        if (curr->key == key) {
-            break;
-        } else if (curr->key > key) {
-            // Key not found.
-#ifdef BUCKET_LOCKING
-            pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-            pthread_rwlock_unlock(prev->lock);
-            pthread_rwlock_unlock(curr->lock);
+        tail->next = node;
+        tail = node;
+        ++nodes;
 #endif
-            return -1;
+
+        if (table->filters != NULL) {
+            filter_adjust(table, index, key, 1);
         }
-#if CHAIN_LOCKING
-        pthread_rwlock_unlock(prev->lock);
-#endif
-        prev = curr;
-        curr = curr->next;
+        ++loaded;
     }
 
-    assert(prev != NULL);
+    if (table->chain_lengths != NULL && loaded > 0) {
+        table->chain_lengths[index] = loaded;
+        chains->buckets[0]--;
+        chains->buckets[length_class(loaded)]++;
+    }
+    if (table->index_lengths != NULL) {
+        table->index_lengths[index] = nodes;
+        if (nodes > CHAIN_INDEX_TREEIFY) {
+            index_build(table, index);
+        }
+    }
 
-    if (curr == NULL) {
-        // Could not find a matching key
-#ifdef BUCKET_LOCKING
-        pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif CHAIN_LOCKING
-        pthread_rwlock_unlock(prev->lock);
-#endif
+    return loaded;
+}
+
+// Partition the keys into their ranges and allocate the threads' buffers, everything before the first chain is built,
+// so that a failure leaves the table empty. Returns 0 on success, else -1.
+static int bulk_partition(BulkLoad* load, BulkWorker* workers) {
+    int num_threads = load->num_threads;
+    int num_ranges = load->num_ranges;
+
+    load->offsets = (int*)calloc((size_t)num_threads * num_ranges, sizeof(int));
+    load->range_start = (int*)malloc(sizeof(int) * (num_ranges + 1));
+    load->partitioned = (int*)malloc(sizeof(int) * (load->n > 0 ? load->n : 1));
+    if (load->offsets == NULL || load->range_start == NULL || load->partitioned == NULL) {
         return -1;
     }
 
-#ifdef OPTIMISTIC_LOCKING
-    pthread_rwlock_wrlock(prev->lock);
-    pthread_rwlock_wrlock(curr->lock);
+    bulk_run(workers, num_threads, bulk_count);
 
-    if (!validate(bucket, prev, curr)) {
-        pthread_rwlock_unlock(prev->lock);
-        pthread_rwlock_unlock(curr->lock);
-        return -1;
+    // Turn the counts into offsets: the ranges one after the other, and the threads' keys within a range likewise
+    int offset = 0;
+    int largest = 0;
+    for (int r = 0; r < num_ranges; ++r) {
+        load->range_start[r] = offset;
+        for (int t = 0; t < num_threads; ++t) {
+            int count = load->offsets[t * num_ranges + r];
+            load->offsets[t * num_ranges + r] = offset;
+            offset += count;
+        }
+        if (offset - load->range_start[r] > largest) {
+            largest = offset - load->range_start[r];
+        }
     }
-#endif
+    load->range_start[num_ranges] = offset;
 
-    // logical deletion
-    prev->next = curr->next;
-    curr->next = NULL;
+    for (int i = 0; i < num_threads; ++i) {
+        workers[i].counts = (int*)malloc(sizeof(int) * (load->buckets_per_range + 1));
+        workers[i].sorted = (int*)malloc(sizeof(int) * (largest > 0 ? largest : 1));
+        if (workers[i].counts == NULL || workers[i].sorted == NULL) {
+            return -1;
+        }
+    }
 
-#ifdef BUCKET_LOCKING
-    // release before physical deletion
-    pthread_rwlock_unlock(&table->bucket_locks[index]);
-#elif defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
-    pthread_rwlock_unlock(prev->lock);
-    pthread_rwlock_unlock(curr->lock);
+    bulk_run(workers, num_threads, bulk_scatter);
+    return 0;
+}
+
+static void bulk_release(BulkLoad* load, BulkWorker* workers) {
+    free(load->offsets);
+    free(load->range_start);
+    free(load->partitioned);
+    for (int i = 0; i < load->num_threads; ++i) {
+        free(workers[i].counts);
+        free(workers[i].sorted);
+    }
+}
+
+// Claim ranges until none is left, sort each by bucket and key and build its chains
+static void* bulk_build(void* arg) {
+    BulkWorker* worker = (BulkWorker*)arg;
+    BulkLoad* load = worker->load;
+    HashTable* table = load->table;
+
+    for (;;) {
+        int range = __atomic_fetch_add(&load->next_range, 1, __ATOMIC_RELAXED);
+        if (range >= load->num_ranges) {
+            return NULL;
+        }
+
+        const int* keys = &load->partitioned[load->range_start[range]];
+        int n = load->range_start[range + 1] - load->range_start[range];
+        int first = range * load->buckets_per_range;
+        int num_buckets = table->size - first < load->buckets_per_range ? table->size - first : load->buckets_per_range;
+
+        // Counting sort by bucket
+        int* counts = worker->counts;
+        memset(counts, 0, sizeof(int) * (num_buckets + 1));
+        for (int i = 0; i < n; ++i) {
+            counts[hash_func(keys[i], table->size) - first + 1]++;
+        }
+        for (int b = 0; b < num_buckets; ++b) {
+            counts[b + 1] += counts[b];
+        }
+        for (int i = 0; i < n; ++i) {
+            worker->sorted[counts[hash_func(keys[i], table->size) - first]++] = keys[i];
+        }
+
+        // Each count now ends its bucket
+        int begin = 0;
+        for (int b = 0; b < num_buckets; ++b) {
+            int end = counts[b];
+            bulk_sort(&worker->sorted[begin], end - begin);
+            worker->loaded += bulk_build_chain(table, first + b, &worker->sorted[begin], end - begin, &worker->chains);
+            begin = end;
+        }
+    }
+}
 #endif
 
-// TODO: Handle separate garbage collection for optimistic locking.
-// The traversals do not acquire lock, creating memory access issues when free.
-#ifndef OPTIMISTIC_LOCKING
-    // phyisical deletion
-    free(curr);
+int hashtable_bulk_load(HashTable* table, const int* keys, int n, int num_threads) {
+    assert(table != NULL);
+    assert(n >= 0);
+    assert(num_threads > 0);
+
+    BulkLoad load;
+    load.table = table;
+    load.keys = keys;
+    load.n = n;
+    load.num_threads = num_threads;
+    load.num_ranges = num_threads * BULK_RANGES_PER_THREAD < table->size ? num_threads * BULK_RANGES_PER_THREAD
+                                                                         : table->size;
+    load.buckets_per_range = (table->size + load.num_ranges - 1) / load.num_ranges;
+    load.num_ranges = (table->size + load.buckets_per_range - 1) / load.buckets_per_range;
+    load.offsets = NULL;
+    load.range_start = NULL;
+    load.partitioned = NULL;
+    load.next_range = 0;
+
+    BulkWorker* workers = (BulkWorker*)calloc(num_threads, sizeof(BulkWorker));
+    if (workers == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        workers[i].load = &load;
+        workers[i].id = i;
+    }
+
+#ifdef CUCKOO_LOCKING
+    bulk_run(workers, num_threads, bulk_insert_slice);
+    int result = 0;
+#else
+    int result = bulk_partition(&load, workers);
+    if (result == 0) {
+        bulk_run(workers, num_threads, bulk_build);
+    }
+    bulk_release(&load, workers);
 #endif
 
-    return 0;
+    for (int i = 0; result >= 0 && i < num_threads; ++i) {
+        result += workers[i].loaded;
+
+        // The threads were the caller's helpers, so the caller reports their changes
+        ChainStats* sink = chain_sink;
+        if (sink != NULL) {
+            for (int length = 0; length < CHAIN_LENGTH_CLASSES; ++length) {
+                int64_t* bucket = &sink->buckets[length];
+                __atomic_store_n(bucket, *bucket + workers[i].chains.buckets[length], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    free(workers);
+    if (table->cache != NULL && result > 0) {
+        table->cache->entries += result;
+        cache_evict(table);
+    }
+    return result;
 }
 
 void hashtable_print(HashTable* table) {
     assert(table != NULL);
 
+#ifdef CUCKOO_LOCKING
+    CuckooArray* array = table->cuckoo->array;
+    for (uint64_t b = 0; b <= array->mask; ++b) {
+        printf("bucket[%lu]:", b);
+        for (int i = 0; i < CUCKOO_SLOTS; ++i) {
+            int key = array->buckets[b].keys[i];
+            if (key == CUCKOO_EMPTY) {
+                printf(" -");
+            } else {
+                printf(" %d", key);
+            }
+        }
+        printf("\n");
+    }
+#else
     for (int i = 0; i < table->size; ++i) {
         printf("bucket[%d]->", i);
 
         Node* bucket = table->buckets[i];
         Node* curr = bucket->next;
         while (curr != NULL) {
+#ifdef UNROLLED_CHAINS
+            printf("[");
+            for (int k = 0; k < curr->count; ++k) {
+                printf(k == 0 ? "%d" : " %d", curr->keys[k]);
+            }
+            printf("]->");
+#else
             printf("[%d]->", curr->key);
+#endif
             curr = curr->next;
         }
         printf("(NULL)\n");
     }
+#endif
 }
 
 int hashtable_size(HashTable* table) {
+#ifdef CUCKOO_LOCKING
+    return cuckoo_size(table->cuckoo);
+#else
     int count = 0;
     for (int i = 0; i < table->size; ++i) {
         Node* curr = table->buckets[i]->next;
         while (curr != NULL) {
+#ifdef UNROLLED_CHAINS
+            count += curr->count;
+#else
             ++count;
+#endif
             curr = curr->next;
         }
     }
     return count;
+#endif
+}
+
+int hashtable_keys(HashTable* table, int* keys, int max) {
+#ifdef CUCKOO_LOCKING
+    return cuckoo_keys(table->cuckoo, keys, max);
+#else
+    int count = 0;
+    for (int i = 0; i < table->size; ++i) {
+        for (Node* curr = table->buckets[i]->next; curr != NULL; curr = curr->next) {
+#ifdef UNROLLED_CHAINS
+            for (int k = 0; k < curr->count && count < max; ++k) {
+                keys[count++] = curr->keys[k];
+            }
+#else
+            if (count < max) {
+                keys[count++] = curr->key;
+            }
+#endif
+        }
+    }
+    return count;
+#endif
+}
+
+const char* hashtable_policy_name(void) {
+#ifdef CUCKOO_LOCKING
+    return "cuckoo";
+#elif UNROLLED_LOCKING
+    return "unrolled";
+#elif BRAVO_LOCKING
+    return "bravo";
+#elif BUCKET_LOCKING
+    return "bucket";
+#elif CHAIN_LOCKING
+    return "chain";
+#elif OPTIMISTIC_LOCKING
+    return "optimistic";
+#else
+    return "none";
+#endif
+}
+
+void hashtable_stats(HashTable* table, HashTableStats* stats) {
+    assert(table != NULL);
+    assert(stats != NULL);
+
+    memset(stats, 0, sizeof(HashTableStats));
+    if (table->hotcache != NULL) {
+        stats->hotcache_hits = counter_read(&table->hotcache->hits);
+        stats->hotcache_misses = counter_read(&table->hotcache->misses);
+    }
+    stats->filter_skips = counter_read(&table->filter_skips);
+    stats->filter_false_positives = counter_read(&table->filter_false_positives);
+    stats->index_builds = counter_read(&table->index_builds);
+    stats->index_drops = counter_read(&table->index_drops);
+    stats->gate_retries = counter_read(&table->gate_retries);
+    stats->applies = counter_read(&table->applies);
+    stats->rollbacks = counter_read(&table->rollbacks);
+    if (table->cache != NULL) {
+        stats->cache_evictions = counter_read(&table->cache->evictions);
+        stats->cache_expirations = counter_read(&table->cache->expirations);
+    }
+
+#ifdef OPTIMISTIC_LOCKING
+    stats->validation_failures = counter_read(&table->validation_failures);
+    stats->retries = counter_read(&table->retries);
+    stats->fallbacks = counter_read(&table->fallbacks);
+#endif
+
+#ifdef SEQLOCK_READERS
+    stats->read_failures = counter_read(&table->read_failures);
+    stats->read_fallbacks = counter_read(&table->read_fallbacks);
+#endif
+
+#ifdef CUCKOO_LOCKING
+    stats->cuckoo_displacements = counter_read(&table->cuckoo->displacements);
+    stats->cuckoo_path_aborts = counter_read(&table->cuckoo->path_aborts);
+    stats->cuckoo_read_retries = counter_read(&table->cuckoo->read_retries);
+    stats->cuckoo_resizes = __atomic_load_n(&table->cuckoo->resizes, __ATOMIC_RELAXED);
+#endif
+}
+
+void hashtable_stats_print(FILE* out, HashTable* table) {
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+
+    if (table->hotcache != NULL) {
+        uint64_t accesses = stats.hotcache_hits + stats.hotcache_misses;
+        fprintf(out, "Hot-key cache hits: %lu / %lu (%.2f%%)\n", stats.hotcache_hits, accesses,
+                accesses == 0 ? 0.0 : 100.0 * stats.hotcache_hits / accesses);
+    }
+
+    if (table->filters != NULL) {
+        // Every miss is either skipped or a false positive
+        uint64_t misses = stats.filter_skips + stats.filter_false_positives;
+        fprintf(out, "Bucket filter skips: %lu / %lu misses, false positive rate: %.2f%%\n", stats.filter_skips, misses,
+                misses == 0 ? 0.0 : 100.0 * stats.filter_false_positives / misses);
+    }
+
+    if (table->gates != NULL) {
+        fprintf(out, "Atomic groups applied: %lu, rolled back: %lu, gated lookup retries: %lu\n", stats.applies,
+                stats.rollbacks, stats.gate_retries);
+    }
+
+    if (table->cache != NULL) {
+        CacheMode* cache = table->cache;
+        double seconds = cache_now(cache) / 1000.0;
+        fprintf(out, "Cache keys: %ld / ", __atomic_load_n(&cache->entries, __ATOMIC_RELAXED));
+        if (cache->capacity == INT64_MAX) {
+            fprintf(out, "uncapped");
+        } else {
+            fprintf(out, "%ld", cache->capacity);
+        }
+        fprintf(out, ", evictions: %lu (%.0f/s), expirations: %lu (%.0f/s)\n", stats.cache_evictions,
+                stats.cache_evictions / seconds, stats.cache_expirations, stats.cache_expirations / seconds);
+    }
+
+    if (table->indexes != NULL) {
+        fprintf(out, "Chain indexes built: %lu, dropped: %lu\n", stats.index_builds, stats.index_drops);
+    }
+
+#ifdef OPTIMISTIC_LOCKING
+    fprintf(out, "Optimistic validation failures: %lu, retries: %lu, fallbacks to lock coupling: %lu\n",
+            stats.validation_failures, stats.retries, stats.fallbacks);
+#endif
+
+#ifdef SEQLOCK_READERS
+    fprintf(out, "Lock-free lookup validation failures: %lu, fallbacks to the read lock: %lu\n", stats.read_failures,
+            stats.read_fallbacks);
+#endif
+
+#ifdef CUCKOO_LOCKING
+    fprintf(out, "Cuckoo displacements: %lu, aborted paths: %lu, lookup retries: %lu, resizes: %lu, load: %.2f\n",
+            stats.cuckoo_displacements, stats.cuckoo_path_aborts, stats.cuckoo_read_retries, stats.cuckoo_resizes,
+            (double)cuckoo_size(table->cuckoo) / cuckoo_capacity(table->cuckoo));
+#endif
 }
 
 #ifdef OPTIMISTIC_LOCKING
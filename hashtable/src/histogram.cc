@@ -0,0 +1,158 @@
+#include "histogram.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HALF_SUB_BUCKETS (1 << (HISTOGRAM_SUB_BITS - 1))
+
+static int bucket_of(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    int shift = msb - HISTOGRAM_SUB_BITS + 1;
+    return shift * HALF_SUB_BUCKETS + (int)(value >> shift);
+}
+
+static uint64_t lower_bound_of(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = bucket / HALF_SUB_BUCKETS - 1;
+    uint64_t sub = bucket - shift * HALF_SUB_BUCKETS;
+    return sub << shift;
+}
+
+static uint64_t upper_bound_of(int bucket) {
+    if (bucket == HISTOGRAM_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+    return lower_bound_of(bucket + 1) - 1;
+}
+
+void histogram_init(Histogram* hist) {
+    memset(hist, 0, sizeof(Histogram));
+    hist->min = UINT64_MAX;
+}
+
+void histogram_record(Histogram* hist, uint64_t value) {
+    hist->counts[bucket_of(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void histogram_merge(Histogram* dst, const Histogram* src) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t histogram_percentile(const Histogram* hist, double percentile) {
+    assert(percentile >= 0.0 && percentile <= 100.0);
+
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(hist->count * percentile / 100.0 + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            // Report the bucket's upper bound, but never more than the largest value recorded
+            uint64_t value = upper_bound_of(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+double histogram_mean(const Histogram* hist) { return hist->count == 0 ? 0.0 : (double)hist->sum / hist->count; }
+
+void histogram_print_header(FILE* out) {
+    fprintf(out, "%-24s %12s %10s %10s %10s %10s %10s %10s\n", "latency (ns)", "count", "mean", "p50", "p90", "p99",
+            "p99.9", "max");
+}
+
+void histogram_print_summary(FILE* out, const Histogram* hist, const char* name) {
+    fprintf(out, "%-24s %12lu %10.1f %10lu %10lu %10lu %10lu %10lu\n", name, hist->count, histogram_mean(hist),
+            histogram_percentile(hist, 50.0), histogram_percentile(hist, 90.0), histogram_percentile(hist, 99.0),
+            histogram_percentile(hist, 99.9), hist->max);
+}
+
+void histogram_write_csv(FILE* out, const Histogram* hist, const char* name) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (hist->counts[i] != 0) {
+            fprintf(out, "%s,%lu,%lu,%lu\n", name, lower_bound_of(i), upper_bound_of(i), hist->counts[i]);
+        }
+    }
+}
+
+void histogram_write_json(FILE* out, const Histogram* hist, const char* name) {
+    fprintf(out,
+            "{\"name\":\"%s\",\"count\":%lu,\"mean\":%.1f,\"min\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,"
+            "\"p999\":%lu,\"max\":%lu,\"buckets\":[",
+            name, hist->count, histogram_mean(hist), hist->count == 0 ? 0 : hist->min,
+            histogram_percentile(hist, 50.0), histogram_percentile(hist, 90.0), histogram_percentile(hist, 99.0),
+            histogram_percentile(hist, 99.9), hist->max);
+
+    bool first = true;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (hist->counts[i] != 0) {
+            fprintf(out, "%s[%lu,%lu,%lu]", first ? "" : ",", lower_bound_of(i), upper_bound_of(i), hist->counts[i]);
+            first = false;
+        }
+    }
+    fprintf(out, "]}");
+}
+
+int histogram_export(const char* path, const Histogram* hists, const char* const* names, int num_hists) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0) {
+        fprintf(out, "[");
+        for (int i = 0; i < num_hists; ++i) {
+            fprintf(out, "%s", i == 0 ? "" : ",\n");
+            histogram_write_json(out, &hists[i], names[i]);
+        }
+        fprintf(out, "]\n");
+    } else {
+        fprintf(out, "name,lower_ns,upper_ns,count\n");
+        for (int i = 0; i < num_hists; ++i) {
+            histogram_write_csv(out, &hists[i], names[i]);
+        }
+    }
+
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,241 @@
+#include "hotcache.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESET_CHECK_INTERVAL (256)
+
+static thread_local uint32_t reset_countdown = RESET_CHECK_INTERVAL;
+
+static uint64_t mix(int key, uint64_t seed) {
+    uint64_t x = (uint32_t)key + seed * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int next_power_of_two(int n) {
+    int p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static HotCacheSet* set_of(HotCache* cache, int key) { return &cache->sets[mix(key, 0) & (cache->num_sets - 1)]; }
+
+static void lock_set(HotCacheSet* set) {
+    while (true) {
+        uint32_t seq = __atomic_load_n(&set->seq, __ATOMIC_RELAXED);
+        if (seq % 2 == 0 && __sync_bool_compare_and_swap(&set->seq, seq, seq + 1)) {
+            return;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+static void unlock_set(HotCacheSet* set) { __atomic_store_n(&set->seq, set->seq + 1, __ATOMIC_RELEASE); }
+
+// The counters of a key live in one cache line of the sketch, one byte per row.
+static uint8_t* sketch_block(HotCache* cache, int key, uint64_t* hash) {
+    *hash = mix(key, 1);
+    return &cache->sketch[(*hash & (cache->sketch_blocks - 1)) * CACHE_LINE_SIZE];
+}
+
+static uint8_t* sketch_counter(uint8_t* block, uint64_t hash, int row) {
+    return &block[(hash >> (16 + 6 * row)) & (CACHE_LINE_SIZE - 1)];
+}
+
+static int estimate(HotCache* cache, int key) {
+    uint64_t hash;
+    uint8_t* block = sketch_block(cache, key, &hash);
+
+    int freq = HOTCACHE_MAX_FREQUENCY;
+    for (int row = 0; row < HOTCACHE_SKETCH_DEPTH; ++row) {
+        int value = __atomic_load_n(sketch_counter(block, hash, row), __ATOMIC_RELAXED);
+        if (value < freq) {
+            freq = value;
+        }
+    }
+    return freq;
+}
+
+// Halve every counter so that the sketch forgets keys that are no longer hot.
+static void age_sketch(HotCache* cache) {
+    int num_counters = cache->sketch_blocks * CACHE_LINE_SIZE;
+    for (int i = 0; i < num_counters; ++i) {
+        __atomic_store_n(&cache->sketch[i], __atomic_load_n(&cache->sketch[i], __ATOMIC_RELAXED) / 2,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+// Count an access with conservative update and return the new estimate.
+static int record_access(HotCache* cache, int key) {
+    int freq = estimate(cache, key);
+    if (freq < HOTCACHE_MAX_FREQUENCY) {
+        // Saturated counters are only read, so hot keys do not keep writing the same lines
+        uint64_t hash;
+        uint8_t* block = sketch_block(cache, key, &hash);
+        for (int row = 0; row < HOTCACHE_SKETCH_DEPTH; ++row) {
+            uint8_t* counter = sketch_counter(block, hash, row);
+            if (__atomic_load_n(counter, __ATOMIC_RELAXED) == freq) {
+                __atomic_store_n(counter, freq + 1, __ATOMIC_RELAXED);
+            }
+        }
+        ++freq;
+    }
+
+    counter_add(&cache->accesses, 1);
+    if (--reset_countdown == 0) {
+        reset_countdown = RESET_CHECK_INTERVAL;
+
+        uint64_t next_reset = __atomic_load_n(&cache->next_reset, __ATOMIC_RELAXED);
+        if (counter_read(&cache->accesses) >= next_reset &&
+            __sync_bool_compare_and_swap(&cache->next_reset, next_reset, next_reset + cache->sample_size)) {
+            age_sketch(cache);
+        }
+    }
+
+    return freq;
+}
+
+HotCache* hotcache_create(int capacity) {
+    assert(capacity > 0);
+
+    HotCache* cache = (HotCache*)malloc(sizeof(HotCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->num_sets = next_power_of_two((capacity + HOTCACHE_WAYS - 1) / HOTCACHE_WAYS);
+    cache->sets = (HotCacheSet*)aligned_alloc(CACHE_LINE_SIZE, sizeof(HotCacheSet) * cache->num_sets);
+    if (cache->sets == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    for (int i = 0; i < cache->num_sets; ++i) {
+        HotCacheSet* set = &cache->sets[i];
+        set->seq = 0;
+        set->epoch = 0;
+        for (int way = 0; way < HOTCACHE_WAYS; ++way) {
+            set->keys[way] = -1;
+            set->nodes[way] = NULL;
+        }
+    }
+
+    // About two counters per row and cached key
+    cache->sketch_blocks = next_power_of_two((capacity * 2 + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
+    cache->sketch = (uint8_t*)aligned_alloc(CACHE_LINE_SIZE, cache->sketch_blocks * CACHE_LINE_SIZE);
+    if (cache->sketch == NULL) {
+        free(cache->sets);
+        free(cache);
+        return NULL;
+    }
+
+    memset(cache->sketch, 0, cache->sketch_blocks * CACHE_LINE_SIZE);
+
+    cache->sample_size = (uint64_t)capacity * 10;
+    cache->next_reset = cache->sample_size;
+    counter_init(&cache->accesses);
+    counter_init(&cache->hits);
+    counter_init(&cache->misses);
+
+    return cache;
+}
+
+void hotcache_free(HotCache* cache) {
+    assert(cache != NULL);
+
+    free(cache->sketch);
+    free(cache->sets);
+    free(cache);
+}
+
+bool hotcache_lookup(HotCache* cache, int key, struct Node** node, uint32_t* epoch) {
+    HotCacheSet* set = set_of(cache, key);
+
+    uint32_t seq = __atomic_load_n(&set->seq, __ATOMIC_ACQUIRE);
+    *epoch = __atomic_load_n(&set->epoch, __ATOMIC_ACQUIRE);
+
+    if (seq % 2 == 0) {
+        for (int way = 0; way < HOTCACHE_WAYS; ++way) {
+            if (__atomic_load_n(&set->keys[way], __ATOMIC_RELAXED) == key) {
+                struct Node* found = __atomic_load_n(&set->nodes[way], __ATOMIC_RELAXED);
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&set->seq, __ATOMIC_RELAXED) == seq && found != NULL) {
+                    record_access(cache, key);
+                    counter_add(&cache->hits, 1);
+                    *node = found;
+                    return true;
+                }
+                break;
+            }
+        }
+    }
+
+    // A reader racing with a writer does not wait, it just walks the chain
+    counter_add(&cache->misses, 1);
+    return false;
+}
+
+void hotcache_admit(HotCache* cache, int key, struct Node* node, uint32_t epoch) {
+    int freq = record_access(cache, key);
+
+    HotCacheSet* set = set_of(cache, key);
+    lock_set(set);
+
+    if (set->epoch != epoch) {
+        // The key may have been deleted after the chain walk
+        unlock_set(set);
+        return;
+    }
+
+    int victim = -1;
+    int victim_freq = HOTCACHE_MAX_FREQUENCY + 1;
+    for (int way = 0; way < HOTCACHE_WAYS; ++way) {
+        if (set->keys[way] == key) {
+            unlock_set(set);
+            return;
+        }
+        if (set->keys[way] == -1) {
+            victim = way;
+            victim_freq = -1;
+        } else if (victim_freq != -1) {
+            int way_freq = estimate(cache, set->keys[way]);
+            if (way_freq < victim_freq) {
+                victim = way;
+                victim_freq = way_freq;
+            }
+        }
+    }
+
+    if (freq > victim_freq) {
+        __atomic_store_n(&set->keys[victim], key, __ATOMIC_RELAXED);
+        __atomic_store_n(&set->nodes[victim], node, __ATOMIC_RELAXED);
+    }
+
+    unlock_set(set);
+}
+
+void hotcache_invalidate(HotCache* cache, int key) {
+    HotCacheSet* set = set_of(cache, key);
+    lock_set(set);
+
+    __atomic_store_n(&set->epoch, set->epoch + 1, __ATOMIC_RELAXED);
+    for (int way = 0; way < HOTCACHE_WAYS; ++way) {
+        if (set->keys[way] == key) {
+            __atomic_store_n(&set->keys[way], -1, __ATOMIC_RELAXED);
+            __atomic_store_n(&set->nodes[way], NULL, __ATOMIC_RELAXED);
+        }
+    }
+
+    unlock_set(set);
+}
@@ -0,0 +1,162 @@
+#include "lockprof.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+thread_local int lockprof_countdown = 0;
+
+LockProfile* lockprof_create(int num_slots, int sample_every, const char* unit) {
+    if (num_slots <= 0 || sample_every <= 0) {
+        return NULL;
+    }
+
+    LockProfile* profile = (LockProfile*)malloc(sizeof(LockProfile));
+    if (profile == NULL) {
+        return NULL;
+    }
+    profile->slots = (LockSlot*)calloc(num_slots, sizeof(LockSlot));
+    if (profile->slots == NULL) {
+        free(profile);
+        return NULL;
+    }
+    profile->num_slots = num_slots;
+    profile->sample_every = sample_every;
+    profile->unit = unit;
+    return profile;
+}
+
+void lockprof_destroy(LockProfile* profile) {
+    free(profile->slots);
+    free(profile);
+}
+
+int lockprof_bin(uint64_t wait_ns) {
+    uint64_t scaled = wait_ns / LOCKPROF_FIRST_BIN_NS;
+    if (scaled == 0) {
+        return 0;
+    }
+    int bin = 64 - __builtin_clzll(scaled);
+    return bin < LOCKPROF_BINS ? bin : LOCKPROF_BINS - 1;
+}
+
+static inline uint64_t bin_upper_bound(int bin) {
+    return bin < LOCKPROF_BINS - 1 ? (uint64_t)LOCKPROF_FIRST_BIN_NS << bin : UINT64_MAX;
+}
+
+void lockprof_record(LockProfile* profile, int slot, LockMode mode, uint64_t wait_ns) {
+    if (slot < 0 || slot >= profile->num_slots) {
+        return;
+    }
+    LockSlot* s = &profile->slots[slot];
+    __atomic_fetch_add(&s->acquisitions[mode], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->wait_ns[mode], wait_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->bins[lockprof_bin(wait_ns)], 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t slot_acquisitions(const LockSlot* slot) {
+    return slot->acquisitions[LockRead] + slot->acquisitions[LockWrite];
+}
+
+static uint64_t slot_wait(const LockSlot* slot) { return slot->wait_ns[LockRead] + slot->wait_ns[LockWrite]; }
+
+uint64_t lockprof_percentile(const LockSlot* slot, double percentile) {
+    uint64_t count = 0;
+    for (int bin = 0; bin < LOCKPROF_BINS; ++bin) {
+        count += slot->bins[bin];
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int bin = 0; bin < LOCKPROF_BINS; ++bin) {
+        seen += slot->bins[bin];
+        if (seen >= rank) {
+            return bin_upper_bound(bin);
+        }
+    }
+    return UINT64_MAX;
+}
+
+void lockprof_total(const LockProfile* profile, LockSlot* total) {
+    memset(total, 0, sizeof(LockSlot));
+    for (int i = 0; i < profile->num_slots; ++i) {
+        const LockSlot* slot = &profile->slots[i];
+        for (int mode = 0; mode < LOCK_MODES; ++mode) {
+            total->acquisitions[mode] += slot->acquisitions[mode];
+            total->wait_ns[mode] += slot->wait_ns[mode];
+        }
+        for (int bin = 0; bin < LOCKPROF_BINS; ++bin) {
+            total->bins[bin] += slot->bins[bin];
+        }
+    }
+}
+
+int lockprof_hottest(const LockProfile* profile, int* slots, int max) {
+    // Insertion into the sorted top, the profile is read once at the end of a run
+    int n = 0;
+    for (int i = 0; i < profile->num_slots; ++i) {
+        uint64_t wait = slot_wait(&profile->slots[i]);
+        if (wait == 0 || (n == max && wait <= slot_wait(&profile->slots[slots[n - 1]]))) {
+            continue;
+        }
+        int j = n < max ? n++ : max - 1;
+        while (j > 0 && slot_wait(&profile->slots[slots[j - 1]]) < wait) {
+            slots[j] = slots[j - 1];
+            j--;
+        }
+        slots[j] = i;
+    }
+    return n;
+}
+
+static void print_bound(FILE* out, uint64_t bound) {
+    if (bound == UINT64_MAX) {
+        fprintf(out, "%10s", "inf");
+    } else {
+        fprintf(out, "%10lu", bound);
+    }
+}
+
+void lockprof_print(FILE* out, const LockProfile* profile, int top) {
+    LockSlot total;
+    lockprof_total(profile, &total);
+    const char* mode_names[LOCK_MODES] = {"read", "write"};
+
+    fprintf(out, "Lock waits, 1 in %d acquisitions sampled:\n", profile->sample_every);
+    fprintf(out, "%-8s %12s %12s\n", "mode", "sampled", "mean_ns");
+    for (int mode = 0; mode < LOCK_MODES; ++mode) {
+        uint64_t n = total.acquisitions[mode];
+        fprintf(out, "%-8s %12lu %12.1f\n", mode_names[mode], n, n == 0 ? 0.0 : (double)total.wait_ns[mode] / n);
+    }
+
+    fprintf(out, "%-12s %12s\n", "wait_ns <", "sampled");
+    for (int bin = 0; bin < LOCKPROF_BINS; ++bin) {
+        if (total.bins[bin] != 0) {
+            fprintf(out, "  ");
+            print_bound(out, bin_upper_bound(bin));
+            fprintf(out, " %12u\n", total.bins[bin]);
+        }
+    }
+
+    int* hottest = (int*)malloc(sizeof(int) * (top > 0 ? top : 1));
+    int n = hottest != NULL ? lockprof_hottest(profile, hottest, top) : 0;
+    fprintf(out, "Hottest %ss by total wait:\n", profile->unit);
+    fprintf(out, "%-8s %12s %12s %12s %10s %10s\n", profile->unit, "sampled", "total_us", "mean_ns", "p50_ns <",
+            "p99_ns <");
+    for (int i = 0; i < n; ++i) {
+        const LockSlot* slot = &profile->slots[hottest[i]];
+        uint64_t acquisitions = slot_acquisitions(slot);
+        fprintf(out, "%-8d %12lu %12.1f %12.1f ", hottest[i], acquisitions, slot_wait(slot) / 1000.0,
+                (double)slot_wait(slot) / acquisitions);
+        print_bound(out, lockprof_percentile(slot, 50));
+        fprintf(out, " ");
+        print_bound(out, lockprof_percentile(slot, 99));
+        fprintf(out, "\n");
+    }
+    free(hottest);
+}
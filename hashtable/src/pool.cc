@@ -0,0 +1,168 @@
+#include "pool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// The free list link of a freed object
+static inline void** link_of(void* object) { return (void**)object; }
+
+Pool* pool_create(size_t object_size, void (*init)(void*)) {
+    assert(object_size >= sizeof(void*));
+
+    Pool* pool = (Pool*)aligned_alloc(CACHE_LINE_SIZE, sizeof(Pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    // Keep the links aligned
+    pool->object_size = (object_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    pool->init = init;
+    for (int i = 0; i < COUNTER_STRIPES; ++i) {
+        pthread_mutex_init(&pool->stripes[i].lock, NULL);
+        pool->stripes[i].free_list = NULL;
+    }
+    pthread_mutex_init(&pool->slab_lock, NULL);
+    pool->slabs = NULL;
+
+    return pool;
+}
+
+static void destroy_slab(Pool* pool, PoolSlab* slab, void (*fini)(void*)) {
+    if (fini != NULL) {
+        for (int i = 0; i < POOL_SLAB_OBJECTS; ++i) {
+            fini(slab->objects + i * pool->object_size);
+        }
+    }
+    free(slab->objects);
+    free(slab);
+}
+
+typedef struct SlabShare {
+    Pool* pool;
+    void (*fini)(void*);
+    PoolSlab** slabs;
+    int begin;
+    int end;
+} SlabShare;
+
+static void* destroy_share(void* arg) {
+    SlabShare* share = (SlabShare*)arg;
+    for (int i = share->begin; i < share->end; ++i) {
+        destroy_slab(share->pool, share->slabs[i], share->fini);
+    }
+    return NULL;
+}
+
+void pool_destroy(Pool* pool, void (*fini)(void*)) { pool_destroy_parallel(pool, fini, 1); }
+
+void pool_destroy_parallel(Pool* pool, void (*fini)(void*), int num_threads) {
+    assert(pool != NULL);
+    assert(num_threads > 0);
+
+    int num_slabs = 0;
+    for (PoolSlab* slab = pool->slabs; slab != NULL; slab = slab->next) {
+        ++num_slabs;
+    }
+
+    // An array of the slabs to split, unless there is a single thread or no memory for it
+    PoolSlab** slabs = NULL;
+    if (num_threads > 1 && num_slabs > 1) {
+        slabs = (PoolSlab**)malloc(sizeof(PoolSlab*) * num_slabs);
+    }
+
+    if (slabs == NULL) {
+        PoolSlab* slab = pool->slabs;
+        while (slab != NULL) {
+            PoolSlab* next = slab->next;
+            destroy_slab(pool, slab, fini);
+            slab = next;
+        }
+    } else {
+        int i = 0;
+        for (PoolSlab* slab = pool->slabs; slab != NULL; slab = slab->next) {
+            slabs[i++] = slab;
+        }
+
+        if (num_threads > num_slabs) {
+            num_threads = num_slabs;
+        }
+        pthread_t threads[num_threads];
+        SlabShare shares[num_threads];
+        for (int t = 0; t < num_threads; ++t) {
+            shares[t] = {pool, fini, slabs, num_slabs * t / num_threads, num_slabs * (t + 1) / num_threads};
+            if (t > 0) {
+                pthread_create(&threads[t], NULL, destroy_share, &shares[t]);
+            }
+        }
+        destroy_share(&shares[0]);
+        for (int t = 1; t < num_threads; ++t) {
+            pthread_join(threads[t], NULL);
+        }
+        free(slabs);
+    }
+
+    for (int i = 0; i < COUNTER_STRIPES; ++i) {
+        pthread_mutex_destroy(&pool->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&pool->slab_lock);
+    free(pool);
+}
+
+// Carve a new slab, returns its first object and puts the others on the stripe's free list.
+// Must be called with the stripe locked.
+static void* pool_grow(Pool* pool, PoolStripe* stripe) {
+    PoolSlab* slab = (PoolSlab*)malloc(sizeof(PoolSlab));
+    if (slab == NULL) {
+        return NULL;
+    }
+    // Line aligned, so objects of a line's size never straddle two lines
+    slab->objects = (char*)aligned_alloc(CACHE_LINE_SIZE, pool->object_size * POOL_SLAB_OBJECTS);
+    if (slab->objects == NULL) {
+        free(slab);
+        return NULL;
+    }
+
+    for (int i = 0; i < POOL_SLAB_OBJECTS; ++i) {
+        void* object = slab->objects + i * pool->object_size;
+        if (pool->init != NULL) {
+            pool->init(object);
+        }
+        if (i > 0) {
+            *link_of(object) = stripe->free_list;
+            stripe->free_list = object;
+        }
+    }
+
+    pthread_mutex_lock(&pool->slab_lock);
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pthread_mutex_unlock(&pool->slab_lock);
+
+    return slab->objects;
+}
+
+void* pool_alloc(Pool* pool) {
+    PoolStripe* stripe = &pool->stripes[counter_stripe()];
+
+    pthread_mutex_lock(&stripe->lock);
+    void* object = stripe->free_list;
+    if (object != NULL) {
+        stripe->free_list = *link_of(object);
+    } else {
+        object = pool_grow(pool, stripe);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    return object;
+}
+
+void pool_free(Pool* pool, void* object) {
+    assert(object != NULL);
+
+    PoolStripe* stripe = &pool->stripes[counter_stripe()];
+
+    pthread_mutex_lock(&stripe->lock);
+    *link_of(object) = stripe->free_list;
+    stripe->free_list = object;
+    pthread_mutex_unlock(&stripe->lock);
+}
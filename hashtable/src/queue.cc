@@ -2,32 +2,78 @@
 
 #include <pthread.h>
 
-void init_queue(OperationQueue* queue) {
-    queue->front = 0;
-    queue->rear = 0;
+static void init_lane(OperationLane* lane) {
+    lane->front = 0;
+    lane->rear = 0;
     for (int i = 0; i < QUEUE_SIZE; ++i) {
-        queue->instructions[i].key = -1;
-        queue->instructions[i].flag = 0;
-        queue->instructions[i].type = Undefined;
+        lane->instructions[i].key = -1;
+        lane->instructions[i].flag = 0;
+        lane->instructions[i].type = Undefined;
+        lane->instructions[i].timestamp = 0;
+        lane->instructions[i].tag = 0;
+    }
+}
+
+void init_queue(OperationQueue* queue) {
+    for (int lane = 0; lane < QUEUE_LANES; ++lane) {
+        init_lane(&queue->lanes[lane]);
+    }
+    queue->split_lanes = false;
+    for (int i = 0; i < QUEUE_PENDING_STRIPES; ++i) {
+        queue->pending[i] = 0;
+    }
+    for (int i = 0; i < COMPOUND_MAILBOXES; ++i) {
+        queue->mailboxes[i].num_ops = 0;
+        queue->mailboxes[i].done = 0;
     }
     queue->is_ready = true;
 }
 
-void enqueue(OperationQueue* queue, int key, OperationType type) {
-    uint64_t seq = __sync_fetch_and_add(&queue->rear, 1);
+void queue_split_lanes(OperationQueue* queue) { queue->split_lanes = true; }
+
+static inline int* pending_of(OperationQueue* queue, int key) { return &queue->pending[key % QUEUE_PENDING_STRIPES]; }
+
+static inline int pending_count(int pending) { return pending & ~QUEUE_PENDING_LOOKUP_LANE; }
+
+// Count an operation of the key as pending, and pick its lane: the lane of the operations of its stripe still pending,
+// so it cannot overtake them, else the lookup lane for a lookup and the main lane for a write.
+static QueueLane claim_lane(OperationQueue* queue, int key, OperationType type) {
+    int* pending = pending_of(queue, key);
+    int old = __atomic_load_n(pending, __ATOMIC_RELAXED);
+    while (true) {
+        QueueLane lane;
+        int next;
+        if (pending_count(old) == 0) {
+            lane = type == Lookup ? LookupLane : MainLane;
+            next = (lane == LookupLane ? QUEUE_PENDING_LOOKUP_LANE : 0) | 1;
+        } else {
+            lane = old & QUEUE_PENDING_LOOKUP_LANE ? LookupLane : MainLane;
+            next = old + 1;
+        }
+        // Counted before it is published, so a later operation of the stripe sees it
+        if (__atomic_compare_exchange_n(pending, &old, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return lane;
+        }
+    }
+}
+
+static void lane_enqueue(OperationLane* lane, int key, OperationType type, uint64_t timestamp, uint32_t tag) {
+    uint64_t seq = __sync_fetch_and_add(&lane->rear, 1);
     int slot_idx = seq % QUEUE_SIZE;
     uint64_t round = seq / QUEUE_SIZE;
 
     while (true) {
-        uint64_t flag = queue->instructions[slot_idx].flag;
+        uint64_t flag = lane->instructions[slot_idx].flag;
         if (flag % 2 == 1) {  // queue is full
             pthread_yield();
         } else {
             if (flag / 2 == round) {  // for fairness
-                queue->instructions[slot_idx].key = key;
-                queue->instructions[slot_idx].type = type;
+                lane->instructions[slot_idx].key = key;
+                lane->instructions[slot_idx].type = type;
+                lane->instructions[slot_idx].timestamp = timestamp;
+                lane->instructions[slot_idx].tag = tag;
                 __sync_synchronize();
-                queue->instructions[slot_idx].flag++;
+                lane->instructions[slot_idx].flag++;
                 break;
             } else {
                 pthread_yield();
@@ -36,22 +82,75 @@ void enqueue(OperationQueue* queue, int key, OperationType type) {
     }
 }
 
+void enqueue(OperationQueue* queue, int key, OperationType type) { enqueue_at(queue, key, type, 0); }
+
+void enqueue_at(OperationQueue* queue, int key, OperationType type, uint64_t timestamp) {
+    enqueue_tagged(queue, key, type, timestamp, 0);
+}
+
+void enqueue_tagged(OperationQueue* queue, int key, OperationType type, uint64_t timestamp, uint32_t tag) {
+    QueueLane lane = queue->split_lanes ? claim_lane(queue, key, type) : MainLane;
+    lane_enqueue(&queue->lanes[lane], key, type, timestamp, tag);
+}
+
+void enqueue_compound(OperationQueue* queue, int mailbox, uint64_t timestamp) {
+    CompoundRequest* request = &queue->mailboxes[mailbox];
+    request->done = 0;
+
+    // The operations of the request stay pending in the main lane until it is answered. Lookups of its keys still
+    // pending in the lookup lane go first, so the request does not overtake them.
+    if (queue->split_lanes) {
+        for (int i = 0; i < request->num_ops && i < COMPOUND_MAX_OPS; ++i) {
+            int* pending = pending_of(queue, request->keys[i]);
+            int old = __atomic_load_n(pending, __ATOMIC_RELAXED);
+            while (true) {
+                if (pending_count(old) != 0 && (old & QUEUE_PENDING_LOOKUP_LANE)) {
+                    pthread_yield();
+                    old = __atomic_load_n(pending, __ATOMIC_RELAXED);
+                    continue;
+                }
+                int next = pending_count(old) + 1;
+                if (__atomic_compare_exchange_n(pending, &old, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    lane_enqueue(&queue->lanes[MainLane], mailbox, Compound, timestamp, 0);  // publishes the request with the slot
+
+    while (!__atomic_load_n(&request->done, __ATOMIC_ACQUIRE)) {
+        pthread_yield();
+    }
+
+    if (queue->split_lanes) {
+        for (int i = 0; i < request->num_ops && i < COMPOUND_MAX_OPS; ++i) {
+            __atomic_fetch_sub(pending_of(queue, request->keys[i]), 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void compound_complete(CompoundRequest* request) { __atomic_store_n(&request->done, 1, __ATOMIC_RELEASE); }
+
 Operation dequeue(OperationQueue* queue) {
-    uint64_t seq = __sync_fetch_and_add(&queue->front, 1);
+    OperationLane* lane = &queue->lanes[MainLane];
+    uint64_t seq = __sync_fetch_and_add(&lane->front, 1);
     int slot_idx = seq % QUEUE_SIZE;
     uint64_t round = seq / QUEUE_SIZE;
     Operation ret;
 
     while (true) {
-        uint64_t flag = queue->instructions[slot_idx].flag;
+        uint64_t flag = lane->instructions[slot_idx].flag;
         if (flag % 2 == 0) {  // queue is empty
             pthread_yield();
         } else {
             if (flag / 2 == round) {  // for fairness
-                ret.key = queue->instructions[slot_idx].key;
-                ret.type = queue->instructions[slot_idx].type;
+                ret.key = lane->instructions[slot_idx].key;
+                ret.type = lane->instructions[slot_idx].type;
+                ret.timestamp = lane->instructions[slot_idx].timestamp;
+                ret.tag = lane->instructions[slot_idx].tag;
                 __sync_synchronize();
-                queue->instructions[slot_idx].flag++;
+                lane->instructions[slot_idx].flag++;
                 break;
             } else {
                 pthread_yield();
@@ -62,9 +161,110 @@ Operation dequeue(OperationQueue* queue) {
     return ret;
 }
 
+// Claim the front slot only once its operation is published, so a consumer never waits on an empty lane.
+// Returns false if the lane is empty.
+static bool lane_try_dequeue(OperationLane* lane, Operation* op) {
+    while (true) {
+        int seq = __atomic_load_n(&lane->front, __ATOMIC_ACQUIRE);
+        Operation* slot = &lane->instructions[(uint64_t)seq % QUEUE_SIZE];
+        uint64_t flag = __atomic_load_n(&slot->flag, __ATOMIC_ACQUIRE);
+        if (flag % 2 == 0 || flag / 2 != (uint64_t)seq / QUEUE_SIZE) {
+            // Not published yet, or another consumer took the slot and the lane moved on
+            if (__atomic_load_n(&lane->front, __ATOMIC_RELAXED) != seq) {
+                continue;
+            }
+            return false;
+        }
+
+        if (__atomic_compare_exchange_n(&lane->front, &seq, seq + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            op->key = slot->key;
+            op->type = slot->type;
+            op->timestamp = slot->timestamp;
+            op->tag = slot->tag;
+            __sync_synchronize();
+            slot->flag++;
+            return true;
+        }
+    }
+}
+
+void lane_scheduler_init(LaneScheduler* scheduler, LanePolicy policy, int weight) {
+    scheduler->policy = policy;
+    scheduler->weight = weight > 0 ? weight : 1;
+    scheduler->credit = scheduler->weight;
+}
+
+// Try the lane the scheduler picks, then the other one. Returns false if both are empty.
+static bool try_dequeue_lanes(OperationQueue* queue, LaneScheduler* scheduler, Operation* op) {
+    // A write is due once the lookups used up their credit
+    bool lookups_first = scheduler->policy == LaneStrict || scheduler->credit > 0;
+    QueueLane first = lookups_first ? LookupLane : MainLane;
+    QueueLane second = lookups_first ? MainLane : LookupLane;
+
+    if (!lane_try_dequeue(&queue->lanes[first], op) && !lane_try_dequeue(&queue->lanes[second], op)) {
+        return false;
+    }
+
+    if (op->type == Lookup) {
+        scheduler->credit -= scheduler->credit > 0;
+    } else {
+        scheduler->credit = scheduler->weight;
+    }
+    return true;
+}
+
+Operation dequeue_lanes(OperationQueue* queue, LaneScheduler* scheduler) {
+    Operation op;
+    while (!try_dequeue_lanes(queue, scheduler, &op)) {
+        pthread_yield();
+    }
+    return op;
+}
+
+int dequeue_batch(OperationQueue* queue, LaneScheduler* scheduler, Operation* ops, int max) {
+    ops[0] = scheduler != NULL ? dequeue_lanes(queue, scheduler) : dequeue(queue);
+    int n = 1;
+    while (n < max && ops[n - 1].type != Compound) {
+        bool dequeued = scheduler != NULL ? try_dequeue_lanes(queue, scheduler, &ops[n])
+                                          : lane_try_dequeue(&queue->lanes[MainLane], &ops[n]);
+        if (!dequeued) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+void queue_complete(OperationQueue* queue, const Operation* op) {
+    if (queue->split_lanes && op->type != Compound) {
+        __atomic_fetch_sub(pending_of(queue, op->key), 1, __ATOMIC_RELEASE);
+    }
+}
+
 bool queue_is_empty(OperationQueue* queue) {
-    uint64_t front = __sync_fetch_and_add(&queue->front, 0);
-    uint64_t rear = __sync_fetch_and_add(&queue->rear, 0);
+    for (int lane = 0; lane < QUEUE_LANES; ++lane) {
+        uint64_t front = __sync_fetch_and_add(&queue->lanes[lane].front, 0);
+        uint64_t rear = __sync_fetch_and_add(&queue->lanes[lane].rear, 0);
+        if (front != rear) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    return front == rear;
+int queue_lane_occupancy(OperationQueue* queue, QueueLane lane) {
+    int front = __atomic_load_n(&queue->lanes[lane].front, __ATOMIC_RELAXED);
+    int rear = __atomic_load_n(&queue->lanes[lane].rear, __ATOMIC_RELAXED);
+
+    // Consumers waiting on an empty queue push front past rear
+    return rear > front ? rear - front : 0;
+}
+
+int queue_occupancy(OperationQueue* queue) {
+    int occupancy = 0;
+    for (int lane = 0; lane < QUEUE_LANES; ++lane) {
+        occupancy += queue_lane_occupancy(queue, (QueueLane)lane);
+    }
+    return occupancy;
 }
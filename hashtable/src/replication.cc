@@ -0,0 +1,620 @@
+#include "replication.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+#define REPL_LOG_MAGIC (0x48544c4f47000001ULL)       // "HTLOG", version 1
+#define REPL_SNAPSHOT_MAGIC (0x4854534e41500001ULL)  // "HTSNAP", version 1
+
+typedef struct SnapshotHeader {
+    uint64_t magic;
+    uint64_t epoch;
+    uint64_t lsn;  // the keys hold the writes of every LSN before
+    int64_t num_keys;
+} SnapshotHeader;
+
+static inline int stripe_of(int key) { return (int)(((uint32_t)key * 0x9e3779b9U) >> 20) & (REPL_STRIPES - 1); }
+
+static bool apply_record(HashTable* table, int key, int type) {
+    if (type == Insert) {
+        return hashtable_insert(table, key) != NULL;
+    }
+    return hashtable_delete(table, key) == 0;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Snapshot files
+ */
+
+// Written next to the path and renamed over it, so a follower reading the previous snapshot keeps reading it
+static int write_snapshot(const char* path, uint64_t epoch, uint64_t lsn, const int* keys, int64_t num_keys) {
+    char tmp_path[REPL_SNAPSHOT_PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    SnapshotHeader header = {REPL_SNAPSHOT_MAGIC, epoch, lsn, num_keys};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   (num_keys == 0 || fwrite(keys, sizeof(int), num_keys, file) == (size_t)num_keys);
+    written = fclose(file) == 0 && written;
+    if (!written || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// The caller frees the keys
+static int read_snapshot(const char* path, SnapshotHeader* header, int** keys) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    if (fread(header, sizeof(*header), 1, file) != 1 || header->magic != REPL_SNAPSHOT_MAGIC ||
+        header->num_keys < 0 || header->num_keys > INT_MAX) {
+        fclose(file);
+        return -1;
+    }
+
+    *keys = (int*)malloc(sizeof(int) * (header->num_keys > 0 ? header->num_keys : 1));
+    if (*keys == NULL || (int64_t)fread(*keys, sizeof(int), header->num_keys, file) != header->num_keys) {
+        free(*keys);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Log
+ */
+
+void repl_log_init(ReplLog* log) {
+    assert(log != NULL);
+
+    memset(log, 0, sizeof(ReplLog));
+    log->epoch = 1;
+    __atomic_store_n(&log->magic, REPL_LOG_MAGIC, __ATOMIC_RELEASE);
+}
+
+ReplLog* repl_log_open(void) {
+    int shm_fd = shm_open(REPL_SHM_ID, O_CREAT | O_RDWR, 0666);
+    if (shm_fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(shm_fd, &st) != 0 || ((size_t)st.st_size < sizeof(ReplLog) && ftruncate(shm_fd, sizeof(ReplLog)) != 0)) {
+        close(shm_fd);
+        return NULL;
+    }
+
+    void* area = mmap(NULL, sizeof(ReplLog), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (area == MAP_FAILED) {
+        return NULL;
+    }
+
+    // A log left by a previous primary is recovered, see repl_primary_open()
+    ReplLog* log = (ReplLog*)area;
+    if (__atomic_load_n(&log->magic, __ATOMIC_ACQUIRE) != REPL_LOG_MAGIC) {
+        repl_log_init(log);
+    }
+    return log;
+}
+
+ReplLog* repl_log_attach(void) {
+    int shm_fd = shm_open(REPL_SHM_ID, O_RDWR, 0666);
+    if (shm_fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(shm_fd, &st) != 0 || (size_t)st.st_size < sizeof(ReplLog)) {
+        close(shm_fd);
+        return NULL;
+    }
+
+    void* area = mmap(NULL, sizeof(ReplLog), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (area == MAP_FAILED) {
+        return NULL;
+    }
+
+    ReplLog* log = (ReplLog*)area;
+    if (__atomic_load_n(&log->magic, __ATOMIC_ACQUIRE) != REPL_LOG_MAGIC) {
+        munmap(area, sizeof(ReplLog));
+        return NULL;
+    }
+    return log;
+}
+
+void repl_log_detach(ReplLog* log) { munmap(log, sizeof(ReplLog)); }
+
+static void log_append(ReplLog* log, int key, OperationType type) {
+    uint64_t lsn = __atomic_fetch_add(&log->head, 1, __ATOMIC_RELAXED);
+    ReplRecord* slot = &log->records[lsn & (REPL_LOG_RECORDS - 1)];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->time, timer_now(), __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->type, (int)type, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, lsn + 1, __ATOMIC_RELEASE);
+}
+
+ReplRead repl_log_read(const ReplLog* log, uint64_t lsn, ReplRecord* record) {
+    assert(log != NULL);
+    assert(record != NULL);
+
+    const ReplRecord* slot = &log->records[lsn & (REPL_LOG_RECORDS - 1)];
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq != lsn + 1) {
+        // A later LSN took the slot, or is being written into it after the ring went around
+        if (seq > lsn + 1 || __atomic_load_n(&log->head, __ATOMIC_RELAXED) - lsn > REPL_LOG_RECORDS) {
+            return ReplReadOverrun;
+        }
+        return ReplReadPending;
+    }
+
+    record->time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+    record->key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED);
+    record->type = __atomic_load_n(&slot->type, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        return ReplReadOverrun;
+    }
+    record->seq = seq;
+    return ReplReadOk;
+}
+
+/*
+ * Primary
+ */
+
+static void* service_func(void* arg) {
+    ReplPrimary* primary = (ReplPrimary*)arg;
+    ReplLog* log = primary->log;
+
+    while (!__atomic_load_n(&primary->stop, __ATOMIC_ACQUIRE)) {
+        usleep(REPL_POLL_US);
+
+        // A snapshot every half ring keeps the records after the last one in the ring, for a restart
+        uint64_t head = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+        bool asked = __atomic_load_n(&log->snapshot_requests, __ATOMIC_ACQUIRE) !=
+                     __atomic_load_n(&log->snapshot_served, __ATOMIC_RELAXED);
+        if (asked || head - log->snapshot_lsn >= REPL_LOG_RECORDS / 2) {
+            repl_primary_snapshot(primary);
+        }
+
+        if (primary->stats != NULL) {
+            __atomic_store_n(&primary->stats->repl_head, head, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the LSN it stopped at, the head unless a record is missing
+static uint64_t replay(ReplPrimary* primary, uint64_t lsn) {
+    ReplLog* log = primary->log;
+    ReplRecord record;
+    while (lsn < log->head && repl_log_read(log, lsn, &record) == ReplReadOk) {
+        apply_record(primary->table, record.key, record.type);
+        ++primary->replayed;
+        ++lsn;
+    }
+    return lsn;
+}
+
+int repl_primary_open(ReplPrimary* primary, ReplLog* log, HashTable* table, const char* snapshot_path,
+                      ServerStats* stats) {
+    assert(primary != NULL);
+    assert(log != NULL);
+    assert(table != NULL);
+    assert(snapshot_path != NULL);
+
+    // Followers run elsewhere, so a relative path is resolved here
+    char cwd[REPL_SNAPSHOT_PATH_MAX];
+    int length = snapshot_path[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL
+                     ? snprintf(log->snapshot_path, sizeof(log->snapshot_path), "%s", snapshot_path)
+                     : snprintf(log->snapshot_path, sizeof(log->snapshot_path), "%s/%s", cwd, snapshot_path);
+    if (length >= REPL_SNAPSHOT_PATH_MAX) {
+        return -1;
+    }
+
+    primary->log = log;
+    primary->table = table;
+    primary->stats = stats;
+    for (int i = 0; i < REPL_STRIPES; ++i) {
+        pthread_mutex_init(&primary->stripes[i], NULL);
+    }
+    primary->recovered = 0;
+    primary->replayed = 0;
+    primary->new_epoch = false;
+    primary->snapshots = 0;
+    primary->serving = false;
+    primary->stop = false;
+
+    // Recover from the snapshot of the log's history and the records after it, else from the whole ring
+    uint64_t lsn = 0;
+    bool recovered_all = true;
+    SnapshotHeader header;
+    int* keys;
+    if (read_snapshot(log->snapshot_path, &header, &keys) == 0) {
+        primary->recovered = hashtable_bulk_load(table, keys, (int)header.num_keys, 1);
+        free(keys);
+        if (primary->recovered < 0) {
+            return -1;
+        }
+        lsn = header.lsn;
+        recovered_all = header.epoch == log->epoch && header.lsn <= log->head;
+    }
+    uint64_t head = log->head;
+    if (recovered_all) {
+        lsn = replay(primary, lsn);
+        recovered_all = lsn == head;
+    }
+
+    // Followers may have applied records that are gone, a new epoch makes them resynchronize. The records left past
+    // the cut are cleared first, so that no follower takes them for new ones.
+    if (!recovered_all) {
+        uint64_t cut = lsn < head ? lsn : head;
+        for (uint64_t i = cut; i < head && i - cut < REPL_LOG_RECORDS; ++i) {
+            __atomic_store_n(&log->records[i & (REPL_LOG_RECORDS - 1)].seq, 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&log->head, cut, __ATOMIC_RELAXED);
+        __atomic_store_n(&log->epoch, log->epoch + 1, __ATOMIC_RELEASE);
+        primary->new_epoch = true;
+    }
+
+    __atomic_store_n(&log->primary_running, true, __ATOMIC_RELEASE);
+    if (stats != NULL) {
+        stats->repl_role = RolePrimary;
+        stats->repl_head = log->head;
+    }
+
+    if (repl_primary_snapshot(primary) != 0) {
+        __atomic_store_n(&log->primary_running, false, __ATOMIC_RELEASE);
+        return -1;
+    }
+    if (pthread_create(&primary->service, NULL, service_func, primary) != 0) {
+        __atomic_store_n(&log->primary_running, false, __ATOMIC_RELEASE);
+        return -1;
+    }
+    primary->serving = true;
+    return 0;
+}
+
+int repl_primary_close(ReplPrimary* primary) {
+    assert(primary != NULL);
+
+    if (primary->serving) {
+        __atomic_store_n(&primary->stop, true, __ATOMIC_RELEASE);
+        pthread_join(primary->service, NULL);
+        primary->serving = false;
+    }
+
+    int result = repl_primary_snapshot(primary);
+    __atomic_store_n(&primary->log->primary_running, false, __ATOMIC_RELEASE);
+    if (primary->stats != NULL) {
+        __atomic_store_n(&primary->stats->repl_head, primary->log->head, __ATOMIC_RELAXED);
+    }
+
+    for (int i = 0; i < REPL_STRIPES; ++i) {
+        pthread_mutex_destroy(&primary->stripes[i]);
+    }
+    return result;
+}
+
+bool repl_primary_write(ReplPrimary* primary, int key, OperationType type) {
+    assert(type == Insert || type == Delete);
+
+    pthread_mutex_t* stripe = &primary->stripes[stripe_of(key)];
+    pthread_mutex_lock(stripe);
+    bool succeeded = apply_record(primary->table, key, type);
+    if (succeeded) {
+        log_append(primary->log, key, type);
+    }
+    pthread_mutex_unlock(stripe);
+    return succeeded;
+}
+
+bool repl_primary_apply(ReplPrimary* primary, const int* keys, const OperationType* types, int n, bool all_or_nothing,
+                        bool* succeeded) {
+    assert(n >= 0 && n <= HASHTABLE_APPLY_MAX_OPS);
+
+    // The stripes of the writes in ascending order, like the gates
+    int stripes[HASHTABLE_APPLY_MAX_OPS];
+    int num_stripes = 0;
+    for (int i = 0; i < n; ++i) {
+        if (types[i] == Lookup) {
+            continue;
+        }
+        int stripe = stripe_of(keys[i]);
+        int j = num_stripes;
+        while (j > 0 && stripes[j - 1] > stripe) {
+            stripes[j] = stripes[j - 1];
+            --j;
+        }
+        if (j > 0 && stripes[j - 1] == stripe) {
+            memmove(&stripes[j], &stripes[j + 1], sizeof(int) * (num_stripes - j));
+            continue;
+        }
+        stripes[j] = stripe;
+        ++num_stripes;
+    }
+
+    for (int i = 0; i < num_stripes; ++i) {
+        pthread_mutex_lock(&primary->stripes[stripes[i]]);
+    }
+    bool applied = hashtable_apply(primary->table, keys, types, n, all_or_nothing, succeeded);
+    if (applied) {
+        for (int i = 0; i < n; ++i) {
+            if (types[i] != Lookup && succeeded[i]) {
+                log_append(primary->log, keys[i], types[i]);
+            }
+        }
+    }
+    for (int i = num_stripes - 1; i >= 0; --i) {
+        pthread_mutex_unlock(&primary->stripes[stripes[i]]);
+    }
+    return applied;
+}
+
+int repl_primary_snapshot(ReplPrimary* primary) {
+    assert(primary != NULL);
+
+    ReplLog* log = primary->log;
+    uint64_t requests = __atomic_load_n(&log->snapshot_requests, __ATOMIC_ACQUIRE);
+
+    // No write is in progress while every stripe is held, so the keys are exactly those of the head
+    for (int i = 0; i < REPL_STRIPES; ++i) {
+        pthread_mutex_lock(&primary->stripes[i]);
+    }
+    uint64_t lsn = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    int num_keys = hashtable_size(primary->table);
+    int* keys = (int*)malloc(sizeof(int) * (num_keys > 0 ? num_keys : 1));
+    if (keys != NULL) {
+        num_keys = hashtable_keys(primary->table, keys, num_keys);
+    }
+    for (int i = REPL_STRIPES - 1; i >= 0; --i) {
+        pthread_mutex_unlock(&primary->stripes[i]);
+    }
+    if (keys == NULL) {
+        return -1;
+    }
+
+    int result = write_snapshot(log->snapshot_path, log->epoch, lsn, keys, num_keys);
+    free(keys);
+    if (result != 0) {
+        return -1;
+    }
+
+    log->snapshot_lsn = lsn;
+    __atomic_store_n(&log->snapshot_served, requests, __ATOMIC_RELEASE);
+    ++primary->snapshots;
+    return 0;
+}
+
+/*
+ * Follower
+ */
+
+void repl_follower_init(ReplFollower* follower, ReplLog* log, HashTable* table, ServerStats* stats) {
+    assert(follower != NULL);
+    assert(log != NULL);
+    assert(table != NULL);
+
+    follower->log = log;
+    follower->table = table;
+    follower->stats = stats;
+    follower->snapshot_timeout_ms = REPL_SNAPSHOT_TIMEOUT_MS;
+    follower->epoch = 0;
+    follower->next = 0;
+    follower->applied = 0;
+    follower->resyncs = 0;
+    histogram_init(&follower->lag);
+    follower->applying = false;
+    follower->stop = false;
+
+    if (stats != NULL) {
+        stats->repl_role = RoleFollower;
+    }
+}
+
+// Ask a running primary for a fresh snapshot and wait for it, else the last one will do
+static void request_snapshot(ReplFollower* follower) {
+    ReplLog* log = follower->log;
+    if (!__atomic_load_n(&log->primary_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    uint64_t ticket = __atomic_add_fetch(&log->snapshot_requests, 1, __ATOMIC_ACQ_REL);
+    for (long waited_us = 0; waited_us < follower->snapshot_timeout_ms * 1000L; waited_us += REPL_POLL_US) {
+        if (__atomic_load_n(&log->snapshot_served, __ATOMIC_ACQUIRE) >= ticket) {
+            return;
+        }
+        usleep(REPL_POLL_US);
+    }
+}
+
+static void publish(ReplFollower* follower, uint64_t lag_ns) {
+    ServerStats* stats = follower->stats;
+    if (stats == NULL) {
+        return;
+    }
+    __atomic_store_n(&stats->repl_head, __atomic_load_n(&follower->log->head, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->repl_applied, follower->next, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->repl_lag_ns, lag_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->repl_resyncs, follower->resyncs, __ATOMIC_RELAXED);
+}
+
+int64_t repl_follower_bootstrap(ReplFollower* follower) {
+    assert(follower != NULL);
+
+    request_snapshot(follower);
+
+    SnapshotHeader header;
+    int* keys;
+    if (read_snapshot(follower->log->snapshot_path, &header, &keys) != 0) {
+        return -1;
+    }
+    int loaded = hashtable_bulk_load(follower->table, keys, (int)header.num_keys, 1);
+    free(keys);
+    if (loaded < 0) {
+        return -1;
+    }
+
+    follower->epoch = header.epoch;
+    follower->next = header.lsn;
+    publish(follower, 0);
+    return loaded;
+}
+
+// Turn the keys of the table into those of a snapshot, while the workers keep looking up
+static int resync(ReplFollower* follower) {
+    HashTable* table = follower->table;
+
+    request_snapshot(follower);
+
+    SnapshotHeader header;
+    int* keys;
+    if (read_snapshot(follower->log->snapshot_path, &header, &keys) != 0) {
+        return -1;
+    }
+    // The primary has not written a snapshot of its new epoch yet
+    if (header.epoch != __atomic_load_n(&follower->log->epoch, __ATOMIC_ACQUIRE)) {
+        free(keys);
+        return -1;
+    }
+
+    // The follower is the only writer of its table, so its keys can be listed
+    int num_current = hashtable_size(table);
+    int* current = (int*)malloc(sizeof(int) * (num_current > 0 ? num_current : 1));
+    if (current == NULL) {
+        free(keys);
+        return -1;
+    }
+    num_current = hashtable_keys(table, current, num_current);
+
+    int num_keys = (int)header.num_keys;
+    qsort(keys, num_keys, sizeof(int), compare_keys);
+    qsort(current, num_current, sizeof(int), compare_keys);
+    int i = 0;
+    int j = 0;
+    while (i < num_keys || j < num_current) {
+        if (j == num_current || (i < num_keys && keys[i] < current[j])) {
+            hashtable_insert(table, keys[i++]);
+        } else if (i == num_keys || current[j] < keys[i]) {
+            hashtable_delete(table, current[j++]);
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+    free(current);
+    free(keys);
+
+    follower->epoch = header.epoch;
+    follower->next = header.lsn;
+    ++follower->resyncs;
+    return 0;
+}
+
+int repl_follower_poll(ReplFollower* follower, int max_records) {
+    assert(follower != NULL);
+
+    ReplLog* log = follower->log;
+    if (__atomic_load_n(&log->epoch, __ATOMIC_ACQUIRE) != follower->epoch && resync(follower) != 0) {
+        return -1;
+    }
+
+    int applied = 0;
+    uint64_t lag_ns = 0;
+    ReplRecord record;
+    while (applied < max_records) {
+        ReplRead read = repl_log_read(log, follower->next, &record);
+        if (read == ReplReadPending) {
+            break;
+        }
+        if (read == ReplReadOverrun) {
+            if (resync(follower) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        apply_record(follower->table, record.key, record.type);
+        uint64_t now = timer_now();
+        lag_ns = now > record.time ? timer_ticks_to_ns(now - record.time) : 0;
+        histogram_record(&follower->lag, lag_ns);
+        ++follower->next;
+        ++follower->applied;
+        ++applied;
+    }
+
+    publish(follower, applied == max_records ? lag_ns : 0);
+    return applied;
+}
+
+uint64_t repl_follower_behind(const ReplFollower* follower) {
+    uint64_t head = __atomic_load_n(&follower->log->head, __ATOMIC_RELAXED);
+    return head > follower->next ? head - follower->next : 0;
+}
+
+static void* applier_func(void* arg) {
+    ReplFollower* follower = (ReplFollower*)arg;
+
+    while (!__atomic_load_n(&follower->stop, __ATOMIC_ACQUIRE)) {
+        int applied = repl_follower_poll(follower, REPL_APPLY_RECORDS);
+        if (applied <= 0) {
+            usleep(applied < 0 ? REPL_POLL_US : REPL_IDLE_US);
+        }
+    }
+
+    return NULL;
+}
+
+int repl_follower_start(ReplFollower* follower) {
+    assert(follower != NULL);
+    assert(!follower->applying);
+
+    follower->stop = false;
+    if (pthread_create(&follower->applier, NULL, applier_func, follower) != 0) {
+        return -1;
+    }
+    follower->applying = true;
+    return 0;
+}
+
+void repl_follower_stop(ReplFollower* follower) {
+    if (!follower->applying) {
+        return;
+    }
+
+    __atomic_store_n(&follower->stop, true, __ATOMIC_RELEASE);
+    pthread_join(follower->applier, NULL);
+    follower->applying = false;
+}
@@ -4,8 +4,13 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+static const char* shm_id = SHM_ID;
+
+void shm_set_id(const char* id) { shm_id = id; }
+
 void* shm_create(void) {
     size_t size = sizeof(SharedMem);
 
@@ -15,7 +20,7 @@ void* shm_create(void) {
     // Thus, do not specify MAP_ANONYMOUS flag.
     int visibility = MAP_SHARED;
 
-    int shm_fd = shm_open(SHM_ID, O_CREAT | O_RDWR, 0666);
+    int shm_fd = shm_open(shm_id, O_CREAT | O_RDWR, 0666);
     if (shm_fd == -1) {
         return NULL;
     }
@@ -34,18 +39,47 @@ void* shm_attach(void) {
     int protection = PROT_READ | PROT_WRITE;
     int visibility = MAP_SHARED;
 
-    int shm_fd = shm_open(SHM_ID, O_RDWR, 0666);
+    int shm_fd = shm_open(shm_id, O_RDWR, 0666);
     if (shm_fd == -1) {
         return NULL;
     }
 
+    // The creator might not have sized the area yet, touching it would fault
+    struct stat st;
+    if (fstat(shm_fd, &st) != 0 || (size_t)st.st_size < size) {
+        close(shm_fd);
+        return NULL;
+    }
+
     SharedMem* area = (SharedMem*)mmap(NULL, size, protection, visibility, shm_fd, 0);
     assert(area != MAP_FAILED);
 
     return area;
 }
 
+void* shm_attach_readonly(void) {
+    size_t size = sizeof(SharedMem);
+
+    int shm_fd = shm_open(shm_id, O_RDONLY, 0666);
+    if (shm_fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(shm_fd, &st) != 0 || (size_t)st.st_size < size) {
+        close(shm_fd);
+        return NULL;
+    }
+
+    void* area = mmap(NULL, size, PROT_READ, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+
+    return area != MAP_FAILED ? area : NULL;
+}
+
+void shm_detach(SharedMem* area) { munmap(area, sizeof(SharedMem)); }
+
 void shm_free(SharedMem* area) {
     munmap(area, sizeof(SharedMem));
-    shm_unlink(SHM_ID);
+    shm_unlink(shm_id);
 }
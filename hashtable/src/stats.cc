@@ -0,0 +1,39 @@
+#include "stats.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+void stats_init(ServerStats* stats, int num_buckets, const char* policy) {
+    assert(stats != NULL);
+
+    memset(stats, 0, sizeof(ServerStats));
+    stats->num_buckets = num_buckets;
+    snprintf(stats->policy, sizeof(stats->policy), "%s", policy);
+
+    // Every bucket starts with an empty chain
+    stats->chain_base[0] = num_buckets;
+}
+
+void stats_snapshot(const ServerStats* stats, StatsSnapshot* snapshot) {
+    assert(stats != NULL);
+    assert(snapshot != NULL);
+
+    memset(snapshot, 0, sizeof(StatsSnapshot));
+    memcpy(snapshot->chains, stats->chain_base, sizeof(snapshot->chains));
+
+    int num_workers = __atomic_load_n(&stats->num_workers, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < num_workers && i < STATS_MAX_WORKERS; ++i) {
+        const WorkerStats* worker = &stats->workers[i];
+        for (int type = 0; type < 3; ++type) {
+            snapshot->ops[type] += __atomic_load_n(&worker->ops[type], __ATOMIC_RELAXED);
+            snapshot->succeeded[type] += __atomic_load_n(&worker->succeeded[type], __ATOMIC_RELAXED);
+        }
+        for (int length = 0; length < CHAIN_LENGTH_CLASSES; ++length) {
+            snapshot->chains[length] += __atomic_load_n(&worker->chains.buckets[length], __ATOMIC_RELAXED);
+        }
+    }
+
+    snapshot->elements = (int64_t)snapshot->succeeded[Insert] - (int64_t)snapshot->succeeded[Delete];
+    snapshot->load_factor = stats->num_buckets == 0 ? 0.0 : (double)snapshot->elements / stats->num_buckets;
+}
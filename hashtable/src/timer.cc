@@ -0,0 +1,28 @@
+#include "timer.h"
+
+#define CALIBRATION_NS (20000000)  // 20 ms
+
+static double ns_per_tick = 1.0;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void timer_calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t begin_ns = monotonic_ns();
+    uint64_t begin_ticks = timer_now();
+
+    uint64_t end_ns;
+    do {
+        end_ns = monotonic_ns();
+    } while (end_ns - begin_ns < CALIBRATION_NS);
+    uint64_t end_ticks = timer_now();
+
+    ns_per_tick = (double)(end_ns - begin_ns) / (end_ticks - begin_ticks);
+#endif
+}
+
+uint64_t timer_ticks_to_ns(uint64_t ticks) { return (uint64_t)(ticks * ns_per_tick); }
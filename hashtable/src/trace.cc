@@ -0,0 +1,195 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        ptr += written;
+        size -= written;
+    }
+    return 0;
+}
+
+int trace_writer_open(TraceWriter* writer, const char* path, int num_workers) {
+    assert(writer != NULL);
+    assert(num_workers > 0);
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        return -1;
+    }
+
+    memset(&writer->header, 0, sizeof(TraceHeader));
+    memcpy(writer->header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    writer->header.version = TRACE_VERSION;
+    writer->header.num_workers = num_workers;
+    writer->failed = false;
+    pthread_mutex_init(&writer->lock, NULL);
+
+    // The counts are filled in at close, readers reject a trace whose counts do not match its chunks
+    if (write_all(writer->fd, &writer->header, sizeof(TraceHeader)) != 0) {
+        close(writer->fd);
+        return -1;
+    }
+
+    writer->start = timer_now();
+    return 0;
+}
+
+int trace_writer_close(TraceWriter* writer) {
+    assert(writer != NULL);
+
+    if (pwrite(writer->fd, &writer->header, sizeof(TraceHeader), 0) != (ssize_t)sizeof(TraceHeader)) {
+        writer->failed = true;
+    }
+    if (close(writer->fd) != 0) {
+        writer->failed = true;
+    }
+    pthread_mutex_destroy(&writer->lock);
+
+    return writer->failed ? -1 : 0;
+}
+
+void trace_buffer_init(TraceBuffer* buffer, TraceWriter* writer, int worker) {
+    assert(buffer != NULL);
+
+    buffer->writer = writer;
+    buffer->chunk.worker = worker;
+    buffer->chunk.num_records = 0;
+}
+
+void trace_buffer_flush(TraceBuffer* buffer) {
+    TraceWriter* writer = buffer->writer;
+    uint32_t num_records = buffer->chunk.num_records;
+    if (num_records == 0) {
+        return;
+    }
+
+    // The chunk header directly precedes the records, so the chunk goes out in one write
+    static_assert(offsetof(TraceBuffer, records) == offsetof(TraceBuffer, chunk) + sizeof(TraceChunk),
+                  "the chunk header must precede the records");
+    size_t size = sizeof(TraceChunk) + sizeof(TraceRecord) * num_records;
+
+    pthread_mutex_lock(&writer->lock);
+    if (!writer->failed) {
+        if (write_all(writer->fd, &buffer->chunk, size) == 0) {
+            writer->header.num_records += num_records;
+            writer->header.num_chunks++;
+        } else {
+            writer->failed = true;
+        }
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    buffer->chunk.num_records = 0;
+}
+
+void trace_record(TraceBuffer* buffer, const Operation* op, uint64_t now) {
+    uint64_t start = buffer->writer->start;
+    uint64_t arrival = op->timestamp != 0 ? op->timestamp : now;
+
+    TraceRecord* record = &buffer->records[buffer->chunk.num_records++];
+    record->time_ns = arrival > start ? timer_ticks_to_ns(arrival - start) : 0;
+    record->key = op->key;
+    record->type = op->type;
+
+    if (buffer->chunk.num_records == TRACE_BUFFER_RECORDS) {
+        trace_buffer_flush(buffer);
+    }
+}
+
+int trace_open(Trace* trace, const char* path) {
+    assert(trace != NULL);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    trace->data = (const char*)data;
+    trace->size = st.st_size;
+    trace->header = (const TraceHeader*)data;
+
+    const TraceHeader* header = trace->header;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header->version != TRACE_VERSION) {
+        trace_close(trace);
+        return -1;
+    }
+
+    // Walk the chunks once, so replaying never reads past the mapping
+    uint64_t num_records = 0, num_chunks = 0;
+    size_t offset = sizeof(TraceHeader);
+    while (offset < trace->size) {
+        if (trace->size - offset < sizeof(TraceChunk)) {
+            trace_close(trace);
+            return -1;
+        }
+        const TraceChunk* chunk = (const TraceChunk*)(trace->data + offset);
+        size_t size = sizeof(TraceChunk) + sizeof(TraceRecord) * (size_t)chunk->num_records;
+        if (chunk->num_records == 0 || chunk->worker >= header->num_workers || trace->size - offset < size) {
+            trace_close(trace);
+            return -1;
+        }
+        num_records += chunk->num_records;
+        num_chunks++;
+        offset += size;
+    }
+
+    if (num_records != header->num_records || num_chunks != header->num_chunks) {
+        trace_close(trace);
+        return -1;
+    }
+
+    return 0;
+}
+
+void trace_close(Trace* trace) {
+    munmap((void*)trace->data, trace->size);
+    trace->data = NULL;
+    trace->header = NULL;
+    trace->size = 0;
+}
+
+const TraceChunk* trace_first_chunk(const Trace* trace) {
+    if (trace->size == sizeof(TraceHeader)) {
+        return NULL;
+    }
+    return (const TraceChunk*)(trace->data + sizeof(TraceHeader));
+}
+
+const TraceChunk* trace_next_chunk(const Trace* trace, const TraceChunk* chunk) {
+    const char* next = (const char*)(trace_chunk_records(chunk) + chunk->num_records);
+    if (next >= trace->data + trace->size) {
+        return NULL;
+    }
+    return (const TraceChunk*)next;
+}
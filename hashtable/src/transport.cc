@@ -0,0 +1,426 @@
+#include "transport.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+#define LISTEN_EVENT (UINT32_MAX)    // epoll data of the listening socket, the connections use their index
+#define WAKE_EVENT (UINT32_MAX - 1)  // epoll data of the eventfd
+#define EPOLL_EVENTS (64)
+#define EPOLL_TIMEOUT_MS (100)  // bounds the time the loop takes to notice a stop
+#define IN_BYTES (TRANSPORT_WINDOW * sizeof(WireRequest))
+
+static inline uint32_t slot_of(uint64_t seq) { return (uint32_t)(seq & (TRANSPORT_WINDOW - 1)); }
+
+// Register the events the connection wants, skipping the syscall if they did not change.
+static void update_events(Transport* t, int index) {
+    Connection* c = &t->connections[index];
+    uint32_t events = (c->reading ? (uint32_t)EPOLLIN : 0) | (c->writing ? (uint32_t)EPOLLOUT : 0);
+    if (events == c->events) {
+        return;
+    }
+    struct epoll_event event;
+    event.events = events;
+    event.data.u32 = index;
+    epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+    c->events = events;
+}
+
+static void free_connection(Transport* t, int index) {
+    Connection* c = &t->connections[index];
+    epoll_ctl(t->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->results);
+    free(c->out);
+    memset(c, 0, sizeof(Connection));
+    c->fd = -1;
+}
+
+static void accept_connections(Transport* t) {
+    while (true) {
+        int fd = accept4(t->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;  // no connection left to accept
+        }
+
+        int index = 0;
+        while (index < TRANSPORT_MAX_CONNECTIONS && t->connections[index].fd >= 0) {
+            index++;
+        }
+        if (index == TRANSPORT_MAX_CONNECTIONS) {
+            fprintf(stderr, "Refused a connection, %d are open\n", TRANSPORT_MAX_CONNECTIONS);
+            close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // fails harmlessly on Unix-domain sockets
+
+        Connection* c = &t->connections[index];
+        c->in = (char*)malloc(IN_BYTES);
+        c->results = (uint8_t*)calloc(TRANSPORT_WINDOW, 1);
+        c->out = (uint8_t*)malloc(TRANSPORT_WINDOW);
+        c->fd = fd;
+        c->reading = true;
+        c->events = EPOLLIN;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        if (c->in == NULL || c->results == NULL || c->out == NULL ||
+            epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            perror("Failed to accept a connection");
+            free_connection(t, index);
+        }
+    }
+}
+
+// Enqueue the complete messages read so far.
+// Returns 0 on success, else -1 if the client broke the protocol.
+static int parse_requests(Transport* t, int index) {
+    Connection* c = &t->connections[index];
+    int offset = 0;
+
+    if (!c->greeted) {
+        if (c->in_bytes < (int)sizeof(WireHello)) {
+            return 0;
+        }
+        WireHello hello;
+        memcpy(&hello, c->in, sizeof(hello));
+        if (hello.magic != WIRE_MAGIC || hello.num_threads <= 0 || hello.num_ops_per_thread <= 0) {
+            return -1;
+        }
+        c->greeted = true;
+        offset = sizeof(hello);
+
+        if (!t->ready) {
+            t->num_threads = hello.num_threads;
+            t->num_ops_per_thread = hello.num_ops_per_thread;
+            __atomic_store_n(&t->ready, true, __ATOMIC_RELEASE);
+        }
+    }
+
+    uint64_t now = timer_now();
+    for (; c->in_bytes - offset >= (int)sizeof(WireRequest); offset += sizeof(WireRequest)) {
+        WireRequest request;
+        memcpy(&request, c->in + offset, sizeof(request));
+        // Keys index the stripes of the queue and the buckets of the table
+        if (request.type > Lookup || request.key < 0) {
+            return -1;
+        }
+        // The workers dequeue no more than the load of the run, a request past it would never be answered
+        if (t->requests == (uint64_t)t->num_threads * t->num_ops_per_thread) {
+            return -1;
+        }
+
+        uint32_t slot = slot_of(c->received);
+        c->results[slot] = 0;
+        enqueue_tagged(t->queue, request.key, (OperationType)request.type, now, index * TRANSPORT_WINDOW + slot);
+        c->received++;
+        t->requests++;
+    }
+
+    memmove(c->in, c->in + offset, c->in_bytes - offset);
+    c->in_bytes -= offset;
+    return 0;
+}
+
+static void read_requests(Transport* t, int index) {
+    Connection* c = &t->connections[index];
+
+    while (c->reading) {
+        // The hello alone, then no more requests than the ring has room for
+        int capacity = c->greeted ? (int)((TRANSPORT_WINDOW - (c->received - c->sent)) * sizeof(WireRequest))
+                                  : (int)sizeof(WireHello);
+        if (capacity <= c->in_bytes) {
+            c->reading = false;  // until answers are sent
+            break;
+        }
+
+        ssize_t n = recv(c->fd, c->in + c->in_bytes, capacity - c->in_bytes, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            c->closed = true;  // the answers in flight are still sent, the client may have shut down its side only
+            c->reading = false;
+            break;
+        }
+
+        t->reads++;
+        c->in_bytes += n;
+        if (parse_requests(t, index) != 0) {
+            fprintf(stderr, "Closed a connection that broke the protocol\n");
+            c->closed = true;
+            c->reading = false;
+        }
+    }
+}
+
+// Move the answered prefix of the ring into out, and send what is not sent yet.
+static void send_answers(Transport* t, int index) {
+    Connection* c = &t->connections[index];
+
+    while (c->collected < c->received) {
+        uint32_t slot = slot_of(c->collected);
+        uint8_t result = __atomic_load_n(&c->results[slot], __ATOMIC_ACQUIRE);
+        if (result == 0) {
+            break;
+        }
+        c->out[slot] = result - 1;  // a slot of out is free, no more than a window is unsent
+        c->collected++;
+    }
+
+    while (c->sent < c->collected) {
+        uint32_t start = slot_of(c->sent);
+        uint64_t pending = c->collected - c->sent;
+        uint64_t first = pending < TRANSPORT_WINDOW - start ? pending : TRANSPORT_WINDOW - start;
+
+        // The answers may wrap around the ring, still one syscall
+        struct iovec iov[2];
+        iov[0].iov_base = c->out + start;
+        iov[0].iov_len = first;
+        iov[1].iov_base = c->out;
+        iov[1].iov_len = pending - first;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = pending > first ? 2 : 1;
+
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0) {
+            c->sent = c->collected;  // the client is gone, drop its answers
+            c->closed = true;
+            c->reading = false;
+            break;
+        }
+        t->sends++;
+        c->sent += n;
+    }
+
+    c->writing = c->sent < c->collected;
+    if (!c->closed && !c->reading && c->received - c->sent < TRANSPORT_WINDOW) {
+        c->reading = true;
+    }
+}
+
+static void* loop_func(void* arg) {
+    Transport* t = (Transport*)arg;
+    struct epoll_event events[EPOLL_EVENTS];
+
+    while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(t->epoll_fd, events, EPOLL_EVENTS, EPOLL_TIMEOUT_MS);
+        for (int i = 0; i < n; ++i) {
+            uint32_t data = events[i].data.u32;
+            if (data == LISTEN_EVENT) {
+                accept_connections(t);
+            } else if (data == WAKE_EVENT) {
+                uint64_t count;
+                if (read(t->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("Failed to clear the wakeups of the event loop");
+                }
+                // Acquires the answers of the workers that found no wakeup pending
+                (void)__atomic_exchange_n(&t->wake_pending, false, __ATOMIC_ACQ_REL);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                read_requests(t, data);
+            }
+        }
+
+        // Answers of every connection, also those the workers answered while the loop was reading
+        for (int i = 0; i < TRANSPORT_MAX_CONNECTIONS; ++i) {
+            Connection* c = &t->connections[i];
+            if (c->fd < 0) {
+                continue;
+            }
+            send_answers(t, i);
+            if (c->closed && c->sent == c->received) {
+                free_connection(t, i);
+            } else {
+                update_events(t, i);
+            }
+        }
+    }
+    return NULL;
+}
+
+int transport_open(Transport* t, OperationQueue* queue, const char* unix_path, int port) {
+    memset(t, 0, sizeof(Transport));
+    t->queue = queue;
+    t->listen_fd = -1;
+    t->epoll_fd = -1;
+    t->wake_fd = -1;
+    for (int i = 0; i < TRANSPORT_MAX_CONNECTIONS; ++i) {
+        t->connections[i].fd = -1;
+    }
+
+    if (unix_path != NULL) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(unix_path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Socket path too long: %s\n", unix_path);
+            return -1;
+        }
+        strcpy(addr.sun_path, unix_path);
+
+        t->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(unix_path);  // a socket left by a previous run
+        if (t->listen_fd < 0 || bind(t->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("Failed to bind the Unix-domain socket");
+            transport_close(t);
+            return -1;
+        }
+        snprintf(t->unix_path, sizeof(t->unix_path), "%s", unix_path);
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int one = 1;
+        t->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (t->listen_fd < 0 || setsockopt(t->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(t->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("Failed to bind the TCP socket");
+            transport_close(t);
+            return -1;
+        }
+    }
+
+    t->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    t->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.u32 = LISTEN_EVENT;
+    struct epoll_event wake_event;
+    wake_event.events = EPOLLIN;
+    wake_event.data.u32 = WAKE_EVENT;
+    if (listen(t->listen_fd, TRANSPORT_BACKLOG) != 0 || t->epoll_fd < 0 || t->wake_fd < 0 ||
+        epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->listen_fd, &listen_event) != 0 ||
+        epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->wake_fd, &wake_event) != 0) {
+        perror("Failed to set up the event loop");
+        transport_close(t);
+        return -1;
+    }
+
+    if (pthread_create(&t->loop, NULL, loop_func, t) != 0) {
+        perror("Failed to start the event loop");
+        transport_close(t);
+        return -1;
+    }
+    t->running = true;
+    return 0;
+}
+
+void transport_close(Transport* t) {
+    if (t->running) {
+        __atomic_store_n(&t->stop, true, __ATOMIC_RELEASE);
+        uint64_t one = 1;
+        if (write(t->wake_fd, &one, sizeof(one)) < 0) {
+            perror("Failed to wake the event loop, it stops within its timeout");
+        }
+        pthread_join(t->loop, NULL);
+        t->running = false;
+    }
+
+    // The workers are done, the answers left go out on blocking sockets
+    for (int i = 0; i < TRANSPORT_MAX_CONNECTIONS; ++i) {
+        Connection* c = &t->connections[i];
+        if (c->fd < 0) {
+            continue;
+        }
+        int flags = fcntl(c->fd, F_GETFL);
+        fcntl(c->fd, F_SETFL, flags & ~O_NONBLOCK);
+        send_answers(t, i);
+        free_connection(t, i);
+    }
+
+    if (t->listen_fd >= 0) {
+        close(t->listen_fd);
+        t->listen_fd = -1;
+    }
+    if (t->epoll_fd >= 0) {
+        close(t->epoll_fd);
+        t->epoll_fd = -1;
+    }
+    if (t->wake_fd >= 0) {
+        close(t->wake_fd);
+        t->wake_fd = -1;
+    }
+    if (t->unix_path[0] != '\0') {
+        unlink(t->unix_path);
+        t->unix_path[0] = '\0';
+    }
+}
+
+void transport_answer(Transport* t, const Operation* ops, const bool* succeeded, int n) {
+    for (int i = 0; i < n; ++i) {
+        Connection* c = &t->connections[ops[i].tag / TRANSPORT_WINDOW];
+        uint8_t result = 1 + (succeeded[i] ? WireSucceeded : WireFailed);
+        __atomic_store_n(&c->results[ops[i].tag % TRANSPORT_WINDOW], result, __ATOMIC_RELEASE);
+    }
+
+    // Only the first answer after the loop cleared the flag pays for the syscall
+    if (n > 0 && !__atomic_exchange_n(&t->wake_pending, true, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        if (write(t->wake_fd, &one, sizeof(one)) < 0) {
+            perror("Failed to wake the event loop");
+        }
+    }
+}
+
+int transport_connect(const char* unix_path, int port) {
+    int fd;
+    if (unix_path != NULL) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(unix_path) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, unix_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd >= 0 && (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0 ||
+                        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
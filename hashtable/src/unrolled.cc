@@ -0,0 +1,68 @@
+#include "unrolled.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+int block_rank(const int* keys, int count, int key) {
+    assert(count >= 0 && count <= BLOCK_KEYS);
+
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi32(key);
+    __m256i low = _mm256_loadu_si256((const __m256i*)keys);
+    __m256i high = _mm256_loadu_si256((const __m256i*)(keys + 8));
+    unsigned less = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, low))) |
+                    (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, high))) << 8;
+#elif defined(__SSE2__)
+    __m128i needle = _mm_set1_epi32(key);
+    unsigned less = 0;
+    for (int i = 0; i < BLOCK_SEARCHED / 4; ++i) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(keys + 4 * i));
+        less |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(chunk, needle))) << (4 * i);
+    }
+#else
+    unsigned less = 0;
+    for (int i = 0; i < count; ++i) {
+        less |= (unsigned)(keys[i] < key) << i;
+    }
+#endif
+
+    return __builtin_popcount(less & ((1u << count) - 1));
+}
+
+void block_insert_at(int* keys, int* count, int rank, int key) {
+    assert(*count < BLOCK_KEYS);
+    assert(rank >= 0 && rank <= *count);
+
+    memmove(&keys[rank + 1], &keys[rank], sizeof(int) * (*count - rank));
+    keys[rank] = key;
+    (*count)++;
+}
+
+void block_remove_at(int* keys, int* count, int rank) {
+    assert(rank >= 0 && rank < *count);
+
+    memmove(&keys[rank], &keys[rank + 1], sizeof(int) * (*count - rank - 1));
+    (*count)--;
+}
+
+void block_split(int* keys, int* count, int* upper, int* upper_count) {
+    assert(*count == BLOCK_KEYS);
+    assert(*upper_count == 0);
+
+    int half = BLOCK_KEYS / 2;
+    memcpy(upper, &keys[half], sizeof(int) * (BLOCK_KEYS - half));
+    *upper_count = BLOCK_KEYS - half;
+    *count = half;
+}
+
+void block_merge(int* keys, int* count, int* next, int* next_count) {
+    assert(*count + *next_count <= BLOCK_KEYS);
+
+    memcpy(&keys[*count], next, sizeof(int) * *next_count);
+    *count += *next_count;
+    *next_count = 0;
+}
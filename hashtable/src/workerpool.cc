@@ -0,0 +1,105 @@
+#include "workerpool.h"
+
+#include <assert.h>
+
+void elastic_default_config(ElasticConfig* config, int max_workers) {
+    config->min_workers = 1;
+    config->max_workers = max_workers;
+    config->interval_us = ELASTIC_INTERVAL_US;
+    config->high_occupancy = ELASTIC_HIGH_OCCUPANCY;
+    config->low_occupancy = ELASTIC_LOW_OCCUPANCY;
+    config->target_wait_us = ELASTIC_TARGET_WAIT_US;
+    config->calm_samples = ELASTIC_CALM_SAMPLES;
+}
+
+int worker_pool_init(WorkerPool* pool, const ElasticConfig* config, int64_t total_ops) {
+    assert(pool != NULL);
+    assert(config != NULL);
+
+    if (config->min_workers <= 0 || config->max_workers < config->min_workers ||
+        config->low_occupancy >= config->high_occupancy) {
+        return -1;
+    }
+
+    pool->config = *config;
+    pool->remaining = total_ops;
+    pool->served = 0;
+    pool->active = config->min_workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    pool->calm = 0;
+    pool->last_served = 0;
+    pool->scale_ups = 0;
+    pool->scale_downs = 0;
+    pool->samples = 0;
+    pool->active_samples = 0;
+    return 0;
+}
+
+void worker_pool_destroy(WorkerPool* pool) {
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+}
+
+bool worker_pool_checkpoint(WorkerPool* pool, int id) {
+    if (id < __atomic_load_n(&pool->active, __ATOMIC_RELAXED)) {
+        return __atomic_load_n(&pool->remaining, __ATOMIC_RELAXED) > 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (id >= pool->active && __atomic_load_n(&pool->remaining, __ATOMIC_RELAXED) > 0) {
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return __atomic_load_n(&pool->remaining, __ATOMIC_RELAXED) > 0;
+}
+
+void worker_pool_wake_all(WorkerPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int worker_pool_sample(WorkerPool* pool, int occupancy, uint64_t elapsed_ns) {
+    const ElasticConfig* config = &pool->config;
+
+    uint64_t served = __atomic_load_n(&pool->served, __ATOMIC_RELAXED);
+    uint64_t delta = served - pool->last_served;
+    pool->last_served = served;
+
+    // Little's law: the queued operations drain at the rate they were served, a stalled queue waits forever
+    bool too_slow = false;
+    if (occupancy > config->low_occupancy) {
+        too_slow = delta == 0 || (double)occupancy * elapsed_ns / delta >= config->target_wait_us * 1000.0;
+    }
+
+    int active = pool->active;
+    if (occupancy >= config->high_occupancy || too_slow) {
+        pool->calm = 0;
+        if (active < config->max_workers) {
+            active = active * 2 < config->max_workers ? active * 2 : config->max_workers;
+            pool->scale_ups++;
+        }
+    } else if (occupancy <= config->low_occupancy) {
+        if (++pool->calm >= config->calm_samples && active > config->min_workers) {
+            active--;
+            pool->calm = 0;
+            pool->scale_downs++;
+        }
+    } else {
+        pool->calm = 0;
+    }
+
+    if (active != pool->active) {
+        pthread_mutex_lock(&pool->lock);
+        __atomic_store_n(&pool->active, active, __ATOMIC_RELAXED);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    pool->samples++;
+    pool->active_samples += active;
+    return active;
+}
@@ -0,0 +1,208 @@
+#include "workload.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PREFILL_RESOLUTION (1000000)
+
+static uint64_t scramble(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static double zeta(int n, double theta) {
+    double sum = 0.0;
+    for (int i = 1; i <= n; ++i) {
+        sum += 1.0 / pow(i, theta);
+    }
+    return sum;
+}
+
+// Returns a rank in [0, key_space), rank 0 being the most popular.
+static int next_zipfian_rank(Workload* workload, Prng* prng) {
+    int n = workload->config.key_space;
+    double theta = workload->config.theta;
+
+    double u = prng_next_double(prng);
+    double uz = u * workload->zeta_n;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, theta)) {
+        return 1;
+    }
+
+    int rank = (int)(n * pow(workload->eta * u - workload->eta + 1.0, workload->alpha));
+    return rank < n ? rank : n - 1;
+}
+
+static int next_key(Workload* workload, Prng* prng) {
+    const WorkloadConfig* config = &workload->config;
+    int n = config->key_space;
+
+    switch (config->distribution) {
+        case DistUniform:
+            return (int)prng_next_below(prng, n);
+        case DistZipfian:
+            return (int)(scramble(next_zipfian_rank(workload, prng)) % n);
+        case DistLatest: {
+            int latest = __atomic_load_n(&workload->latest, __ATOMIC_RELAXED);
+            int key = latest - 1 - next_zipfian_rank(workload, prng);
+            return key >= 0 ? key : 0;
+        }
+        case DistHotspot: {
+            int hot_n = (int)(n * config->hot_fraction);
+            if (hot_n < 1) {
+                hot_n = 1;
+            }
+            if (prng_next_double(prng) < config->hot_op_fraction || hot_n == n) {
+                return (int)prng_next_below(prng, hot_n);
+            }
+            return hot_n + (int)prng_next_below(prng, n - hot_n);
+        }
+    }
+
+    assert(false);  // should never happen
+    return 0;
+}
+
+void workload_default_config(WorkloadConfig* config) {
+    config->distribution = DistUniform;
+    config->theta = 0.99;
+    config->key_space = 1000000;
+    config->hot_fraction = 0.2;
+    config->hot_op_fraction = 0.8;
+    config->lookup_permille = 500;
+    config->insert_permille = 250;
+    config->delete_permille = 250;
+    config->prefill = 0.5;
+    config->warmup_ops = 0;
+}
+
+int workload_init(Workload* workload, const WorkloadConfig* config) {
+    assert(workload != NULL);
+    assert(config != NULL);
+
+    if (config->key_space <= 0 || config->prefill < 0.0 || config->prefill > 1.0 || config->theta <= 0.0 ||
+        config->theta >= 1.0 || config->hot_fraction <= 0.0 || config->hot_fraction > 1.0 ||
+        config->lookup_permille + config->insert_permille + config->delete_permille != 1000) {
+        return -1;
+    }
+
+    workload->config = *config;
+
+    if (config->distribution == DistZipfian || config->distribution == DistLatest) {
+        double theta = config->theta;
+        int n = config->key_space;
+
+        workload->zeta_n = zeta(n, theta);
+        workload->zeta_2 = zeta(2, theta);
+        workload->alpha = 1.0 / (1.0 - theta);
+        workload->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - workload->zeta_2 / workload->zeta_n);
+    }
+
+    workload->latest = config->key_space;
+
+    return 0;
+}
+
+int workload_parse_distribution(const char* str, KeyDistribution* distribution) {
+    if (strcmp(str, "uniform") == 0) {
+        *distribution = DistUniform;
+    } else if (strcmp(str, "zipfian") == 0) {
+        *distribution = DistZipfian;
+    } else if (strcmp(str, "latest") == 0) {
+        *distribution = DistLatest;
+    } else if (strcmp(str, "hotspot") == 0) {
+        *distribution = DistHotspot;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int workload_parse_mix(const char* str, WorkloadConfig* config) {
+    // lookup, insert, delete in 1/1000
+    static const int presets[6][3] = {
+        {500, 250, 250},  // A: update heavy
+        {950, 25, 25},    // B: read mostly
+        {1000, 0, 0},     // C: read only
+        {950, 50, 0},     // D: read latest
+        {950, 50, 0},     // E: short ranges, scans are issued as lookups
+        {670, 165, 165},  // F: read-modify-write
+    };
+
+    if (strlen(str) == 1 && str[0] >= 'a' && str[0] <= 'f') {
+        const int* preset = presets[str[0] - 'a'];
+        config->lookup_permille = preset[0];
+        config->insert_permille = preset[1];
+        config->delete_permille = preset[2];
+        if (str[0] == 'd') {
+            config->distribution = DistLatest;
+        }
+        return 0;
+    }
+
+    int lookup, insert, remove;
+    if (sscanf(str, "%d:%d:%d", &lookup, &insert, &remove) != 3 || lookup < 0 || insert < 0 || remove < 0 ||
+        lookup + insert + remove != 100) {
+        return -1;
+    }
+
+    config->lookup_permille = lookup * 10;
+    config->insert_permille = insert * 10;
+    config->delete_permille = remove * 10;
+
+    return 0;
+}
+
+bool workload_is_prefilled(const Workload* workload, int key) {
+    if (key < 0 || key >= workload->config.key_space) {
+        return false;
+    }
+    return scramble(key) % PREFILL_RESOLUTION < workload->config.prefill * PREFILL_RESOLUTION;
+}
+
+Operation workload_next(Workload* workload, Prng* prng) {
+    const WorkloadConfig* config = &workload->config;
+
+    Operation op;
+    op.flag = 0;
+
+    int dice = (int)prng_next_below(prng, 1000);
+    if (dice < config->lookup_permille) {
+        op.type = Lookup;
+    } else if (dice < config->lookup_permille + config->insert_permille) {
+        op.type = Insert;
+    } else {
+        op.type = Delete;
+    }
+
+    if (op.type == Insert && config->distribution == DistLatest) {
+        op.key = __sync_fetch_and_add(&workload->latest, 1);
+    } else {
+        op.key = next_key(workload, prng);
+    }
+
+    return op;
+}
+
+Operation* workload_generate(Workload* workload, Prng* prng, int num_ops) {
+    Operation* trace = (Operation*)malloc(sizeof(Operation) * num_ops);
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < num_ops; ++i) {
+        trace[i] = workload_next(workload, prng);
+    }
+
+    return trace;
+}
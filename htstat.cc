@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "replication.h"
+#include "shm.h"
+#include "stats.h"
+
+const char* type_names[3] = {"insert", "delete", "lookup"};
+const char* repl_role_names[3] = {"standalone", "primary", "follower"};  // indexed by ReplRole
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "  -i <interval_ms>           refresh interval (default: 1000)\n");
+    fprintf(stderr, "  -n <count>                 stop after this many refreshes (default: until the server exits)\n");
+    fprintf(stderr, "  -j                         print one JSON object per refresh instead of the view\n");
+    fprintf(stderr, "  -Q <name>                  shared memory segment of the server (default: %s)\n", SHM_ID);
+    exit(EXIT_FAILURE);
+}
+
+double now_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+uint64_t worker_ops(const WorkerStats* worker) {
+    return worker->ops[Insert] + worker->ops[Delete] + worker->ops[Lookup];
+}
+
+void save_worker_ops(const ServerStats* stats, uint64_t* ops) {
+    for (int i = 0; i < stats->num_workers; ++i) {
+        ops[i] = worker_ops(&stats->workers[i]);
+    }
+}
+
+void print_json(const SharedMem* area, const StatsSnapshot* snapshot, const double* rates, int occupancy) {
+    const ServerStats* stats = &area->stats;
+
+    printf("{\"policy\":\"%s\",\"running\":%s,\"workers\":%d,\"buckets\":%d,\"elements\":%ld,\"load_factor\":%.3f,"
+           "\"queue_occupancy\":%d,\"active_workers\":%d,\"scale_ups\":%lu,\"scale_downs\":%lu",
+           stats->policy, stats->running ? "true" : "false", stats->num_workers, stats->num_buckets,
+           snapshot->elements, snapshot->load_factor, occupancy, stats->active_workers, stats->scale_ups,
+           stats->scale_downs);
+    if (stats->repl_role != RoleStandalone) {
+        printf(",\"replication\":{\"role\":\"%s\",\"head\":%lu,\"applied\":%lu,\"lag_ns\":%lu,\"resyncs\":%lu}",
+               repl_role_names[stats->repl_role], stats->repl_head, stats->repl_applied, stats->repl_lag_ns,
+               stats->repl_resyncs);
+    }
+
+    for (int type = 0; type < 3; ++type) {
+        printf(",\"%s\":{\"ops\":%lu,\"succeeded\":%lu,\"ops_per_s\":%.0f}", type_names[type], snapshot->ops[type],
+               snapshot->succeeded[type], rates[type]);
+    }
+
+    if (stats->chains_tracked) {
+        printf(",\"chain_lengths\":[");
+        for (int length = 0; length < CHAIN_LENGTH_CLASSES; ++length) {
+            printf("%s%ld", length == 0 ? "" : ",", snapshot->chains[length]);
+        }
+        printf("]");
+    } else {
+        printf(",\"chain_lengths\":null");
+    }
+
+    printf(",\"worker_ops\":[");
+    for (int i = 0; i < stats->num_workers; ++i) {
+        printf("%s%lu", i == 0 ? "" : ",", worker_ops(&stats->workers[i]));
+    }
+    printf("]}\n");
+}
+
+void print_view(const SharedMem* area, const StatsSnapshot* snapshot, const double* rates, int occupancy,
+                const uint64_t* prev_worker_ops, double elapsed_s) {
+    const ServerStats* stats = &area->stats;
+
+    if (isatty(STDOUT_FILENO)) {
+        printf("\033[H\033[2J");  // top-like, redraw from the top left
+    }
+
+    printf("htstat - %s locking, %d workers, %d buckets, %s\n", stats->policy, stats->num_workers, stats->num_buckets,
+           stats->running ? "running" : "waiting for client");
+    printf("ops/s: %.0f total, %.0f insert, %.0f delete, %.0f lookup\n", rates[0] + rates[1] + rates[2],
+           rates[Insert], rates[Delete], rates[Lookup]);
+
+    uint64_t lookups = snapshot->ops[Lookup];
+    printf("lookup hits: %lu / %lu (%.2f%%)\n", snapshot->succeeded[Lookup], lookups,
+           lookups == 0 ? 0.0 : 100.0 * snapshot->succeeded[Lookup] / lookups);
+    printf("elements: %ld, load factor: %.3f, queue: %d / %d\n", snapshot->elements, snapshot->load_factor, occupancy,
+           QUEUE_SIZE);
+    if (stats->scale_ups + stats->scale_downs > 0 || stats->active_workers < stats->num_workers) {
+        printf("active workers: %d / %d, scaled up %lu times, down %lu times\n", stats->active_workers,
+               stats->num_workers, stats->scale_ups, stats->scale_downs);
+    }
+
+    if (stats->repl_role == RolePrimary) {
+        printf("primary, shipped up to LSN %lu\n", stats->repl_head);
+    } else if (stats->repl_role == RoleFollower) {
+        uint64_t behind = stats->repl_head > stats->repl_applied ? stats->repl_head - stats->repl_applied : 0;
+        printf("follower at LSN %lu of %lu, %lu records behind, lag %.1f us, resynchronized %lu times\n",
+               stats->repl_applied, stats->repl_head, behind, stats->repl_lag_ns / 1000.0, stats->repl_resyncs);
+    }
+
+    printf("chain length (buckets):");
+    if (!stats->chains_tracked) {
+        printf(" not tracked, see server -T");
+    }
+    for (int length = 0; stats->chains_tracked && length < CHAIN_LENGTH_CLASSES; ++length) {
+        if (snapshot->chains[length] != 0) {
+            printf(" %d%s:%ld", length, length == CHAIN_LENGTH_CLASSES - 1 ? "+" : "", snapshot->chains[length]);
+        }
+    }
+    printf("\n\n");
+
+    printf("%-8s %12s %12s %12s %12s %12s\n", "worker", "insert", "delete", "lookup", "lookup hits", "ops/s");
+    for (int i = 0; i < stats->num_workers; ++i) {
+        const WorkerStats* worker = &stats->workers[i];
+        printf("%-8d %12lu %12lu %12lu %12lu %12.0f\n", i, worker->ops[Insert], worker->ops[Delete],
+               worker->ops[Lookup], worker->succeeded[Lookup], (worker_ops(worker) - prev_worker_ops[i]) / elapsed_s);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int interval_ms = 1000;
+    int count = 0;
+    bool json = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:jQ:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval_ms = atoi(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 'Q':
+                if (optarg[0] != '/') {
+                    usage(argv[0]);
+                }
+                shm_set_id(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (interval_ms <= 0 || count < 0) {
+        usage(argv[0]);
+    }
+
+    // Read-only, so the workers' lines are never written or invalidated by us
+    const SharedMem* area = (const SharedMem*)shm_attach_readonly();
+    if (area == NULL) {
+        fprintf(stderr, "Failed to load shared memory. Please make sure that the server is running.\n");
+        exit(EXIT_FAILURE);
+    }
+    const ServerStats* stats = &area->stats;
+
+    StatsSnapshot prev;
+    stats_snapshot(stats, &prev);
+    uint64_t prev_worker_ops[STATS_MAX_WORKERS] = {0};
+    save_worker_ops(stats, prev_worker_ops);
+    double prev_time = now_s();
+
+    bool was_running = false;
+    for (int refresh = 0; count == 0 || refresh < count; ++refresh) {
+        usleep(interval_ms * 1000);
+
+        StatsSnapshot snapshot;
+        stats_snapshot(stats, &snapshot);
+        double now = now_s();
+        double elapsed_s = now - prev_time;
+
+        double rates[3];
+        for (int type = 0; type < 3; ++type) {
+            rates[type] = (snapshot.ops[type] - prev.ops[type]) / elapsed_s;
+        }
+        int occupancy = queue_occupancy((OperationQueue*)&area->queue);
+
+        if (json) {
+            print_json(area, &snapshot, rates, occupancy);
+        } else {
+            print_view(area, &snapshot, rates, occupancy, prev_worker_ops, elapsed_s);
+        }
+
+        save_worker_ops(stats, prev_worker_ops);
+        prev = snapshot;
+        prev_time = now;
+
+        // The server clears the flag when its workers are done
+        if (stats->running) {
+            was_running = true;
+        } else if (was_running) {
+            break;
+        }
+    }
+
+    munmap((void*)area, sizeof(SharedMem));
+
+    return EXIT_SUCCESS;
+}
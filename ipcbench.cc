@@ -0,0 +1,251 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "queue.h"
+#include "shm.h"
+
+#define MAX_ARGS (64)
+#define MAX_PATH (4096)
+#define SERVER_TIMEOUT_MS (10000)
+
+typedef struct Sample {
+    double time_ms;  // since the client was launched
+    int occupancy;
+} Sample;
+
+double elapsed_ms(struct timespec* begin, struct timespec* end) {
+    return (end->tv_nsec - begin->tv_nsec) / 1000000.0 + (end->tv_sec - begin->tv_sec) * 1000;
+}
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <hashtable_size> <num_threads> <num_ops_per_thread> [-- <server options>]\n",
+            prog);
+    fprintf(stderr, "  -i <interval_ms>           queue occupancy sampling interval (default: 10)\n");
+    fprintf(stderr, "  -q <path>                  write the occupancy samples as CSV\n");
+    fprintf(stderr, "  -T                         let the client pre-generate its operations\n");
+    fprintf(stderr, "  -B <dir>                   directory of the server and client binaries (default: own dir)\n");
+    exit(EXIT_FAILURE);
+}
+
+pid_t spawn(const char** argv) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], (char* const*)argv);
+        fprintf(stderr, "Failed to execute %s.\n", argv[0]);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Returns true if the child exited, and stores whether it succeeded
+bool reap(pid_t pid, bool* succeeded) {
+    int status;
+    if (waitpid(pid, &status, WNOHANG) != pid) {
+        return false;
+    }
+    *succeeded = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int interval_ms = 10;
+    const char* occupancy_path = NULL;
+    bool pregenerate = false;
+    char bin_dir[MAX_PATH] = "";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:q:TB:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval_ms = atoi(optarg);
+                break;
+            case 'q':
+                occupancy_path = optarg;
+                break;
+            case 'T':
+                pregenerate = true;
+                break;
+            case 'B':
+                snprintf(bin_dir, sizeof(bin_dir), "%s", optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind < 3 || interval_ms <= 0) {
+        usage(argv[0]);
+    }
+
+    const char* hashtable_size = argv[optind];
+    const char* num_threads = argv[optind + 1];
+    const char* num_ops_per_thread = argv[optind + 2];
+
+    // Everything after "--" is passed to the server
+    char** server_args = argv + optind + 3;
+    int num_server_args = argc - optind - 3;
+    if (num_server_args > 0 && strcmp(server_args[0], "--") == 0) {
+        server_args++;
+        num_server_args--;
+    }
+    if (num_server_args > MAX_ARGS - 3) {
+        usage(argv[0]);
+    }
+
+    if (bin_dir[0] == '\0') {
+        ssize_t len = readlink("/proc/self/exe", bin_dir, sizeof(bin_dir) - 1);
+        if (len < 0) {
+            fprintf(stderr, "Failed to locate the server and client binaries, please pass -B.\n");
+            exit(EXIT_FAILURE);
+        }
+        bin_dir[len] = '\0';
+        *strrchr(bin_dir, '/') = '\0';
+    }
+
+    char server_path[MAX_PATH + 16];
+    char client_path[MAX_PATH + 16];
+    snprintf(server_path, sizeof(server_path), "%s/server", bin_dir);
+    snprintf(client_path, sizeof(client_path), "%s/client", bin_dir);
+
+    // Drop the area of a server that did not exit cleanly, so we do not attach to it
+    shm_unlink(SHM_ID);
+
+    const char* server_argv[MAX_ARGS];
+    int server_argc = 0;
+    server_argv[server_argc++] = server_path;
+    for (int i = 0; i < num_server_args; ++i) {
+        server_argv[server_argc++] = server_args[i];
+    }
+    server_argv[server_argc++] = hashtable_size;
+    server_argv[server_argc] = NULL;
+
+    pid_t server = spawn(server_argv);
+    if (server < 0) {
+        fprintf(stderr, "Failed to launch the server.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Wait for the server to initialize the shared memory
+    bool server_succeeded = false;
+    SharedMem* area = NULL;
+    for (int waited_ms = 0; area == NULL || !area->server_is_ready; waited_ms += interval_ms) {
+        if (area == NULL) {
+            area = (SharedMem*)shm_attach();
+        }
+        if (reap(server, &server_succeeded) || waited_ms > SERVER_TIMEOUT_MS) {
+            fprintf(stderr, "The server did not get ready.\n");
+            kill(server, SIGTERM);
+            exit(EXIT_FAILURE);
+        }
+        usleep(interval_ms * 1000);
+    }
+
+    const char* client_argv[8];
+    int client_argc = 0;
+    client_argv[client_argc++] = client_path;
+    client_argv[client_argc++] = "-e";
+    if (pregenerate) {
+        client_argv[client_argc++] = "-T";
+    }
+    client_argv[client_argc++] = num_threads;
+    client_argv[client_argc++] = num_ops_per_thread;
+    client_argv[client_argc] = NULL;
+
+    struct timespec begin, now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+
+    pid_t client = spawn(client_argv);
+    if (client < 0) {
+        fprintf(stderr, "Failed to launch the client.\n");
+        kill(server, SIGTERM);
+        exit(EXIT_FAILURE);
+    }
+
+    // Sample the queue occupancy until both sides are done. The mapping stays valid after the server unlinks it.
+    Histogram occupancy;
+    histogram_init(&occupancy);
+    int num_samples = 0;
+    int max_samples = 1024;
+    Sample* samples = (Sample*)malloc(sizeof(Sample) * max_samples);
+
+    bool server_done = false, client_done = false;
+    bool client_succeeded = false;
+    while (!server_done || !client_done) {
+        if (!client_done) {
+            client_done = reap(client, &client_succeeded);
+        }
+        if (!server_done) {
+            server_done = reap(server, &server_succeeded);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+        if (area->client_is_ready && !server_done) {
+            int occupied = queue_occupancy(&area->queue);
+            histogram_record(&occupancy, occupied);
+
+            if (num_samples == max_samples) {
+                max_samples *= 2;
+                samples = (Sample*)realloc(samples, sizeof(Sample) * max_samples);
+            }
+            samples[num_samples].time_ms = elapsed_ms(&begin, &now);
+            samples[num_samples].occupancy = occupied;
+            num_samples++;
+        }
+
+        if (server_done && !server_succeeded && !client_done) {
+            // The client cannot finish without a consumer
+            kill(client, SIGTERM);
+            waitpid(client, NULL, 0);
+            client_done = true;
+        }
+
+        usleep(interval_ms * 1000);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    shm_detach(area);
+
+    if (!server_succeeded || !client_succeeded) {
+        fprintf(stderr, "The %s failed.\n", server_succeeded ? "client" : "server");
+        free(samples);
+        exit(EXIT_FAILURE);
+    }
+
+    double total_ms = elapsed_ms(&begin, &now);
+    long total_ops = atol(num_threads) * atol(num_ops_per_thread);
+    printf("End-to-end: %ld operations in %.3f ms (%.0f ops/s, including startup)\n", total_ops, total_ms,
+           total_ops / total_ms * 1000);
+
+    uint64_t full = 0;
+    for (int i = 0; i < num_samples; ++i) {
+        full += samples[i].occupancy >= QUEUE_SIZE;
+    }
+    printf("Queue occupancy (%d samples every %d ms, capacity %d): mean %.1f, p50 %lu, p99 %lu, max %lu, full %.1f%%\n",
+           num_samples, interval_ms, QUEUE_SIZE, histogram_mean(&occupancy), histogram_percentile(&occupancy, 50.0),
+           histogram_percentile(&occupancy, 99.0), occupancy.max, num_samples == 0 ? 0.0 : 100.0 * full / num_samples);
+
+    if (occupancy_path != NULL) {
+        FILE* out = fopen(occupancy_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open %s.\n", occupancy_path);
+        } else {
+            fprintf(out, "time_ms,occupancy\n");
+            for (int i = 0; i < num_samples; ++i) {
+                fprintf(out, "%.3f,%d\n", samples[i].time_ms, samples[i].occupancy);
+            }
+            fclose(out);
+        }
+    }
+
+    free(samples);
+
+    return EXIT_SUCCESS;
+}
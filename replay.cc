@@ -0,0 +1,377 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "hashtable.h"
+#include "histogram.h"
+#include "timer.h"
+#include "trace.h"
+
+// Latency breakdown of a replayed operation. Lag and end-to-end are only known when pacing.
+enum Stage { Service = 0, Lag = 1, EndToEnd = 2, NUM_STAGES = 3 };
+const char* stage_names[NUM_STAGES] = {"service", "lag", "end_to_end"};
+
+// All replay threads and the main thread meet here before the first operation
+pthread_barrier_t start_barrier;
+uint64_t start_ticks;  // set by the main thread before the barrier
+
+typedef struct ThreadArgs {
+    int id;
+    HashTable* table;
+    const TraceChunk** chunks;  // the chunks of the recorded workers mapped to this thread
+    int num_chunks;
+    double speed;  // replay the recorded arrival times this much faster, 0 for full speed
+    int sample_every;
+    uint64_t num_ops;
+
+    Histogram latency[NUM_STAGES][3];  // indexed by Stage and OperationType
+} ThreadArgs;
+
+double elapsed_ms(struct timespec* begin, struct timespec* end) {
+    return (end->tv_nsec - begin->tv_nsec) / 1000000.0 + (end->tv_sec - begin->tv_sec) * 1000;
+}
+
+void* thread_func(void* thd_args);
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <hashtable_size> <trace>\n", prog);
+    fprintf(stderr, "  -t <num_threads>           number of replay threads (default: the recorded workers)\n");
+    fprintf(stderr, "  -p                         pace the operations at their recorded arrival times\n");
+    fprintf(stderr, "  -x <speed>                 pace this many times faster than recorded (default: 1.0)\n");
+    fprintf(stderr, "  -a <none|compact|scatter>  thread placement policy\n");
+    fprintf(stderr, "  -l <llc>                   only use the cpus of this LLC domain\n");
+    fprintf(stderr, "  -o <offset>                skip the first cpus of the placement order\n");
+    fprintf(stderr, "  -c <capacity>              put a hot-key cache of this many keys in front of the table\n");
+    fprintf(stderr, "  -f                         put a counting Bloom filter in front of every bucket\n");
+    fprintf(stderr, "  -i                         index the chains that grow long for logarithmic walks\n");
+    fprintf(stderr, "  -C <max_keys>              evict keys with CLOCK beyond this many keys\n");
+    fprintf(stderr, "  -Y <max_mib>               evict keys with CLOCK beyond this many MiB of nodes\n");
+    fprintf(stderr, "  -E <ttl_ms>                expire keys this long after their insert\n");
+    fprintf(stderr, "  -S <n>                     time every n-th operation only (default: 1)\n");
+    fprintf(stderr, "  -H <path>                  export latency histograms as CSV, or JSON for a .json path\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    PinPolicy pin_policy = PinNone;
+    int pin_llc = -1;
+    int pin_offset = 0;
+    int hotcache_capacity = 0;
+    bool use_filter = false;
+    bool use_index = false;
+    bool use_cache = false;
+    CacheConfig cache_config;
+    cache_default_config(&cache_config);
+    int num_threads = 0;
+    bool paced = false;
+    double speed = 1.0;
+    int sample_every = 1;
+    const char* histogram_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:px:a:l:o:c:fiC:Y:E:S:H:")) != -1) {
+        switch (opt) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'p':
+                paced = true;
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'a':
+                if (placement_parse_policy(optarg, &pin_policy) != 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'l':
+                pin_llc = atoi(optarg);
+                break;
+            case 'o':
+                pin_offset = atoi(optarg);
+                break;
+            case 'c':
+                hotcache_capacity = atoi(optarg);
+                break;
+            case 'f':
+                use_filter = true;
+                break;
+            case 'i':
+                use_index = true;
+                break;
+            case 'C':
+                cache_config.max_keys = atoi(optarg);
+                use_cache = true;
+                break;
+            case 'Y':
+                cache_config.max_bytes = (size_t)atol(optarg) << 20;
+                use_cache = true;
+                break;
+            case 'E':
+                cache_config.default_ttl_ms = atoi(optarg);
+                use_cache = true;
+                break;
+            case 'S':
+                sample_every = atoi(optarg);
+                break;
+            case 'H':
+                histogram_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+    }
+
+    int num_buckets = atoi(argv[optind]);
+    const char* trace_path = argv[optind + 1];
+    if (num_buckets <= 0 || num_threads < 0 || sample_every <= 0 || speed <= 0.0) {
+        fprintf(stderr, "<hashtable_size>, threads, sampling and speed must be greater than 0.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Trace trace;
+    if (trace_open(&trace, trace_path) != 0) {
+        fprintf(stderr, "Failed to open the trace %s, or it is not a complete trace.\n", trace_path);
+        exit(EXIT_FAILURE);
+    }
+
+    // Each recorded worker is replayed by one thread, so its operations keep their order
+    int num_workers = trace.header->num_workers;
+    if (num_threads == 0) {
+        num_threads = num_workers;
+    }
+
+    timer_calibrate();
+
+    printf("Replaying %lu operations of %d workers with %d threads, %s locking, %s.\n", trace.header->num_records,
+           num_workers, num_threads, hashtable_policy_name(), paced ? "paced" : "full speed");
+
+    Topology topo;
+    Placement placement;
+    if (topology_detect(&topo) != 0 || placement_init(&placement, &topo, pin_policy, pin_llc, pin_offset) != 0) {
+        fprintf(stderr, "Failed to place threads with the given affinity options.\n");
+        exit(EXIT_FAILURE);
+    }
+    placement_print(stdout, &placement, "thread", num_threads);
+
+    affinity_pin_self(placement_cpu(&placement, 0));
+    affinity_prefer_node(placement_home_node(&placement));
+
+    HashTable* table = hashtable_create(num_buckets);
+    if (table == NULL) {
+        fprintf(stderr, "Failed to create hash table with %d buckets.", num_buckets);
+    }
+
+    if (hotcache_capacity > 0 && hashtable_attach_hotcache(table, hotcache_capacity) != 0) {
+        fprintf(stderr, "Failed to create hot-key cache of %d keys.", hotcache_capacity);
+    }
+
+    if (use_filter && hashtable_attach_filter(table) != 0) {
+        fprintf(stderr, "Failed to create the bucket filters.");
+    }
+
+    if (use_index && hashtable_attach_index(table) != 0) {
+        fprintf(stderr, "Failed to create the chain indexes.");
+    }
+
+    if (use_cache && hashtable_attach_cache(table, &cache_config) != 0) {
+        fprintf(stderr, "Failed to turn the table into a cache.");
+    }
+
+    pthread_t threads[num_threads];
+    ThreadArgs* args = (ThreadArgs*)malloc(sizeof(ThreadArgs) * num_threads);  // too large for the stack
+
+    // Distribute the chunks up front, so the threads only walk their own
+    uint64_t num_chunks = trace.header->num_chunks;
+    const TraceChunk** chunks = (const TraceChunk**)malloc(sizeof(TraceChunk*) * (num_chunks + 1));
+    int* chunk_counts = (int*)calloc(num_threads, sizeof(int));
+    for (const TraceChunk* chunk = trace_first_chunk(&trace); chunk != NULL; chunk = trace_next_chunk(&trace, chunk)) {
+        chunk_counts[chunk->worker % num_threads]++;
+    }
+    int offset = 0;
+    for (int i = 0; i < num_threads; i++) {
+        args[i].chunks = chunks + offset;
+        args[i].num_chunks = 0;
+        offset += chunk_counts[i];
+    }
+    for (const TraceChunk* chunk = trace_first_chunk(&trace); chunk != NULL; chunk = trace_next_chunk(&trace, chunk)) {
+        ThreadArgs* arg = &args[chunk->worker % num_threads];
+        arg->chunks[arg->num_chunks++] = chunk;
+    }
+    free(chunk_counts);
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+
+    for (int i = 0; i < num_threads; i++) {
+        args[i].id = i;
+        args[i].table = table;
+        args[i].speed = paced ? speed : 0.0;
+        args[i].sample_every = sample_every;
+        args[i].num_ops = 0;
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            for (int type = 0; type < 3; ++type) {
+                histogram_init(&args[i].latency[stage][type]);
+            }
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        affinity_set_attr(&attr, placement_cpu(&placement, i));
+        pthread_create(&threads[i], &attr, thread_func, (void**)&args[i]);
+        pthread_attr_destroy(&attr);
+    }
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+    start_ticks = timer_now();
+    pthread_barrier_wait(&start_barrier);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+    Histogram latency[NUM_STAGES][3];
+    uint64_t total_ops = 0;
+    for (int i = 0; i < num_threads; i++) {
+        total_ops += args[i].num_ops;
+    }
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        for (int type = 0; type < 3; ++type) {
+            histogram_init(&latency[stage][type]);
+            for (int i = 0; i < num_threads; i++) {
+                histogram_merge(&latency[stage][type], &args[i].latency[stage][type]);
+            }
+        }
+    }
+
+    double total_ms = elapsed_ms(&begin, &end);
+    fprintf(stdout, "Total operation time (ms): %.3f\n", total_ms);
+    fprintf(stdout, "Throughput (ops/s): %.0f\n", total_ops / total_ms * 1000);
+
+    if (sample_every > 1) {
+        printf("Latencies of every %d-th operation:\n", sample_every);
+    }
+    const char* type_names[3] = {"insert", "delete", "lookup"};
+    char names[NUM_STAGES * 3][32];
+    const char* name_ptrs[NUM_STAGES * 3];
+    int num_stages = paced ? NUM_STAGES : 1;
+
+    histogram_print_header(stdout);
+    for (int stage = 0; stage < num_stages; ++stage) {
+        for (int type = 0; type < 3; ++type) {
+            char* name = names[stage * 3 + type];
+            snprintf(name, sizeof(names[0]), "%s_%s", stage_names[stage], type_names[type]);
+            name_ptrs[stage * 3 + type] = name;
+            histogram_print_summary(stdout, &latency[stage][type], name);
+        }
+    }
+
+    if (histogram_path != NULL && histogram_export(histogram_path, &latency[0][0], name_ptrs, num_stages * 3) != 0) {
+        fprintf(stderr, "Failed to export histograms to %s.\n", histogram_path);
+    }
+
+    hashtable_stats_print(stdout, table);
+
+    printf("Keys in the table: %d\n", hashtable_size(table));
+
+    pthread_barrier_destroy(&start_barrier);
+    free(chunks);
+    free(args);
+    trace_close(&trace);
+
+    int freed = hashtable_free_parallel(table, num_threads);
+    if (freed != 0) {
+        fprintf(stderr, "Failed to free hash table.");
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void execute(HashTable* table, const TraceRecord* record) {
+    switch (record->type) {
+        case Insert:
+            hashtable_insert(table, record->key);
+            break;
+        case Delete:
+            hashtable_delete(table, record->key);
+            break;
+        case Lookup:
+            hashtable_lookup(table, record->key);
+            break;
+        default:
+            break;
+    }
+}
+
+void* thread_func(void* thd_args) {
+    ThreadArgs* args = (ThreadArgs*)thd_args;
+
+    HashTable* table = args->table;
+    double speed = args->speed;
+    int sample_every = args->sample_every;
+
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = start_ticks;
+
+    uint64_t i = 0;
+    for (int c = 0; c < args->num_chunks; ++c) {
+        const TraceChunk* chunk = args->chunks[c];
+        const TraceRecord* records = trace_chunk_records(chunk);
+
+        for (uint32_t r = 0; r < chunk->num_records; ++r, ++i) {
+            const TraceRecord* record = &records[r];
+            if (record->type < Insert || record->type > Lookup) {
+                continue;
+            }
+
+            if (speed == 0.0) {
+                if (i % sample_every != 0) {
+                    execute(table, record);
+                    continue;
+                }
+
+                uint64_t begin = timer_now();
+                execute(table, record);
+                uint64_t end = timer_now();
+                histogram_record(&args->latency[Service][record->type], timer_ticks_to_ns(end - begin));
+                continue;
+            }
+
+            // Wait for the recorded arrival. When behind schedule, issue at once and account for the lag, so a
+            // slow build is not hidden by fewer operations being issued (coordinated omission).
+            uint64_t scheduled_ns = (uint64_t)(record->time_ns / speed);
+            uint64_t begin = timer_now();
+            while (timer_ticks_to_ns(begin - start) < scheduled_ns) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+                begin = timer_now();
+            }
+
+            execute(table, record);
+
+            if (i % sample_every == 0) {
+                uint64_t end = timer_now();
+                uint64_t service = timer_ticks_to_ns(end - begin);
+                uint64_t begin_ns = timer_ticks_to_ns(begin - start);
+                uint64_t lag = begin_ns > scheduled_ns ? begin_ns - scheduled_ns : 0;
+                histogram_record(&args->latency[Service][record->type], service);
+                histogram_record(&args->latency[Lag][record->type], lag);
+                histogram_record(&args->latency[EndToEnd][record->type], lag + service);
+            }
+        }
+    }
+
+    args->num_ops = i;
+    pthread_exit(NULL);
+}
@@ -1,11 +1,21 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "batch.h"
 #include "hashtable.h"
+#include "histogram.h"
 #include "queue.h"
+#include "replication.h"
 #include "shm.h"
+#include "timer.h"
+#include "trace.h"
+#include "transport.h"
+#include "workerpool.h"
 
 // For controlling the worker threads
 pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
@@ -16,14 +26,70 @@ pthread_cond_t main_cond = PTHREAD_COND_INITIALIZER;
 pthread_mutex_t main_mutex = PTHREAD_MUTEX_INITIALIZER;
 int left_over;  // last worker will signal the main thread, should set it to num_threads
 
+// Latency breakdown of an operation. Queueing is only known for operations stamped by the producer.
+enum Stage { Service = 0, Queueing = 1, EndToEnd = 2, NUM_STAGES = 3 };
+const char* stage_names[NUM_STAGES] = {"service", "queue", "end_to_end"};
+
 typedef struct ThreadArgs {
     int id;
     HashTable* table;
     OperationQueue* queue;
     int num_ops;
     bool is_ready;
+    int sample_every;    // time every n-th operation only
+    int width;           // operations dequeued and executed together
+    WorkerStats* stats;  // published in the shared memory, NULL if there are too many workers
+    TraceBuffer* trace;  // captures the dequeued operations, NULL unless capturing
+    bool atomic_groups;  // apply compound requests, else refuse them
+    bool split_lanes;    // dequeue from both lanes of the queue with the scheduler
+    LaneScheduler scheduler;
+    WorkerPool* pool;      // shares the operations among the active workers, NULL for num_ops each
+    ReplPrimary* primary;  // applies the writes and ships them to the followers, NULL unless primary
+    bool read_only;        // a follower refuses the writes of its clients
+    Transport* transport;  // answers the operations of socket clients, NULL if the clients use the shared memory
+
+    Histogram latency[NUM_STAGES][3];  // indexed by Stage and OperationType
 } ThreadArgs;
 
+// Apply the operations of a compound request atomically and answer its producer
+static void serve_compound(ThreadArgs* args, const Operation* op, uint64_t now) {
+    CompoundRequest* request = &args->queue->mailboxes[op->key];
+    int n = request->num_ops;
+
+    if (args->atomic_groups && n > 0 && n <= COMPOUND_MAX_OPS && args->primary != NULL) {
+        request->applied = repl_primary_apply(args->primary, request->keys, request->types, n,
+                                              request->all_or_nothing, request->succeeded);
+    } else if (args->atomic_groups && n > 0 && n <= COMPOUND_MAX_OPS) {
+        request->applied = hashtable_apply(args->table, request->keys, request->types, n, request->all_or_nothing,
+                                           request->succeeded);
+    } else {
+        for (int i = 0; i < n && i < COMPOUND_MAX_OPS; ++i) {
+            request->succeeded[i] = false;
+        }
+        request->applied = false;
+    }
+
+    for (int i = 0; i < n && i < COMPOUND_MAX_OPS; ++i) {
+        if (args->stats != NULL) {
+            stats_record(args->stats, request->types[i], request->succeeded[i]);
+        }
+
+        // Replayed one at a time
+        if (args->trace != NULL) {
+            Operation inner = {request->keys[i], request->types[i], 0, op->timestamp, op->tag};
+            trace_record(args->trace, &inner, now);
+        }
+    }
+
+    compound_complete(request);
+}
+
+static bool replicate_write(void* primary, int key, OperationType type) {
+    return repl_primary_write((ReplPrimary*)primary, key, type);
+}
+
+static bool refuse_write(void*, int, OperationType) { return false; }
+
 // Works as workload consumer
 void* thread_func(void* thd_args) {
     ThreadArgs* args = (ThreadArgs*)thd_args;
@@ -32,6 +98,16 @@ void* thread_func(void* thd_args) {
     HashTable* table = args->table;
     OperationQueue* queue = args->queue;
     int num_ops = args->num_ops;
+    int sample_every = args->sample_every;
+    int width = args->width;
+    WorkerStats* stats = args->stats;
+    TraceBuffer* trace = args->trace;
+    WorkerPool* pool = args->pool;
+    BatchWriter write = args->primary != NULL ? replicate_write : args->read_only ? refuse_write : NULL;
+
+    if (stats != NULL) {
+        hashtable_set_chain_sink(&stats->chains);
+    }
 
     // Wait until all workers are generated
     pthread_mutex_lock(&worker_mutex);
@@ -39,26 +115,88 @@ void* thread_func(void* thd_args) {
     pthread_cond_wait(&worker_cond, &worker_mutex);
     pthread_mutex_unlock(&worker_mutex);
 
-    for (int i = 0; i < num_ops; i++) {
-        Operation op;
-        op = dequeue(queue);
+    Operation ops[BATCH_MAX_OPS];
+    bool succeeded[BATCH_MAX_OPS];
+    LaneScheduler* scheduler = args->split_lanes ? &args->scheduler : NULL;
+    int claimed = 0;  // operations claimed from the pool but not dequeued yet
+    int n;
+    for (int i = 0; pool != NULL || i < num_ops; i += n) {
+        // Never park on claimed operations, nobody else would dequeue them
+        if (pool != NULL && claimed == 0 && !worker_pool_checkpoint(pool, tid)) {
+            break;
+        }
+        while (pool != NULL && claimed < width && worker_pool_claim(pool)) {
+            claimed++;
+        }
+        int max = pool != NULL ? claimed : num_ops - i < width ? num_ops - i : width;
+        if (max == 0) {
+            break;
+        }
+
+        // Only the first operation is waited for: a socket client keeps a window of requests in flight and sends no
+        // more until they are answered. A compound request ends the batch, its producer waits for the answer.
+        n = dequeue_batch(queue, scheduler, ops, max);
+        claimed -= pool != NULL ? n : 0;
+        int num_single = ops[n - 1].type == Compound ? n - 1 : n;
+
+        // printf("[Server %d] type: %d, key: %d\n", tid, (int)ops[0].type, ops[0].key);
+        // Time the batch if it holds a sampled operation, each of its operations is served by the whole batch
+        int first_sampled = (i + sample_every - 1) / sample_every * sample_every;
+        bool timed = first_sampled < i + n;
+        uint64_t begin = timed || trace != NULL ? timer_now() : 0;
+
+        if (trace != NULL) {
+            for (int j = 0; j < num_single; ++j) {
+                trace_record(trace, &ops[j], begin);
+            }
+        }
 
-        // printf("[Server %d] type: %d, key: %d\n", tid, (int)op.type, op.key);
-        switch (op.type) {
-            case Insert:
-                hashtable_insert(table, op.key);
-                break;
-            case Delete:
-                hashtable_delete(table, op.key);
-                break;
-            case Lookup:
-                hashtable_lookup(table, op.key);
-                break;
-            default:
-                assert(false);  // should never happen
+        batch_execute_writes(table, ops, succeeded, num_single, width, write, args->primary);
+        for (int j = 0; j < num_single; ++j) {
+            queue_complete(queue, &ops[j]);
+        }
+        if (args->transport != NULL) {
+            transport_answer(args->transport, ops, succeeded, num_single);
+        }
+        if (num_single < n) {
+            serve_compound(args, &ops[num_single], begin);
+        }
+
+        if (stats != NULL) {
+            for (int j = 0; j < num_single; ++j) {
+                stats_record(stats, ops[j].type, succeeded[j]);
+            }
+        }
+
+        if (timed) {
+            uint64_t service = timer_ticks_to_ns(timer_now() - begin);
+            for (int j = first_sampled - i; j < num_single; j += sample_every) {
+                const Operation* op = &ops[j];
+                histogram_record(&args->latency[Service][op->type], service);
+
+                // Time from the producer's enqueue until the batch was dequeued, including the wait for the slot
+                if (op->timestamp != 0) {
+                    uint64_t queueing = begin > op->timestamp ? timer_ticks_to_ns(begin - op->timestamp) : 0;
+                    histogram_record(&args->latency[Queueing][op->type], queueing);
+                    histogram_record(&args->latency[EndToEnd][op->type], queueing + service);
+                }
+            }
+        }
+
+        if (pool != NULL) {
+            worker_pool_served(pool, n);
         }
     }
 
+    // The parked workers exit as well once everything is claimed
+    if (pool != NULL) {
+        worker_pool_wake_all(pool);
+    }
+
+    if (trace != NULL) {
+        trace_buffer_flush(trace);
+    }
+
     int order = __sync_sub_and_fetch(&left_over, 1);
     if (order == 0) {  // last thread exiting should wakeup the main thread
         pthread_mutex_lock(&main_mutex);
@@ -69,18 +207,216 @@ void* thread_func(void* thd_args) {
     pthread_exit(NULL);
 }
 
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <hashtable_size>\n", prog);
+    fprintf(stderr, "  -a <none|compact|scatter>  thread placement policy\n");
+    fprintf(stderr, "  -l <llc>                   only use the cpus of this LLC domain\n");
+    fprintf(stderr, "  -o <offset>                skip the first cpus of the placement order\n");
+    fprintf(stderr, "  -c <capacity>              put a hot-key cache of this many keys in front of the table\n");
+    fprintf(stderr, "  -f                         put a counting Bloom filter in front of every bucket\n");
+    fprintf(stderr, "  -i                         index the chains that grow long for logarithmic walks\n");
+    fprintf(stderr, "  -C <max_keys>              evict keys with CLOCK beyond this many keys\n");
+    fprintf(stderr, "  -Y <max_mib>               evict keys with CLOCK beyond this many MiB of nodes\n");
+    fprintf(stderr, "  -E <ttl_ms>                expire keys this long after their insert\n");
+    fprintf(stderr, "  -S <n>                     time every n-th operation only (default: 1)\n");
+    fprintf(stderr, "  -b <width>                 dequeue up to this many operations and interleave their lookups\n");
+    fprintf(stderr, "  -H <path>                  export latency histograms as CSV, or JSON for a .json path\n");
+    fprintf(stderr, "  -K <n>                     time every n-th lock acquisition into a lock profile (USE_PROBES)\n");
+    fprintf(stderr, "  -r <path>                  capture the dequeued operations into a trace for replay\n");
+    fprintf(stderr, "  -m                         apply the compound requests of clients atomically\n");
+    fprintf(stderr, "  -L <strict|weight>         give lookups their own lane, served first or weight per write\n");
+    fprintf(stderr, "  -P <min>[:<max>]           scale the workers with the queue depth (default max: cores)\n");
+    fprintf(stderr, "  -R <snapshot>              ship the writes to followers, keeping snapshots of the table here\n");
+    fprintf(stderr, "  -F                         follow the primary's writes and serve lookups, refusing writes\n");
+    fprintf(stderr, "  -Q <name>                  shared memory segment of the clients (default: %s)\n", SHM_ID);
+    fprintf(stderr, "  -U <path>                  serve the clients over a Unix-domain socket at this path\n");
+    fprintf(stderr, "  -N <port>                  serve the clients over TCP on this loopback port\n");
+    fprintf(stderr, "  -T                         track the chain lengths for htstat, costs every insert and delete\n");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <hashtable_size>\n", argv[0]);
+    PinPolicy pin_policy = PinNone;
+    int pin_llc = -1;
+    int pin_offset = 0;
+    int hotcache_capacity = 0;
+    bool use_filter = false;
+    bool use_index = false;
+    bool use_cache = false;
+    CacheConfig cache_config;
+    cache_default_config(&cache_config);
+    bool atomic_groups = false;
+    bool split_lanes = false;
+    LanePolicy lane_policy = LaneStrict;
+    int lane_weight = 1;
+    bool elastic = false;
+    ElasticConfig elastic_config;
+    elastic_default_config(&elastic_config, sysconf(_SC_NPROCESSORS_ONLN));
+    int sample_every = 1;
+    int lockprof_every = 0;
+    int width = 1;
+    const char* histogram_path = NULL;
+    const char* trace_path = NULL;
+    const char* snapshot_path = NULL;
+    bool follow = false;
+    const char* unix_path = NULL;
+    int tcp_port = 0;
+    bool track_chains = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:l:o:c:fiC:Y:E:S:b:H:r:mL:P:R:FQ:U:N:K:T")) != -1) {
+        switch (opt) {
+            case 'a':
+                if (placement_parse_policy(optarg, &pin_policy) != 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'l':
+                pin_llc = atoi(optarg);
+                break;
+            case 'o':
+                pin_offset = atoi(optarg);
+                break;
+            case 'c':
+                hotcache_capacity = atoi(optarg);
+                break;
+            case 'f':
+                use_filter = true;
+                break;
+            case 'i':
+                use_index = true;
+                break;
+            case 'C':
+                cache_config.max_keys = atoi(optarg);
+                use_cache = true;
+                break;
+            case 'Y':
+                cache_config.max_bytes = (size_t)atol(optarg) << 20;
+                use_cache = true;
+                break;
+            case 'E':
+                cache_config.default_ttl_ms = atoi(optarg);
+                use_cache = true;
+                break;
+            case 'S':
+                sample_every = atoi(optarg);
+                break;
+            case 'b':
+                width = atoi(optarg);
+                break;
+            case 'H':
+                histogram_path = optarg;
+                break;
+            case 'K':
+                lockprof_every = atoi(optarg);
+                if (lockprof_every <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'r':
+                trace_path = optarg;
+                break;
+            case 'm':
+                atomic_groups = true;
+                break;
+            case 'L':
+                split_lanes = true;
+                if (strcmp(optarg, "strict") != 0) {
+                    lane_policy = LaneWeighted;
+                    lane_weight = atoi(optarg);
+                    if (lane_weight <= 0) {
+                        usage(argv[0]);
+                    }
+                }
+                break;
+            case 'P':
+                elastic = true;
+                switch (sscanf(optarg, "%d:%d", &elastic_config.min_workers, &elastic_config.max_workers)) {
+                    case 1:
+                        if (elastic_config.max_workers < elastic_config.min_workers) {
+                            elastic_config.max_workers = elastic_config.min_workers;
+                        }
+                        break;
+                    case 2:
+                        break;
+                    default:
+                        usage(argv[0]);
+                }
+                break;
+            case 'R':
+                snapshot_path = optarg;
+                break;
+            case 'F':
+                follow = true;
+                break;
+            case 'Q':
+                if (optarg[0] != '/') {
+                    usage(argv[0]);
+                }
+                shm_set_id(optarg);
+                break;
+            case 'U':
+                unix_path = optarg;
+                break;
+            case 'N':
+                tcp_port = atoi(optarg);
+                if (tcp_port <= 0 || tcp_port > 65535) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'T':
+                track_chains = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+    }
+
+    int hashtable_size = atoi(argv[optind]);
+    if (hashtable_size <= 0 || sample_every <= 0) {
+        fprintf(stderr, "<hashtable_size> and sampling must be an integer greater than 0.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (width <= 0 || width > BATCH_MAX_OPS) {
+        fprintf(stderr, "The batch width must be between 1 and %d.\n", BATCH_MAX_OPS);
+        exit(EXIT_FAILURE);
+    }
+    if (elastic && (elastic_config.min_workers <= 0 || elastic_config.max_workers < elastic_config.min_workers)) {
+        fprintf(stderr, "The worker pool needs 1 <= min <= max workers.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (snapshot_path != NULL && follow) {
+        fprintf(stderr, "A server is either a primary or a follower.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Evictions and expirations happen on their own in every table, so they cannot be shipped
+    if ((snapshot_path != NULL || follow) && use_cache) {
+        fprintf(stderr, "Replication does not support the cache mode.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (unix_path != NULL && tcp_port != 0) {
+        fprintf(stderr, "The clients connect over a Unix-domain socket or TCP, not both.\n");
         exit(EXIT_FAILURE);
     }
 
-    int hashtable_size = atoi(argv[1]);
-    if (hashtable_size <= 0) {
-        fprintf(stderr, "<hashtable_size> must be an integer greater than 0.\n");
+    timer_calibrate();
+
+    Topology topo;
+    Placement placement;
+    if (topology_detect(&topo) != 0 || placement_init(&placement, &topo, pin_policy, pin_llc, pin_offset) != 0) {
+        fprintf(stderr, "Failed to place threads with the given affinity options.\n");
         exit(EXIT_FAILURE);
     }
 
+    // The main thread initializes the queue and the table, so keep it (and the first touch) on the workers' node
+    int home_node = placement_home_node(&placement);
+    affinity_pin_self(placement_cpu(&placement, 0));
+    affinity_prefer_node(home_node);
+
     // Initialize shared memory
     SharedMem* area = (SharedMem*)shm_create();
     if (area == NULL) {
@@ -89,38 +425,198 @@ int main(int argc, char** argv) {
     }
     fprintf(stdout, "Initialized shared memory of size: %ld\n", sizeof(*area));
 
+    affinity_bind_memory(area, sizeof(*area), home_node);
     shm_init(area);
 
     // Setup operation queue for client/server communication
     init_queue(&area->queue);
+    if (split_lanes) {
+        queue_split_lanes(&area->queue);
+    }
 
     HashTable* table = hashtable_create(hashtable_size);
     if (table == NULL) {
         fprintf(stderr, "Failed to create hash table with %d buckets.", hashtable_size);
     }
 
+    if (hotcache_capacity > 0 && hashtable_attach_hotcache(table, hotcache_capacity) != 0) {
+        fprintf(stderr, "Failed to create hot-key cache of %d keys.", hotcache_capacity);
+    }
+
+    if (use_filter && hashtable_attach_filter(table) != 0) {
+        fprintf(stderr, "Failed to create the bucket filters.");
+    }
+
+    if (use_index && hashtable_attach_index(table) != 0) {
+        fprintf(stderr, "Failed to create the chain indexes.");
+    }
+
+    if (use_cache && hashtable_attach_cache(table, &cache_config) != 0) {
+        fprintf(stderr, "Failed to turn the table into a cache.");
+    }
+
+    if (lockprof_every > 0 && hashtable_attach_lockprof(table, lockprof_every) != 0) {
+        fprintf(stderr, "Failed to profile the lock waits, it needs a build with -DUSE_PROBES=ON.\n");
+    }
+
+    if (atomic_groups && follow) {
+        fprintf(stderr, "Followers refuse compound requests.\n");
+        atomic_groups = false;
+    }
+
+    if (atomic_groups && hashtable_attach_gates(table) != 0) {
+        fprintf(stderr, "Failed to create the bucket gates, refusing compound requests.\n");
+        atomic_groups = false;
+    }
+
+    // Publish live statistics for htstat, the chain lengths only on request
+    stats_init(&area->stats, hashtable_size, hashtable_policy_name());
+    if (track_chains && hashtable_track_chains(table) != 0) {
+        fprintf(stderr, "Failed to track the chain lengths, cuckoo hashing has no chains.\n");
+    } else {
+        area->stats.chains_tracked = track_chains;
+    }
+
+    // The table is loaded before the workers share it: recovered by a primary, bootstrapped and caught up by a follower
+    ReplLog* repl_log = NULL;
+    ReplPrimary* primary = NULL;
+    ReplFollower* follower = NULL;
+    if (snapshot_path != NULL) {
+        primary = (ReplPrimary*)malloc(sizeof(ReplPrimary));
+        repl_log = repl_log_open();
+        if (primary == NULL || repl_log == NULL ||
+            repl_primary_open(primary, repl_log, table, snapshot_path, &area->stats) != 0) {
+            fprintf(stderr, "Failed to open the replication log with the snapshot %s.\n", snapshot_path);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stdout, "Primary recovered %ld keys and replayed %ld records%s, shipping from LSN %lu.\n",
+                primary->recovered, primary->replayed, primary->new_epoch ? " into a new epoch" : "",
+                repl_log->head);
+    } else if (follow) {
+        follower = (ReplFollower*)malloc(sizeof(ReplFollower));
+        repl_log = repl_log_attach();
+        if (follower == NULL || repl_log == NULL) {
+            fprintf(stderr, "Failed to attach the replication log. Please make sure that a primary ran.\n");
+            exit(EXIT_FAILURE);
+        }
+        repl_follower_init(follower, repl_log, table, &area->stats);
+        int64_t loaded = repl_follower_bootstrap(follower);
+        if (loaded < 0) {
+            fprintf(stderr, "Failed to bootstrap from the primary's snapshot.\n");
+            exit(EXIT_FAILURE);
+        }
+        uint64_t bootstrapped = follower->next;
+        while (repl_follower_poll(follower, REPL_APPLY_RECORDS) > 0) {
+        }
+        fprintf(stdout, "Follower bootstrapped %ld keys at LSN %lu and caught up to LSN %lu.\n", loaded,
+                bootstrapped, follower->next);
+        if (repl_follower_start(follower) != 0) {
+            fprintf(stderr, "Failed to start applying the primary's writes.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Socket clients do not map the shared memory, the front end enqueues their requests and says what load they run
+    Transport* transport = NULL;
+    if (unix_path != NULL || tcp_port != 0) {
+        transport = (Transport*)malloc(sizeof(Transport));
+        if (transport == NULL || transport_open(transport, &area->queue, unix_path, tcp_port) != 0) {
+            fprintf(stderr, "Failed to listen for socket clients.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (unix_path != NULL) {
+            fprintf(stdout, "Listening on %s\n", unix_path);
+        } else {
+            fprintf(stdout, "Listening on 127.0.0.1:%d\n", tcp_port);
+        }
+    }
+
     fprintf(stdout, "Server is ready, waiting for client connection...\n");
 
     area->server_is_ready = true;
-    while (!area->client_is_ready) {
+    while (transport != NULL ? !transport_ready(transport) : !area->client_is_ready) {
         usleep(100000);  // sleep 100 ms
     }
+    if (transport != NULL) {
+        area->num_threads = transport->num_threads;
+        area->num_ops_per_thread = transport->num_ops_per_thread;
+    }
 
     fprintf(stdout, "Client is ready! Executing operations from client.\n");
+    if (split_lanes && lane_policy == LaneStrict) {
+        fprintf(stdout, "Lookups take their own lane, served before writes.\n");
+    } else if (split_lanes) {
+        fprintf(stdout, "Lookups take their own lane, up to %d between two writes.\n", lane_weight);
+    }
+    // An elastic pool starts its largest size and parks the workers it does not need
+    int num_workers = elastic ? elastic_config.max_workers : area->num_threads;
+    WorkerPool pool;
+    if (elastic) {
+        long total_ops = (long)area->num_threads * area->num_ops_per_thread;
+        if (worker_pool_init(&pool, &elastic_config, total_ops) != 0) {
+            fprintf(stderr, "Failed to create the worker pool.\n");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stdout, "Elastic pool of %d to %d workers.\n", elastic_config.min_workers, elastic_config.max_workers);
+    }
+    placement_print(stdout, &placement, "worker", num_workers);
 
-    pthread_t threads[area->num_threads];
-    ThreadArgs args[area->num_threads];
+    if (num_workers > STATS_MAX_WORKERS) {
+        fprintf(stderr, "Only the first %d workers publish statistics.\n", STATS_MAX_WORKERS);
+    }
+    area->stats.running = true;
+    int num_published = num_workers < STATS_MAX_WORKERS ? num_workers : STATS_MAX_WORKERS;
+    area->stats.active_workers = elastic ? elastic_config.min_workers : num_workers;
+    __atomic_store_n(&area->stats.num_workers, num_published, __ATOMIC_RELEASE);
+
+    TraceWriter trace_writer;
+    TraceBuffer* trace_buffers = NULL;
+    if (trace_path != NULL) {
+        trace_buffers = (TraceBuffer*)malloc(sizeof(TraceBuffer) * num_workers);
+        if (trace_buffers == NULL || trace_writer_open(&trace_writer, trace_path, num_workers) != 0) {
+            fprintf(stderr, "Failed to create the trace %s.\n", trace_path);
+            free(trace_buffers);
+            trace_buffers = NULL;
+        }
+    }
+
+    pthread_t threads[num_workers];
+    ThreadArgs* args = (ThreadArgs*)malloc(sizeof(ThreadArgs) * num_workers);  // too large for the stack
 
-    left_over = area->num_threads;
+    left_over = num_workers;
 
-    for (int i = 0; i < area->num_threads; i++) {
+    for (int i = 0; i < num_workers; i++) {
         args[i].id = i;
         args[i].table = table;
         args[i].queue = &area->queue;
         args[i].num_ops = area->num_ops_per_thread;
         args[i].is_ready = false;
+        args[i].sample_every = sample_every;
+        args[i].width = width;
+        args[i].stats = i < STATS_MAX_WORKERS ? &area->stats.workers[i] : NULL;
+        args[i].trace = NULL;
+        args[i].atomic_groups = atomic_groups;
+        args[i].split_lanes = split_lanes;
+        lane_scheduler_init(&args[i].scheduler, lane_policy, lane_weight);
+        args[i].pool = elastic ? &pool : NULL;
+        args[i].primary = primary;
+        args[i].read_only = follow;
+        args[i].transport = transport;
+        if (trace_buffers != NULL) {
+            trace_buffer_init(&trace_buffers[i], &trace_writer, i);
+            args[i].trace = &trace_buffers[i];
+        }
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            for (int type = 0; type < 3; ++type) {
+                histogram_init(&args[i].latency[stage][type]);
+            }
+        }
 
-        pthread_create(&threads[i], 0, thread_func, (void**)&args[i]);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        affinity_set_attr(&attr, placement_cpu(&placement, i));
+        pthread_create(&threads[i], &attr, thread_func, (void**)&args[i]);
+        pthread_attr_destroy(&attr);
 
         // Wait for the worker thread to fall asleep. Using spin wait seems enough.
         while (!args[i].is_ready) {
@@ -128,6 +624,9 @@ int main(int argc, char** argv) {
         }
     }
 
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+
     // Wake the worker threads waiting on the condition variable
     pthread_mutex_lock(&worker_mutex);
 
@@ -139,19 +638,132 @@ int main(int argc, char** argv) {
     pthread_cond_broadcast(&worker_cond);
     pthread_mutex_unlock(&worker_mutex);
 
-    // Main thread asleep
-    pthread_cond_wait(&main_cond, &main_mutex);
+    // Main thread asleep, or steering the pool between the samples until the last worker is done
+    if (!elastic) {
+        pthread_cond_wait(&main_cond, &main_mutex);
+    } else {
+        uint64_t last = timer_now();
+        while (__atomic_load_n(&left_over, __ATOMIC_ACQUIRE) > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)elastic_config.interval_us * 1000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&main_cond, &main_mutex, &deadline);
+
+            uint64_t now = timer_now();
+            int active = worker_pool_sample(&pool, queue_occupancy(&area->queue), timer_ticks_to_ns(now - last));
+            last = now;
+            __atomic_store_n(&area->stats.active_workers, active, __ATOMIC_RELAXED);
+            __atomic_store_n(&area->stats.scale_ups, pool.scale_ups, __ATOMIC_RELAXED);
+            __atomic_store_n(&area->stats.scale_downs, pool.scale_downs, __ATOMIC_RELAXED);
+        }
+    }
     pthread_mutex_unlock(&main_mutex);
 
-    for (int i = 0; i < area->num_threads; i++) {
+    for (int i = 0; i < num_workers; i++) {
         pthread_join(threads[i], NULL);
     }
 
-    int freed = hashtable_free(table);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    if (transport != NULL) {
+        transport_close(transport);  // sends the last answers
+    }
+    double total_ms = (end.tv_nsec - begin.tv_nsec) / 1000000.0 + (end.tv_sec - begin.tv_sec) * 1000;
+    long total_ops = (long)area->num_threads * area->num_ops_per_thread;
+    fprintf(stdout, "Served %ld operations in %.3f ms (%.0f ops/s)\n", total_ops, total_ms,
+            total_ops / total_ms * 1000);
+    if (elastic) {
+        fprintf(stdout, "Elastic pool: %.2f active workers on average, scaled up %lu times, down %lu times\n",
+                pool.samples == 0 ? (double)elastic_config.min_workers : (double)pool.active_samples / pool.samples,
+                pool.scale_ups, pool.scale_downs);
+        worker_pool_destroy(&pool);
+    }
+    if (transport != NULL) {
+        fprintf(stdout, "Socket front end: %lu requests in %lu reads (%.1f per read), %lu sends (%.1f per send)\n",
+                transport->requests, transport->reads,
+                transport->reads == 0 ? 0.0 : (double)transport->requests / transport->reads, transport->sends,
+                transport->sends == 0 ? 0.0 : (double)transport->requests / transport->sends);
+        free(transport);
+    }
+
+    Histogram latency[NUM_STAGES][3];
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        for (int type = 0; type < 3; ++type) {
+            histogram_init(&latency[stage][type]);
+            for (int i = 0; i < num_workers; i++) {
+                histogram_merge(&latency[stage][type], &args[i].latency[stage][type]);
+            }
+        }
+    }
+    free(args);
+
+    if (trace_buffers != NULL) {
+        if (trace_writer_close(&trace_writer) != 0) {
+            fprintf(stderr, "Failed to write the trace %s.\n", trace_path);
+        } else {
+            fprintf(stdout, "Captured %lu operations into %s\n", trace_writer.header.num_records, trace_path);
+        }
+        free(trace_buffers);
+    }
+
+    // Only report the queueing stages if the operations were stamped (client -e, or the socket front end)
+    uint64_t stamped = 0;
+    for (int type = 0; type < 3; ++type) {
+        stamped += latency[Queueing][type].count;
+    }
+    int num_stages = stamped == 0 ? 1 : NUM_STAGES;
+
+    const char* type_names[3] = {"insert", "delete", "lookup"};
+    char names[NUM_STAGES * 3][32];
+    const char* name_ptrs[NUM_STAGES * 3];
+
+    fprintf(stdout, "Latency breakdown with %s locking:\n", hashtable_policy_name());
+    histogram_print_header(stdout);
+    for (int stage = 0; stage < num_stages; ++stage) {
+        for (int type = 0; type < 3; ++type) {
+            char* name = names[stage * 3 + type];
+            snprintf(name, sizeof(names[0]), "%s_%s", stage_names[stage], type_names[type]);
+            name_ptrs[stage * 3 + type] = name;
+            histogram_print_summary(stdout, &latency[stage][type], name);
+        }
+    }
+
+    if (histogram_path != NULL && histogram_export(histogram_path, &latency[0][0], name_ptrs, num_stages * 3) != 0) {
+        fprintf(stderr, "Failed to export histograms to %s.\n", histogram_path);
+    }
+
+    if (primary != NULL) {
+        if (repl_primary_close(primary) != 0) {
+            fprintf(stderr, "Failed to write the snapshot %s.\n", snapshot_path);
+        }
+        fprintf(stdout, "Shipped up to LSN %lu, wrote %lu snapshots.\n", repl_log->head, primary->snapshots);
+        free(primary);
+    }
+    if (follower != NULL) {
+        repl_follower_stop(follower);
+        fprintf(stdout, "Follower applied %lu records up to LSN %lu (head: %lu), resynchronized %lu times.\n",
+                follower->applied, follower->next, __atomic_load_n(&repl_log->head, __ATOMIC_RELAXED),
+                follower->resyncs);
+        histogram_print_header(stdout);
+        histogram_print_summary(stdout, &follower->lag, "replication_lag");
+        free(follower);
+    }
+    if (repl_log != NULL) {
+        repl_log_detach(repl_log);
+    }
+
+    hashtable_stats_print(stdout, table);
+    if (table->lockprof != NULL) {
+        lockprof_print(stdout, table->lockprof, LOCKPROF_TOP);
+    }
+
+    int freed = hashtable_free_parallel(table, num_workers);
     if (freed != 0) {
         fprintf(stderr, "Failed to free hash table.");
     }
 
+    area->stats.running = false;
     shm_free(area);
 
     return EXIT_SUCCESS;
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "HashTableConfig.h"
+
+#define MAX_VALUES (32)   // per swept parameter
+#define MAX_FIELDS (64)   // per benchmark record
+#define MAX_LINE (4096)
+
+// Comma separated values of a swept parameter, split in place
+typedef struct List {
+    char* items[MAX_VALUES];
+    int count;
+} List;
+
+// Header and record written by `benchmark -R`
+typedef struct Result {
+    char header[MAX_LINE];
+    char record[MAX_LINE];
+} Result;
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] [-- <benchmark options>]\n", prog);
+    fprintf(stderr, "  -p <policies>              comma separated policies (default: %s)\n", HashTable_POLICIES);
+    fprintf(stderr, "  -t <threads>               comma separated thread counts (default: 1, 2, 4, ... cores)\n");
+    fprintf(stderr, "  -b <buckets>               comma separated table sizes (default: 1024)\n");
+    fprintf(stderr, "  -w <mixes>                 comma separated workload mixes, see benchmark -w (default: a,b,c)\n");
+    fprintf(stderr, "  -r <repetitions>           runs per configuration (default: 3)\n");
+    fprintf(stderr, "  -n <num_ops_per_thread>    operations per thread and run (default: 100000)\n");
+    fprintf(stderr, "  -o <path>                  write CSV, or JSON if path ends in .json (default: CSV to stdout)\n");
+    fprintf(stderr, "  -B <dir>                   directory of the benchmark_<policy> binaries (default: own dir)\n");
+    exit(EXIT_FAILURE);
+}
+
+int split(char* str, List* list) {
+    list->count = 0;
+    for (char* item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (list->count == MAX_VALUES) {
+            return -1;
+        }
+        list->items[list->count++] = item;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+// Split a CSV line in place. Returns the number of fields.
+int split_fields(char* line, char** fields) {
+    int count = 0;
+    line[strcspn(line, "\n")] = '\0';
+    for (char* field = strtok(line, ","); field != NULL && count < MAX_FIELDS; field = strtok(NULL, ",")) {
+        fields[count++] = field;
+    }
+    return count;
+}
+
+// Run one benchmark and read back its result. Returns 0 on success, else -1.
+int run_benchmark(const char* bin_dir, const char* policy, const char* threads, const char* buckets, const char* mix,
+                  const char* num_ops, char** extra_args, int num_extra_args, Result* result) {
+    char path[MAX_LINE];
+    snprintf(path, sizeof(path), "%s/benchmark_%s", bin_dir, policy);
+
+    char result_path[] = "/tmp/sweep_XXXXXX";
+    int fd = mkstemp(result_path);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+
+    fflush(NULL);  // the child must not flush our buffered output again
+    pid_t pid = fork();
+    if (pid < 0) {
+        unlink(result_path);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // The human readable report of every run is not needed
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+
+        const char* argv[MAX_FIELDS];
+        int argc = 0;
+        argv[argc++] = path;
+        argv[argc++] = "-t";
+        argv[argc++] = threads;
+        argv[argc++] = "-w";
+        argv[argc++] = mix;
+        argv[argc++] = "-R";
+        argv[argc++] = result_path;
+        for (int i = 0; i < num_extra_args && argc < MAX_FIELDS - 3; ++i) {
+            argv[argc++] = extra_args[i];
+        }
+        argv[argc++] = buckets;
+        argv[argc++] = num_ops;
+        argv[argc] = NULL;
+
+        execv(path, (char* const*)argv);
+        fprintf(stderr, "Failed to execute %s.\n", path);
+        _exit(EXIT_FAILURE);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    int ret = -1;
+    FILE* in = fopen(result_path, "r");
+    if (in != NULL) {
+        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS &&
+            fgets(result->header, sizeof(result->header), in) != NULL &&
+            fgets(result->record, sizeof(result->record), in) != NULL) {
+            ret = 0;
+        }
+        fclose(in);
+    }
+    unlink(result_path);
+
+    return ret;
+}
+
+void read_cpu_model(char* model, size_t len) {
+    snprintf(model, len, "unknown");
+
+    FILE* in = fopen("/proc/cpuinfo", "r");
+    if (in == NULL) {
+        return;
+    }
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char* value = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && value != NULL) {
+            value += 2;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(model, len, "%s", value);
+            break;
+        }
+    }
+    fclose(in);
+}
+
+// Environment metadata as key/value pairs, so runs can be compared across machines and releases
+int read_environment(const char** keys, char values[][256], char** extra_args, int num_extra_args) {
+    struct utsname uts;
+    uname(&uts);
+
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+
+    int count = 0;
+    keys[count] = "date";
+    strftime(values[count++], 256, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    keys[count] = "host";
+    snprintf(values[count++], 256, "%s", uts.nodename);
+    keys[count] = "kernel";
+    snprintf(values[count++], 256, "%s %s %s", uts.sysname, uts.release, uts.machine);
+    keys[count] = "cpu";
+    read_cpu_model(values[count++], 256);
+    keys[count] = "cores";
+    snprintf(values[count++], 256, "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    keys[count] = "version";
+    snprintf(values[count++], 256, "%s", HashTable_VERSION);
+    keys[count] = "revision";
+    snprintf(values[count++], 256, "%s", HashTable_GIT_REVISION);
+    keys[count] = "compiler";
+    snprintf(values[count++], 256, "%s", __VERSION__);
+
+    keys[count] = "benchmark_args";
+    values[count][0] = '\0';
+    for (int i = 0; i < num_extra_args; ++i) {
+        size_t len = strlen(values[count]);
+        snprintf(values[count] + len, 256 - len, "%s%s", i == 0 ? "" : " ", extra_args[i]);
+    }
+    count++;
+
+    return count;
+}
+
+int main(int argc, char** argv) {
+    char policies_arg[MAX_LINE] = HashTable_POLICIES;
+    char threads_arg[MAX_LINE] = "";
+    char buckets_arg[MAX_LINE] = "1024";
+    char mixes_arg[MAX_LINE] = "a,b,c";
+    int repetitions = 3;
+    const char* num_ops = "100000";
+    const char* output_path = NULL;
+    char bin_dir[MAX_LINE] = "";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:b:w:r:n:o:B:")) != -1) {
+        switch (opt) {
+            case 'p':
+                snprintf(policies_arg, sizeof(policies_arg), "%s", optarg);
+                break;
+            case 't':
+                snprintf(threads_arg, sizeof(threads_arg), "%s", optarg);
+                break;
+            case 'b':
+                snprintf(buckets_arg, sizeof(buckets_arg), "%s", optarg);
+                break;
+            case 'w':
+                snprintf(mixes_arg, sizeof(mixes_arg), "%s", optarg);
+                break;
+            case 'r':
+                repetitions = atoi(optarg);
+                break;
+            case 'n':
+                num_ops = optarg;
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'B':
+                snprintf(bin_dir, sizeof(bin_dir), "%s", optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    // Everything after "--" is passed to every benchmark run
+    char** extra_args = argv + optind;
+    int num_extra_args = argc - optind;
+
+    if (repetitions <= 0 || atoi(num_ops) <= 0) {
+        fprintf(stderr, "Repetitions and operations must be an integer greater than 0.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (threads_arg[0] == '\0') {
+        long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long threads = 1; threads < ncores; threads *= 2) {
+            size_t len = strlen(threads_arg);
+            snprintf(threads_arg + len, sizeof(threads_arg) - len, "%ld,", threads);
+        }
+        size_t len = strlen(threads_arg);
+        snprintf(threads_arg + len, sizeof(threads_arg) - len, "%ld", ncores);
+    }
+
+    if (bin_dir[0] == '\0') {
+        ssize_t len = readlink("/proc/self/exe", bin_dir, sizeof(bin_dir) - 1);
+        if (len < 0) {
+            fprintf(stderr, "Failed to locate the benchmark binaries, please pass -B.\n");
+            exit(EXIT_FAILURE);
+        }
+        bin_dir[len] = '\0';
+        *strrchr(bin_dir, '/') = '\0';
+    }
+
+    List policies, threads, buckets, mixes;
+    if (split(policies_arg, &policies) != 0 || split(threads_arg, &threads) != 0 || split(buckets_arg, &buckets) != 0 ||
+        split(mixes_arg, &mixes) != 0) {
+        usage(argv[0]);
+    }
+
+    FILE* out = stdout;
+    if (output_path != NULL && (out = fopen(output_path, "w")) == NULL) {
+        fprintf(stderr, "Failed to open %s.\n", output_path);
+        exit(EXIT_FAILURE);
+    }
+    size_t output_len = output_path == NULL ? 0 : strlen(output_path);
+    bool json = output_len >= 5 && strcmp(output_path + output_len - 5, ".json") == 0;
+
+    const char* env_keys[16];
+    char env_values[16][256];
+    int num_env = read_environment(env_keys, env_values, extra_args, num_extra_args);
+
+    if (json) {
+        fprintf(out, "{\"environment\":{");
+        for (int i = 0; i < num_env; ++i) {
+            fprintf(out, "%s\"%s\":\"%s\"", i == 0 ? "" : ",", env_keys[i], env_values[i]);
+        }
+        fprintf(out, "},\n\"results\":[");
+    } else {
+        for (int i = 0; i < num_env; ++i) {
+            fprintf(out, "# %s: %s\n", env_keys[i], env_values[i]);
+        }
+    }
+
+    int num_runs = policies.count * threads.count * buckets.count * mixes.count * repetitions;
+    int run = 0;
+    int failed = 0;
+
+    for (int p = 0; p < policies.count; ++p) {
+        for (int b = 0; b < buckets.count; ++b) {
+            for (int w = 0; w < mixes.count; ++w) {
+                for (int t = 0; t < threads.count; ++t) {
+                    for (int r = 0; r < repetitions; ++r) {
+                        const char* policy = policies.items[p];
+                        fprintf(stderr, "[%d/%d] policy=%s threads=%s buckets=%s mix=%s repetition=%d\n", ++run,
+                                num_runs, policy, threads.items[t], buckets.items[b], mixes.items[w], r);
+
+                        Result result;
+                        if (run_benchmark(bin_dir, policy, threads.items[t], buckets.items[b], mixes.items[w], num_ops,
+                                          extra_args, num_extra_args, &result) != 0) {
+                            fprintf(stderr, "Benchmark failed, skipping.\n");
+                            ++failed;
+                            continue;
+                        }
+
+                        char* names[MAX_FIELDS];
+                        char* values[MAX_FIELDS];
+                        int num_fields = split_fields(result.header, names);
+                        if (split_fields(result.record, values) != num_fields) {
+                            fprintf(stderr, "Malformed benchmark result, skipping.\n");
+                            ++failed;
+                            continue;
+                        }
+
+                        if (json) {
+                            fprintf(out,
+                                    "%s\n{\"policy\":\"%s\",\"threads\":%s,\"buckets\":%s,\"mix\":\"%s\","
+                                    "\"ops_per_thread\":%s,\"repetition\":%d",
+                                    run - failed == 1 ? "" : ",", policy, threads.items[t], buckets.items[b],
+                                    mixes.items[w], num_ops, r);
+                            for (int i = 0; i < num_fields; ++i) {
+                                fprintf(out, ",\"%s\":%s", names[i], values[i]);
+                            }
+                            fprintf(out, "}");
+                        } else {
+                            if (run - failed == 1) {
+                                fprintf(out, "policy,threads,buckets,mix,ops_per_thread,repetition");
+                                for (int i = 0; i < num_fields; ++i) {
+                                    fprintf(out, ",%s", names[i]);
+                                }
+                                fprintf(out, "\n");
+                            }
+                            fprintf(out, "%s,%s,%s,%s,%s,%d", policy, threads.items[t], buckets.items[b],
+                                    mixes.items[w], num_ops, r);
+                            for (int i = 0; i < num_fields; ++i) {
+                                fprintf(out, ",%s", values[i]);
+                            }
+                            fprintf(out, "\n");
+                        }
+                        fflush(out);
+                    }
+                }
+            }
+        }
+    }
+
+    if (json) {
+        fprintf(out, "]}\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "%d of %d runs failed.\n", failed, num_runs);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
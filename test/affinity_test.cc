@@ -0,0 +1,73 @@
+#include "affinity.h"
+
+#include <gtest/gtest.h>
+#include <sched.h>
+
+/*
+ * Test topology detection.
+ * 1. Every allowed cpu is listed with a valid LLC and node
+ */
+TEST(AffinityTest, DetectsTopology) {
+    Topology topo;
+    ASSERT_EQ(topology_detect(&topo), 0);
+
+    ASSERT_GT(topo.num_cpus, 0);
+    for (int i = 0; i < topo.num_cpus; ++i) {
+        ASSERT_GE(topo.cpus[i].llc, 0);
+        ASSERT_LT(topo.cpus[i].llc, topo.num_llcs);
+        ASSERT_LT(topo.cpus[i].node, topo.num_nodes);
+    }
+}
+
+/*
+ * Test placement policies.
+ * 1. No cpu is handed out without pinning
+ * 2. Compact and scatter hand out every allowed cpu exactly once
+ * 3. Restricting to an LLC only hands out cpus of that LLC
+ */
+TEST(AffinityTest, Placement) {
+    Topology topo;
+    ASSERT_EQ(topology_detect(&topo), 0);
+
+    Placement placement;
+    ASSERT_EQ(placement_init(&placement, &topo, PinNone, -1, 0), 0);
+    ASSERT_EQ(placement_cpu(&placement, 0), -1);
+
+    PinPolicy policies[] = {PinCompact, PinScatter};
+    for (PinPolicy policy : policies) {
+        ASSERT_EQ(placement_init(&placement, &topo, policy, -1, 0), 0);
+        ASSERT_EQ(placement.num_cpus, topo.num_cpus);
+
+        for (int i = 0; i < topo.num_cpus; ++i) {
+            int cpu = placement_cpu(&placement, i);
+            ASSERT_NE(topology_node_of(&topo, cpu), -1);
+            for (int j = 0; j < i; ++j) {
+                ASSERT_NE(placement_cpu(&placement, j), cpu);
+            }
+        }
+    }
+
+    ASSERT_EQ(placement_init(&placement, &topo, PinCompact, 0, 0), 0);
+    for (int i = 0; i < placement.num_cpus; ++i) {
+        for (int j = 0; j < topo.num_cpus; ++j) {
+            if (topo.cpus[j].cpu == placement.cpus[i]) {
+                ASSERT_EQ(topo.cpus[j].llc, 0);
+            }
+        }
+    }
+
+    ASSERT_EQ(placement_init(&placement, &topo, PinCompact, -1, topo.num_cpus), -1);
+}
+
+TEST(AffinityTest, PinSelf) {
+    Topology topo;
+    ASSERT_EQ(topology_detect(&topo), 0);
+
+    ASSERT_EQ(affinity_pin_self(topo.cpus[0].cpu), 0);
+    ASSERT_EQ(sched_getcpu(), topo.cpus[0].cpu);
+
+    PinPolicy policy;
+    ASSERT_EQ(placement_parse_policy("scatter", &policy), 0);
+    ASSERT_EQ(policy, PinScatter);
+    ASSERT_EQ(placement_parse_policy("bogus", &policy), -1);
+}
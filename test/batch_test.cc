@@ -0,0 +1,37 @@
+#include "batch.h"
+
+#include <gtest/gtest.h>
+
+/*
+ * Test that a batch executes as if one operation at a time.
+ * 1. Lookups after a write in the batch observe the write
+ * 2. Lookups before a write do not
+ * 3. Every operation reports its own result
+ */
+TEST(BatchTest, ProgramOrder) {
+    HashTable* table = hashtable_create(16);
+    ASSERT_TRUE(table != NULL);
+
+    ASSERT_TRUE(hashtable_insert(table, 1) != NULL);
+
+    Operation ops[] = {
+        {2, Lookup, 0, 0, 0}, {1, Lookup, 0, 0, 0}, {2, Insert, 0, 0, 0}, {2, Lookup, 0, 0, 0}, {1, Delete, 0, 0, 0},
+        {1, Lookup, 0, 0, 0}, {3, Lookup, 0, 0, 0}, {2, Insert, 0, 0, 0}, {2, Lookup, 0, 0, 0},
+    };
+    bool expected[] = {false, true, true, true, true, false, false, false, true};
+    int n = sizeof(ops) / sizeof(ops[0]);
+
+    for (int width = 1; width <= 8; width *= 2) {
+        bool succeeded[BATCH_MAX_OPS];
+        batch_execute(table, ops, succeeded, n, width);
+        for (int i = 0; i < n; ++i) {
+            ASSERT_EQ(succeeded[i], expected[i]) << "width " << width << ", operation " << i;
+        }
+
+        // Restore the initial population
+        ASSERT_EQ(hashtable_delete(table, 2), 0);
+        ASSERT_TRUE(hashtable_insert(table, 1) != NULL);
+    }
+
+    ASSERT_EQ(hashtable_free(table), 0);
+}
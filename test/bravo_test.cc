@@ -0,0 +1,74 @@
+#include "bravo.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+
+#define NUM_READERS (4)
+#define NUM_WRITES (20000)
+
+typedef struct BravoArgs {
+    BravoLock* lock;
+    int64_t* pair;  // writers keep both values equal
+    bool* done;
+    int result;
+} BravoArgs;
+
+static void* read_pair(void* thd_args) {
+    BravoArgs* args = (BravoArgs*)thd_args;
+    args->result = 0;
+
+    while (!__atomic_load_n(args->done, __ATOMIC_ACQUIRE)) {
+        int slot = bravo_read_lock(args->lock);
+        if (args->pair[0] != args->pair[1]) {
+            args->result = -1;
+        }
+        bravo_read_unlock(args->lock, slot);
+    }
+    return NULL;
+}
+
+/*
+ * Test that readers never see a write in progress.
+ * 1. Readers check an invariant under the read lock while a writer breaks it under the write lock
+ * 2. The first read sets the bias, so later reads take the fast path until a writer revokes it
+ */
+TEST(BravoTest, ReadersExcludeWriter) {
+    BravoLock lock;
+    bravo_init(&lock);
+
+    int slot = bravo_read_lock(&lock);
+    ASSERT_EQ(slot, -1);
+    bravo_read_unlock(&lock, slot);
+    slot = bravo_read_lock(&lock);
+    ASSERT_GE(slot, 0);
+    bravo_read_unlock(&lock, slot);
+
+    bravo_write_lock(&lock);
+    ASSERT_FALSE(lock.read_bias);
+    bravo_write_unlock(&lock);
+
+    int64_t pair[2] = {0, 0};
+    bool done = false;
+    pthread_t readers[NUM_READERS];
+    BravoArgs args[NUM_READERS];
+    for (int i = 0; i < NUM_READERS; ++i) {
+        args[i] = {&lock, pair, &done, 0};
+        pthread_create(&readers[i], NULL, read_pair, &args[i]);
+    }
+
+    for (int i = 0; i < NUM_WRITES; ++i) {
+        bravo_write_lock(&lock);
+        pair[0]++;
+        pair[1]++;
+        bravo_write_unlock(&lock);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < NUM_READERS; ++i) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(args[i].result, 0);
+    }
+    ASSERT_EQ(pair[0], NUM_WRITES);
+
+    bravo_destroy(&lock);
+}
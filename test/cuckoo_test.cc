@@ -0,0 +1,104 @@
+#include "cuckoo.h"
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#define NUM_KEYS (100000)
+#define NUM_THREADS (4)
+
+/*
+ * Test a table that has to grow many times.
+ * 1. Every inserted key is found, duplicates are refused
+ * 2. The table grows rather than fail, and stays well filled
+ * 3. Deleted keys are not found, the others are
+ */
+TEST(CuckooTest, GrowAndDelete) {
+    CuckooTable* table = cuckoo_create(1);
+    ASSERT_TRUE(table != NULL);
+
+    for (int key = 0; key < NUM_KEYS; ++key) {
+        const int* slot = cuckoo_insert(table, key);
+        ASSERT_TRUE(slot != NULL) << "key " << key;
+        ASSERT_EQ(*slot, key);
+    }
+    ASSERT_TRUE(cuckoo_insert(table, NUM_KEYS / 2) == NULL);
+    ASSERT_EQ(cuckoo_size(table), NUM_KEYS);
+    ASSERT_GT(table->resizes, 0);
+    ASSERT_GT((double)NUM_KEYS / cuckoo_capacity(table), 0.35);
+
+    for (int key = 0; key < NUM_KEYS; key += 2) {
+        ASSERT_EQ(cuckoo_delete(table, key), 0);
+    }
+    ASSERT_EQ(cuckoo_delete(table, 0), -1);
+    for (int key = 0; key < NUM_KEYS; ++key) {
+        ASSERT_EQ(cuckoo_lookup(table, key) != NULL, key % 2 == 1) << "key " << key;
+    }
+
+    cuckoo_destroy(table);
+}
+
+/*
+ * Test the load factor reached by displacing keys.
+ * 1. A table of fixed capacity takes more than 90% of its slots before it grows
+ */
+TEST(CuckooTest, LoadFactor) {
+    CuckooTable* table = cuckoo_create(1024);
+    int64_t capacity = cuckoo_capacity(table);
+
+    int key = 0;
+    while (table->resizes == 0) {
+        ASSERT_TRUE(cuckoo_insert(table, key++) != NULL);
+    }
+    ASSERT_GT((double)(key - 1) / capacity, 0.9);
+    ASSERT_GT(counter_read(&table->displacements), 0u);
+
+    cuckoo_destroy(table);
+}
+
+typedef struct ChurnArgs {
+    CuckooTable* table;
+    int id;
+    int failures;
+} ChurnArgs;
+
+// Insert and delete the thread's own keys, which displace the others' keys and grow the table
+static void* churn(void* arg) {
+    ChurnArgs* args = (ChurnArgs*)arg;
+    for (int round = 0; round < 4; ++round) {
+        for (int key = args->id; key < NUM_KEYS; key += NUM_THREADS) {
+            args->failures += cuckoo_insert(args->table, key) == NULL;
+        }
+        for (int key = args->id; key < NUM_KEYS; key += NUM_THREADS) {
+            args->failures += cuckoo_lookup(args->table, key) == NULL;
+        }
+        if (round < 3) {
+            for (int key = args->id; key < NUM_KEYS; key += NUM_THREADS) {
+                args->failures += cuckoo_delete(args->table, key) != 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Test concurrent writers of disjoint keys.
+ * 1. No key is lost or duplicated while others move it or the table grows
+ */
+TEST(CuckooTest, ConcurrentChurn) {
+    CuckooTable* table = cuckoo_create(16);
+
+    pthread_t threads[NUM_THREADS];
+    ChurnArgs args[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        args[i] = {table, i, 0};
+        pthread_create(&threads[i], NULL, churn, &args[i]);
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        ASSERT_EQ(args[i].failures, 0) << "thread " << i;
+    }
+    ASSERT_EQ(cuckoo_size(table), NUM_KEYS);
+
+    cuckoo_destroy(table);
+}
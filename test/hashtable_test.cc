@@ -3,9 +3,11 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 
 #define MAX_ITERATION (1000)
+#define BATCH_KEYS (64)  // keys per hashtable_lookup_batch() call of the batched readers
 
 /*******************************************************************************
  * NOTE from TA: Jaechan An
@@ -28,11 +30,20 @@ TEST(HashTableInitTest, HandlesInitialization) {
     ASSERT_TRUE(table != NULL);
 
     ASSERT_EQ(table->size, hashtable_size);
+#ifdef CUCKOO_LOCKING
+    ASSERT_GE(cuckoo_capacity(table->cuckoo), hashtable_size * CUCKOO_SLOTS);
+    ASSERT_EQ(cuckoo_size(table->cuckoo), 0);
+#else
     for (int i = 0; i < table->size; ++i) {
         ASSERT_TRUE(table->buckets[i] != NULL);
+#ifdef UNROLLED_CHAINS
+        ASSERT_EQ(table->buckets[i]->count, 0);
+#else
         ASSERT_TRUE(table->buckets[i]->key == -1);
+#endif
         ASSERT_TRUE(table->buckets[i]->next == NULL);
     }
+#endif
 
     int freed = hashtable_free(table);
     ASSERT_EQ(freed, 0);
@@ -103,6 +114,467 @@ TEST_F(HashTableBasicTest, Delete) {
     ASSERT_EQ(should_fail, -1);
 }
 
+/*
+ * Test the hot-key cache in front of the buckets
+ * 1. Repeated lookups of a key are answered by the cache
+ * 2. A deleted key is never answered by the cache
+ * 3. Keys seen only once (scan) do not replace hot keys
+ */
+TEST_F(HashTableBasicTest, HotCache) {
+    ASSERT_EQ(hashtable_attach_hotcache(table, 256), 0);
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, 7) != NULL);
+    }
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.hotcache_hits + stats.hotcache_misses, MAX_ITERATION);
+    ASSERT_GE(stats.hotcache_hits, MAX_ITERATION - 1);
+
+    // A scan over all keys must not evict the hot key
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, i) != NULL);
+    }
+    hashtable_stats(table, &stats);
+    uint64_t hits_before = stats.hotcache_hits;
+    ASSERT_TRUE(hashtable_lookup(table, 7) != NULL);
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.hotcache_hits, hits_before + 1);
+
+    ASSERT_EQ(hashtable_delete(table, 7), 0);
+    ASSERT_TRUE(hashtable_lookup(table, 7) == NULL);
+
+    ASSERT_TRUE(hashtable_insert(table, 7) != NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 7) != NULL);
+}
+
+/*
+ * Test the bucket filters
+ * 1. Lookups and deletes of missing keys are skipped or counted as false positives, present keys are always found
+ * 2. Once a bucket's keys are deleted, its filter rejects every key
+ */
+TEST_F(HashTableBasicTest, Filter) {
+    ASSERT_EQ(hashtable_attach_filter(table), 0);
+
+    for (int i = 0; i < MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_EQ(hashtable_lookup(table, i) != NULL, i % 2 == 0) << "key " << i;
+    }
+    for (int i = 1; i < MAX_ITERATION; i += 2) {
+        ASSERT_EQ(hashtable_delete(table, i), -1);
+    }
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.filter_skips + stats.filter_false_positives, MAX_ITERATION);
+    ASSERT_GT(stats.filter_skips, 0);
+
+    for (int i = 0; i < MAX_ITERATION; i += 2) {
+        ASSERT_EQ(hashtable_delete(table, i), 0);
+    }
+
+    hashtable_stats(table, &stats);
+    uint64_t false_positives = stats.filter_false_positives;
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, i) == NULL);
+    }
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.filter_false_positives, false_positives);
+}
+
+/*
+ * Test a single long chain
+ * 1. Keys inserted out of order are all found, in every policy's chain layout
+ * 2. Deleting every other key keeps the rest, and deleted keys are not found
+ */
+TEST(HashTableChainTest, LongChain) {
+    HashTable* table = hashtable_create(1);
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, (i * 37) % MAX_ITERATION) != NULL);
+    }
+    ASSERT_EQ(hashtable_size(table), MAX_ITERATION);
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        int key = (i * 53) % MAX_ITERATION;
+        if (key % 2 == 1) {
+            ASSERT_EQ(hashtable_delete(table, key), 0);
+        }
+    }
+    ASSERT_EQ(hashtable_size(table), MAX_ITERATION / 2);
+
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_EQ(hashtable_lookup(table, i) != NULL, i % 2 == 0) << "key " << i;
+    }
+
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+/*
+ * Test the index of a long chain
+ * 1. A chain that grows long gets indexed, and every key is found through the index, in every chain layout
+ * 2. Deleting most keys keeps the rest reachable and drops the index once the chain is short again
+ */
+TEST(HashTableChainTest, Indexed) {
+    HashTable* table = hashtable_create(1);
+#ifdef CUCKOO_LOCKING
+    ASSERT_EQ(hashtable_attach_index(table), -1);
+#else
+    ASSERT_EQ(hashtable_attach_index(table), 0);
+    int num_keys = 10 * MAX_ITERATION;
+
+    for (int i = 0; i < num_keys; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, (i * 37) % num_keys) != NULL);
+    }
+    for (int i = 0; i < num_keys; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, i) != NULL) << "key " << i;
+    }
+    ASSERT_TRUE(hashtable_lookup(table, num_keys) == NULL);
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_GT(stats.index_builds, 0);
+
+    for (int i = 0; i < num_keys; ++i) {
+        int key = (i * 53) % num_keys;
+        if (key % 1000 != 0) {
+            ASSERT_EQ(hashtable_delete(table, key), 0);
+        }
+    }
+    ASSERT_EQ(hashtable_size(table), num_keys / 1000);
+
+    for (int i = 0; i < num_keys; ++i) {
+        ASSERT_EQ(hashtable_lookup(table, i) != NULL, i % 1000 == 0) << "key " << i;
+    }
+    hashtable_stats(table, &stats);
+    ASSERT_GT(stats.index_drops, 0);
+#endif
+
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+/*
+ * Test bulk loading
+ * 1. Unsorted keys with duplicates are loaded once each, with more threads than ranges of buckets as well
+ * 2. The loaded table behaves like one filled by inserts: duplicates are rejected, keys are deleted, filters agree
+ * 3. Freeing with several threads releases every bucket
+ */
+TEST(HashTableBulkTest, Load) {
+    int num_keys = 10 * MAX_ITERATION;
+    int* keys = (int*)malloc(sizeof(int) * 2 * num_keys);
+    for (int i = 0; i < num_keys; ++i) {
+        keys[2 * i] = (i * 37) % num_keys;
+        keys[2 * i + 1] = (i * 53) % num_keys;
+    }
+
+    int sizes[] = {1, 7, 100, 5 * num_keys};
+    int thread_counts[] = {1, 4};
+    for (int size : sizes) {
+        for (int num_threads : thread_counts) {
+            HashTable* table = hashtable_create(size);
+            ASSERT_EQ(hashtable_attach_filter(table), 0);
+
+            ASSERT_EQ(hashtable_bulk_load(table, keys, 2 * num_keys, num_threads), num_keys);
+            ASSERT_EQ(hashtable_size(table), num_keys);
+
+            for (int i = 0; i < num_keys; ++i) {
+                ASSERT_TRUE(hashtable_lookup(table, i) != NULL) << "key " << i << ", size " << size;
+            }
+            ASSERT_TRUE(hashtable_lookup(table, num_keys) == NULL);
+            ASSERT_TRUE(hashtable_insert(table, num_keys / 2) == NULL);
+            ASSERT_TRUE(hashtable_insert(table, num_keys) != NULL);
+
+            for (int i = 0; i < num_keys; i += 2) {
+                ASSERT_EQ(hashtable_delete(table, i), 0);
+            }
+            for (int i = 0; i < num_keys; ++i) {
+                ASSERT_EQ(hashtable_lookup(table, i) != NULL, i % 2 == 1) << "key " << i << ", size " << size;
+            }
+
+            ASSERT_EQ(hashtable_free_parallel(table, num_threads), 0);
+        }
+    }
+
+    free(keys);
+}
+
+/*
+ * Test listing the keys
+ * 1. Every key is listed once, whatever the policy lays them out
+ * 2. No more than max keys are stored
+ */
+TEST_F(HashTableBasicTest, Keys) {
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i * 7) != NULL);
+    }
+    for (int i = 0; i < MAX_ITERATION; i += 3) {
+        ASSERT_EQ(hashtable_delete(table, i * 7), 0);
+    }
+
+    int keys[MAX_ITERATION];
+    int n = hashtable_keys(table, keys, MAX_ITERATION);
+    ASSERT_EQ(n, hashtable_size(table));
+    std::sort(keys, keys + n);
+    int expected = 0;
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        if (i % 3 != 0) {
+            ASSERT_EQ(keys[expected++], i * 7);
+        }
+    }
+    ASSERT_EQ(n, expected);
+
+    ASSERT_EQ(hashtable_keys(table, keys, 10), 10);
+}
+
+#ifndef CUCKOO_LOCKING
+/*
+ * Test bulk loading a chain that is long enough to be indexed
+ */
+TEST(HashTableBulkTest, Indexed) {
+    int keys[MAX_ITERATION];
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        keys[i] = (i * 37) % MAX_ITERATION;
+    }
+
+    HashTable* table = hashtable_create(1);
+    ASSERT_EQ(hashtable_attach_index(table), 0);
+    ASSERT_EQ(hashtable_bulk_load(table, keys, MAX_ITERATION, 2), MAX_ITERATION);
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.index_builds, 1);
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, i) != NULL) << "key " << i;
+    }
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_EQ(hashtable_delete(table, i), 0);
+    }
+    ASSERT_EQ(hashtable_size(table), 0);
+
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+#endif
+
+/*
+ * Test interleaved batch lookups
+ * 1. Every width finds the same nodes as one lookup at a time, including missing keys
+ * 2. Batches longer than the width reuse the slots of finished lookups
+ */
+TEST_F(HashTableBasicTest, LookupBatch) {
+    for (int i = 0; i < MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    int keys[MAX_ITERATION];
+    Node* results[MAX_ITERATION];
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        keys[i] = (i * 37) % MAX_ITERATION;  // not in chain order
+    }
+
+    int widths[] = {1, 2, 8, LOOKUP_BATCH_MAX_WIDTH, LOOKUP_BATCH_MAX_WIDTH + 1};
+    for (int width : widths) {
+        hashtable_lookup_batch(table, keys, results, MAX_ITERATION, width);
+        for (int i = 0; i < MAX_ITERATION; ++i) {
+            ASSERT_EQ(results[i], hashtable_lookup(table, keys[i])) << "width " << width << ", key " << keys[i];
+            ASSERT_EQ(results[i] != NULL, keys[i] % 2 == 0);
+        }
+    }
+}
+
+/*
+ * Test atomic groups of operations
+ * 1. A group that moves a key applies both of its operations.
+ * 2. An all-or-nothing group with a failing operation is undone and skips the rest.
+ * 3. Without all-or-nothing, only the failing operation has no effect.
+ * 4. Single operations still work through the gates.
+ */
+TEST_F(HashTableBasicTest, Apply) {
+    ASSERT_EQ(hashtable_attach_gates(table), 0);
+    ASSERT_TRUE(hashtable_insert(table, 1) != NULL);
+    ASSERT_TRUE(hashtable_insert(table, 102) != NULL);
+
+    int move[] = {1, 2};
+    OperationType move_types[] = {Delete, Insert};
+    bool succeeded[HASHTABLE_APPLY_MAX_OPS];
+    ASSERT_TRUE(hashtable_apply(table, move, move_types, 2, true, succeeded));
+    ASSERT_TRUE(succeeded[0] && succeeded[1]);
+    ASSERT_TRUE(hashtable_lookup(table, 1) == NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 2) != NULL);
+
+    int keys[] = {3, 102, 2, 4};
+    OperationType types[] = {Insert, Delete, Insert, Insert};
+    ASSERT_FALSE(hashtable_apply(table, keys, types, 4, true, succeeded));
+    ASSERT_TRUE(succeeded[0] && succeeded[1]);
+    ASSERT_FALSE(succeeded[2] || succeeded[3]);
+    ASSERT_TRUE(hashtable_lookup(table, 3) == NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 4) == NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 102) != NULL);
+    ASSERT_EQ(hashtable_size(table), 2);
+
+    ASSERT_TRUE(hashtable_apply(table, keys, types, 4, false, succeeded));
+    ASSERT_TRUE(succeeded[0] && succeeded[1] && succeeded[3]);
+    ASSERT_FALSE(succeeded[2]);
+    ASSERT_TRUE(hashtable_lookup(table, 3) != NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 4) != NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 102) == NULL);
+
+    ASSERT_EQ(hashtable_delete(table, 3), 0);
+    ASSERT_TRUE(hashtable_insert(table, 5) != NULL);
+    ASSERT_EQ(hashtable_size(table), 3);
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.applies, 2u);
+    ASSERT_EQ(stats.rollbacks, 1u);
+}
+
+/*
+ * Test the cache mode
+ * 1. Inserts beyond the key cap evict other keys, so the table holds the cap.
+ * 2. A key looked up since the clock hand last passed its bucket survives its pass.
+ * 3. The memory cap bounds the keys by the size of their nodes.
+ */
+TEST_F(HashTableBasicTest, CacheEviction) {
+    CacheConfig config;
+    cache_default_config(&config);
+    config.max_keys = 100;
+    config.sweep_interval_ms = 0;
+#ifndef NODE_EXPIRY
+    ASSERT_EQ(hashtable_attach_cache(table, &config), -1);
+#else
+    ASSERT_EQ(hashtable_attach_cache(table, &config), 0);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+    ASSERT_TRUE(hashtable_lookup(table, 7) != NULL);
+    for (int i = 100; i < 150; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    ASSERT_EQ(hashtable_size(table), 100);
+    ASSERT_TRUE(hashtable_lookup(table, 7) != NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 0) == NULL);  // the first bucket the hand passed
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.cache_evictions, 50u);
+
+    HashTable* bounded = hashtable_create(100);
+    config.max_keys = 0;
+    config.max_bytes = 10 * sizeof(Node);
+    ASSERT_EQ(hashtable_attach_cache(bounded, &config), 0);
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(bounded, i) != NULL);
+    }
+    ASSERT_LE(hashtable_size(bounded), 10);
+    hashtable_free(bounded);
+#endif
+}
+
+#ifdef NODE_EXPIRY
+/*
+ * Test TTL expiry
+ * 1. An expired key counts as missing, and its lookup unlinks it.
+ * 2. An insert replaces an expired duplicate.
+ * 3. A sweep unlinks the expired keys nobody looked up, and keeps the keys without a TTL.
+ */
+TEST_F(HashTableBasicTest, CacheExpiry) {
+    CacheConfig config;
+    cache_default_config(&config);
+    config.sweep_interval_ms = 0;
+    ASSERT_EQ(hashtable_attach_cache(table, &config), 0);
+
+    ASSERT_TRUE(hashtable_insert_ttl(table, 1, 20) != NULL);
+    ASSERT_TRUE(hashtable_insert_ttl(table, 2, 20) != NULL);
+    ASSERT_TRUE(hashtable_insert_ttl(table, 3, 20) != NULL);
+    ASSERT_TRUE(hashtable_insert(table, 4) != NULL);
+    ASSERT_TRUE(hashtable_insert_ttl(table, 1, 0) == NULL);
+    usleep(50 * 1000);
+
+    ASSERT_TRUE(hashtable_lookup(table, 1) == NULL);
+    ASSERT_EQ(hashtable_size(table), 3);
+
+    ASSERT_TRUE(hashtable_insert(table, 2) != NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 2) != NULL);
+
+    ASSERT_EQ(hashtable_cache_sweep(table, 100), 1);
+    ASSERT_TRUE(hashtable_lookup(table, 3) == NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 4) != NULL);
+    ASSERT_EQ(hashtable_size(table), 2);
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.cache_expirations, 3u);
+    ASSERT_EQ(stats.cache_evictions, 0u);
+}
+
+/*
+ * Test undoing an atomic group in cache mode
+ * 1. An undone delete restores the expiry of the deleted key, not the default TTL of the group
+ */
+TEST_F(HashTableBasicTest, ApplyExpiry) {
+    CacheConfig config;
+    cache_default_config(&config);
+    config.sweep_interval_ms = 0;
+    config.default_ttl_ms = 60 * 1000;
+    ASSERT_EQ(hashtable_attach_cache(table, &config), 0);
+    ASSERT_EQ(hashtable_attach_gates(table), 0);
+
+    ASSERT_TRUE(hashtable_insert_ttl(table, 1, 0) != NULL);
+    ASSERT_TRUE(hashtable_insert_ttl(table, 3, 20) != NULL);
+    ASSERT_TRUE(hashtable_insert_ttl(table, 5, 0) != NULL);
+
+    int keys[] = {1, 3, 5};
+    OperationType types[] = {Delete, Delete, Insert};
+    bool succeeded[HASHTABLE_APPLY_MAX_OPS];
+    ASSERT_FALSE(hashtable_apply(table, keys, types, 3, true, succeeded));
+    ASSERT_EQ(hashtable_size(table), 3);
+
+    Node* never = hashtable_lookup(table, 1);
+    ASSERT_TRUE(never != NULL);
+    ASSERT_EQ(never->expires, 0u);
+    usleep(50 * 1000);
+    ASSERT_TRUE(hashtable_lookup(table, 3) == NULL);
+    ASSERT_TRUE(hashtable_lookup(table, 1) != NULL);
+}
+#endif
+
+/*
+ * Test profiling the lock waits
+ * 1. A profile can only be attached when the probes are compiled in
+ * 2. Every acquisition is sampled with a sample rate of 1
+ */
+TEST_F(HashTableBasicTest, LockProfile) {
+#ifdef HASHTABLE_PROBES
+    ASSERT_EQ(hashtable_attach_lockprof(table, 1), 0);
+    ASSERT_TRUE(table->lockprof != NULL);
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_EQ(hashtable_delete(table, i), 0);
+    }
+
+    LockSlot total;
+    lockprof_total(table->lockprof, &total);
+    ASSERT_GE(total.acquisitions[LockWrite], (uint64_t)MAX_ITERATION);
+    int slots[LOCKPROF_TOP];
+    ASSERT_GT(lockprof_hottest(table->lockprof, slots, LOCKPROF_TOP), 0);
+#else
+    ASSERT_EQ(hashtable_attach_lockprof(table, 1), -1);
+    ASSERT_TRUE(table->lockprof == NULL);
+#endif
+}
+
 #if defined(BUCKET_LOCKING) || defined(CHAIN_LOCKING) || defined(OPTIMISTIC_LOCKING)
 /*
  * TestFixture for hash table concurrency test
@@ -151,12 +623,13 @@ void* insert_many_func(void* thd_args) {
     int id = args->id;
     HashTable* table = args->table;
 
+    // Every insert of a new key must succeed, even when optimistic validation fails
+    args->result = 0;
     int start = id * MAX_ITERATION;
     int end = (id + 1) * MAX_ITERATION;
     for (int i = start; i < end; ++i) {
-        Node* node = NULL;
-        while (node == NULL) {  // optimistic locking may fail
-            node = hashtable_insert(table, i);
+        if (hashtable_insert(table, i) == NULL) {
+            args->result = -1;
         }
     }
 
@@ -179,12 +652,12 @@ void* delete_many_func(void* thd_args) {
     int id = args->id;
     HashTable* table = args->table;
 
+    args->result = 0;
     int start = id * MAX_ITERATION;
     int end = (id + 1) * MAX_ITERATION;
     for (int i = start; i < end; ++i) {
-        int ret = -1;
-        while (ret == -1) {  // optimistic locking may fail
-            ret = hashtable_delete(table, i);
+        if (hashtable_delete(table, i) != 0) {
+            args->result = -1;
         }
     }
 
@@ -233,6 +706,7 @@ TEST_F(HashTableConcurrencyTest, InsertMany) {
 
     for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL);
+        EXPECT_EQ(args[i].result, 0);
     }
 
     for (int i = 0; i < num_threads * MAX_ITERATION; ++i) {
@@ -297,6 +771,7 @@ TEST_F(HashTableConcurrencyTest, DeleteMany) {
 
     for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL);
+        EXPECT_EQ(args[i].result, 0);
     }
 
     // Search all keys from 0 ~ num_threads * MAX_ITERATION, none found
@@ -308,4 +783,468 @@ TEST_F(HashTableConcurrencyTest, DeleteMany) {
     int count = hashtable_size(table);
     ASSERT_EQ(count, 0);
 }
+
+typedef struct ChurnArgs {
+    int id;
+    HashTable* table;
+    bool* done;
+    int result;
+} ChurnArgs;
+
+// Insert and delete the odd keys of the thread's range until the readers are done
+void* churn_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    int start = args->id * MAX_ITERATION;
+
+    args->result = 0;
+    while (!__atomic_load_n(args->done, __ATOMIC_ACQUIRE)) {
+        for (int i = start + 1; i < start + MAX_ITERATION; i += 2) {
+            if (hashtable_insert(args->table, i) == NULL) {
+                args->result = -1;
+            }
+        }
+        for (int i = start + 1; i < start + MAX_ITERATION; i += 2) {
+            if (hashtable_delete(args->table, i) != 0) {
+                args->result = -1;
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+// Look up the even keys, which are never deleted, of all writers' ranges
+void* lookup_stable_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    int num_keys = args->id * MAX_ITERATION;  // id holds the number of writers
+
+    args->result = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < num_keys; i += 2) {
+            Node* node = hashtable_lookup(args->table, i);
+            if (node == NULL) {
+                args->result = -1;
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test lookups while the same chain is modified
+ * 1. Insert the even keys into a single bucket.
+ * 2. Writers insert and delete the odd keys in between while readers look up the even keys.
+ * 3. Every lookup of an even key succeeds and the writers never fail.
+ */
+TEST_F(HashTableConcurrencyTest, LookupDuringChurn) {
+    int num_writers = ncores > 1 ? ncores / 2 : 1;
+    int num_readers = ncores > 1 ? ncores - num_writers : 1;
+
+    HashTable* chain = hashtable_create(1);
+    for (int i = 0; i < num_writers * MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(chain, i) != NULL);
+    }
+
+    bool done = false;
+    pthread_t writers[num_writers];
+    pthread_t readers[num_readers];
+    ChurnArgs writer_args[num_writers];
+    ChurnArgs reader_args[num_readers];
+
+    for (int i = 0; i < num_writers; i++) {
+        writer_args[i] = {i, chain, &done, 0};
+        pthread_create(&writers[i], NULL, churn_func, (void**)&writer_args[i]);
+    }
+    for (int i = 0; i < num_readers; i++) {
+        reader_args[i] = {num_writers, chain, &done, 0};
+        pthread_create(&readers[i], NULL, lookup_stable_func, (void**)&reader_args[i]);
+    }
+
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(reader_args[i].result, 0);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num_writers; i++) {
+        pthread_join(writers[i], NULL);
+        EXPECT_EQ(writer_args[i].result, 0);
+    }
+
+    ASSERT_EQ(hashtable_size(chain), num_writers * MAX_ITERATION / 2);
+
+#ifdef SEQLOCK_READERS
+    HashTableStats stats;
+    hashtable_stats(chain, &stats);
+    ASSERT_LE(stats.read_fallbacks, stats.read_failures);
+#endif
+
+    hashtable_free(chain);
+}
+
+/*
+ * Test lookups through the index of a chain while the chain is modified
+ * 1. Writers insert and delete the odd keys of an indexed chain, splitting and merging its gaps, while readers look
+ *    up the even keys.
+ * 2. Every lookup of an even key succeeds and the writers never fail.
+ */
+TEST_F(HashTableConcurrencyTest, IndexDuringChurn) {
+    int num_writers = ncores > 1 ? ncores / 2 : 1;
+    int num_readers = ncores > 1 ? ncores - num_writers : 1;
+
+    HashTable* chain = hashtable_create(1);
+    ASSERT_EQ(hashtable_attach_index(chain), 0);
+    for (int i = 0; i < num_writers * MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(chain, i) != NULL);
+    }
+
+    bool done = false;
+    pthread_t writers[num_writers];
+    pthread_t readers[num_readers];
+    ChurnArgs writer_args[num_writers];
+    ChurnArgs reader_args[num_readers];
+
+    for (int i = 0; i < num_writers; i++) {
+        writer_args[i] = {i, chain, &done, 0};
+        pthread_create(&writers[i], NULL, churn_func, (void**)&writer_args[i]);
+    }
+    for (int i = 0; i < num_readers; i++) {
+        reader_args[i] = {num_writers, chain, &done, 0};
+        pthread_create(&readers[i], NULL, lookup_stable_func, (void**)&reader_args[i]);
+    }
+
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(reader_args[i].result, 0);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num_writers; i++) {
+        pthread_join(writers[i], NULL);
+        EXPECT_EQ(writer_args[i].result, 0);
+    }
+
+    ASSERT_EQ(hashtable_size(chain), num_writers * MAX_ITERATION / 2);
+    for (int i = 0; i < num_writers * MAX_ITERATION; ++i) {
+        ASSERT_EQ(hashtable_lookup(chain, i) != NULL, i % 2 == 0) << "key " << i;
+    }
+
+    hashtable_free(chain);
+}
+
+// Look up all keys of all writers' ranges in batches, the even keys are always found
+void* lookup_batch_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    int num_keys = args->id * MAX_ITERATION;  // id holds the number of writers
+    int keys[BATCH_KEYS];
+    Node* results[BATCH_KEYS];
+
+    args->result = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (int start = 0; start < num_keys; start += BATCH_KEYS) {
+            int n = num_keys - start < BATCH_KEYS ? num_keys - start : BATCH_KEYS;
+            for (int i = 0; i < n; ++i) {
+                keys[i] = start + (i * 37) % n;  // not in chain order
+            }
+            hashtable_lookup_batch(args->table, keys, results, n, 8);
+            for (int i = 0; i < n; ++i) {
+                if (keys[i] % 2 != 0) {
+                    continue;  // the node of an odd key may be recycled as soon as it is returned
+                }
+                if (results[i] == NULL) {
+                    args->result = -1;
+                    continue;
+                }
+#ifndef UNROLLED_CHAINS
+                if (results[i]->key != keys[i]) {
+                    args->result = -1;
+                }
+#endif
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test batched lookups through the index of a chain while the chain is modified
+ * 1. Writers insert and delete the odd keys of an indexed chain, recycling the nodes the index points into, while
+ *    readers look up all keys in interleaved batches.
+ * 2. Every even key is found, in a node that holds it.
+ */
+TEST_F(HashTableConcurrencyTest, IndexedBatchDuringChurn) {
+    int num_writers = ncores > 1 ? ncores / 2 : 1;
+    int num_readers = ncores > 1 ? ncores - num_writers : 1;
+
+    HashTable* chain = hashtable_create(1);
+    ASSERT_EQ(hashtable_attach_index(chain), 0);
+    for (int i = 0; i < num_writers * MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(chain, i) != NULL);
+    }
+
+    bool done = false;
+    pthread_t writers[num_writers];
+    pthread_t readers[num_readers];
+    ChurnArgs writer_args[num_writers];
+    ChurnArgs reader_args[num_readers];
+
+    for (int i = 0; i < num_writers; i++) {
+        writer_args[i] = {i, chain, &done, 0};
+        pthread_create(&writers[i], NULL, churn_func, (void**)&writer_args[i]);
+    }
+    for (int i = 0; i < num_readers; i++) {
+        reader_args[i] = {num_writers, chain, &done, 0};
+        pthread_create(&readers[i], NULL, lookup_batch_func, (void**)&reader_args[i]);
+    }
+
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(reader_args[i].result, 0);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num_writers; i++) {
+        pthread_join(writers[i], NULL);
+        EXPECT_EQ(writer_args[i].result, 0);
+    }
+
+    ASSERT_EQ(hashtable_size(chain), num_writers * MAX_ITERATION / 2);
+
+    hashtable_free(chain);
+}
+
+/*
+ * Test the bucket filters under concurrent updates
+ * 1. Writers insert and delete the odd keys while readers look up the even keys, which are always found.
+ * 2. No counter update is lost: once every key is deleted, the filters reject every lookup.
+ */
+TEST_F(HashTableConcurrencyTest, FilterDuringChurn) {
+    int num_writers = ncores > 1 ? ncores / 2 : 1;
+    int num_readers = ncores > 1 ? ncores - num_writers : 1;
+
+    ASSERT_EQ(hashtable_attach_filter(table), 0);
+    for (int i = 0; i < num_writers * MAX_ITERATION; i += 2) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    bool done = false;
+    pthread_t writers[num_writers];
+    pthread_t readers[num_readers];
+    ChurnArgs writer_args[num_writers];
+    ChurnArgs reader_args[num_readers];
+
+    for (int i = 0; i < num_writers; i++) {
+        writer_args[i] = {i, table, &done, 0};
+        pthread_create(&writers[i], NULL, churn_func, (void**)&writer_args[i]);
+    }
+    for (int i = 0; i < num_readers; i++) {
+        reader_args[i] = {num_writers, table, &done, 0};
+        pthread_create(&readers[i], NULL, lookup_stable_func, (void**)&reader_args[i]);
+    }
+
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(reader_args[i].result, 0);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num_writers; i++) {
+        pthread_join(writers[i], NULL);
+        EXPECT_EQ(writer_args[i].result, 0);
+    }
+
+    for (int i = 0; i < num_writers * MAX_ITERATION; i += 2) {
+        ASSERT_EQ(hashtable_delete(table, i), 0);
+    }
+
+    HashTableStats stats;
+    hashtable_stats(table, &stats);
+    uint64_t false_positives = stats.filter_false_positives;
+    for (int i = 0; i < num_writers * MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_lookup(table, i) == NULL);
+    }
+    hashtable_stats(table, &stats);
+    ASSERT_EQ(stats.filter_false_positives, false_positives);
+}
+
+// Move every key i of [0, MAX_ITERATION) between i and its partner i + MAX_ITERATION, atomically
+void* move_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    OperationType types[] = {Delete, Insert};
+    bool succeeded[2];
+
+    args->result = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < MAX_ITERATION; ++i) {
+            // One of the two moves finds the key, unless another mover moved it meanwhile
+            int there[] = {i, i + MAX_ITERATION};
+            int back[] = {i + MAX_ITERATION, i};
+            if (!hashtable_apply(args->table, there, types, 2, true, succeeded)) {
+                hashtable_apply(args->table, back, types, 2, true, succeeded);
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+// Look up every key and its partner together until the movers are done, exactly one of them is present
+void* lookup_pair_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    OperationType types[] = {Lookup, Lookup};
+    bool succeeded[2];
+
+    args->result = 0;
+    while (!__atomic_load_n(args->done, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < MAX_ITERATION; ++i) {
+            int pair[] = {i, i + MAX_ITERATION};
+            hashtable_apply(args->table, pair, types, 2, false, succeeded);
+            if (succeeded[0] == succeeded[1]) {
+                args->result = -1;
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test atomic groups under concurrency
+ * 1. Movers atomically delete keys and insert their partners, in both directions, contending on the same keys.
+ * 2. Readers look up every key together with its partner: they always find exactly one of them.
+ * 3. Once done, exactly one of every pair is present.
+ */
+TEST_F(HashTableConcurrencyTest, ApplyDuringChurn) {
+    int num_movers = ncores > 1 ? ncores / 2 : 1;
+    int num_readers = ncores > 1 ? ncores - num_movers : 1;
+
+    ASSERT_EQ(hashtable_attach_gates(table), 0);
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_TRUE(hashtable_insert(table, i) != NULL);
+    }
+
+    bool done = false;
+    pthread_t movers[num_movers];
+    pthread_t readers[num_readers];
+    ChurnArgs mover_args[num_movers];
+    ChurnArgs reader_args[num_readers];
+
+    for (int i = 0; i < num_readers; i++) {
+        reader_args[i] = {i, table, &done, 0};
+        pthread_create(&readers[i], NULL, lookup_pair_func, (void**)&reader_args[i]);
+    }
+    for (int i = 0; i < num_movers; i++) {
+        mover_args[i] = {i, table, &done, 0};
+        pthread_create(&movers[i], NULL, move_func, (void**)&mover_args[i]);
+    }
+
+    for (int i = 0; i < num_movers; i++) {
+        pthread_join(movers[i], NULL);
+        EXPECT_EQ(mover_args[i].result, 0);
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+        EXPECT_EQ(reader_args[i].result, 0);
+    }
+
+    ASSERT_EQ(hashtable_size(table), MAX_ITERATION);
+    for (int i = 0; i < MAX_ITERATION; ++i) {
+        ASSERT_NE(hashtable_lookup(table, i) != NULL, hashtable_lookup(table, i + MAX_ITERATION) != NULL);
+    }
+}
+
+#ifdef NODE_EXPIRY
+// Insert, look up and delete the keys of the thread's range, expiring half of them quickly
+void* cache_churn_func(void* thd_args) {
+    ChurnArgs* args = (ChurnArgs*)thd_args;
+    int start = args->id * MAX_ITERATION;
+
+    args->result = 0;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = start; i < start + MAX_ITERATION; ++i) {
+            hashtable_insert_ttl(args->table, i, i % 2 == 0 ? 1 : 0);
+        }
+        for (int i = start; i < start + MAX_ITERATION; i += 3) {
+            hashtable_lookup(args->table, i);
+        }
+        for (int i = start; i < start + MAX_ITERATION; i += 5) {
+            hashtable_delete(args->table, i);
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test the cache mode under concurrency
+ * 1. Threads insert, look up and delete keys, beyond the cap, while the sweeper expires keys.
+ * 2. Once done, the count of keys matches the table and respects the cap.
+ */
+TEST_F(HashTableConcurrencyTest, CacheDuringChurn) {
+    int num_threads = ncores * 2;
+
+    CacheConfig config;
+    cache_default_config(&config);
+    config.max_keys = MAX_ITERATION / 2;
+    config.sweep_interval_ms = 1;
+    ASSERT_EQ(hashtable_attach_cache(table, &config), 0);
+
+    pthread_t threads[num_threads];
+    ChurnArgs args[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        args[i] = {i, table, NULL, 0};
+        pthread_create(&threads[i], NULL, cache_churn_func, (void**)&args[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Stop the sweeper before counting
+    cache_stop_sweeper(table->cache);
+    ASSERT_EQ(hashtable_size(table), table->cache->entries);
+    ASSERT_LE(hashtable_size(table), MAX_ITERATION / 2);
+}
+#endif
+
+#ifdef OPTIMISTIC_LOCKING
+/*
+ * Test optimistic retries on a single contended chain
+ * 1. Insert and delete interleaved keys of one bucket with {number of cores * 2} threads.
+ * 2. No operation fails spuriously.
+ * 3. Every failed validation either led to a retry or to a fallback.
+ */
+TEST_F(HashTableConcurrencyTest, OptimisticRetries) {
+    int num_threads = ncores * 2;
+
+    HashTable* chain = hashtable_create(1);
+
+    pthread_t threads[num_threads];
+    ThreadArgs args[num_threads];
+
+    for (int i = 0; i < num_threads; i++) {
+        args[i].id = i;
+        args[i].table = chain;
+        pthread_create(&threads[i], NULL, insert_many_func, (void**)&args[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ(args[i].result, 0);
+    }
+    ASSERT_EQ(hashtable_size(chain), num_threads * MAX_ITERATION);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, delete_many_func, (void**)&args[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ(args[i].result, 0);
+    }
+    ASSERT_EQ(hashtable_size(chain), 0);
+
+    HashTableStats stats;
+    hashtable_stats(chain, &stats);
+    ASSERT_EQ(stats.validation_failures, stats.retries + stats.fallbacks);
+
+    hashtable_free(chain);
+}
+#endif
 #endif
@@ -0,0 +1,79 @@
+#include "histogram.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+/*
+ * Test the percentiles of a uniform distribution of values.
+ * 1. Small values are counted exactly
+ * 2. Percentiles of large values stay within the relative error of the buckets
+ */
+TEST(HistogramTest, Percentile) {
+    Histogram hist;
+    histogram_init(&hist);
+    ASSERT_EQ(histogram_percentile(&hist, 99.0), 0u);
+
+    for (uint64_t value = 1; value <= 16; ++value) {
+        histogram_record(&hist, value);
+    }
+    ASSERT_EQ(histogram_percentile(&hist, 50.0), 8u);
+    ASSERT_EQ(histogram_percentile(&hist, 100.0), 16u);
+    ASSERT_DOUBLE_EQ(histogram_mean(&hist), 8.5);
+
+    histogram_init(&hist);
+    for (uint64_t value = 1; value <= 1000000; ++value) {
+        histogram_record(&hist, value);
+    }
+    ASSERT_EQ(hist.count, 1000000u);
+    ASSERT_EQ(hist.min, 1u);
+    ASSERT_EQ(hist.max, 1000000u);
+
+    double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+    for (double percentile : percentiles) {
+        double expected = percentile * 10000;
+        double value = histogram_percentile(&hist, percentile);
+        ASSERT_NEAR(value, expected, expected * 0.04) << "p" << percentile;
+    }
+    ASSERT_EQ(histogram_percentile(&hist, 100.0), 1000000u);
+}
+
+/*
+ * Test merging per-thread histograms.
+ */
+TEST(HistogramTest, Merge) {
+    Histogram a, b;
+    histogram_init(&a);
+    histogram_init(&b);
+
+    for (int i = 0; i < 99; ++i) {
+        histogram_record(&a, 100);
+    }
+    histogram_record(&b, 1000000);
+
+    histogram_merge(&a, &b);
+    ASSERT_EQ(a.count, 100u);
+    ASSERT_EQ(a.min, 100u);
+    ASSERT_EQ(a.max, 1000000u);
+    ASSERT_LE(histogram_percentile(&a, 99.0), 103u);
+    ASSERT_EQ(histogram_percentile(&a, 99.9), 1000000u);
+
+    // Values beyond the tracked range are clamped into the last bucket
+    histogram_record(&a, UINT64_MAX);
+    ASSERT_EQ(histogram_percentile(&a, 100.0), UINT64_MAX);
+}
+
+/*
+ * Test that the calibrated timer advances at roughly the rate of the clock.
+ */
+TEST(HistogramTest, Timer) {
+    timer_calibrate();
+
+    uint64_t begin = timer_now();
+    usleep(10000);
+    uint64_t elapsed_ns = timer_ticks_to_ns(timer_now() - begin);
+
+    ASSERT_GE(elapsed_ns, 9000000u);
+    ASSERT_LT(elapsed_ns, 1000000000u);
+}
@@ -0,0 +1,103 @@
+#include "lockprof.h"
+
+#include <gtest/gtest.h>
+
+/*
+ * Test the bins of the waits
+ * 1. Waits below the first bound go to the first bin
+ * 2. Every later bin doubles the bound
+ * 3. The last bin counts every longer wait
+ */
+TEST(LockProfileTest, Bins) {
+    ASSERT_EQ(lockprof_bin(0), 0);
+    ASSERT_EQ(lockprof_bin(LOCKPROF_FIRST_BIN_NS - 1), 0);
+    ASSERT_EQ(lockprof_bin(LOCKPROF_FIRST_BIN_NS), 1);
+    ASSERT_EQ(lockprof_bin(2 * LOCKPROF_FIRST_BIN_NS - 1), 1);
+    ASSERT_EQ(lockprof_bin(2 * LOCKPROF_FIRST_BIN_NS), 2);
+    ASSERT_EQ(lockprof_bin(1000000000ULL), LOCKPROF_BINS - 1);
+}
+
+/*
+ * Test recording waits
+ * 1. A slot counts its acquisitions and waits per mode
+ * 2. The percentiles are the bounds of the bins that hold them
+ * 3. Slots out of range are ignored
+ */
+TEST(LockProfileTest, Record) {
+    LockProfile* profile = lockprof_create(4, 1, "bucket");
+    ASSERT_TRUE(profile != NULL);
+
+    for (int i = 0; i < 98; ++i) {
+        lockprof_record(profile, 2, LockRead, 10);
+    }
+    lockprof_record(profile, 2, LockWrite, 1000);
+    lockprof_record(profile, 2, LockWrite, 10000000000ULL);
+    lockprof_record(profile, 4, LockWrite, 1000);
+    lockprof_record(profile, -1, LockWrite, 1000);
+
+    const LockSlot* slot = &profile->slots[2];
+    ASSERT_EQ(slot->acquisitions[LockRead], 98u);
+    ASSERT_EQ(slot->acquisitions[LockWrite], 2u);
+    ASSERT_EQ(slot->wait_ns[LockRead], 980u);
+    ASSERT_EQ(slot->wait_ns[LockWrite], 10000001000ULL);
+    ASSERT_EQ(lockprof_percentile(slot, 50), (uint64_t)LOCKPROF_FIRST_BIN_NS);
+    ASSERT_EQ(lockprof_percentile(slot, 99), (uint64_t)1024);
+    ASSERT_EQ(lockprof_percentile(slot, 100), UINT64_MAX);
+    ASSERT_EQ(lockprof_percentile(&profile->slots[0], 99), 0u);
+
+    LockSlot total;
+    lockprof_total(profile, &total);
+    ASSERT_EQ(total.acquisitions[LockRead] + total.acquisitions[LockWrite], 100u);
+
+    lockprof_destroy(profile);
+    ASSERT_TRUE(lockprof_create(0, 1, "bucket") == NULL);
+    ASSERT_TRUE(lockprof_create(4, 0, "bucket") == NULL);
+}
+
+/*
+ * Test finding the hottest slots
+ * 1. They are ordered by total wait, longest first
+ * 2. No more than max are stored and slots without waits are skipped
+ */
+TEST(LockProfileTest, Hottest) {
+    LockProfile* profile = lockprof_create(100, 1, "stripe");
+    ASSERT_TRUE(profile != NULL);
+    for (int i = 0; i < 100; i += 2) {
+        lockprof_record(profile, i, LockWrite, (i * 37) % 100 + 1);
+    }
+
+    int slots[LOCKPROF_TOP];
+    int n = lockprof_hottest(profile, slots, LOCKPROF_TOP);
+    ASSERT_EQ(n, LOCKPROF_TOP);
+    for (int i = 1; i < n; ++i) {
+        ASSERT_GE(profile->slots[slots[i - 1]].wait_ns[LockWrite], profile->slots[slots[i]].wait_ns[LockWrite]);
+    }
+    ASSERT_EQ(profile->slots[slots[0]].wait_ns[LockWrite], 99u);
+
+    LockProfile* sparse = lockprof_create(100, 1, "stripe");
+    lockprof_record(sparse, 5, LockRead, 1);
+    lockprof_record(sparse, 7, LockRead, 3);
+    ASSERT_EQ(lockprof_hottest(sparse, slots, LOCKPROF_TOP), 2);
+    ASSERT_EQ(slots[0], 7);
+    ASSERT_EQ(slots[1], 5);
+
+    lockprof_destroy(sparse);
+    lockprof_destroy(profile);
+}
+
+/*
+ * Test sampling: a thread times one in sample_every of its acquisitions
+ */
+TEST(LockProfileTest, Sampled) {
+    LockProfile* profile = lockprof_create(1, 8, "bucket");
+    ASSERT_TRUE(profile != NULL);
+
+    lockprof_countdown = 0;
+    int sampled = 0;
+    for (int i = 0; i < 800; ++i) {
+        sampled += lockprof_sampled(profile);
+    }
+    ASSERT_EQ(sampled, 100);
+
+    lockprof_destroy(profile);
+}
@@ -0,0 +1,78 @@
+#include "pool.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+typedef struct Object {
+    void* link;
+    int value;
+    int initialized;
+} Object;
+
+static int num_finalized = 0;
+
+static void init_object(void* object) { ((Object*)object)->initialized = 1; }
+
+static void fini_object(void* object) { num_finalized += ((Object*)object)->initialized; }
+
+/*
+ * Test that freed objects are recycled and never given back.
+ * 1. Objects of one slab are distinct and initialized once
+ * 2. A freed object is handed out again, its fields past the link intact
+ * 3. Destroying the pool finalizes every object carved
+ */
+TEST(PoolTest, Recycle) {
+    Pool* pool = pool_create(sizeof(Object), init_object);
+    ASSERT_TRUE(pool != NULL);
+
+    std::set<Object*> objects;
+    for (int i = 0; i < POOL_SLAB_OBJECTS; ++i) {
+        Object* object = (Object*)pool_alloc(pool);
+        ASSERT_TRUE(object != NULL);
+        ASSERT_EQ(object->initialized, 1);
+        object->value = i;
+        objects.insert(object);
+    }
+    ASSERT_EQ(objects.size(), (size_t)POOL_SLAB_OBJECTS);
+
+    Object* freed = *objects.begin();
+    int value = freed->value;
+    pool_free(pool, freed);
+    ASSERT_EQ(freed->value, value);
+
+    Object* reused = (Object*)pool_alloc(pool);
+    ASSERT_EQ(reused, freed);
+
+    // The first slab is used up, so this carves a second one
+    Object* next = (Object*)pool_alloc(pool);
+    ASSERT_TRUE(objects.find(next) == objects.end());
+
+    num_finalized = 0;
+    pool_destroy(pool, fini_object);
+    ASSERT_EQ(num_finalized, 2 * POOL_SLAB_OBJECTS);
+}
+
+static void fini_object_atomic(void* object) {
+    __atomic_add_fetch(&num_finalized, ((Object*)object)->initialized, __ATOMIC_RELAXED);
+}
+
+/*
+ * Test destroying a pool with several threads.
+ * 1. Every object of every slab is finalized exactly once, for more threads than slabs as well
+ */
+TEST(PoolTest, DestroyParallel) {
+    int num_slabs = 5;
+    int thread_counts[] = {2, 4, 8};
+    for (int num_threads : thread_counts) {
+        Pool* pool = pool_create(sizeof(Object), init_object);
+        ASSERT_TRUE(pool != NULL);
+        for (int i = 0; i < num_slabs * POOL_SLAB_OBJECTS; ++i) {
+            ASSERT_TRUE(pool_alloc(pool) != NULL);
+        }
+
+        num_finalized = 0;
+        pool_destroy_parallel(pool, fini_object_atomic, num_threads);
+        ASSERT_EQ(num_finalized, num_slabs * POOL_SLAB_OBJECTS) << num_threads << " threads";
+    }
+}
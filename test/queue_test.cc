@@ -88,3 +88,284 @@ TEST(QueueBasicTest, Correctness) {
         ASSERT_EQ(flag_verification[i], true);
     }
 }
+
+/*
+ * Test enqueue timestamps, tags and occupancy.
+ * 1. Stamped operations come back with their timestamp, plain ones with 0
+ * 2. Occupancy counts the enqueued but not yet dequeued operations
+ * 3. Tagged operations come back with their tag, plain ones with 0
+ */
+TEST(QueueBasicTest, Timestamp) {
+    OperationQueue queue;
+    init_queue(&queue);
+    ASSERT_EQ(queue_occupancy(&queue), 0);
+
+    enqueue_at(&queue, 1, Insert, 12345);
+    enqueue(&queue, 2, Lookup);
+    ASSERT_EQ(queue_occupancy(&queue), 2);
+
+    Operation op = dequeue(&queue);
+    ASSERT_EQ(op.key, 1);
+    ASSERT_EQ(op.timestamp, 12345u);
+    ASSERT_EQ(queue_occupancy(&queue), 1);
+
+    op = dequeue(&queue);
+    ASSERT_EQ(op.key, 2);
+    ASSERT_EQ(op.timestamp, 0u);
+    ASSERT_EQ(op.tag, 0u);
+    ASSERT_EQ(queue_occupancy(&queue), 0);
+
+    enqueue_tagged(&queue, 3, Delete, 678, 4242);
+    op = dequeue(&queue);
+    ASSERT_EQ(op.key, 3);
+    ASSERT_EQ(op.type, Delete);
+    ASSERT_EQ(op.timestamp, 678u);
+    ASSERT_EQ(op.tag, 4242u);
+}
+
+typedef struct CompoundArgs {
+    OperationQueue* queue;
+    int num_requests;
+} CompoundArgs;
+
+// Answer every compound request with the number of its operations, and every plain one by nothing
+void* CompoundConsumerFunc(void* thd_args) {
+    CompoundArgs* args = (CompoundArgs*)thd_args;
+
+    for (int i = 0; i < args->num_requests; i++) {
+        Operation op = dequeue(args->queue);
+        if (op.type != Compound) {
+            continue;
+        }
+
+        CompoundRequest* request = &args->queue->mailboxes[op.key];
+        for (int j = 0; j < request->num_ops; j++) {
+            request->succeeded[j] = request->keys[j] % 2 == 0;
+        }
+        request->applied = request->num_ops > 1;
+        compound_complete(request);
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test compound requests.
+ * 1. A compound request travels as one operation naming the producer's mailbox
+ * 2. enqueue_compound() returns once the consumer answered, with the consumer's results in the mailbox
+ * 3. Plain operations share the queue with them
+ */
+TEST(QueueBasicTest, Compound) {
+    OperationQueue queue;
+    init_queue(&queue);
+
+    CompoundArgs args = {&queue, 1 + 2 * COMPOUND_MAILBOXES};
+    pthread_t consumer;
+    pthread_create(&consumer, 0, CompoundConsumerFunc, (void**)&args);
+
+    enqueue(&queue, 7, Lookup);
+    for (int round = 0; round < 2; round++) {
+        for (int mailbox = 0; mailbox < COMPOUND_MAILBOXES; mailbox++) {
+            CompoundRequest* request = &queue.mailboxes[mailbox];
+            request->num_ops = 1 + (mailbox + round) % COMPOUND_MAX_OPS;
+            for (int j = 0; j < request->num_ops; j++) {
+                request->keys[j] = mailbox + j;
+                request->types[j] = Insert;
+            }
+
+            enqueue_compound(&queue, mailbox, 0);
+            ASSERT_EQ(request->applied, request->num_ops > 1);
+            for (int j = 0; j < request->num_ops; j++) {
+                ASSERT_EQ(request->succeeded[j], (mailbox + j) % 2 == 0);
+            }
+        }
+    }
+
+    pthread_join(consumer, NULL);
+    ASSERT_TRUE(queue_is_empty(&queue));
+}
+
+/*
+ * Test split lanes.
+ * 1. With strict priority, lookups go before the writes queued ahead of them
+ * 2. A lookup of a key with a pending write stays behind the write, until the write is completed
+ * 3. A write of a key with a pending lookup in the lookup lane stays behind the lookup as well
+ * 4. With weights, every write follows at most weight lookups, and an empty lane holds up nothing
+ */
+TEST(QueueBasicTest, Lanes) {
+    OperationQueue queue;
+    init_queue(&queue);
+    queue_split_lanes(&queue);
+
+    LaneScheduler strict;
+    lane_scheduler_init(&strict, LaneStrict, 0);
+    enqueue(&queue, 1, Insert);
+    enqueue(&queue, 2, Insert);
+    enqueue(&queue, 3, Lookup);
+    enqueue(&queue, 1, Lookup);
+    ASSERT_EQ(queue_lane_occupancy(&queue, MainLane), 3);
+    ASSERT_EQ(queue_lane_occupancy(&queue, LookupLane), 1);
+
+    int keys[] = {3, 1, 2, 1};
+    OperationType types[] = {Lookup, Insert, Insert, Lookup};
+    for (int i = 0; i < 4; ++i) {
+        Operation op = dequeue_lanes(&queue, &strict);
+        ASSERT_EQ(op.key, keys[i]);
+        ASSERT_EQ(op.type, types[i]);
+        queue_complete(&queue, &op);
+    }
+    ASSERT_TRUE(queue_is_empty(&queue));
+
+    // Key 1 has no pending write anymore, the delete follows its lookup, and key 4 has nothing pending
+    enqueue(&queue, 1, Lookup);
+    enqueue(&queue, 1, Delete);
+    enqueue(&queue, 4, Insert);
+    ASSERT_EQ(queue_lane_occupancy(&queue, LookupLane), 2);
+    ASSERT_EQ(queue_lane_occupancy(&queue, MainLane), 1);
+
+    LaneScheduler writes_first;
+    lane_scheduler_init(&writes_first, LaneWeighted, 1);
+    writes_first.credit = 0;
+    int later_keys[] = {4, 1, 1};
+    OperationType later_types[] = {Insert, Lookup, Delete};
+    for (int i = 0; i < 3; ++i) {
+        Operation op = dequeue_lanes(&queue, &writes_first);
+        ASSERT_EQ(op.key, later_keys[i]);
+        ASSERT_EQ(op.type, later_types[i]);
+        queue_complete(&queue, &op);
+    }
+    ASSERT_TRUE(queue_is_empty(&queue));
+
+    LaneScheduler weighted;
+    lane_scheduler_init(&weighted, LaneWeighted, 2);
+    for (int i = 0; i < 3; ++i) {
+        enqueue(&queue, 10 + i, Delete);
+    }
+    for (int i = 0; i < 8; ++i) {
+        enqueue(&queue, 20 + i, Lookup);
+    }
+    const char* expected = "LLDLLDLLDLL";
+    for (int i = 0; expected[i] != '\0'; ++i) {
+        Operation op = dequeue_lanes(&queue, &weighted);
+        ASSERT_EQ(op.type, expected[i] == 'L' ? Lookup : Delete) << "at " << i;
+        queue_complete(&queue, &op);
+    }
+    ASSERT_TRUE(queue_is_empty(&queue));
+}
+
+/*
+ * Test dequeuing batches.
+ * 1. A batch takes the operations already queued, up to max, without waiting for more
+ * 2. A Compound operation ends its batch
+ * 3. The split lanes are batched in the scheduler's order
+ */
+TEST(QueueBasicTest, Batch) {
+    OperationQueue queue;
+    init_queue(&queue);
+    Operation ops[8];
+
+    for (int i = 0; i < 3; ++i) {
+        enqueue(&queue, i, Insert);
+    }
+    ASSERT_EQ(dequeue_batch(&queue, NULL, ops, 8), 3);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(ops[i].key, i);
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        enqueue(&queue, i, Lookup);
+    }
+    ASSERT_EQ(dequeue_batch(&queue, NULL, ops, 2), 2);
+    ASSERT_EQ(dequeue_batch(&queue, NULL, ops, 8), 3);
+    ASSERT_EQ(ops[0].key, 2);
+    ASSERT_TRUE(queue_is_empty(&queue));
+
+    enqueue(&queue, 1, Insert);
+    enqueue(&queue, 0, Compound);
+    enqueue(&queue, 2, Insert);
+    ASSERT_EQ(dequeue_batch(&queue, NULL, ops, 8), 2);
+    ASSERT_EQ(ops[1].type, Compound);
+    ASSERT_EQ(dequeue_batch(&queue, NULL, ops, 8), 1);
+    ASSERT_EQ(ops[0].key, 2);
+
+    queue_split_lanes(&queue);
+    LaneScheduler strict;
+    lane_scheduler_init(&strict, LaneStrict, 0);
+    enqueue(&queue, 1, Insert);
+    enqueue(&queue, 3, Lookup);
+    ASSERT_EQ(dequeue_batch(&queue, &strict, ops, 8), 2);
+    ASSERT_EQ(ops[0].type, Lookup);
+    ASSERT_EQ(ops[1].type, Insert);
+    queue_complete(&queue, &ops[1]);
+    ASSERT_TRUE(queue_is_empty(&queue));
+}
+
+typedef struct LaneArgs {
+    int id;
+    OperationQueue* queue;
+    int* counts;  // dequeues per key
+} LaneArgs;
+
+#define NUM_LANE_THREADS (8)
+#define NUM_LANE_OPS (20000)
+
+// Every third operation is a write, the rest are lookups
+void* LaneProducerFunc(void* thd_args) {
+    LaneArgs* args = (LaneArgs*)thd_args;
+
+    for (int i = 0; i < NUM_LANE_OPS; i++) {
+        int key = args->id * NUM_LANE_OPS + i;
+        enqueue(args->queue, key, i % 3 == 0 ? Insert : Lookup);
+    }
+
+    pthread_exit(NULL);
+}
+
+void* LaneConsumerFunc(void* thd_args) {
+    LaneArgs* args = (LaneArgs*)thd_args;
+
+    LaneScheduler scheduler;
+    lane_scheduler_init(&scheduler, args->id % 2 == 0 ? LaneStrict : LaneWeighted, 4);
+    for (int i = 0; i < NUM_LANE_OPS; i++) {
+        Operation op = dequeue_lanes(args->queue, &scheduler);
+        __atomic_fetch_add(&args->counts[op.key], 1, __ATOMIC_RELAXED);
+        queue_complete(args->queue, &op);
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+ * Test split lanes under concurrency.
+ * 1. Producers spread their operations over both lanes, consumers with either policy take them
+ * 2. Every operation is dequeued exactly once, and none stays pending
+ */
+TEST(QueueBasicTest, LanesConcurrent) {
+    OperationQueue* queue = (OperationQueue*)malloc(sizeof(OperationQueue));
+    init_queue(queue);
+    queue_split_lanes(queue);
+
+    int* counts = (int*)calloc(NUM_LANE_THREADS * NUM_LANE_OPS, sizeof(int));
+    pthread_t threads[2 * NUM_LANE_THREADS];
+    LaneArgs args[2 * NUM_LANE_THREADS];
+    for (int i = 0; i < NUM_LANE_THREADS; i++) {
+        args[i] = {i, queue, counts};
+        pthread_create(&threads[i], 0, LaneConsumerFunc, (void**)&args[i]);
+        args[NUM_LANE_THREADS + i] = {i, queue, counts};
+        pthread_create(&threads[NUM_LANE_THREADS + i], 0, LaneProducerFunc, (void**)&args[NUM_LANE_THREADS + i]);
+    }
+    for (int i = 0; i < 2 * NUM_LANE_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < NUM_LANE_THREADS * NUM_LANE_OPS; i++) {
+        ASSERT_EQ(counts[i], 1) << "key " << i;
+    }
+    for (int i = 0; i < QUEUE_PENDING_STRIPES; i++) {
+        ASSERT_EQ(queue->pending[i] & ~QUEUE_PENDING_LOOKUP_LANE, 0);
+    }
+    ASSERT_TRUE(queue_is_empty(queue));
+
+    free(counts);
+    free(queue);
+}
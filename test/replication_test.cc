@@ -0,0 +1,304 @@
+#include "replication.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "prng.h"
+#include "timer.h"
+
+#define NUM_BUCKETS (1000)
+#define NUM_KEYS (5000)
+
+static std::vector<int> sorted_keys(HashTable* table) {
+    std::vector<int> keys(hashtable_size(table));
+    keys.resize(hashtable_keys(table, keys.data(), (int)keys.size()));
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+// Apply everything the primary appended
+static void catch_up(ReplFollower* follower) {
+    while (repl_follower_behind(follower) > 0) {
+        ASSERT_GE(repl_follower_poll(follower, REPL_APPLY_RECORDS), 0);
+    }
+}
+
+/*
+ * TestFixture with a log in private memory instead of the shared segment
+ */
+class ReplicationTest : public ::testing::Test {
+protected:
+    ReplicationTest() {
+        timer_calibrate();
+        log = (ReplLog*)aligned_alloc(CACHE_LINE_SIZE, sizeof(ReplLog));
+        repl_log_init(log);
+        snapshot_path = "/tmp/replication_test_" + std::to_string(getpid()) + ".snap";
+        unlink(snapshot_path.c_str());
+    }
+
+    ~ReplicationTest() {
+        unlink(snapshot_path.c_str());
+        free(log);
+    }
+
+    ReplLog* log;
+    std::string snapshot_path;
+};
+
+/*
+ * Test shipping the writes
+ * 1. A follower that bootstrapped from the first snapshot applies the later writes
+ * 2. Only the writes that succeeded are appended
+ * 3. A follower that bootstrapped midway catches up from its snapshot
+ */
+TEST_F(ReplicationTest, Ship) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ReplPrimary primary;
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+    ASSERT_EQ(primary.recovered, 0);
+    ASSERT_FALSE(primary.new_epoch);
+
+    HashTable* early = hashtable_create(NUM_BUCKETS);
+    ReplFollower follower;
+    repl_follower_init(&follower, log, early, NULL);
+    ASSERT_EQ(repl_follower_bootstrap(&follower), 0);
+
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Insert));
+    }
+    ASSERT_FALSE(repl_primary_write(&primary, 0, Insert));
+    for (int i = 0; i < NUM_KEYS; i += 2) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Delete));
+    }
+    ASSERT_FALSE(repl_primary_write(&primary, 0, Delete));
+    ASSERT_EQ(log->head, (uint64_t)NUM_KEYS + NUM_KEYS / 2);
+
+    catch_up(&follower);
+    ASSERT_EQ(follower.applied, log->head);
+    ASSERT_EQ(follower.lag.count, log->head);
+    ASSERT_EQ(sorted_keys(early), sorted_keys(table));
+
+    HashTable* late = hashtable_create(NUM_BUCKETS);
+    ReplFollower late_follower;
+    repl_follower_init(&late_follower, log, late, NULL);
+    ASSERT_EQ(repl_follower_bootstrap(&late_follower), NUM_KEYS / 2);
+    ASSERT_EQ(late_follower.next, log->head);
+
+    for (int i = 0; i < NUM_KEYS; i += 4) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Insert));
+    }
+    catch_up(&follower);
+    catch_up(&late_follower);
+    ASSERT_EQ(sorted_keys(early), sorted_keys(table));
+    ASSERT_EQ(sorted_keys(late), sorted_keys(table));
+
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(hashtable_free(late), 0);
+    ASSERT_EQ(hashtable_free(early), 0);
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+/*
+ * Test groups of operations
+ * 1. The writes of an applied group are appended
+ * 2. An undone group appends nothing
+ */
+TEST_F(ReplicationTest, Apply) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ASSERT_EQ(hashtable_attach_gates(table), 0);
+    ReplPrimary primary;
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+
+    int keys[] = {1, 2, 3, 1};
+    OperationType types[] = {Insert, Insert, Lookup, Delete};
+    bool succeeded[4];
+    ASSERT_TRUE(repl_primary_apply(&primary, keys, types, 4, false, succeeded));
+    ASSERT_EQ(log->head, 3u);
+
+    OperationType undone[] = {Insert, Delete, Delete, Insert};
+    ASSERT_FALSE(repl_primary_apply(&primary, keys, undone, 4, true, succeeded));
+    ASSERT_EQ(log->head, 3u);
+
+    HashTable* replica = hashtable_create(NUM_BUCKETS);
+    ReplFollower follower;
+    repl_follower_init(&follower, log, replica, NULL);
+    follower.epoch = log->epoch;  // from the start of the log, without a snapshot
+    ASSERT_EQ(repl_follower_poll(&follower, REPL_APPLY_RECORDS), 3);
+    ASSERT_EQ(sorted_keys(replica), std::vector<int>({2}));
+
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(hashtable_free(replica), 0);
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+typedef struct WriterArgs {
+    ReplPrimary* primary;
+    int id;
+    int num_ops;
+} WriterArgs;
+
+static void* writer_func(void* arg) {
+    WriterArgs* args = (WriterArgs*)arg;
+    Prng prng;
+    prng_seed(&prng, 42, args->id);
+    for (int i = 0; i < args->num_ops; ++i) {
+        int key = (int)prng_next_below(&prng, NUM_KEYS / 10);
+        repl_primary_write(args->primary, key, prng_next_below(&prng, 2) == 0 ? Insert : Delete);
+    }
+    return NULL;
+}
+
+/*
+ * Test concurrent writers on the same keys with a follower that applies meanwhile
+ * 1. The records of a key follow the order its writes took effect, so the follower ends up with the same keys
+ */
+TEST_F(ReplicationTest, ConcurrentWriters) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ReplPrimary primary;
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+
+    HashTable* replica = hashtable_create(NUM_BUCKETS);
+    ReplFollower follower;
+    repl_follower_init(&follower, log, replica, NULL);
+    ASSERT_EQ(repl_follower_bootstrap(&follower), 0);
+    ASSERT_EQ(repl_follower_start(&follower), 0);
+
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    WriterArgs args[num_threads];
+    for (int i = 0; i < num_threads; ++i) {
+        args[i] = {&primary, i, 20 * NUM_KEYS};
+        pthread_create(&threads[i], NULL, writer_func, &args[i]);
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    repl_follower_stop(&follower);
+    catch_up(&follower);
+    ASSERT_EQ(follower.resyncs, 0u);
+    ASSERT_EQ(sorted_keys(replica), sorted_keys(table));
+
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(hashtable_free(replica), 0);
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+/*
+ * Test a follower that fell a whole ring behind
+ * 1. It notices the dropped records and resynchronizes from a snapshot
+ */
+TEST_F(ReplicationTest, Overrun) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ReplPrimary primary;
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+
+    HashTable* replica = hashtable_create(NUM_BUCKETS);
+    ReplFollower follower;
+    repl_follower_init(&follower, log, replica, NULL);
+    ASSERT_EQ(repl_follower_bootstrap(&follower), 0);
+    ASSERT_TRUE(repl_primary_write(&primary, NUM_KEYS, Insert));
+    ASSERT_EQ(repl_follower_poll(&follower, REPL_APPLY_RECORDS), 1);
+
+    for (int i = 0; i < REPL_LOG_RECORDS / 2 + 1; ++i) {
+        repl_primary_write(&primary, i % NUM_KEYS, Insert);
+        repl_primary_write(&primary, i % NUM_KEYS, Delete);
+    }
+    repl_primary_write(&primary, 7, Insert);
+    ASSERT_GT(log->head - follower.next, (uint64_t)REPL_LOG_RECORDS);
+
+    catch_up(&follower);
+    ASSERT_EQ(follower.resyncs, 1u);
+    ASSERT_EQ(sorted_keys(replica), sorted_keys(table));
+
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(hashtable_free(replica), 0);
+    ASSERT_EQ(hashtable_free(table), 0);
+}
+
+/*
+ * Test restarting the primary
+ * 1. After a clean exit, it loads its last snapshot and the followers carry on
+ * 2. After a crash, it replays the records after its last snapshot
+ * 3. If a record is lost, it starts a new epoch and the followers resynchronize
+ */
+TEST_F(ReplicationTest, Restart) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ReplPrimary primary;
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Insert));
+    }
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    std::vector<int> expected = sorted_keys(table);
+    ASSERT_EQ(hashtable_free(table), 0);
+    ASSERT_FALSE(log->primary_running);
+
+    // The follower comes up from the last snapshot while the primary is down
+    HashTable* replica = hashtable_create(NUM_BUCKETS);
+    ReplFollower follower;
+    repl_follower_init(&follower, log, replica, NULL);
+    ASSERT_EQ(repl_follower_bootstrap(&follower), NUM_KEYS);
+
+    table = hashtable_create(NUM_BUCKETS);
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+    ASSERT_EQ(primary.recovered, NUM_KEYS);
+    ASSERT_EQ(primary.replayed, 0);
+    ASSERT_FALSE(primary.new_epoch);
+    ASSERT_EQ(sorted_keys(table), expected);
+
+    // A crash right after the writes: the snapshot of the clean exit is taken back
+    std::string saved = snapshot_path + ".saved";
+    ASSERT_EQ(rename(snapshot_path.c_str(), saved.c_str()), 0);
+    for (int i = 0; i < NUM_KEYS; i += 2) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Delete));
+    }
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(rename(saved.c_str(), snapshot_path.c_str()), 0);
+    expected = sorted_keys(table);
+    ASSERT_EQ(hashtable_free(table), 0);
+
+    table = hashtable_create(NUM_BUCKETS);
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+    ASSERT_EQ(primary.recovered, NUM_KEYS);
+    ASSERT_EQ(primary.replayed, NUM_KEYS / 2);
+    ASSERT_FALSE(primary.new_epoch);
+    ASSERT_EQ(sorted_keys(table), expected);
+
+    catch_up(&follower);
+    ASSERT_EQ(follower.resyncs, 0u);
+    ASSERT_EQ(sorted_keys(replica), expected);
+
+    // A crash that lost a record after the last snapshot
+    ASSERT_EQ(rename(snapshot_path.c_str(), saved.c_str()), 0);
+    uint64_t lost = log->head + 1;
+    for (int i = 1; i < NUM_KEYS; i += 2) {
+        ASSERT_TRUE(repl_primary_write(&primary, i, Delete));
+    }
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(rename(saved.c_str(), snapshot_path.c_str()), 0);
+    log->records[lost & (REPL_LOG_RECORDS - 1)].seq = 0;
+    ASSERT_EQ(hashtable_free(table), 0);
+
+    table = hashtable_create(NUM_BUCKETS);
+    ASSERT_EQ(repl_primary_open(&primary, log, table, snapshot_path.c_str(), NULL), 0);
+    ASSERT_EQ(primary.replayed, 1);
+    ASSERT_TRUE(primary.new_epoch);
+    ASSERT_EQ(log->head, lost);
+    ASSERT_TRUE(repl_primary_write(&primary, NUM_KEYS, Insert));
+
+    catch_up(&follower);
+    ASSERT_EQ(follower.resyncs, 1u);
+    ASSERT_EQ(sorted_keys(replica), sorted_keys(table));
+
+    ASSERT_EQ(repl_primary_close(&primary), 0);
+    ASSERT_EQ(hashtable_free(replica), 0);
+    ASSERT_EQ(hashtable_free(table), 0);
+}
@@ -0,0 +1,123 @@
+#include "stats.h"
+
+#include <gtest/gtest.h>
+
+#define NUM_BUCKETS (16)
+#define NUM_KEYS (200)
+
+/*
+ * Test that a snapshot sums up the workers.
+ * 1. Only the published workers are counted
+ * 2. The elements are the added minus the removed keys
+ */
+TEST(StatsTest, Snapshot) {
+    ServerStats* stats = new ServerStats;
+    stats_init(stats, NUM_BUCKETS, "test");
+
+    stats_record(&stats->workers[0], Insert, true);
+    stats_record(&stats->workers[0], Insert, true);
+    stats_record(&stats->workers[1], Insert, false);
+    stats_record(&stats->workers[1], Delete, true);
+    stats_record(&stats->workers[1], Lookup, true);
+    stats_record(&stats->workers[2], Lookup, true);
+
+    StatsSnapshot snapshot;
+    stats->num_workers = 2;
+    stats_snapshot(stats, &snapshot);
+
+    ASSERT_EQ(snapshot.ops[Insert], 3u);
+    ASSERT_EQ(snapshot.succeeded[Insert], 2u);
+    ASSERT_EQ(snapshot.ops[Delete], 1u);
+    ASSERT_EQ(snapshot.ops[Lookup], 1u);
+    ASSERT_EQ(snapshot.elements, 1);
+    ASSERT_DOUBLE_EQ(snapshot.load_factor, 1.0 / NUM_BUCKETS);
+    ASSERT_EQ(snapshot.chains[0], NUM_BUCKETS);
+    ASSERT_FALSE(stats->chains_tracked);
+
+    delete stats;
+}
+
+/*
+ * Test the chain length histogram against the table contents.
+ * 1. Changes of two threads' sinks add up to the actual chain lengths
+ * 2. Every bucket is counted exactly once
+ */
+TEST(StatsTest, ChainLengths) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ASSERT_TRUE(table != NULL);
+    ASSERT_EQ(hashtable_track_chains(table), 0);
+
+    ServerStats* stats = new ServerStats;
+    stats_init(stats, NUM_BUCKETS, hashtable_policy_name());
+    stats->num_workers = 2;
+
+    hashtable_set_chain_sink(&stats->workers[0].chains);
+    for (int key = 0; key < NUM_KEYS; ++key) {
+        ASSERT_TRUE(hashtable_insert(table, key * 7) != NULL);
+    }
+    hashtable_set_chain_sink(&stats->workers[1].chains);
+    for (int key = 0; key < NUM_KEYS; key += 3) {
+        ASSERT_EQ(hashtable_delete(table, key * 7), 0);
+    }
+    hashtable_set_chain_sink(NULL);
+
+    int64_t expected[CHAIN_LENGTH_CLASSES] = {0};
+    for (int i = 0; i < table->size; ++i) {
+        int length = 0;
+        for (Node* node = table->buckets[i]->next; node != NULL; node = node->next) {
+            length++;
+        }
+        ASSERT_EQ(table->chain_lengths[i], length);
+        expected[length < CHAIN_LENGTH_CLASSES - 1 ? length : CHAIN_LENGTH_CLASSES - 1]++;
+    }
+
+    StatsSnapshot snapshot;
+    stats_snapshot(stats, &snapshot);
+    int64_t buckets = 0;
+    for (int length = 0; length < CHAIN_LENGTH_CLASSES; ++length) {
+        ASSERT_EQ(snapshot.chains[length], expected[length]) << "length " << length;
+        buckets += snapshot.chains[length];
+    }
+    ASSERT_EQ(buckets, NUM_BUCKETS);
+
+    delete stats;
+    hashtable_free(table);
+}
+
+/*
+ * Test the chain length histogram after a bulk load.
+ * 1. The calling thread's sink receives the changes of the loading threads
+ */
+TEST(StatsTest, BulkLoadChainLengths) {
+    HashTable* table = hashtable_create(NUM_BUCKETS);
+    ASSERT_TRUE(table != NULL);
+    ASSERT_EQ(hashtable_track_chains(table), 0);
+
+    ServerStats* stats = new ServerStats;
+    stats_init(stats, NUM_BUCKETS, hashtable_policy_name());
+    stats->num_workers = 1;
+
+    int keys[NUM_KEYS];
+    for (int key = 0; key < NUM_KEYS; ++key) {
+        keys[key] = key * 7;
+    }
+    hashtable_set_chain_sink(&stats->workers[0].chains);
+    ASSERT_EQ(hashtable_bulk_load(table, keys, NUM_KEYS, 4), NUM_KEYS);
+    hashtable_set_chain_sink(NULL);
+
+    int64_t expected[CHAIN_LENGTH_CLASSES] = {0};
+    for (int i = 0; i < table->size; ++i) {
+        int length = table->chain_lengths[i];
+        expected[length < CHAIN_LENGTH_CLASSES - 1 ? length : CHAIN_LENGTH_CLASSES - 1]++;
+    }
+
+    StatsSnapshot snapshot;
+    stats_snapshot(stats, &snapshot);
+    for (int length = 0; length < CHAIN_LENGTH_CLASSES; ++length) {
+        ASSERT_EQ(snapshot.chains[length], expected[length]) << "length " << length;
+    }
+    ASSERT_EQ(hashtable_size(table), NUM_KEYS);
+
+    delete stats;
+    hashtable_free(table);
+}
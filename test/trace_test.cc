@@ -0,0 +1,68 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+#define NUM_OPS (10000)
+
+/*
+ * Test a capture of two workers read back.
+ * 1. Every record is in a chunk of its worker, in the order it was recorded
+ * 2. Enqueue stamps are kept as the arrival time
+ * 3. A truncated trace is rejected
+ */
+TEST(TraceTest, CaptureAndRead) {
+    char path[] = "/tmp/trace_test_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    timer_calibrate();
+
+    TraceWriter writer;
+    ASSERT_EQ(trace_writer_open(&writer, path, 2), 0);
+
+    TraceBuffer* buffers = new TraceBuffer[2];
+    trace_buffer_init(&buffers[0], &writer, 0);
+    trace_buffer_init(&buffers[1], &writer, 1);
+
+    uint64_t stamp = timer_now();
+    for (int i = 0; i < NUM_OPS; ++i) {
+        Operation op = {i, (OperationType)(i % 3), 0, i == 0 ? stamp : 0, 0};
+        trace_record(&buffers[i % 2], &op, timer_now());
+    }
+    trace_buffer_flush(&buffers[0]);
+    trace_buffer_flush(&buffers[1]);
+    ASSERT_EQ(trace_writer_close(&writer), 0);
+    delete[] buffers;
+
+    Trace trace;
+    ASSERT_EQ(trace_open(&trace, path), 0);
+    ASSERT_EQ(trace.header->num_workers, 2u);
+    ASSERT_EQ(trace.header->num_records, (uint64_t)NUM_OPS);
+
+    int next_key[2] = {0, 1};
+    uint64_t last_time[2] = {0, 0};
+    for (const TraceChunk* chunk = trace_first_chunk(&trace); chunk != NULL; chunk = trace_next_chunk(&trace, chunk)) {
+        int worker = chunk->worker;
+        const TraceRecord* records = trace_chunk_records(chunk);
+        for (uint32_t r = 0; r < chunk->num_records; ++r) {
+            ASSERT_EQ(records[r].key, next_key[worker]);
+            ASSERT_EQ(records[r].type, next_key[worker] % 3);
+            ASSERT_GE(records[r].time_ns, last_time[worker]);
+            last_time[worker] = records[r].time_ns;
+            next_key[worker] += 2;
+        }
+    }
+    ASSERT_EQ(next_key[0], NUM_OPS);
+    ASSERT_EQ(next_key[1], NUM_OPS + 1);
+    trace_close(&trace);
+
+    ASSERT_EQ(truncate(path, sizeof(TraceHeader) + 100), 0);
+    ASSERT_NE(trace_open(&trace, path), 0);
+
+    unlink(path);
+}
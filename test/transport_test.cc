@@ -0,0 +1,289 @@
+#include "transport.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "timer.h"
+
+#define NUM_REQUESTS (20000)
+#define DEPTH (512)
+#define BATCH (8)
+
+typedef struct WorkerArgs {
+    Transport* transport;
+    OperationQueue* queue;
+    int num_ops;
+    int width;
+} WorkerArgs;
+
+// Answer every operation by the parity of its key, in batches like the server's workers
+static void* WorkerFunc(void* thd_args) {
+    WorkerArgs* args = (WorkerArgs*)thd_args;
+    Operation ops[BATCH];
+    bool succeeded[BATCH];
+
+    for (int i = 0; i < args->num_ops;) {
+        int max = args->num_ops - i < args->width ? args->num_ops - i : args->width;
+        int n = dequeue_batch(args->queue, NULL, ops, max);
+        for (int j = 0; j < n; ++j) {
+            succeeded[j] = ops[j].key % 2 == 0;
+        }
+        transport_answer(args->transport, ops, succeeded, n);
+        i += n;
+    }
+    return NULL;
+}
+
+static void send_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        ASSERT_GT(n, 0);
+        p += n;
+        len -= n;
+    }
+}
+
+static void send_hello(int fd, int num_threads, int num_ops_per_thread) {
+    WireHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = WIRE_MAGIC;
+    hello.num_threads = num_threads;
+    hello.num_ops_per_thread = num_ops_per_thread;
+    send_all(fd, &hello, sizeof(hello));
+}
+
+// Send the requests with up to depth in flight, and check that the answers come back in order
+static void pipeline(int fd, int first_key, int num_requests, int depth) {
+    std::vector<WireRequest> requests(depth);
+    std::vector<uint8_t> answers(depth);
+    int sent = 0;
+    int answered = 0;
+
+    while (answered < num_requests) {
+        int n = 0;
+        for (; sent + n < num_requests && sent + n - answered < depth; ++n) {
+            memset(&requests[n], 0, sizeof(WireRequest));
+            requests[n].key = first_key + sent + n;
+            requests[n].type = Lookup;
+        }
+        send_all(fd, requests.data(), n * sizeof(WireRequest));
+        sent += n;
+
+        ssize_t got = recv(fd, answers.data(), sent - answered, 0);
+        ASSERT_GT(got, 0);
+        for (int k = 0; k < got; ++k, ++answered) {
+            ASSERT_EQ(answers[k], (first_key + answered) % 2 == 0 ? WireSucceeded : WireFailed);
+        }
+    }
+}
+
+/*
+ * TestFixture with a queue in private memory and one worker answering it
+ */
+class TransportTest : public ::testing::Test {
+protected:
+    TransportTest() {
+        timer_calibrate();
+        queue = (OperationQueue*)malloc(sizeof(OperationQueue));
+        init_queue(queue);
+        transport = (Transport*)malloc(sizeof(Transport));
+        socket_path = "/tmp/transport_test_" + std::to_string(getpid()) + ".sock";
+    }
+
+    ~TransportTest() {
+        free(transport);
+        free(queue);
+    }
+
+    void start_worker(int num_ops, int width = BATCH) {
+        worker_args.transport = transport;
+        worker_args.queue = queue;
+        worker_args.num_ops = num_ops;
+        worker_args.width = width;
+        ASSERT_EQ(pthread_create(&worker, NULL, WorkerFunc, &worker_args), 0);
+    }
+
+    OperationQueue* queue;
+    Transport* transport;
+    std::string socket_path;
+    pthread_t worker;
+    WorkerArgs worker_args;
+};
+
+/*
+ * Test pipelining over a Unix-domain socket
+ * 1. The first hello makes the transport ready with the load of the run
+ * 2. Every request is answered, in request order, with the worker's result
+ * 3. Many requests share a syscall
+ * 4. Closing unlinks the socket
+ */
+TEST_F(TransportTest, UnixPipeline) {
+    ASSERT_EQ(transport_open(transport, queue, socket_path.c_str(), 0), 0);
+    start_worker(NUM_REQUESTS);
+    ASSERT_FALSE(transport_ready(transport));
+
+    int fd = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(fd, 0);
+    send_hello(fd, 1, NUM_REQUESTS);
+    while (!transport_ready(transport)) {
+        usleep(1000);
+    }
+    ASSERT_EQ(transport->num_threads, 1);
+    ASSERT_EQ(transport->num_ops_per_thread, NUM_REQUESTS);
+
+    pipeline(fd, 0, NUM_REQUESTS, DEPTH);
+    close(fd);
+    pthread_join(worker, NULL);
+    transport_close(transport);
+
+    ASSERT_EQ(transport->requests, (uint64_t)NUM_REQUESTS);
+    ASSERT_LT(transport->reads, (uint64_t)NUM_REQUESTS);
+    ASSERT_NE(access(socket_path.c_str(), F_OK), 0);
+}
+
+/*
+ * Test a window narrower than the batches of the workers
+ * 1. A worker runs the requests that arrived instead of waiting for a full batch
+ * 2. Every request of a depth 1 client is answered
+ */
+TEST_F(TransportTest, NarrowWindow) {
+    ASSERT_EQ(transport_open(transport, queue, socket_path.c_str(), 0), 0);
+    start_worker(1000, BATCH);
+
+    int fd = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(fd, 0);
+    send_hello(fd, 1, 1000);
+    pipeline(fd, 0, 1000, 1);
+    close(fd);
+    pthread_join(worker, NULL);
+    transport_close(transport);
+
+    ASSERT_EQ(transport->requests, (uint64_t)1000);
+}
+
+/*
+ * Test several TCP connections at once
+ * 1. Each connection gets the answers of its own requests
+ * 2. A later hello does not change the load of the run
+ */
+TEST_F(TransportTest, TcpConnections) {
+    int port = 20000 + getpid() % 20000;
+    ASSERT_EQ(transport_open(transport, queue, NULL, port), 0);
+    start_worker(3 * NUM_REQUESTS);
+
+    int fds[3];
+    for (int i = 0; i < 3; ++i) {
+        fds[i] = transport_connect(NULL, port);
+        ASSERT_GE(fds[i], 0);
+        send_hello(fds[i], 3 + i, NUM_REQUESTS);
+    }
+    // Interleave the connections, one window at a time
+    for (int round = 0; round < NUM_REQUESTS / DEPTH; ++round) {
+        for (int i = 0; i < 3; ++i) {
+            pipeline(fds[i], i * NUM_REQUESTS + round * DEPTH + i, DEPTH, DEPTH);
+        }
+    }
+    int left = NUM_REQUESTS % DEPTH;
+    for (int i = 0; i < 3; ++i) {
+        pipeline(fds[i], i, left, DEPTH);
+        close(fds[i]);
+    }
+    pthread_join(worker, NULL);
+    transport_close(transport);
+
+    ASSERT_EQ(transport->num_threads, 3);
+    ASSERT_EQ(transport->requests, (uint64_t)3 * NUM_REQUESTS);
+}
+
+/*
+ * Test protocol errors
+ * 1. A connection with a bad hello is closed
+ * 2. A request of an unknown type closes its connection
+ * 3. So does a request of a negative key
+ * 4. Other connections are still served
+ */
+TEST_F(TransportTest, ProtocolError) {
+    ASSERT_EQ(transport_open(transport, queue, socket_path.c_str(), 0), 0);
+    start_worker(100);
+
+    char byte;
+    int bad = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(bad, 0);
+    WireHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = WIRE_MAGIC + 1;
+    send_all(bad, &hello, sizeof(hello));
+    ASSERT_EQ(recv(bad, &byte, 1, 0), 0);
+    close(bad);
+    ASSERT_FALSE(transport_ready(transport));
+
+    int unknown = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(unknown, 0);
+    send_hello(unknown, 1, 100);
+    WireRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = Compound;
+    send_all(unknown, &request, sizeof(request));
+    ASSERT_EQ(recv(unknown, &byte, 1, 0), 0);
+    close(unknown);
+
+    int negative = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(negative, 0);
+    send_hello(negative, 1, 100);
+    request.type = Lookup;
+    request.key = -1;
+    send_all(negative, &request, sizeof(request));
+    ASSERT_EQ(recv(negative, &byte, 1, 0), 0);
+    close(negative);
+
+    int good = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(good, 0);
+    send_hello(good, 1, 100);
+    pipeline(good, 7, 100, 10);
+    close(good);
+    pthread_join(worker, NULL);
+    transport_close(transport);
+}
+
+/*
+ * Test requests past the load of the run
+ * 1. The requests the first hello announced are answered
+ * 2. One more closes its connection, which would otherwise wait for a worker forever
+ * 3. So does one on a new connection, the load counts over all connections
+ */
+TEST_F(TransportTest, Overflow) {
+    ASSERT_EQ(transport_open(transport, queue, socket_path.c_str(), 0), 0);
+    start_worker(100);
+
+    char byte;
+    WireRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = Lookup;
+
+    int first = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(first, 0);
+    send_hello(first, 2, 50);
+    pipeline(first, 0, 100, 10);
+    send_all(first, &request, sizeof(request));
+    ASSERT_EQ(recv(first, &byte, 1, 0), 0);
+    close(first);
+
+    int second = transport_connect(socket_path.c_str(), 0);
+    ASSERT_GE(second, 0);
+    send_hello(second, 2, 50);
+    send_all(second, &request, sizeof(request));
+    ASSERT_EQ(recv(second, &byte, 1, 0), 0);
+    close(second);
+
+    pthread_join(worker, NULL);
+    transport_close(transport);
+    ASSERT_EQ(transport->requests, (uint64_t)100);
+}
@@ -0,0 +1,58 @@
+#include "unrolled.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+/*
+ * Test the search within a node's keys.
+ * 1. The rank counts the keys less than the key, for keys in and between the keys
+ * 2. Ints past the count are ignored
+ */
+TEST(UnrolledTest, Rank) {
+    int keys[BLOCK_SEARCHED];
+    memset(keys, 0, sizeof(keys));  // smaller than every key searched below
+    int count = 0;
+    ASSERT_EQ(block_rank(keys, count, 5), 0);
+
+    for (int n = 1; n <= BLOCK_KEYS; ++n) {
+        block_insert_at(keys, &count, n - 1, n * 10);
+        ASSERT_EQ(count, n);
+        for (int key = 1; key <= (n + 1) * 10; ++key) {
+            int expected = (key - 1) / 10 < n ? (key - 1) / 10 : n;
+            ASSERT_EQ(block_rank(keys, count, key), expected) << "count " << n << ", key " << key;
+        }
+    }
+}
+
+/*
+ * Test splitting and merging nodes' keys.
+ * 1. A split moves the upper half, keeping both halves sorted
+ * 2. A merge appends the following keys and empties them
+ * 3. Removing keeps the remaining keys in order
+ */
+TEST(UnrolledTest, SplitMerge) {
+    int keys[BLOCK_SEARCHED] = {};
+    int upper[BLOCK_SEARCHED] = {};
+    int count = 0;
+    int upper_count = 0;
+    for (int i = 0; i < BLOCK_KEYS; ++i) {
+        block_insert_at(keys, &count, 0, (BLOCK_KEYS - i) * 2);  // insert in reverse order
+    }
+
+    block_split(keys, &count, upper, &upper_count);
+    ASSERT_EQ(count + upper_count, BLOCK_KEYS);
+    ASSERT_GT(upper_count, 0);
+    ASSERT_LT(keys[count - 1], upper[0]);
+    for (int i = 1; i < upper_count; ++i) {
+        ASSERT_LT(upper[i - 1], upper[i]);
+    }
+
+    block_remove_at(keys, &count, 0);
+    block_merge(keys, &count, upper, &upper_count);
+    ASSERT_EQ(count, BLOCK_KEYS - 1);
+    ASSERT_EQ(upper_count, 0);
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(keys[i], (i + 2) * 2);
+    }
+}
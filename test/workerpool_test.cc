@@ -0,0 +1,142 @@
+#include "workerpool.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+
+#define MS (1000000)  // one sample interval in ns
+
+static void test_config(ElasticConfig* config) {
+    elastic_default_config(config, 8);
+    config->high_occupancy = 256;
+    config->low_occupancy = 4;
+    config->target_wait_us = 200;
+    config->calm_samples = 3;
+}
+
+/*
+ * Test the scaling decisions.
+ * 1. A deep queue doubles the active workers up to the maximum
+ * 2. A queue of moderate depth adds workers only if its expected wait is too long
+ * 3. A shallow queue parks one worker per calm_samples samples in a row, down to the minimum
+ * 4. A sample in between the thresholds restarts the calm samples
+ */
+TEST(WorkerPoolTest, Decisions) {
+    ElasticConfig config;
+    test_config(&config);
+    WorkerPool pool;
+    ASSERT_EQ(worker_pool_init(&pool, &config, 0), 0);
+    ASSERT_EQ(pool.active, 1);
+
+    ASSERT_EQ(worker_pool_sample(&pool, 300, MS), 2);
+    ASSERT_EQ(worker_pool_sample(&pool, 300, MS), 4);
+    ASSERT_EQ(worker_pool_sample(&pool, 300, MS), 8);
+    ASSERT_EQ(worker_pool_sample(&pool, 300, MS), 8);
+    ASSERT_EQ(pool.scale_ups, 3u);
+
+    // 100 queued at 1 op/us wait 100 us, at 0.1 op/us 1 ms
+    worker_pool_served(&pool, 1000);
+    ASSERT_EQ(worker_pool_sample(&pool, 100, MS), 8);
+    ASSERT_EQ(pool.scale_ups, 3u);
+
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQ(worker_pool_sample(&pool, 0, MS), i < 2 ? 8 : 7);
+    }
+    ASSERT_EQ(worker_pool_sample(&pool, 10, MS), 8);  // nothing served meanwhile, the queue is stalled
+    ASSERT_EQ(pool.scale_ups, 4u);
+
+    worker_pool_served(&pool, 1000);
+    ASSERT_EQ(worker_pool_sample(&pool, 10, MS), 8);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(worker_pool_sample(&pool, 0, MS), 8);
+    }
+    ASSERT_EQ(worker_pool_sample(&pool, 0, MS), 7);
+    ASSERT_EQ(pool.scale_downs, 2u);
+
+    for (int i = 0; i < 100; ++i) {
+        worker_pool_sample(&pool, 0, MS);
+    }
+    ASSERT_EQ(pool.active, config.min_workers);
+
+    worker_pool_destroy(&pool);
+}
+
+/*
+ * Test invalid configurations.
+ */
+TEST(WorkerPoolTest, Config) {
+    ElasticConfig config;
+    WorkerPool pool;
+
+    test_config(&config);
+    config.min_workers = 0;
+    ASSERT_EQ(worker_pool_init(&pool, &config, 0), -1);
+
+    test_config(&config);
+    config.min_workers = 9;
+    ASSERT_EQ(worker_pool_init(&pool, &config, 0), -1);
+
+    test_config(&config);
+    config.low_occupancy = config.high_occupancy;
+    ASSERT_EQ(worker_pool_init(&pool, &config, 0), -1);
+}
+
+typedef struct WorkerArgs {
+    int id;
+    WorkerPool* pool;
+    int claimed;
+} WorkerArgs;
+
+// The server's worker loop without the queue
+static void* worker_func(void* arg) {
+    WorkerArgs* args = (WorkerArgs*)arg;
+
+    args->claimed = 0;
+    while (worker_pool_checkpoint(args->pool, args->id)) {
+        if (!worker_pool_claim(args->pool)) {
+            break;
+        }
+        args->claimed++;
+        worker_pool_served(args->pool, 1);
+    }
+    worker_pool_wake_all(args->pool);
+
+    return NULL;
+}
+
+/*
+ * Test that the workers share the operations.
+ * 1. Parked workers claim nothing and exit once the active ones claimed everything
+ * 2. Active workers together claim every operation exactly once
+ */
+TEST(WorkerPoolTest, Claim) {
+    const int num_workers = 4;
+    const int total_ops = 100000;
+
+    for (int min_workers = 1; min_workers <= num_workers; min_workers += num_workers - 1) {
+        ElasticConfig config;
+        elastic_default_config(&config, num_workers);
+        config.min_workers = min_workers;
+        WorkerPool pool;
+        ASSERT_EQ(worker_pool_init(&pool, &config, total_ops), 0);
+
+        pthread_t threads[num_workers];
+        WorkerArgs args[num_workers];
+        for (int i = 0; i < num_workers; ++i) {
+            args[i] = {i, &pool, 0};
+            pthread_create(&threads[i], NULL, worker_func, &args[i]);
+        }
+
+        int claimed = 0;
+        for (int i = 0; i < num_workers; ++i) {
+            pthread_join(threads[i], NULL);
+            claimed += args[i].claimed;
+            if (i >= min_workers) {
+                ASSERT_EQ(args[i].claimed, 0);
+            }
+        }
+        ASSERT_EQ(claimed, total_ops);
+        ASSERT_EQ(pool.served, (uint64_t)total_ops);
+
+        worker_pool_destroy(&pool);
+    }
+}
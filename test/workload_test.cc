@@ -0,0 +1,165 @@
+#include "workload.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#define NUM_SAMPLES (100000)
+
+/*
+ * Test parsing of the workload options.
+ */
+TEST(WorkloadTest, Parse) {
+    WorkloadConfig config;
+    workload_default_config(&config);
+
+    ASSERT_EQ(workload_parse_mix("b", &config), 0);
+    ASSERT_EQ(config.lookup_permille, 950);
+    ASSERT_EQ(config.distribution, DistUniform);
+
+    ASSERT_EQ(workload_parse_mix("d", &config), 0);
+    ASSERT_EQ(config.distribution, DistLatest);
+
+    ASSERT_EQ(workload_parse_mix("90:5:5", &config), 0);
+    ASSERT_EQ(config.lookup_permille, 900);
+    ASSERT_EQ(config.insert_permille, 50);
+    ASSERT_EQ(config.delete_permille, 50);
+
+    ASSERT_EQ(workload_parse_mix("90:5:6", &config), -1);
+    ASSERT_EQ(workload_parse_mix("g", &config), -1);
+
+    KeyDistribution distribution;
+    ASSERT_EQ(workload_parse_distribution("zipfian", &distribution), 0);
+    ASSERT_EQ(distribution, DistZipfian);
+    ASSERT_EQ(workload_parse_distribution("normal", &distribution), -1);
+}
+
+/*
+ * Test the operation mix and the key range.
+ * 1. Every key is within the key space
+ * 2. The operation types follow the configured ratio
+ */
+TEST(WorkloadTest, Mix) {
+    WorkloadConfig config;
+    workload_default_config(&config);
+    config.key_space = 1000;
+    ASSERT_EQ(workload_parse_mix("90:5:5", &config), 0);
+
+    Workload workload;
+    ASSERT_EQ(workload_init(&workload, &config), 0);
+
+    Prng prng;
+    prng_seed(&prng, 42, 0);
+    int count[3] = {0, 0, 0};
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        Operation op = workload_next(&workload, &prng);
+        ASSERT_GE(op.key, 0);
+        ASSERT_LT(op.key, config.key_space);
+        count[op.type]++;
+    }
+
+    ASSERT_NEAR(count[Lookup], NUM_SAMPLES * 0.9, NUM_SAMPLES * 0.01);
+    ASSERT_NEAR(count[Insert], NUM_SAMPLES * 0.05, NUM_SAMPLES * 0.01);
+    ASSERT_NEAR(count[Delete], NUM_SAMPLES * 0.05, NUM_SAMPLES * 0.01);
+}
+
+/*
+ * Test the skewed distributions.
+ * 1. With Zipfian keys, the hottest key receives far more than a uniform share
+ * 2. With hotspot keys, the configured fraction of operations hits the hot range
+ */
+TEST(WorkloadTest, Skew) {
+    WorkloadConfig config;
+    workload_default_config(&config);
+    config.key_space = 1000;
+    config.distribution = DistZipfian;
+
+    Workload workload;
+    ASSERT_EQ(workload_init(&workload, &config), 0);
+
+    Prng prng;
+    prng_seed(&prng, 42, 0);
+    std::vector<int> count(config.key_space, 0);
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        count[workload_next(&workload, &prng).key]++;
+    }
+
+    int hottest = 0;
+    for (int key = 0; key < config.key_space; ++key) {
+        hottest = std::max(hottest, count[key]);
+    }
+    ASSERT_GT(hottest, NUM_SAMPLES / config.key_space * 50);
+
+    config.distribution = DistHotspot;
+    ASSERT_EQ(workload_init(&workload, &config), 0);
+
+    int hot = 0;
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        if (workload_next(&workload, &prng).key < config.key_space * config.hot_fraction) {
+            ++hot;
+        }
+    }
+    ASSERT_NEAR(hot, NUM_SAMPLES * config.hot_op_fraction, NUM_SAMPLES * 0.01);
+}
+
+/*
+ * Test the prefilled population.
+ * 1. Roughly the configured fraction of the key space is prefilled
+ */
+TEST(WorkloadTest, Prefill) {
+    WorkloadConfig config;
+    workload_default_config(&config);
+    config.key_space = NUM_SAMPLES;
+    config.prefill = 0.3;
+
+    Workload workload;
+    ASSERT_EQ(workload_init(&workload, &config), 0);
+
+    int prefilled = 0;
+    for (int key = 0; key < config.key_space; ++key) {
+        if (workload_is_prefilled(&workload, key)) {
+            ++prefilled;
+        }
+    }
+    ASSERT_NEAR(prefilled, NUM_SAMPLES * 0.3, NUM_SAMPLES * 0.01);
+    ASSERT_FALSE(workload_is_prefilled(&workload, config.key_space));
+}
+
+/*
+ * Test reproducibility from a seed.
+ * 1. The same seed and stream replay the same trace
+ * 2. Different streams (threads) draw different traces
+ */
+TEST(WorkloadTest, Seed) {
+    WorkloadConfig config;
+    workload_default_config(&config);
+    config.distribution = DistZipfian;
+    config.key_space = 1000;
+
+    Workload workload;
+    ASSERT_EQ(workload_init(&workload, &config), 0);
+
+    Prng prng;
+    prng_seed(&prng, 42, 1);
+    Operation* trace = workload_generate(&workload, &prng, NUM_SAMPLES);
+    ASSERT_NE(trace, nullptr);
+
+    prng_seed(&prng, 42, 1);
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        Operation op = workload_next(&workload, &prng);
+        ASSERT_EQ(op.type, trace[i].type);
+        ASSERT_EQ(op.key, trace[i].key);
+    }
+
+    prng_seed(&prng, 42, 2);
+    int same = 0;
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        Operation op = workload_next(&workload, &prng);
+        if (op.type == trace[i].type && op.key == trace[i].key) {
+            ++same;
+        }
+    }
+    ASSERT_LT(same, NUM_SAMPLES / 2);
+
+    free(trace);
+}